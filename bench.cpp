@@ -0,0 +1,1149 @@
+// ============================================================================
+// This is the benchmark driver for nearest neighbor. It generates synthetic
+// point sets (see CDataGenerator) and times each phase of the k-d tree on
+// its own: build, single query, incremental query (CNeighborIterator),
+// batch query, the batch in interleaved groups with prefetching
+// (CGroupSearch), kNN join of the queries with the points and all-kNN of
+// the points (CKnnJoin), the all-kNN table and its lookups (CKnnTable),
+// planned query (CSearchPlanner), batch query during inserts and the
+// publishes of CSnapshotIndex, queries from many client threads through
+// CQueryService, repeated queries through CResultCache, radius query, box
+// range query and count, delete, and block insert. Every phase runs a few
+// warmup rounds that are not counted, then the timed repetitions.
+//
+// Usage: bench [-n points] [-q queries] [-k neighbors] [-r radius]
+//              [-reps count] [-warmup count] [-threads count] [-seed value]
+//              [-dist uniform|clustered|surface|grid|sorted|all]
+//              [-split insert|median|widest|sliding]
+//              [-order none|morton|hilbert] [-storage double|float|int16]
+//              [-engine auto|brute|kdtree] [-batch count] [-wait us]
+//              [-group count]
+//        -split: insert the points one by one (default), or bulk build the
+//                tree with a split rule (CBSTree::BuildTree)
+//        -order: also run the batch query with the batch sorted along a
+//                space-filling curve ("batch_query_<curve>" phase)
+//        -storage: also run the single query on a CCompactTree with the
+//                  coordinates kept in that type ("compact_query_<type>"
+//                  phase, and a "compact_index" line with its memory)
+//        -engine: engine of the planned query ("planned_query_<engine>"
+//                 phase), auto lets the planner choose (searchplan.h)
+//        -batch, -wait: micro-batch size and wait of the query service
+//                       ("service" lines, -threads gives its workers)
+//        -group: number of interleaved queries of the group query
+//
+// Output: one JSON object per line, for each data set and phase: number of
+//         operation, throughput (operation per second), p50 and p99 latency
+//         (microsecond) and "max_rss_process_kb", the memory high-water
+//         mark of the whole process so far (kilobyte): a phase shows the
+//         peak of the phases before it too, unless it goes higher. After
+//         the build, a "tree_shape" line describes the tree (CTreeShape).
+//         "engine_crossover" lines give the mean query time of the
+//         brute-force scan and of the k-d tree on the first n points, for n
+//         from 16 up, with the engine the planner picks. "service" lines
+//         give the throughput and latency of the query service for 1, 4,
+//         16 and 64 clients. The "result_cache" line gives the hits,
+//         misses and evictions of the cache query. The "disk_index" line
+//         gives the memory budget and number of chunk of the disk index.
+// ============================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "fieldnode.h"
+#include "cbstree.h"
+#include "compacttree.h"
+#include "curveorder.h"
+#include "datagen.h"
+#include "diskindex.h"
+#include "groupsearch.h"
+#include "knnjoin.h"
+#include "knntable.h"
+#include "neighboriter.h"
+#include "parallel.h"
+#include "queryservice.h"
+#include "resultcache.h"
+#include "searchplan.h"
+#include "snapshot.h"
+using namespace std;
+
+// benchmark settings, changed by the command line flags
+struct BenchOptions
+{
+    int         numPoints;
+    int         numQueries;
+    int         numNeighbor;
+    double      radius;
+    int         reps;
+    int         warmup;
+    int         numThreads;
+    unsigned long long seed;
+    string      dist;
+    string      split;
+    CurveType   order;
+    string      storage;
+    SearchEngine engine;
+    int         maxBatch;
+    int         maxWait;
+    int         group;
+};
+
+// function prototype
+void BuildTree(const BenchOptions &opt, const vector<FieldNode> &point
+               , CBSTree<FieldNode> &tree);
+void RunDataSet(const BenchOptions &opt, const DataDistribution dist);
+void RunDisk(const BenchOptions &opt, const DataDistribution dist
+             , const vector<FieldNode> &point
+             , const vector<FieldNode> &query);
+void RunCrossover(const BenchOptions &opt, const DataDistribution dist
+                  , const vector<FieldNode> &point
+                  , const vector<FieldNode> &query);
+void RunService(const BenchOptions &opt, const DataDistribution dist
+                , const CBSTree<FieldNode> &tree
+                , const vector<FieldNode> &query);
+template <typename CoordType>
+void RunCompact(const BenchOptions &opt, const DataDistribution dist
+                , const vector<FieldNode> &point
+                , const vector<FieldNode> &query);
+void Report(const BenchOptions &opt, const DataDistribution dist
+            , const char *phase
+            , const long long ops, vector<double> &latency
+            , const double seconds);
+void ReportStats(const BenchOptions &opt, const DataDistribution dist
+                 , const char *phase, const vector<double> &latency
+                 , const vector<CQueryStats> &queryStats);
+double Now();
+long MaxResidentKB();
+
+
+
+// === main ===================================================================
+//
+// ============================================================================
+
+int main(int argc, char *argv[])
+{
+    BenchOptions opt;
+    opt.numPoints = 100000;
+    opt.numQueries = 10000;
+    opt.numNeighbor = 6;
+    opt.radius = 20;
+    opt.reps = 3;
+    opt.warmup = 1;
+    opt.numThreads = 0;
+    opt.seed = 1;
+    opt.dist = "all";
+    opt.split = "insert";
+    opt.order = CURVE_NONE;
+    opt.storage = "none";
+    opt.engine = ENGINE_AUTO;
+    opt.maxBatch = SERVICE_BATCH;
+    opt.maxWait = SERVICE_WAIT_US;
+    opt.group = QUERY_GROUP;
+
+    for (int arg = 1; arg + 1 < argc; arg += 2)
+    {
+        if (strcmp(argv[arg], "-n") == 0)
+            opt.numPoints = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-q") == 0)
+            opt.numQueries = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-k") == 0)
+            opt.numNeighbor = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-r") == 0)
+            opt.radius = atof(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-reps") == 0)
+            opt.reps = max(1, atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "-warmup") == 0)
+            opt.warmup = max(0, atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "-threads") == 0)
+            opt.numThreads = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-batch") == 0)
+            opt.maxBatch = max(1, atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "-wait") == 0)
+            opt.maxWait = max(0, atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "-group") == 0)
+            opt.group = max(1, atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "-seed") == 0)
+            opt.seed = strtoull(argv[arg + 1], NULL, 10);
+        else if (strcmp(argv[arg], "-dist") == 0)
+            opt.dist = argv[arg + 1];
+        else if (strcmp(argv[arg], "-split") == 0)
+            opt.split = argv[arg + 1];
+        else if (strcmp(argv[arg], "-storage") == 0)
+            opt.storage = argv[arg + 1];
+        else if (strcmp(argv[arg], "-order") == 0)
+        {
+            if (!ParseCurve(argv[arg + 1], opt.order))
+            {
+                fprintf(stderr, "unknown curve %s\n", argv[arg + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "-engine") == 0)
+        {
+            if (!ParseEngine(argv[arg + 1], opt.engine))
+            {
+                fprintf(stderr, "unknown engine %s\n", argv[arg + 1]);
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "unknown flag %s\n", argv[arg]);
+            return 1;
+        }
+    }
+
+    DataDistribution dist = DIST_UNIFORM;
+    if ((opt.dist != "all")
+        && !CDataGenerator::ParseDistribution(opt.dist, dist))
+    {
+        fprintf(stderr, "unknown distribution %s\n", opt.dist.c_str());
+        return 1;
+    }
+    if ((opt.split != "insert") && (opt.split != "median")
+        && (opt.split != "widest") && (opt.split != "sliding"))
+    {
+        fprintf(stderr, "unknown split rule %s\n", opt.split.c_str());
+        return 1;
+    }
+    if ((opt.storage != "none") && (opt.storage != "double")
+        && (opt.storage != "float") && (opt.storage != "int16"))
+    {
+        fprintf(stderr, "unknown storage %s\n", opt.storage.c_str());
+        return 1;
+    }
+    const DataDistribution allDist[] = {DIST_UNIFORM, DIST_CLUSTERED
+                                        , DIST_SURFACE, DIST_GRID
+                                        , DIST_SORTED};
+    for (int index = 0; index < 5; ++index)
+    {
+        if ((opt.dist == "all") || (dist == allDist[index]))
+        {
+            RunDataSet(opt, allDist[index]);
+        }
+    }
+    return 0;
+
+} // end of "main"
+
+
+
+// === BuildTree ==============================================================
+// This function will insert every point into an empty tree, or bulk build
+// the tree with the split rule of the settings.
+//
+// Input: -- opt: benchmark settings
+//        -- point: the points
+//        -- tree: reference to the tree
+//
+// Output: nothing
+// ============================================================================
+
+void BuildTree(const BenchOptions &opt, const vector<FieldNode> &point
+               , CBSTree<FieldNode> &tree)
+{
+    if (opt.split == "median")
+        tree.BuildTree(point.data(), point.size(), SPLIT_MEDIAN);
+    else if (opt.split == "widest")
+        tree.BuildTree(point.data(), point.size(), SPLIT_WIDEST);
+    else if (opt.split == "sliding")
+        tree.BuildTree(point.data(), point.size(), SPLIT_SLIDING_MIDPOINT);
+    else
+    {
+        tree.DestroyTree();
+        for (auto it = point.begin(); it != point.end(); ++it)
+        {
+            tree.InsertItem(*it);
+        }
+    }
+
+} // end of "BuildTree"
+
+
+
+// === RunDataSet =============================================================
+// This function will time every phase on one distribution.
+//
+// Input: -- opt: benchmark settings
+//        -- dist: name of the distribution
+//
+// Output: nothing
+// ============================================================================
+
+void RunDataSet(const BenchOptions &opt, const DataDistribution dist)
+{
+    CDataGenerator generator(opt.seed);
+    vector<FieldNode> point;
+    vector<FieldNode> query;
+    vector<FieldNode> listN;
+    vector<double> latency;
+    CBSTree<FieldNode> tree;
+    int rounds = opt.warmup + opt.reps;
+    double start = 0;
+    double total = 0;
+
+    // the queries come from the same distribution as the points, every
+    // "stride"-th generated point becomes a query instead of a tree point
+    listN.resize(opt.numPoints + opt.numQueries);
+    generator.Generate(dist, listN.data(), opt.numPoints + opt.numQueries
+                       , opt.numThreads);
+    int stride = (opt.numQueries > 0)
+                 ? max(1, (opt.numPoints + opt.numQueries) / opt.numQueries)
+                 : 0;
+    for (int index = 0; index < static_cast<int>(listN.size()); ++index)
+    {
+        if ((stride > 0) && (index % stride == 0)
+            && (static_cast<int>(query.size()) < opt.numQueries))
+            query.push_back(listN[index]);
+        else
+            point.push_back(listN[index]);
+    }
+
+    // build
+    for (int round = 0; round < rounds; ++round)
+    {
+        start = Now();
+        BuildTree(opt, point, tree);
+        if (round >= opt.warmup)
+        {
+            latency.push_back(Now() - start);
+            total += latency.back();
+        }
+    }
+    Report(opt, dist, "build", 1LL * opt.numPoints * opt.reps, latency, total);
+
+    // quality of the tree that was built
+    CTreeShape shape;
+    tree.AnalyzeTree(shape);
+    printf("{\"dataset\":\"%s\",\"n\":%d,\"phase\":\"tree_shape\""
+           ",\"split\":\"%s\",\"shape\":%s}\n"
+           , CDataGenerator::GetDistributionName(dist), opt.numPoints
+           , opt.split.c_str(), shape.ToJson().c_str());
+
+    // single query, each query timed on its own
+    latency.clear();
+    total = 0;
+    CQueryStats stats;
+    vector<CQueryStats> queryStats;
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (auto it = query.begin(); it != query.end(); ++it)
+        {
+            start = Now();
+            tree.NearestNeighbors(*it, opt.numNeighbor, listN, &stats);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+                queryStats.push_back(stats);
+            }
+        }
+    }
+#ifdef KNN_STATS
+    ReportStats(opt, dist, "single_query_stats", latency, queryStats);
+#endif
+    Report(opt, dist, "single_query", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+
+    // the same queries pulled one neighbor at a time from the best-first
+    // iterator, as a caller that does not know k would do; Reset keeps the
+    // memory of its queue from one query to the next
+    latency.clear();
+    total = 0;
+    queryStats.clear();
+    CNeighborIterator<FieldNode> next(tree, point[0], CEuclideanMetric()
+                                      , &stats);
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (auto it = query.begin(); it != query.end(); ++it)
+        {
+            start = Now();
+            next.Reset(*it);
+            listN.resize(opt.numNeighbor);
+            int count = 0;
+            while ((count < opt.numNeighbor) && next.Next(listN[count]))
+            {
+                ++count;
+            }
+            listN.resize(count);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+                queryStats.push_back(stats);
+            }
+        }
+    }
+#ifdef KNN_STATS
+    ReportStats(opt, dist, "incremental_query_stats", latency, queryStats);
+#endif
+    Report(opt, dist, "incremental_query", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+
+    // batch query, the whole batch on every core, the result of query i
+    // goes to result[i]
+    latency.clear();
+    total = 0;
+    int threads = GetNumThreads(opt.numThreads);
+    vector<vector<FieldNode> > result(query.size());
+    for (int round = 0; round < rounds; ++round)
+    {
+        start = Now();
+        ParallelFor(0, opt.numQueries, threads, [&](int, int index)
+        {
+            tree.NearestNeighbors(query[index], opt.numNeighbor
+                                  , result[index]);
+        });
+        if (round >= opt.warmup)
+        {
+            latency.push_back(Now() - start);
+            total += latency.back();
+        }
+    }
+    Report(opt, dist, "batch_query", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+
+    // the same batch as interleaved groups of queries with prefetching
+    CGroupSearch<FieldNode> group(tree, opt.group);
+    latency.clear();
+    total = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        start = Now();
+        group.NearestNeighbors(query.data(), opt.numQueries, opt.numNeighbor
+                               , result.data(), threads);
+        if (round >= opt.warmup)
+        {
+            latency.push_back(Now() - start);
+            total += latency.back();
+        }
+    }
+    Report(opt, dist, "group_query", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+
+    // the same batch in curve order, the sort is part of the time and the
+    // permutation sends each result back to the slot of its query
+    if (opt.order != CURVE_NONE)
+    {
+        latency.clear();
+        total = 0;
+        vector<int> order;
+        for (int round = 0; round < rounds; ++round)
+        {
+            start = Now();
+            CurveOrder(query.data(), opt.numQueries, opt.order, order
+                       , threads);
+            ParallelFor(0, opt.numQueries, threads, [&](int, int position)
+            {
+                tree.NearestNeighbors(query[order[position]]
+                                      , opt.numNeighbor
+                                      , result[order[position]]);
+            });
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+        string phase = string("batch_query_") + GetCurveName(opt.order);
+        Report(opt, dist, phase.c_str(), 1LL * opt.numQueries * opt.reps
+               , latency, total);
+    }
+
+    // the same batch as a kNN join of a tree of the queries with the tree of
+    // the points, and the points with themselves (all-kNN), on every core
+    CBSTree<FieldNode> queryTree;
+    BuildTree(opt, query, queryTree);
+    vector<vector<FieldNode> > joinResult;
+    CKnnJoin<FieldNode> join;
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        latency.clear();
+        total = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            start = Now();
+            join.Join((mode == 0) ? queryTree : tree, tree, opt.numNeighbor
+                      , listN, joinResult, opt.numThreads);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+        Report(opt, dist, (mode == 0) ? "knn_join" : "all_knn"
+               , 1LL * ((mode == 0) ? opt.numQueries : opt.numPoints)
+                 * opt.reps
+               , latency, total);
+    }
+
+    // the all-kNN as a table, then the single query of each point read from
+    // it (the queries are not points of the set, so the points stand in)
+    CKnnTable<FieldNode> table;
+    latency.clear();
+    total = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        start = Now();
+        table.Build(point.data(), point.size(), opt.numNeighbor
+                    , opt.numThreads);
+        if (round >= opt.warmup)
+        {
+            latency.push_back(Now() - start);
+            total += latency.back();
+        }
+    }
+    Report(opt, dist, "table_build", 1LL * opt.numPoints * opt.reps
+           , latency, total);
+    latency.clear();
+    total = 0;
+    int numLookup = min(opt.numQueries, static_cast<int>(point.size()));
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (int index = 0; index < numLookup; ++index)
+        {
+            start = Now();
+            table.NearestNeighbors(point[index], opt.numNeighbor, listN);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    Report(opt, dist, "table_lookup", 1LL * numLookup * opt.reps
+           , latency, total);
+    RunDisk(opt, dist, point, query);
+
+    // single query on the reduced-precision tree
+    if (opt.storage == "double")
+        RunCompact<double>(opt, dist, point, query);
+    else if (opt.storage == "float")
+        RunCompact<float>(opt, dist, point, query);
+    else if (opt.storage == "int16")
+        RunCompact<unsigned short>(opt, dist, point, query);
+
+    // single query through the planner, and where its choice flips
+    CSearchPlanner<FieldNode> planner(opt.engine);
+    planner.BuildIndex(point.data(), point.size());
+    latency.clear();
+    total = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (auto it = query.begin(); it != query.end(); ++it)
+        {
+            start = Now();
+            planner.NearestNeighbors(*it, opt.numNeighbor, listN);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    string planned = string("planned_query_")
+                     + GetEngineName(planner.GetEngine(opt.numNeighbor));
+    Report(opt, dist, planned.c_str(), 1LL * opt.numQueries * opt.reps
+           , latency, total);
+    RunCrossover(opt, dist, point, query);
+
+    // batch query on every core while one more thread inserts the queries
+    // into the index and publishes a version every 1000 inserts; each
+    // publish is timed too (O(changes), or O(n log n) when it rebuilds)
+    latency.clear();
+    total = 0;
+    vector<double> publishLatency;
+    double publishTotal = 0;
+    CSnapshotIndex<FieldNode> index;
+    for (int round = 0; round < rounds; ++round)
+    {
+        index.Build(point.data(), point.size(), SPLIT_MEDIAN);
+        start = Now();
+        thread writer([&]()
+        {
+            for (auto it = query.begin(); it != query.end(); ++it)
+            {
+                index.Insert(*it);
+                if ((index.GetNumPending() >= 1000)
+                    || (it + 1 == query.end()))
+                {
+                    double publishStart = Now();
+                    index.Publish();
+                    if (round >= opt.warmup)
+                    {
+                        publishLatency.push_back(Now() - publishStart);
+                        publishTotal += publishLatency.back();
+                    }
+                }
+            }
+        });
+        ParallelFor(0, opt.numQueries, threads, [&](int, int position)
+        {
+            index.Acquire()->NearestNeighbors(query[position]
+                                              , opt.numNeighbor
+                                              , result[position]);
+        });
+        writer.join();
+        if (round >= opt.warmup)
+        {
+            latency.push_back(Now() - start);
+            total += latency.back();
+        }
+    }
+    Report(opt, dist, "snapshot_query", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+    Report(opt, dist, "snapshot_publish", publishLatency.size()
+           , publishLatency, publishTotal);
+    RunService(opt, dist, tree, query);
+
+    // repeated queries through the result cache: targets drawn from a hot
+    // tenth of the queries with a skew toward the first ones, for k or k / 2
+    // neighbors; the cache holds half of the hot targets
+    int numHot = max(1, opt.numQueries / 10);
+    CResultCache<FieldNode> cache(tree, max(1, numHot / 2));
+    mt19937 pick(static_cast<unsigned>(opt.seed));
+    uniform_real_distribution<double> unit(0, 1);
+    vector<int> hot(opt.numQueries);
+    for (auto it = hot.begin(); it != hot.end(); ++it)
+    {
+        double draw = unit(pick);
+        *it = static_cast<int>(numHot * draw * draw);
+    }
+    latency.clear();
+    total = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (int index = 0; index < opt.numQueries; ++index)
+        {
+            start = Now();
+            cache.NearestNeighbors(query[hot[index]]
+                                   , (index % 2 == 0) ? opt.numNeighbor
+                                                      : opt.numNeighbor / 2
+                                   , listN);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    Report(opt, dist, "cache_query", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+    printf("{\"dataset\":\"%s\",\"n\":%d,\"k\":%d"
+           ",\"phase\":\"result_cache\",\"cache\":%s}\n"
+           , CDataGenerator::GetDistributionName(dist), opt.numPoints
+           , opt.numNeighbor, cache.ToJson().c_str());
+
+    // radius query
+    latency.clear();
+    total = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (auto it = query.begin(); it != query.end(); ++it)
+        {
+            start = Now();
+            tree.RadiusNeighbors(*it, opt.radius, listN);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    Report(opt, dist, "radius", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+
+    // box range query and count, the box is the cube of half side "radius"
+    // around each query
+    const char *rangePhase[] = {"range_query", "range_count"};
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        latency.clear();
+        total = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            for (auto it = query.begin(); it != query.end(); ++it)
+            {
+                FieldNode low = *it;
+                FieldNode high = *it;
+                low.SetXCoord(it->GetXCoord() - opt.radius);
+                low.SetYCoord(it->GetYCoord() - opt.radius);
+                low.SetZCoord(it->GetZCoord() - opt.radius);
+                high.SetXCoord(it->GetXCoord() + opt.radius);
+                high.SetYCoord(it->GetYCoord() + opt.radius);
+                high.SetZCoord(it->GetZCoord() + opt.radius);
+                start = Now();
+                if (mode == 0)
+                    tree.RangeQuery(low, high, listN);
+                else
+                    tree.RangeCount(low, high);
+                if (round >= opt.warmup)
+                {
+                    latency.push_back(Now() - start);
+                    total += latency.back();
+                }
+            }
+        }
+        Report(opt, dist, rangePhase[mode], 1LL * opt.numQueries * opt.reps
+               , latency, total);
+    }
+
+    // delete, from a fresh tree every round
+    latency.clear();
+    total = 0;
+    int numDelete = min(opt.numQueries, static_cast<int>(point.size()));
+    for (int round = 0; round < rounds; ++round)
+    {
+        BuildTree(opt, point, tree);
+        for (int index = 0; index < numDelete; ++index)
+        {
+            start = Now();
+            tree.DeleteItem(point[(1LL * index * point.size()) / numDelete]);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    Report(opt, dist, "delete", 1LL * numDelete * opt.reps, latency, total);
+
+    // the points in blocks of 10000 into a growing tree (InsertBatch), each
+    // sample is one block
+    latency.clear();
+    total = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        tree.DestroyTree();
+        for (int first = 0; first < static_cast<int>(point.size())
+             ; first += 10000)
+        {
+            start = Now();
+            tree.InsertBatch(point.data() + first
+                             , min(10000, static_cast<int>(point.size())
+                                          - first));
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    Report(opt, dist, "batch_insert", 1LL * point.size() * opt.reps
+           , latency, total);
+
+} // end of "RunDataSet"
+
+
+
+// === RunCompact =============================================================
+// This function will build a CCompactTree that keeps the coordinates in
+// "CoordType", print its memory and time the single query on it.
+//
+// Input: -- opt: benchmark settings
+//        -- dist: the distribution
+//        -- point: the points of the tree
+//        -- query: the queries
+//
+// Output: nothing
+// ============================================================================
+
+template <typename CoordType>
+void RunCompact(const BenchOptions &opt, const DataDistribution dist
+                , const vector<FieldNode> &point
+                , const vector<FieldNode> &query)
+{
+    CCompactTree<FieldNode, CoordType> compact;
+    vector<FieldNode> listN;
+    vector<double> latency;
+    int rounds = opt.warmup + opt.reps;
+    double start = 0;
+    double total = 0;
+
+    compact.BuildTree(point.data(), point.size());
+    printf("{\"dataset\":\"%s\",\"n\":%d,\"phase\":\"compact_index\""
+           ",\"storage\":\"%s\",\"memory_bytes\":%lld,\"error\":%g}\n"
+           , CDataGenerator::GetDistributionName(dist), opt.numPoints
+           , opt.storage.c_str(), compact.GetMemoryBytes()
+           , compact.GetError());
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (auto it = query.begin(); it != query.end(); ++it)
+        {
+            start = Now();
+            compact.NearestNeighbors(*it, opt.numNeighbor, listN);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    string phase = "compact_query_" + opt.storage;
+    Report(opt, dist, phase.c_str(), 1LL * opt.numQueries * opt.reps
+           , latency, total);
+
+} // end of "RunCompact"
+
+
+
+// === RunDisk ================================================================
+// This function will write the points to a file, build a CDiskIndex of it
+// with a memory budget of an eighth of the points (so it takes several
+// chunks), print the index and time the single query on it. The files are
+// removed at the end.
+//
+// Input: -- opt: benchmark settings
+//        -- dist: the distribution
+//        -- point: the points of the index
+//        -- query: the queries
+//
+// Output: nothing
+// ============================================================================
+
+void RunDisk(const BenchOptions &opt, const DataDistribution dist
+             , const vector<FieldNode> &point
+             , const vector<FieldNode> &query)
+{
+    const char *pointFile = "bench_disk.points";
+    const char *indexFile = "bench_disk.index";
+    long long budget = 1LL * point.size() * sizeof(CDiskPoint) / 8;
+    CDiskIndex<FieldNode> disk;
+    vector<FieldNode> listN;
+    vector<double> latency;
+    int rounds = opt.warmup + opt.reps;
+    double start = 0;
+    double total = 0;
+
+    if (!CDiskIndex<FieldNode>::WritePoints(pointFile, point.data()
+                                            , point.size()))
+    {
+        fprintf(stderr, "bench: cannot write %s\n", pointFile);
+        return;
+    }
+    for (int round = 0; round < rounds; ++round)
+    {
+        start = Now();
+        bool bBuilt = CDiskIndex<FieldNode>::Build(pointFile, indexFile
+                                                   , budget);
+        if (round >= opt.warmup)
+        {
+            latency.push_back(Now() - start);
+            total += latency.back();
+        }
+        if (!bBuilt)
+        {
+            fprintf(stderr, "bench: cannot build %s\n", indexFile);
+            remove(pointFile);
+            return;
+        }
+    }
+    Report(opt, dist, "disk_build", 1LL * opt.numPoints * opt.reps
+           , latency, total);
+    remove(pointFile);
+    if (!disk.Open(indexFile))
+    {
+        fprintf(stderr, "bench: cannot open %s\n", indexFile);
+        remove(indexFile);
+        return;
+    }
+    printf("{\"dataset\":\"%s\",\"n\":%d,\"phase\":\"disk_index\""
+           ",\"budget_bytes\":%lld,\"chunks\":%d}\n"
+           , CDataGenerator::GetDistributionName(dist), opt.numPoints
+           , max(budget, 1LL << 20), disk.GetNumChunks());
+
+    latency.clear();
+    total = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (auto it = query.begin(); it != query.end(); ++it)
+        {
+            start = Now();
+            disk.NearestNeighbors(*it, opt.numNeighbor, listN);
+            if (round >= opt.warmup)
+            {
+                latency.push_back(Now() - start);
+                total += latency.back();
+            }
+        }
+    }
+    Report(opt, dist, "disk_query", 1LL * opt.numQueries * opt.reps
+           , latency, total);
+    disk.Close();
+    remove(indexFile);
+
+} // end of "RunDisk"
+
+
+
+// === RunCrossover ===========================================================
+// This function will time the brute-force scan and the k-d tree (median
+// split) on the first n points, n = 16, 32, ... up to 8192, with up to 1000
+// of the queries, and print the mean time of a query on each engine next to
+// the choice of PlanEngine; the limits of searchplan.h come from here.
+//
+// Input: -- opt: benchmark settings
+//        -- dist: the distribution
+//        -- point: the points
+//        -- query: the queries
+//
+// Output: nothing
+// ============================================================================
+
+void RunCrossover(const BenchOptions &opt, const DataDistribution dist
+                  , const vector<FieldNode> &point
+                  , const vector<FieldNode> &query)
+{
+    CBruteForce<FieldNode> brute;
+    CBSTree<FieldNode> tree;
+    vector<FieldNode> listN;
+    int numQuery = min(1000, static_cast<int>(query.size()));
+    int maxPoints = min(8192, static_cast<int>(point.size()));
+
+    for (int num = 16; (num <= maxPoints) && (numQuery > 0); num *= 2)
+    {
+        double seconds[2] = {0, 0};     // brute force, k-d tree
+        brute.BuildIndex(point.data(), num);
+        tree.BuildTree(point.data(), num, SPLIT_MEDIAN);
+        for (int round = 0; round < opt.warmup + opt.reps; ++round)
+        {
+            for (int engine = 0; engine < 2; ++engine)
+            {
+                double start = Now();
+                for (int index = 0; index < numQuery; ++index)
+                {
+                    if (engine == 0)
+                        brute.NearestNeighbors(query[index], opt.numNeighbor
+                                               , listN);
+                    else
+                        tree.NearestNeighbors(query[index], opt.numNeighbor
+                                              , listN);
+                }
+                if (round >= opt.warmup)
+                {
+                    seconds[engine] += Now() - start;
+                }
+            }
+        }
+        double ops = 1e-6 * numQuery * opt.reps;
+        printf("{\"dataset\":\"%s\",\"n\":%d,\"k\":%d"
+               ",\"phase\":\"engine_crossover\",\"brute_us\":%.3f"
+               ",\"kdtree_us\":%.3f,\"planned\":\"%s\"}\n"
+               , CDataGenerator::GetDistributionName(dist), num
+               , opt.numNeighbor, seconds[0] / ops, seconds[1] / ops
+               , GetEngineName(PlanEngine(num, DIMENSIONAL
+                                          , opt.numNeighbor)));
+    }
+
+} // end of "RunCrossover"
+
+
+
+// === RunService =============================================================
+// This function is the load generator of the query service (CQueryService).
+// For 1, 4, 16 and 64 client threads, each client submits its share of the
+// queries one at a time and waits for each answer (closed loop), so more
+// clients offer more load. One JSON line per client count gives the
+// throughput, the p50/p99 latency of a request from Submit to its answer
+// and the mean size of a micro-batch.
+//
+// Input: -- opt: benchmark settings (-batch, -wait and -threads workers)
+//        -- dist: the distribution
+//        -- tree: the tree to serve
+//        -- query: the queries
+//
+// Output: nothing
+// ============================================================================
+
+void RunService(const BenchOptions &opt, const DataDistribution dist
+                , const CBSTree<FieldNode> &tree
+                , const vector<FieldNode> &query)
+{
+    const int numClients[] = {1, 4, 16, 64};
+    for (int level = 0; level < 4; ++level)
+    {
+        int clients = min(numClients[level], max(1, opt.numQueries));
+        CQueryService<FieldNode> service(tree, opt.numThreads, opt.maxBatch
+                                         , opt.maxWait);
+        vector<double> latency(opt.numQueries);
+        vector<double> all;
+        double total = 0;
+        for (int round = 0; round < opt.warmup + opt.reps; ++round)
+        {
+            long long batches = service.GetNumBatches();
+            double start = Now();
+            vector<thread> pool;
+            for (int client = 0; client < clients; ++client)
+            {
+                pool.push_back(thread([&, client]()
+                {
+                    for (int index = client; index < opt.numQueries
+                         ; index += clients)
+                    {
+                        double begin = Now();
+                        service.Submit(query[index], opt.numNeighbor).get();
+                        latency[index] = Now() - begin;
+                    }
+                }));
+            }
+            for (auto it = pool.begin(); it != pool.end(); ++it)
+            {
+                (*it).join();
+            }
+            if (round >= opt.warmup)
+            {
+                total += Now() - start;
+                all.insert(all.end(), latency.begin(), latency.end());
+            }
+            if (round + 1 == opt.warmup + opt.reps)
+            {
+                batches = service.GetNumBatches() - batches;
+                sort(all.begin(), all.end());
+                double p50 = all.empty() ? 0 : all[(all.size() - 1) / 2];
+                double p99 = all.empty() ? 0
+                                         : all[(all.size() - 1) * 99 / 100];
+                long long ops = 1LL * opt.numQueries * opt.reps;
+                printf("{\"dataset\":\"%s\",\"n\":%d,\"k\":%d"
+                       ",\"phase\":\"service\",\"clients\":%d"
+                       ",\"workers\":%d,\"batch\":%d,\"wait_us\":%d"
+                       ",\"ops\":%lld,\"throughput\":%.1f"
+                       ",\"p50_us\":%.3f,\"p99_us\":%.3f"
+                       ",\"mean_batch\":%.2f}\n"
+                       , CDataGenerator::GetDistributionName(dist)
+                       , opt.numPoints, opt.numNeighbor, clients
+                       , service.GetNumWorkers(), opt.maxBatch, opt.maxWait
+                       , ops, (total > 0) ? ops / total : 0.0, p50 * 1e6
+                       , p99 * 1e6, (batches > 0)
+                                    ? 1.0 * opt.numQueries / batches : 0.0);
+                fflush(stdout);
+            }
+        }
+    }
+
+} // end of "RunService"
+
+
+
+// === Report =================================================================
+// This function will print the result of one phase as a JSON object.
+//
+// Input: -- opt: benchmark settings
+//        -- dist: name of the distribution
+//        -- phase: name of the phase
+//        -- ops: number of operation in the timed repetitions
+//        -- latency: time of each sample, in second (sorted here)
+//        -- seconds: total timed duration
+//
+// Output: nothing
+// ============================================================================
+
+void Report(const BenchOptions &opt, const DataDistribution dist
+            , const char *phase
+            , const long long ops, vector<double> &latency
+            , const double seconds)
+{
+    double p50 = 0;
+    double p99 = 0;
+    if (!latency.empty())
+    {
+        sort(latency.begin(), latency.end());
+        p50 = latency[(latency.size() - 1) * 50 / 100];
+        p99 = latency[(latency.size() - 1) * 99 / 100];
+    }
+    printf("{\"dataset\":\"%s\",\"n\":%d,\"k\":%d,\"phase\":\"%s\""
+           ",\"reps\":%d,\"ops\":%lld,\"seconds\":%.6f"
+           ",\"throughput\":%.1f,\"p50_us\":%.3f,\"p99_us\":%.3f"
+           ",\"max_rss_process_kb\":%ld}\n"
+           , CDataGenerator::GetDistributionName(dist), opt.numPoints
+           , opt.numNeighbor, phase, opt.reps
+           , ops, seconds, (seconds > 0) ? ops / seconds : 0.0
+           , p50 * 1e6, p99 * 1e6, MaxResidentKB());
+    fflush(stdout);
+
+} // end of "Report"
+
+
+
+// === ReportStats ============================================================
+// This function will print the work counters of a phase as a JSON object:
+// the histograms over every query, and over the slowest 1% of the queries
+// (latency at or above p99) so the tail can be compared with the rest. The
+// counters are only filled when compiled with KNN_STATS.
+//
+// Input: -- opt: benchmark settings
+//        -- dist: the distribution
+//        -- phase: name of the phase
+//        -- latency: time of each query, in second (same order as
+//                    queryStats, not sorted)
+//        -- queryStats: counters of each query
+//
+// Output: nothing
+// ============================================================================
+
+void ReportStats(const BenchOptions &opt, const DataDistribution dist
+                 , const char *phase, const vector<double> &latency
+                 , const vector<CQueryStats> &queryStats)
+{
+    CQueryStatsAggregate all;
+    CQueryStatsAggregate tail;
+    vector<double> sorted(latency);
+    double p99 = 0;
+
+    if (!sorted.empty())
+    {
+        sort(sorted.begin(), sorted.end());
+        p99 = sorted[(sorted.size() - 1) * 99 / 100];
+    }
+    for (size_t index = 0; index < queryStats.size(); ++index)
+    {
+        all.Add(queryStats[index]);
+        if (latency[index] >= p99)
+        {
+            tail.Add(queryStats[index]);
+        }
+    }
+    printf("{\"dataset\":\"%s\",\"n\":%d,\"k\":%d,\"phase\":\"%s\""
+           ",\"all\":%s,\"tail\":%s}\n"
+           , CDataGenerator::GetDistributionName(dist), opt.numPoints
+           , opt.numNeighbor, phase, all.ToJson().c_str()
+           , tail.ToJson().c_str());
+    fflush(stdout);
+
+} // end of "ReportStats"
+
+
+
+// === Now ====================================================================
+// This function will return the wall clock time in seconds.
+// ============================================================================
+
+double Now()
+{
+    return chrono::duration<double>(
+               chrono::steady_clock::now().time_since_epoch()).count();
+
+} // end of "Now"
+
+
+
+// === MaxResidentKB ==========================================================
+// This function will return the memory high-water mark of the process in
+// kilobytes, since it started: getrusage keeps no peak per phase.
+// ============================================================================
+
+long MaxResidentKB()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    return usage.ru_maxrss;
+
+} // end of "MaxResidentKB"
@@ -0,0 +1,250 @@
+// ============================================================================
+// File: boundedqueue.cpp
+// ============================================================================
+// This header file contains the implementation of the CBoundedQueue class.
+// It uses the template parameter "ItemType" for the type of the items, which
+// must be movable and have a default constructor.
+// ============================================================================
+
+#include    <algorithm>
+using namespace std;
+#include    "boundedqueue.h"
+
+// ==== CBoundedQueue::CBoundedQueue ==========================================
+//
+// This is the constructor.
+//
+// Access: public
+//
+// Input:
+//      capacity [IN]   -- largest number of item in the queue (at least 1)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  ItemType>
+CBoundedQueue<ItemType>::CBoundedQueue(const int capacity)
+    : m_ring(max(capacity, 1)), m_head(0), m_size(0), m_bClosed(false)
+{
+
+}  // end of "CBoundedQueue<ItemType>::CBoundedQueue"
+
+
+
+// ==== CBoundedQueue::Close ==================================================
+//
+// This function closes the queue: pushes fail from now on, and the threads
+// waiting in Push or PopBatch return.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  ItemType>
+void    CBoundedQueue<ItemType>::Close()
+{
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_bClosed = true;
+    }
+    m_notEmpty.notify_all();
+    m_notFull.notify_all();
+
+}  // end of "CBoundedQueue<ItemType>::Close"
+
+
+
+// ==== CBoundedQueue::GetSize ================================================
+//
+// This function returns the number of item in the queue, which may have
+// changed by the time the caller looks at it.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      The number of item.
+//
+// ============================================================================
+
+template    <typename  ItemType>
+int     CBoundedQueue<ItemType>::GetSize() const
+{
+    lock_guard<mutex> guard(m_lock);
+    return m_size;
+
+}  // end of "CBoundedQueue<ItemType>::GetSize"
+
+
+
+// ==== CBoundedQueue::IsClosed ===============================================
+//
+// This function tells if Close was called.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      True if the queue is closed.
+//
+// ============================================================================
+
+template    <typename  ItemType>
+bool    CBoundedQueue<ItemType>::IsClosed() const
+{
+    lock_guard<mutex> guard(m_lock);
+    return m_bClosed;
+
+}  // end of "CBoundedQueue<ItemType>::IsClosed"
+
+
+
+// ==== CBoundedQueue::PopBatch ===============================================
+//
+// This function takes the oldest items of the queue. It waits for one item,
+// then until "maxCount" items are in the queue or "maxWait" has passed,
+// whichever comes first, and takes what is there (at most "maxCount"). A
+// closed queue does not wait for more items.
+//
+// Access: public
+//
+// Input:
+//      batch [OUT]     -- the items, oldest first
+//      maxCount [IN]   -- largest number of item to take (at least 1)
+//      maxWait [IN]    -- longest wait for the batch to fill after the first
+//                         item
+//
+// Output:
+//      The number of item taken, 0 only when the queue is closed and empty.
+//
+// ============================================================================
+
+template    <typename  ItemType>
+int     CBoundedQueue<ItemType>::PopBatch(vector<ItemType> &batch
+                                          , const int maxCount
+                                          , const chrono::microseconds maxWait)
+{
+    int capacity = static_cast<int>(m_ring.size());
+    int want = min(max(maxCount, 1), capacity);
+
+    batch.clear();
+    unique_lock<mutex> guard(m_lock);
+    m_notEmpty.wait(guard, [this]() { return (m_size > 0) || m_bClosed; });
+    if ((m_size < want) && !m_bClosed && (maxWait.count() > 0))
+    {
+        m_notEmpty.wait_for(guard, maxWait, [this, want]()
+        {
+            return (m_size >= want) || m_bClosed;
+        });
+    }
+
+    int count = min(m_size, want);
+    batch.reserve(count);
+    for (int index = 0; index < count; ++index)
+    {
+        batch.push_back(move(m_ring[m_head]));
+        m_head = (m_head + 1 == capacity) ? 0 : m_head + 1;
+    }
+    m_size -= count;
+    bool bMore = (m_size > 0);
+    guard.unlock();
+
+    if (count > 0)
+    {
+        m_notFull.notify_all();
+    }
+    if (bMore)
+    {
+        m_notEmpty.notify_one();    // let another thread take the rest
+    }
+    return count;
+
+}  // end of "CBoundedQueue<ItemType>::PopBatch"
+
+
+
+// ==== CBoundedQueue::Push ===================================================
+//
+// This function adds an item at the end of the queue, waiting while the
+// queue is full.
+//
+// Access: public
+//
+// Input:
+//      item [IN]   -- the item, moved into the queue
+//
+// Output:
+//      True if the item was added, false if the queue is closed.
+//
+// ============================================================================
+
+template    <typename  ItemType>
+bool    CBoundedQueue<ItemType>::Push(ItemType &&item)
+{
+    int capacity = static_cast<int>(m_ring.size());
+    {
+        unique_lock<mutex> guard(m_lock);
+        m_notFull.wait(guard, [this, capacity]()
+        {
+            return (m_size < capacity) || m_bClosed;
+        });
+        if (m_bClosed)
+        {
+            return false;
+        }
+        int tail = m_head + m_size;
+        m_ring[(tail >= capacity) ? tail - capacity : tail] = move(item);
+        ++m_size;
+    }
+    m_notEmpty.notify_one();
+    return true;
+
+}  // end of "CBoundedQueue<ItemType>::Push"
+
+
+
+// ==== CBoundedQueue::TryPush ================================================
+//
+// This function adds an item at the end of the queue if there is room,
+// without waiting.
+//
+// Access: public
+//
+// Input:
+//      item [IN]   -- the item, moved into the queue if it was added
+//
+// Output:
+//      True if the item was added, false if the queue is full or closed.
+//
+// ============================================================================
+
+template    <typename  ItemType>
+bool    CBoundedQueue<ItemType>::TryPush(ItemType &&item)
+{
+    int capacity = static_cast<int>(m_ring.size());
+    {
+        lock_guard<mutex> guard(m_lock);
+        if ((m_size >= capacity) || m_bClosed)
+        {
+            return false;
+        }
+        int tail = m_head + m_size;
+        m_ring[(tail >= capacity) ? tail - capacity : tail] = move(item);
+        ++m_size;
+    }
+    m_notEmpty.notify_one();
+    return true;
+
+}  // end of "CBoundedQueue<ItemType>::TryPush"
@@ -0,0 +1,59 @@
+// ============================================================================
+// File: boundedqueue.h
+// ============================================================================
+// This header file contains the declaration of the CBoundedQueue class, a
+// first-in first-out queue of fixed capacity that many threads can push to
+// and pop from at once. A push waits while the queue is full, so fast
+// producers are held back instead of growing the queue without limit. A pop
+// takes a whole batch: it waits for the first item, then up to a time limit
+// for the batch to fill. Close wakes every waiting thread; the items left
+// can still be popped.
+//
+// The items sit in a ring buffer guarded by one mutex, which is held only
+// to move items in or out.
+// ============================================================================
+
+#ifndef CBOUNDED_QUEUE_HEADER
+#define CBOUNDED_QUEUE_HEADER
+
+#include    <chrono>
+#include    <condition_variable>
+#include    <mutex>
+#include    <vector>
+using namespace std;
+
+template    <typename  ItemType>
+class   CBoundedQueue
+{
+public:
+    // constructor
+    CBoundedQueue(const int capacity);
+
+    // member functions
+    void    Close();
+    int     GetCapacity() const { return static_cast<int>(m_ring.size()); }
+    int     GetSize() const;
+    bool    IsClosed() const;
+    int     PopBatch(vector<ItemType> &batch, const int maxCount
+                     , const chrono::microseconds maxWait);
+    bool    Push(ItemType &&item);
+    bool    TryPush(ItemType &&item);
+
+private:
+    // no copy, threads wait on it
+    CBoundedQueue(const CBoundedQueue &other);
+    CBoundedQueue& operator=(const CBoundedQueue &rhs);
+
+    // data members
+    vector<ItemType>    m_ring;         // the items, m_size from m_head
+    int                 m_head;         // index of the oldest item
+    int                 m_size;         // number of item in the queue
+    bool                m_bClosed;
+    mutable mutex       m_lock;
+    condition_variable  m_notEmpty;     // signaled on push and close
+    condition_variable  m_notFull;      // signaled on pop and close
+};
+
+#include    "boundedqueue.cpp"
+
+#endif  // CBOUNDED_QUEUE_HEADER
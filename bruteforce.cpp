@@ -0,0 +1,253 @@
+// ============================================================================
+// File: bruteforce.cpp
+// ============================================================================
+// This header file contains the implementation of the CBruteForce class. It
+// uses the template parameter "NodeType" for the type of the points.
+// ============================================================================
+
+#include    <algorithm>
+#include    <cmath>
+using namespace std;
+#include    "bruteforce.h"
+
+// ==== CBruteForce::BuildIndex ===============================================
+//
+// This function copies the points and splits their coordinates into one
+// array per dimension. Like CBSTree::BuildTree, repeated coordinates are
+// kept once (the first point of each group), so both engines of
+// CSearchPlanner search the same points. Any previous points are dropped.
+//
+// Access: public
+//
+// Input:
+//      point [IN]  -- the points
+//      num [IN]    -- number of point
+//
+// Output:
+//      The number of point kept.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CBruteForce<NodeType>::BuildIndex(const NodeType point[]
+                                          , const int num)
+{
+    Clear();
+    if ((NULL == point) || (num <= 0))
+    {
+        return 0;
+    }
+    m_point.assign(point, point + num);
+    CBSTree<NodeType>::UniqueItems(m_point);
+    int numPoints = GetNumPoints();
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        m_coord[dim].resize(numPoints);
+    }
+    for (int index = 0; index < numPoints; ++index)
+    {
+        m_coord[0][index] = m_point[index].GetXCoord();
+        m_coord[1][index] = m_point[index].GetYCoord();
+        m_coord[2][index] = m_point[index].GetZCoord();
+    }
+    return numPoints;
+
+}  // end of "CBruteForce<NodeType>::BuildIndex"
+
+
+
+// ==== CBruteForce::Clear ====================================================
+//
+// This function drops every point and gives back the memory.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CBruteForce<NodeType>::Clear()
+{
+    vector<NodeType>().swap(m_point);
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        vector<double>().swap(m_coord[dim]);
+    }
+
+}  // end of "CBruteForce<NodeType>::Clear"
+
+
+
+// ==== CBruteForce::NearestNeighbors =========================================
+//
+// This function finds the "num" nearest neighbors of the target point in the
+// Euclidean metric and returns them nearest first. It does not change the
+// object, so it can be called from several threads at once.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//      stats [IN]  -- if not NULL, gets the work counters of this query (only
+//                     when compiled with KNN_STATS)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CBruteForce<NodeType>::NearestNeighbors(const NodeType &target
+                                                , const int num
+                                                , vector<NodeType> &listN
+                                                , CQueryStats *stats) const
+{
+    NearestNeighbors(target, num, listN, CEuclideanMetric(), stats);
+
+}  // end of "CBruteForce<NodeType>::NearestNeighbors"
+
+
+
+// ==== CBruteForce::NearestNeighbors =========================================
+//
+// This function finds the "num" nearest neighbors of the target point in any
+// metric of metric.h and returns them nearest first, with their distance in
+// that metric. The points are taken BRUTE_BLOCK at a time: their reduced
+// distances are computed first (BlockDistances), then the few that beat the
+// worst neighbor so far go to a max-heap.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//      metric [IN] -- the distance metric
+//      stats [IN]  -- if not NULL, gets the work counters of this query (only
+//                     when compiled with KNN_STATS)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void    CBruteForce<NodeType>::NearestNeighbors(const NodeType &target
+                                                , const int num
+                                                , vector<NodeType> &listN
+                                                , const Metric &metric
+                                                , CQueryStats *stats) const
+{
+    double coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                 , target.GetZCoord()};
+    double dist[BRUTE_BLOCK];
+    vector<pair<double, int> > heap;    // max-heap on the reduced distance
+    double bound = HUGE_VAL;            // worst neighbor once there are num
+    int numPoints = GetNumPoints();
+
+    KNN_COUNT(stats, Clear());
+    listN.clear();
+    if ((numPoints == 0) || (num <= 0))
+    {
+        return;
+    }
+    heap.reserve(num);
+    for (int first = 0; first < numPoints; first += BRUTE_BLOCK)
+    {
+        int count = min(BRUTE_BLOCK, numPoints - first);
+        const double *block[DIMENSIONAL] = {&m_coord[0][first]
+                                            , &m_coord[1][first]
+                                            , &m_coord[2][first]};
+        // a full block has a known length, which the compiler needs to
+        // vectorize the loops without a runtime check
+        if (count == BRUTE_BLOCK)
+            BlockDistances(metric, block, coord, BRUTE_BLOCK, dist);
+        else
+            BlockDistances(metric, block, coord, count, dist);
+        KNN_COUNT(stats, distanceEvals += count);
+
+        for (int index = 0; index < count; ++index)
+        {
+            if ((dist[index] >= bound) || (dist[index] <= 0))
+            {
+                continue;
+            }
+            if (static_cast<int>(heap.size()) < num)
+            {
+                heap.push_back(make_pair(dist[index], first + index));
+                push_heap(heap.begin(), heap.end());
+            }
+            else
+            {
+                pop_heap(heap.begin(), heap.end());
+                heap.back() = make_pair(dist[index], first + index);
+                push_heap(heap.begin(), heap.end());
+                KNN_COUNT(stats, heapReplacements++);
+            }
+            if (static_cast<int>(heap.size()) == num)
+            {
+                bound = heap.front().first;
+            }
+        }
+    }
+
+    sort_heap(heap.begin(), heap.end());
+    listN.resize(heap.size());
+    for (size_t rank = 0; rank < heap.size(); ++rank)
+    {
+        listN[rank] = m_point[heap[rank].second];
+        listN[rank].SetDistance(metric.Distance(heap[rank].first));
+    }
+
+}  // end of "CBruteForce<NodeType>::NearestNeighbors"
+
+
+
+// === BlockDistances =========================================================
+// This function computes the reduced distance from the target to a block of
+// points. It goes over the block once per dimension, with no branch and
+// contiguous loads; gcc 12 vectorizes both loops at the -O2 of the Makefile
+// (two doubles at a time with the default x86-64 target, checked with
+// -fopt-info-vec). Older compilers need -O3 for it.
+//
+// Input: -- metric: the distance metric
+//        -- coord: coordinates of the block, one array per dimension
+//        -- target: the target point
+//        -- count: number of point in the block
+//        -- dist: the reduced distances
+//
+// Output: nothing
+// ============================================================================
+
+template    <typename  Metric>
+inline void BlockDistances(const Metric &metric
+                           , const double *const coord[DIMENSIONAL]
+                           , const double target[DIMENSIONAL]
+                           , const int count, double *dist)
+{
+    const double *axis = coord[0];
+    const double value = target[0];
+    for (int n = 0; n < count; ++n)
+    {
+        dist[n] = metric.Term(metric.Gap(axis[n], value, 0), 0);
+    }
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        const double *axisDim = coord[dim];
+        const double valueDim = target[dim];
+        for (int n = 0; n < count; ++n)
+        {
+            dist[n] = metric.Accumulate(dist[n], metric.Term(
+                            metric.Gap(axisDim[n], valueDim, dim), dim));
+        }
+    }
+
+} // end of "BlockDistances"
@@ -0,0 +1,69 @@
+// ============================================================================
+// File: bruteforce.h
+// ============================================================================
+// This header file contains the declaration of the CBruteForce class. It
+// finds nearest neighbors by looking at every point, with no tree at all:
+// the coordinates are kept in one flat array per dimension, and the
+// distances to a block of points are computed by loops with no branch,
+// which the compiler vectorizes (see BlockDistances). Only the points
+// closer than the current worst neighbor go to the heap. For a few hundred
+// points, or when the number of neighbors is a large part of the points,
+// this beats a tree, which has to visit most of its nodes anyway (see
+// searchplan.h).
+//
+// Like the other searches, the target itself (distance 0) is skipped, and a
+// point repeated at the same coordinates is kept once, as in the tree.
+// ============================================================================
+
+#ifndef CBRUTE_FORCE_HEADER
+#define CBRUTE_FORCE_HEADER
+
+#include    "cbstree.h"
+#include    "fieldnode.h"
+#include    "metric.h"
+#include    "querystats.h"
+#include    <utility>
+#include    <vector>
+using namespace std;
+
+// number of point whose distances are computed in one pass
+const int BRUTE_BLOCK = 256;
+
+template    <typename  NodeType>
+class   CBruteForce
+{
+public:
+    // constructor
+    CBruteForce() {}
+
+    // member functions
+    int     BuildIndex(const NodeType point[], const int num);
+    void    Clear();
+    int     GetNumPoints() const { return static_cast<int>(m_point.size()); }
+    const NodeType* GetPoints() const { return m_point.data(); }
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN
+                             , CQueryStats *stats = NULL) const;
+    template    <typename  Metric>
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN, const Metric &metric
+                             , CQueryStats *stats = NULL) const;
+
+private:
+    // data members
+    vector<NodeType>    m_point;                // the points, sorted by
+                                                // coordinates, no repeats
+    vector<double>      m_coord[DIMENSIONAL];   // coordinate dim of point i
+                                                // is m_coord[dim][i]
+};
+
+// flat reduced-distance kernel used by NearestNeighbors
+template    <typename  Metric>
+inline void BlockDistances(const Metric &metric
+                           , const double *const coord[DIMENSIONAL]
+                           , const double target[DIMENSIONAL]
+                           , const int count, double *dist);
+
+#include    "bruteforce.cpp"
+
+#endif  // CBRUTE_FORCE_HEADER
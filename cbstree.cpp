@@ -9,13 +9,15 @@
 #include    <fstream>
 #include    <iostream>
 #include    <cstdlib>
+#include    <algorithm>
 using namespace std;
 #include    "cbstree.h"
 #include    "math.h"
 
 // ==== CBSTree::CBSTree ======================================================
 //
-// This is the copy constructor for the CBSTree class.
+// This is the copy constructor for the CBSTree class. The copy has the same
+// shape as the other tree, node for node (see CopyTree).
 //
 // Access: public
 //
@@ -25,15 +27,32 @@ using namespace std;
 // ============================================================================
 
 template    <typename  NodeType>
-CBSTree<NodeType>::CBSTree(const CBSTree<NodeType>  &other)
+CBSTree<NodeType>::CBSTree(const CBSTree<NodeType>  &other) : m_version(0)
 {
-    // perform deep copy if they are not the same tree.
-    m_root = NULL;
-    if (m_root != other.m_root)
-    {
-        DestroyTree();
-        CopyTree(other.m_root);
-    }
+    m_root = CopyTree(other.m_root);
+
+}  // end of "CBSTree<NodeType>::CBSTree"
+
+
+
+// ==== CBSTree::CBSTree ======================================================
+//
+// This is the move constructor for the CBSTree class. It takes the nodes of
+// the other tree, which is left empty; nothing is copied.
+//
+// Access: public
+//
+// Input:
+//      other [IN/OUT]  -- the tree to take the nodes from
+//
+// ============================================================================
+
+template    <typename  NodeType>
+CBSTree<NodeType>::CBSTree(CBSTree<NodeType>  &&other) : m_version(0)
+{
+    m_root = other.m_root;
+    other.m_root = NULL;
+    ++other.m_version;
 
 }  // end of "CBSTree<NodeType>::CBSTree"
 
@@ -43,7 +62,9 @@ CBSTree<NodeType>::CBSTree(const CBSTree<NodeType>  &other)
 //
 // This recursive function creates a copy of a CBSTree. It receives a pointer
 // to the source tree's root, creates a copy and returns a pointer to the root
-// of the copy.
+// of the copy. Each node is copied as it is, with its axis, bounding box,
+// count and sums, so the copy has the same shape as the source and takes
+// one pass over it, with no search and no comparison.
 //
 // Access: private
 //
@@ -59,98 +80,357 @@ template    <typename  NodeType>
 CTreeNode<NodeType>*    CBSTree<NodeType>::CopyTree(
                                         const CTreeNode<NodeType>  *sourcePtr)
 {
-    // traverse the source tree in pre-order to get the value that will assign
-    // to new tree.
-    if (NULL != sourcePtr)
+    // copy the node, then replace the children it points to by their copies
+    if (NULL == sourcePtr)
     {
-        InsertItem(sourcePtr->m_value);
-        CopyTree(sourcePtr->m_left);
-        CopyTree(sourcePtr->m_right);
+        return NULL;
     }
-    return m_root;
+    CTreeNode<NodeType> *nodePtr = new CTreeNode<NodeType>(*sourcePtr);
+    nodePtr->m_left = CopyTree(sourcePtr->m_left);
+    nodePtr->m_right = CopyTree(sourcePtr->m_right);
+    return nodePtr;
 
 }  // end of "CBSTree<NodeType>::CopyTree"
 
 
 
-// ==== CBSTree::CountNodes ===================================================
+// ==== CBSTree::AnalyzeTree ==================================================
+//
+// This function walks the whole tree once, without recursion, and describes
+// its shape: node count, height, leaf depth histogram, average search path,
+// imbalance of each level, splits per axis and memory footprint. Each node
+// is visited three times (going down, between its children, going up); the
+// size of a subtree is known when its node is left for the last time.
+//
+// Access: public
+//
+// Input:
+//      shape [OUT]     -- the description of the tree
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CBSTree<NodeType>::AnalyzeTree(CTreeShape  &shape) const
+{
+    struct Frame
+    {
+        const CTreeNode<NodeType>   *nodePtr;
+        int                         depth;
+        int                         stage;      // 0 down, 1 middle, 2 up
+        long long                   leftSize;
+    };
+    vector<Frame>       stack;
+    vector<double>      levelSum;
+    vector<long long>   levelCount;
+    long long           depthSum = 0;
+    long long           leafDepthSum = 0;
+    long long           childSize = 0;
+
+    shape.Clear();
+    if (NULL == m_root)
+    {
+        return;
+    }
+
+    Frame first = {m_root, 0, 0, 0};
+    stack.push_back(first);
+    while (!stack.empty())
+    {
+        int     top = static_cast<int>(stack.size()) - 1;
+        const CTreeNode<NodeType>   *nodePtr = stack[top].nodePtr;
+        int     depth = stack[top].depth;
+
+        if (stack[top].stage == 0)
+        {
+            // first visit, count the node and go to the left child
+            ++shape.numNodes;
+            depthSum += depth;
+            if (depth > shape.height)
+            {
+                shape.height = depth;
+            }
+            if ((NULL == nodePtr->m_left) && (NULL == nodePtr->m_right))
+            {
+                ++shape.numLeaves;
+                leafDepthSum += depth;
+                if (static_cast<int>(shape.leafDepth.size()) <= depth)
+                {
+                    shape.leafDepth.resize(depth + 1, 0);
+                }
+                ++shape.leafDepth[depth];
+            }
+            else
+            {
+                ++shape.axisSplits[nodePtr->m_axis];
+            }
+            stack[top].stage = 1;
+            childSize = 0;
+            if (NULL != nodePtr->m_left)
+            {
+                Frame next = {nodePtr->m_left, depth + 1, 0, 0};
+                stack.push_back(next);
+                continue;
+            }
+        }
+        if (stack[top].stage == 1)
+        {
+            // back from the left child, go to the right child
+            stack[top].leftSize = childSize;
+            stack[top].stage = 2;
+            childSize = 0;
+            if (NULL != nodePtr->m_right)
+            {
+                Frame next = {nodePtr->m_right, depth + 1, 0, 0};
+                stack.push_back(next);
+                continue;
+            }
+        }
+
+        // last visit, both subtree sizes are known
+        long long leftSize = stack[top].leftSize;
+        long long rightSize = childSize;
+        if (leftSize + rightSize > 0)
+        {
+            if (static_cast<int>(levelSum.size()) <= depth)
+            {
+                levelSum.resize(depth + 1, 0);
+                levelCount.resize(depth + 1, 0);
+            }
+            levelSum[depth] += static_cast<double>(llabs(leftSize - rightSize))
+                               / (leftSize + rightSize);
+            ++levelCount[depth];
+        }
+        childSize = leftSize + rightSize + 1;
+        stack.pop_back();
+    }
+
+    // turn the sums into averages
+    shape.avgPathLength = static_cast<double>(depthSum) / shape.numNodes + 1;
+    shape.avgLeafDepth = static_cast<double>(leafDepthSum) / shape.numLeaves;
+    shape.levelImbalance.resize(levelSum.size(), 0);
+    for (size_t depth = 0; depth < levelSum.size(); ++depth)
+    {
+        if (levelCount[depth] > 0)
+        {
+            shape.levelImbalance[depth] = levelSum[depth] / levelCount[depth];
+        }
+        if (shape.levelImbalance[depth] > shape.maxImbalance)
+        {
+            shape.maxImbalance = shape.levelImbalance[depth];
+        }
+    }
+    shape.memoryBytes = shape.numNodes * sizeof(CTreeNode<NodeType>)
+                        + sizeof(*this);
+
+}  // end of "CBSTree<NodeType>::AnalyzeTree"
+
+
+
+// ==== CBSTree::Build ========================================================
 //
-// This recursive function derives the current height and number of nodes in
-// the tree.  The height is a zero-based integer value, which represents the
-// length of the longest path from the root to a leaf (counting the edges, not
-// the nodes).  This function is called by CBSTree::GetTreeInfo so that the
-// client may determine the total number of nodes and the height of the tree.
+// This recursive function builds a balanced subtree from items[first] to
+// items[last - 1], reordering them in place. The split axis and the split
+// value come from the split rule; every item below the value goes left, the
+// others go right, the same as Insert would send them. Each node gets the
+// exact bounding box of its items.
 //
 // Access: protected
 //
 // Input:
-//      nodePtr [IN]        -- a pointer to a tree node; initially this is the 
-//                             root
+//      items [IN/OUT]  -- the items, without repeated coordinates
+//
+//      first [IN]      -- index of the first item of the subtree
 //
-//      currDepth [IN]      -- the depth of the parent node (initial value is -1)
+//      last [IN]       -- one past the index of the last item
 //
-//      numNodes [IN/OUT]   -- a reference to an int that will contain the 
-//                             total number of nodes in the tree (initial value 
-//                             is zero, set by the caller)
+//      depth [IN]      -- the height of the new node
+//
+//      rule [IN]       -- how the split axis and value are picked
 //
 // Output:
-//      The length of the longest path from the initial root.
-// 
+//      A pointer to the root of the subtree (NULL if there is no item).
+//
 // ============================================================================
 
 template    <typename  NodeType>
-int     CBSTree<NodeType>::CountNodes(const CTreeNode<NodeType>  *nodePtr
-                                                        , int  currDepth
-                                                        , int  &numNodes )const
+CTreeNode<NodeType>*    CBSTree<NodeType>::Build(vector<NodeType>  &items
+                                        , const int first, const int last
+                                        , const int depth
+                                        , const SplitRule rule)
 {
-    int		leftHeight = 0;
-    int		rightHeight = 0;
-    
-    // make sure there is a tree node coming into the function.
-    if (nodePtr == NULL)
+    double  low[DIMENSIONAL];
+    double  high[DIMENSIONAL];
+    double  sum[DIMENSIONAL];
+
+    if (first >= last)
+    {
+        return NULL;
+    }
+
+    // get the bounding box and the coordinate sum of the items, they are
+    // also the box and the sum of the node
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
     {
-        numNodes = 0;
-        return -1;
+        low[dim] = HUGE_VAL;
+        high[dim] = -HUGE_VAL;
+        sum[dim] = 0;
     }
-    
-    // count number of node and height of the tree.
-    else
+    for (int index = first; index < last; ++index)
     {
-        if (NULL != nodePtr->m_left)
+        double coord[DIMENSIONAL] = {items[index].GetXCoord()
+                                     , items[index].GetYCoord()
+                                     , items[index].GetZCoord()};
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
         {
-            leftHeight = CountNodes(nodePtr->m_left, currDepth + 1, numNodes);
-            ++numNodes;
+            low[dim] = min(low[dim], coord[dim]);
+            high[dim] = max(high[dim], coord[dim]);
+            sum[dim] += coord[dim];
         }
-        if (NULL != nodePtr->m_right)
+    }
+
+    // pick the axis
+    int currDim = depth % DIMENSIONAL;
+    if (rule != SPLIT_MEDIAN)
+    {
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
         {
-            rightHeight = CountNodes(nodePtr->m_right, currDepth + 1, numNodes);
-            ++numNodes;
+            if (high[dim] - low[dim] > high[currDim] - low[currDim])
+            {
+                currDim = dim;
+            }
         }
     }
-    
-    // pick the longest path from the parent node to one of the leaf
-    if ((currDepth < leftHeight) || (currDepth < rightHeight))
+
+    // get pointer to function that return the coordinate
+    double (FieldNode::*coordFunc)() const = NULL;
+    if (currDim == 0)
+      coordFunc = &FieldNode::GetXCoord;
+    else if (currDim == 1)
+      coordFunc = &FieldNode::GetYCoord;
+    else if (currDim == 2)
+      coordFunc = &FieldNode::GetZCoord;
+
+    // pick the split value, it is always the coordinate of an item
+    double split = high[currDim];
+    if (rule == SPLIT_SLIDING_MIDPOINT)
     {
-        if (leftHeight > rightHeight)
+        double center = (low[currDim] + high[currDim]) / 2;
+        for (int index = first; index < last; ++index)
         {
-            currDepth = leftHeight;
+            double coord = (items[index].*coordFunc)();
+            if ((coord >= center) && (coord < split))
+            {
+                split = coord;
+            }
         }
-        else 
+    }
+    else
+    {
+        nth_element(items.begin() + first, items.begin() + (first + last) / 2
+                    , items.begin() + last
+                    , [coordFunc](const NodeType &a, const NodeType &b)
+                      { return (a.*coordFunc)() < (b.*coordFunc)(); });
+        split = (items[(first + last) / 2].*coordFunc)();
+    }
+
+    // items below the split value go left, the smallest of the others (one
+    // on the split value) becomes the node
+    int middle = static_cast<int>(
+                    partition(items.begin() + first, items.begin() + last
+                              , [coordFunc, split](const NodeType &item)
+                                { return (item.*coordFunc)() < split; })
+                    - items.begin());
+    for (int index = middle; index < last; ++index)
+    {
+        if ((items[index].*coordFunc)() == split)
         {
-            currDepth = rightHeight;
+            swap(items[middle], items[index]);
+            break;
         }
     }
-    return currDepth;
-    
-}  // end of "CBSTree::CountNodes"
+
+    CTreeNode<NodeType> *nodePtr = new CTreeNode<NodeType>(items[middle]);
+    nodePtr->m_axis = currDim;
+    nodePtr->m_count = last - first;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        nodePtr->m_low[dim] = low[dim];
+        nodePtr->m_high[dim] = high[dim];
+        nodePtr->m_sum[dim] = sum[dim];
+    }
+    nodePtr->m_left = Build(items, first, middle, depth + 1, rule);
+    nodePtr->m_right = Build(items, middle + 1, last, depth + 1, rule);
+    return nodePtr;
+
+}  // end of "CBSTree<NodeType>::Build"
+
+
+
+// ==== CBSTree::BuildTree ====================================================
+//
+// This function replaces the content of the tree with a balanced tree of the
+// items, built top-down in O(n log n) instead of inserting them one by one.
+// Items with the same coordinates as an earlier one are skipped, the same as
+// InsertItem does. The axis of each node depends on the split rule:
+//      SPLIT_MEDIAN:           the depth cycles the axes (as Insert does),
+//                              the node is the median item
+//      SPLIT_WIDEST:           the axis where the items spread the most, the
+//                              node is the median item
+//      SPLIT_SLIDING_MIDPOINT: the axis where the items spread the most, the
+//                              node is the first item at or above the middle
+//                              of the spread; the cells stay fat for flat or
+//                              clustered data, the tree is less balanced
+//
+// Access: public
+//
+// Input:
+//      items [IN]  -- the items to store
+//
+//      num [IN]    -- number of item
+//
+//      rule [IN]   -- how the split axis and value are picked
+//
+// Output:
+//      The number of item in the tree.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CBSTree<NodeType>::BuildTree(const NodeType items[], const int num
+                                     , const SplitRule rule)
+{
+    vector<NodeType>    work;
+
+    DestroyTree();
+    if (num <= 0)
+    {
+        return 0;
+    }
+
+    // remove repeated coordinates, the first item of each group is kept
+    work.assign(items, items + num);
+    UniqueItems(work);
+
+    m_root = Build(work, 0, static_cast<int>(work.size()), 0, rule);
+    return static_cast<int>(work.size());
+
+}  // end of "CBSTree<NodeType>::BuildTree"
 
 
 
 // ==== CBSTree::Delete =======================================================
 //
 // This function deletes a target node from the tree.  The function finds the 
-// correct location for the target node by calling itself recursively. It then
-// returns the address of the (potentially new) root of the tree.
+// correct location for the target node by calling itself recursively, going
+// left or right on the split coordinate of each node like Insert does. A
+// node with children is replaced by the node of its right subtree that has
+// the smallest coordinate on the split dimension (if there is only a left
+// subtree, it is moved to the right first). Every node on the way loses the
+// target from its count. It then returns the address of the (potentially
+// new) root of the tree.
 //
 // Access: protected
 //
@@ -161,6 +441,8 @@ int     CBSTree<NodeType>::CountNodes(const CTreeNode<NodeType>  *nodePtr
 //      nodePtr [IN]        -- a pointer to a tree node (initially this is 
 //                             usually the root).
 //
+//      height [IN]         -- the current height of tree
+//
 //      bItemDeleted [OUT]  -- a reference to a bool that will indicate if the
 //                             target item was actually removed from the tree;
 //                             if that's the case it will have a value of true,
@@ -175,9 +457,9 @@ template    <typename  NodeType>
 CTreeNode<NodeType>*  CBSTree<NodeType>::Delete(
                                         const NodeType  &targetItem
                                         , CTreeNode<NodeType>  *nodePtr
+                                        , const int height
                                         , bool  &bItemDeleted)
 {
-    CTreeNode<NodeType>		*childPtr = NULL;
     CTreeNode<NodeType>		*tempPtr = NULL;
     
     // make sure the tree node is valid.
@@ -185,45 +467,60 @@ CTreeNode<NodeType>*  CBSTree<NodeType>::Delete(
     {
         return NULL;
     }
+
+    // get pointer to function that return the coordinate
+    int currDim = nodePtr->m_axis;
+    double (FieldNode::*coordFunc)() const = NULL;
+    if (currDim == 0)
+      coordFunc = &FieldNode::GetXCoord;
+    else if (currDim == 1)
+      coordFunc = &FieldNode::GetYCoord;
+    else if (currDim == 2)
+      coordFunc = &FieldNode::GetZCoord;
+
+    // delete item and adjust pointer if neccessary.
+    if ((nodePtr->m_value.GetXCoord() == targetItem.GetXCoord())
+        && (nodePtr->m_value.GetYCoord() == targetItem.GetYCoord())
+        && (nodePtr->m_value.GetZCoord() == targetItem.GetZCoord()))
+    {
+        // delete a leaf.
+        if ((NULL == nodePtr->m_left) && (NULL == nodePtr->m_right))
+        {
+            delete nodePtr;
+            bItemDeleted = true;
+            return NULL;
+        }
+
+        // only a left subtree, it becomes the right subtree so the
+        // replacement is still the smallest of the right side.
+        if (NULL == nodePtr->m_right)
+        {
+            nodePtr->m_right = nodePtr->m_left;
+            nodePtr->m_left = NULL;
+        }
+        tempPtr = FindMinNode(nodePtr->m_right, currDim, height + 1);
+        nodePtr->m_value = tempPtr->m_value;
+        nodePtr->m_right = Delete(nodePtr->m_value, nodePtr->m_right
+                                  , height + 1, bItemDeleted);
+    }
     
     // perform recursive to the tree node that has the target.
-    if (targetItem.GetDistance() < nodePtr->m_value.GetDistance())
+    else if ((targetItem.*coordFunc)() < (nodePtr->m_value.*coordFunc)())
     {
-        nodePtr->m_left = Delete(targetItem, nodePtr->m_left, bItemDeleted);
+        nodePtr->m_left = Delete(targetItem, nodePtr->m_left, height + 1
+                                 , bItemDeleted);
     }
-    else if (targetItem.GetDistance() > nodePtr->m_value.GetDistance())
+    else
     {
-        nodePtr->m_right = Delete(targetItem, nodePtr->m_right, bItemDeleted);
+        nodePtr->m_right = Delete(targetItem, nodePtr->m_right, height + 1
+                                  , bItemDeleted);
     }
-        
-    // delete item and adjust pointer if neccessary.
-    else
+
+    // the subtree lost the target (its bounding box is kept, it is still
+    // large enough)
+    if (bItemDeleted)
     {
-        
-        // delete tree node with two children.
-        if ((NULL != nodePtr->m_left) && (NULL != nodePtr->m_right))
-        {
-            tempPtr = FindMinNode(nodePtr->m_right);
-            nodePtr->m_value = tempPtr->m_value;
-            nodePtr->m_right = Delete(nodePtr->m_value, nodePtr->m_right
-                                                      , bItemDeleted);
-        }
-            
-        // delete tree node with zero or one child.
-        else
-        {
-            if (nodePtr->m_right)
-            {
-                childPtr = nodePtr->m_right;
-            }
-            else if (nodePtr->m_left)
-            {
-                childPtr = nodePtr->m_left;
-            }
-            delete nodePtr;
-            bItemDeleted = true;
-            return childPtr;
-        }
+        CountItem(nodePtr, targetItem, -1);
     }
     return nodePtr;
 
@@ -259,7 +556,8 @@ bool    CBSTree<NodeType>::DeleteItem(const NodeType  &targetItem)
     }
     else
     {
-        m_root = Delete(targetItem, m_root, bResult);
+        m_root = Delete(targetItem, m_root, 0, bResult);
+        ++m_version;
     }
     return bResult;
     
@@ -285,16 +583,13 @@ bool    CBSTree<NodeType>::DeleteItem(const NodeType  &targetItem)
 template    <typename  NodeType>
 void    CBSTree<NodeType>::DestroyNodes(CTreeNode<NodeType>  *const nodePtr)
 {
-    // perform recursive postorder delete. We will call 'Delete' function
-    // to release memory when we get to the node that we want to delete.
+    // perform recursive postorder delete, the children are released before
+    // the node itself.
     if (NULL != nodePtr)
     {
         DestroyNodes(nodePtr->m_left);
         DestroyNodes(nodePtr->m_right);
-        bool	bResult = false;
-        nodePtr->m_left = NULL;
-        nodePtr->m_right = NULL;
-        Delete(nodePtr->m_value, nodePtr, bResult);
+        delete nodePtr;
     }
 
 }  // end of "CBSTree<ItemType>::DestroyNodes"
@@ -303,14 +598,21 @@ void    CBSTree<NodeType>::DestroyNodes(CTreeNode<NodeType>  *const nodePtr)
 
 // ==== CBSTree::FindMinNode ==================================================
 //
-// This function finds the node with the smallest value, using the input node
-// pointer as a starting point.  It returns a pointer to the target node.
+// This function finds the node with the smallest coordinate on one dimension,
+// using the input node pointer as a starting point.  Below a node that splits
+// on that dimension only the left side can hold the smallest value, below the
+// other nodes both sides are searched.  It returns a pointer to the target
+// node.
 //
 // Access: protected
 //
 // Input:
 //      nodePtr [IN]    -- a pointer to a tree node
 //
+//      dim [IN]        -- the dimension to look at
+//
+//      height [IN]     -- the height of the input node
+//
 // Output:
 //      A pointer to the target node.
 //
@@ -318,17 +620,46 @@ void    CBSTree<NodeType>::DestroyNodes(CTreeNode<NodeType>  *const nodePtr)
 
 template    <typename  NodeType>
 CTreeNode<NodeType>*  CBSTree<NodeType>::FindMinNode(
-                            CTreeNode<NodeType>  *nodePtr) const
+                            CTreeNode<NodeType>  *nodePtr, const int dim
+                            , const int height) const
 {
-    // Get the left most item of the input node pointer.
-    if (NULL != nodePtr)
+    CTreeNode<NodeType>     *minPtr = nodePtr;
+    CTreeNode<NodeType>     *childPtr = NULL;
+
+    if (NULL == nodePtr)
+    {
+        return NULL;
+    }
+
+    // get pointer to function that return the coordinate
+    double (FieldNode::*coordFunc)() const = NULL;
+    if (dim == 0)
+      coordFunc = &FieldNode::GetXCoord;
+    else if (dim == 1)
+      coordFunc = &FieldNode::GetYCoord;
+    else if (dim == 2)
+      coordFunc = &FieldNode::GetZCoord;
+
+    // Get the smallest item of the left side, and of the right side when this
+    // level does not split on the dimension.
+    childPtr = FindMinNode(nodePtr->m_left, dim, height + 1);
+    if ((NULL != childPtr)
+        && ((childPtr->m_value.*coordFunc)() < (minPtr->m_value.*coordFunc)()))
+    {
+        minPtr = childPtr;
+    }
+    if (nodePtr->m_axis != dim)
     {
-        while (nodePtr->m_left)
+        childPtr = FindMinNode(nodePtr->m_right, dim, height + 1);
+        if ((NULL != childPtr)
+            && ((childPtr->m_value.*coordFunc)()
+                < (minPtr->m_value.*coordFunc)()))
         {
-            nodePtr = nodePtr->m_left;
+            minPtr = childPtr;
         }
     }
-    return nodePtr;
+    return minPtr;
+
 }  // end of "CBSTree<NodeType>::FindMinNode"
 
 
@@ -356,21 +687,12 @@ CTreeNode<NodeType>*  CBSTree<NodeType>::FindMinNode(
 template    <typename  NodeType>
 void    CBSTree<NodeType>::GetTreeInfo(int  &numNodes, int  &height) const
 {
-    // if there is at least one node in the tree, hand control over to 
-    // 'CountNodes' member function to get the exact number of node and
-    // height of the tree. otherwise, the tree will have the height of -1
-    // and zero number of node by default.
-    if (m_root != NULL)
-    {
-        numNodes = 1;
-        height = 0;
-        height = CountNodes(m_root, height, numNodes);
-    }
-    else
-    {
-        numNodes = 0;
-        height = -1;
-    }
+    // hand control over to 'AnalyzeTree', an empty tree has the height of -1
+    // and zero number of node.
+    CTreeShape  shape;
+    AnalyzeTree(shape);
+    numNodes = static_cast<int>(shape.numNodes);
+    height = shape.height;
 
 }  // end of "CBSTree::GetTreeInfo"
 
@@ -379,34 +701,39 @@ void    CBSTree<NodeType>::GetTreeInfo(int  &numNodes, int  &height) const
 // ==== CBSTree::InOrder ======================================================
 //
 // This function performs an in-order traversal through the tree, calling the
-// "fPtr" parameter for each node.
+// visitor for each node until it asks to stop.
 //
 // Access: protected
 //
 // Input:
-//      nodePtr [IN]    -- a pointer to a NodeType object (this is a recursive
-//                         function, initially this points to the root).
+//      nodePtr [IN]    -- a pointer to a tree node (this is a recursive
+//                         function, initially this points to the root)
 //
-//      fPtr [IN]       -- a pointer to a non-member function that takes a 
-//                         const reference to a NodeType object as input, and 
-//                         returns nothing
+//      visitor [IN]    -- a callable that takes a const reference to a
+//                         NodeType object and returns nothing or a
+//                         VisitSignal (see visitor.h)
 //
 // Output:
-//      Nothing
+//      A value of false if the visitor stopped the traversal, true otherwise.
 //
 // ============================================================================
 
 template    <typename  NodeType>
-void    CBSTree<NodeType>::InOrder(const CTreeNode<NodeType> *const nodePtr
-                                        , void (*fPtr)(const NodeType&)) const
+template    <typename  Visitor>
+bool    CBSTree<NodeType>::InOrder(const CTreeNode<NodeType> *const nodePtr
+                                  , Visitor  &visitor) const
 {
-    // Perform an in-order traversal through the tree
+    // perform in-order traversal, stop as soon as the visitor asks for it
     if (NULL != nodePtr)
     {
-        InOrder(nodePtr->m_left, fPtr);
-        fPtr(nodePtr->m_value);
-        InOrder(nodePtr->m_right, fPtr);
+        if (!InOrder(nodePtr->m_left, visitor)
+            || !CallVisitor(visitor, nodePtr->m_value)
+            || !InOrder(nodePtr->m_right, visitor))
+        {
+            return false;
+        }
     }
+    return true;
 
 }  // end of "CBSTree<NodeType>::InOrder"
 
@@ -415,30 +742,29 @@ void    CBSTree<NodeType>::InOrder(const CTreeNode<NodeType> *const nodePtr
 // ==== CBSTree::InOrderTraversal =============================================
 //
 // This function allows the caller to execute an in-order traversal through the
-// tree, and have the "fPtr" parameter called for each node in the tree.
+// tree, and have the visitor called for each node in the tree. The visitor
+// is any callable (a function, a function object, a lambda); it may keep
+// state, and it may return VISIT_STOP (or false) to end the walk early.
 //
 // Access: public
 //
 // Input:
-//      fPtr [IN]   -- a pointer to a non-member function that takes a const
-//                     reference to a NodeType object as input, and returns 
-//                     nothing
+//      visitor [IN]    -- a callable that takes a const reference to a
+//                         NodeType object and returns nothing or a
+//                         VisitSignal
 //
 // Output:
-//      Nothing
+//      A value of false if the visitor stopped the traversal, true otherwise.
 //
 // ============================================================================
 
 template    <typename  NodeType>
-void    CBSTree<NodeType>::InOrderTraversal(void  (*fPtr)(const NodeType&)) const
+template    <typename  Visitor>
+bool    CBSTree<NodeType>::InOrderTraversal(Visitor  &&visitor) const
 {
-    
     // call 'InOrder' function to perform in-order traversal
-    if (NULL != m_root)
-    {
-        InOrder(m_root, fPtr);
-    }
-    
+    return InOrder(m_root, visitor);
+
 }  // end of "CBSTree<NodeType>::InOrderTraversal"
 
 
@@ -447,8 +773,9 @@ void    CBSTree<NodeType>::InOrderTraversal(void  (*fPtr)(const NodeType&)) cons
 //
 // This function inserts a new node into the tree.  It finds the correct
 // location for the new node by calling itself recursively. If the new record
-// is unique, a copy is created and inserted into the tree. Then the address of
-// the (potentially new) root of the tree is returned.
+// is unique, a copy is created and inserted into the tree; the new node
+// splits on the axis "treeHeight % DIMENSIONAL". Then the address of the
+// (potentially new) root of the tree is returned.
 //
 // If the root data member of this class is NULL upon entry, it is initialized
 // with the value of the nodePtr parameter.
@@ -473,8 +800,20 @@ template    <typename  NodeType>
 CTreeNode<NodeType>*  CBSTree<NodeType>::Insert(const NodeType  &newItem
 			, CTreeNode<NodeType>  *nodePtr, const int treeHeight)
 {
+    // add a new node to the tree, it splits on the axis of its level.
+    if (NULL == nodePtr)
+    {
+        nodePtr = new CTreeNode<NodeType>;
+        nodePtr->m_value = newItem;
+        nodePtr->m_left = nodePtr->m_right = NULL;
+        nodePtr->m_axis = treeHeight % DIMENSIONAL;
+        ExtendBox(nodePtr, newItem, true);
+        CountItem(nodePtr, newItem, 1);
+        return nodePtr;
+    }
+
     // get pointer to function that return the coordinate
-    int currDim = treeHeight % DIMENSIONAL;
+    int currDim = nodePtr->m_axis;
     double (FieldNode::*coordFunc)() const = NULL;
     if (currDim == 0)
       coordFunc = &FieldNode::GetXCoord;
@@ -483,15 +822,11 @@ CTreeNode<NodeType>*  CBSTree<NodeType>::Insert(const NodeType  &newItem
     else if (currDim == 2)
       coordFunc = &FieldNode::GetZCoord;
 
-    // add a new node to the tree.
-    if (NULL == nodePtr)
-    {
-        nodePtr = new CTreeNode<NodeType>;
-        nodePtr->m_value = newItem;
-        nodePtr->m_left = nodePtr->m_right = NULL;
-    }
-    // apply k-d tree insert algorithm
-    else if ((newItem.*coordFunc)() < (nodePtr->m_value.*coordFunc)())
+    // apply k-d tree insert algorithm, every node on the way gets a bigger
+    // bounding box and one more item
+    ExtendBox(nodePtr, newItem, false);
+    CountItem(nodePtr, newItem, 1);
+    if ((newItem.*coordFunc)() < (nodePtr->m_value.*coordFunc)())
     {
 	   nodePtr->m_left = Insert(newItem, nodePtr->m_left, treeHeight + 1);
     }
@@ -535,6 +870,7 @@ bool    CBSTree<NodeType>::InsertItem(const NodeType  &newItem)
     else
     {
 	   m_root = Insert(newItem, m_root, 0);
+        ++m_version;
         if (NULL == m_root)
         {
             return false;
@@ -546,102 +882,268 @@ bool    CBSTree<NodeType>::InsertItem(const NodeType  &newItem)
 
 
 
-// ==== CBSTree::PostOrder ====================================================
+// ==== CBSTree::InsertBatch ==================================================
 //
-// This function performs a post-order traversal through the tree, calling the
-// "fPtr" parameter for each node.
+// This function inserts a block of items in one pass instead of one
+// InsertItem each. The block is split against the split value of each node
+// on the way down (MergeItems), so each node is looked at once per block,
+// not once per item. A subtree that the block grows by at least
+// 1 / BATCH_REBUILD_SHARE of its size is rebuilt balanced with its new
+// items, so the new items do not pile up below the old leaves; a block at
+// least half the size of the tree rebuilds the whole tree. Items with the
+// same coordinates as a point of the tree, or as an earlier item of the
+// block, are skipped, the same as InsertItem does.
 //
-// Access: protected
+// Access: public
 //
 // Input:
-//      nodePtr [IN]    -- a pointer to a NodeType object (this is a recursive
-//                         function, initially this points to the root)
+//      items [IN]  -- the items to insert
 //
-//      fPtr [IN]       -- a pointer to a non-member function that takes a 
-//                         const reference to a NodeType object as input, and 
-//                         returns nothing
+//      num [IN]    -- number of item
+//
+//      rule [IN]   -- split rule of the rebuilt subtrees (see BuildTree)
 //
 // Output:
-//      Nothing
+//      The number of item inserted.
 //
 // ============================================================================
 
 template    <typename  NodeType>
-void    CBSTree<NodeType>::PostOrder(const CTreeNode<NodeType>  *const nodePtr
-                                        , void (*fPtr)(const NodeType&)) const
+int     CBSTree<NodeType>::InsertBatch(const NodeType items[], const int num
+                                       , const SplitRule rule)
 {
-    // Performs a post-order traversal through the tree
-    if (NULL != nodePtr)
+    vector<NodeType>    work;
+
+    if (num <= 0)
     {
-        PostOrder(nodePtr->m_left, fPtr);
-        PostOrder(nodePtr->m_right, fPtr);
-        fPtr(nodePtr->m_value);
+        return 0;
     }
+    work.assign(items, items + num);
+    UniqueItems(work);
 
-}  // end of "CBSTree<NodeType>::PostOrder"
+    int before = (NULL == m_root) ? 0 : m_root->m_count;
+    ++m_version;
+    m_root = MergeItems(m_root, work, 0, static_cast<int>(work.size()), 0
+                        , rule);
+    return ((NULL == m_root) ? 0 : m_root->m_count) - before;
 
+}  // end of "CBSTree<NodeType>::InsertBatch"
 
 
-// ==== CBSTree::PostOrderTraversal ===========================================
+
+// ==== CBSTree::MergeItems ===================================================
 //
-// This function allows the caller to execute a post-order traversal through
-// the tree, and have the "fPtr" parameter called for each node in the tree.
+// This recursive function merges items[first] to items[last - 1] into a
+// subtree and returns its (potentially new) root. An empty subtree is built
+// from the items, a subtree that grows by at least 1 / BATCH_REBUILD_SHARE
+// of its size is rebuilt with its values and the items; otherwise the items
+// with the coordinates of the node are dropped, the others are split on the
+// axis of the node like Insert sends them, and each side is merged into its
+// child. The box, count and sum of the node are then made again from its
+// value and its children.
 //
-// Access: public
+// Access: protected
 //
 // Input:
-//      fPtr [IN]   -- a pointer to a non-member function that takes a const 
-//                     reference to a NodeType object as input, and returns 
-//                     nothing
+//      nodePtr [IN]    -- a pointer to a tree node (initially the root)
+//
+//      items [IN/OUT]  -- the items, without repeated coordinates; they are
+//                         reordered
+//
+//      first [IN]      -- index of the first item for this subtree
+//
+//      last [IN]       -- one past the index of the last item
+//
+//      depth [IN]      -- the height of the node
+//
+//      rule [IN]       -- split rule of the rebuilt subtrees
 //
 // Output:
-//      Nothing
+//      A pointer to the (potentially new) root of the subtree.
 //
 // ============================================================================
 
 template    <typename  NodeType>
-void    CBSTree<NodeType>::PostOrderTraversal(void  (*fPtr)(const NodeType&)) const
+CTreeNode<NodeType>*    CBSTree<NodeType>::MergeItems(
+                                        CTreeNode<NodeType>  *nodePtr
+                                        , vector<NodeType>  &items
+                                        , const int first, const int last
+                                        , const int depth
+                                        , const SplitRule rule)
 {
-    // execute a post-order traversal through the tree
-    if (NULL != m_root)
+    if (first >= last)
     {
-        PostOrder(m_root, fPtr);
+        return nodePtr;
+    }
+    if (NULL == nodePtr)
+    {
+        return Build(items, first, last, depth, rule);
     }
-}  // end of "CBSTree<NodeType>::PostOrderTraversal"
-
 
+    // a large share of new items, rebuild the subtree with them
+    if ((last - first) * BATCH_REBUILD_SHARE >= nodePtr->m_count)
+    {
+        vector<NodeType> work;
+        auto collect = [&work](const NodeType &value)
+                       { work.push_back(value); };
+        work.reserve(nodePtr->m_count + last - first);
+        PreOrder(nodePtr, collect);
+        work.insert(work.end(), items.begin() + first, items.begin() + last);
+        DestroyNodes(nodePtr);
+        UniqueItems(work);
+        return Build(work, 0, static_cast<int>(work.size()), depth, rule);
+    }
 
-// ==== CBSTree::PreOrder =====================================================
-//
-// This function performs a pre-order traversal through the tree, calling the
-// "fPtr" parameter for each node.
+    // get pointer to function that return the coordinate
+    int currDim = nodePtr->m_axis;
+    double (FieldNode::*coordFunc)() const = NULL;
+    if (currDim == 0)
+      coordFunc = &FieldNode::GetXCoord;
+    else if (currDim == 1)
+      coordFunc = &FieldNode::GetYCoord;
+    else if (currDim == 2)
+      coordFunc = &FieldNode::GetZCoord;
+
+    // items below the node go left, the others right except the ones with
+    // the coordinates of the node (they are already in the tree)
+    const NodeType &value = nodePtr->m_value;
+    double split = (value.*coordFunc)();
+    int middle = static_cast<int>(
+                    partition(items.begin() + first, items.begin() + last
+                              , [coordFunc, split](const NodeType &item)
+                                { return (item.*coordFunc)() < split; })
+                    - items.begin());
+    int end = static_cast<int>(
+                    partition(items.begin() + middle, items.begin() + last
+                              , [&value](const NodeType &item)
+                                {
+                                    return (item.GetXCoord()
+                                            != value.GetXCoord())
+                                           || (item.GetYCoord()
+                                               != value.GetYCoord())
+                                           || (item.GetZCoord()
+                                               != value.GetZCoord());
+                                })
+                    - items.begin());
+
+    nodePtr->m_left = MergeItems(nodePtr->m_left, items, first, middle
+                                 , depth + 1, rule);
+    nodePtr->m_right = MergeItems(nodePtr->m_right, items, middle, end
+                                  , depth + 1, rule);
+    FitNode(nodePtr);
+    return nodePtr;
+
+}  // end of "CBSTree<NodeType>::MergeItems"
+
+
+
+// ==== CBSTree::PostOrder ====================================================
+//
+// This function performs a post-order traversal through the tree, calling the
+// visitor for each node until it asks to stop.
 //
 // Access: protected
 //
 // Input:
-//      nodePtr [IN]    -- a pointer to a NodeType object (this is a recursive
+//      nodePtr [IN]    -- a pointer to a tree node (this is a recursive
 //                         function, initially this points to the root)
 //
-//      fPtr [IN]       -- a pointer to a non-member function that takes a 
-//                         const reference NodeType object as input, and returns 
-//                         nothing
+//      visitor [IN]    -- a callable that takes a const reference to a
+//                         NodeType object and returns nothing or a
+//                         VisitSignal (see visitor.h)
 //
 // Output:
-//      Nothing
+//      A value of false if the visitor stopped the traversal, true otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Visitor>
+bool    CBSTree<NodeType>::PostOrder(const CTreeNode<NodeType> *const nodePtr
+                                  , Visitor  &visitor) const
+{
+    // perform post-order traversal, stop as soon as the visitor asks for it
+    if (NULL != nodePtr)
+    {
+        if (!PostOrder(nodePtr->m_left, visitor)
+            || !PostOrder(nodePtr->m_right, visitor)
+            || !CallVisitor(visitor, nodePtr->m_value))
+        {
+            return false;
+        }
+    }
+    return true;
+
+}  // end of "CBSTree<NodeType>::PostOrder"
+
+
+
+// ==== CBSTree::PostOrderTraversal ===========================================
+//
+// This function allows the caller to execute a post-order traversal through the
+// tree, and have the visitor called for each node in the tree. The visitor
+// is any callable (a function, a function object, a lambda); it may keep
+// state, and it may return VISIT_STOP (or false) to end the walk early.
+//
+// Access: public
+//
+// Input:
+//      visitor [IN]    -- a callable that takes a const reference to a
+//                         NodeType object and returns nothing or a
+//                         VisitSignal
+//
+// Output:
+//      A value of false if the visitor stopped the traversal, true otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Visitor>
+bool    CBSTree<NodeType>::PostOrderTraversal(Visitor  &&visitor) const
+{
+    // call 'PostOrder' function to perform post-order traversal
+    return PostOrder(m_root, visitor);
+
+}  // end of "CBSTree<NodeType>::PostOrderTraversal"
+
+
+
+// ==== CBSTree::PreOrder =====================================================
+//
+// This function performs a pre-order traversal through the tree, calling the
+// visitor for each node until it asks to stop.
+//
+// Access: protected
+//
+// Input:
+//      nodePtr [IN]    -- a pointer to a tree node (this is a recursive
+//                         function, initially this points to the root)
+//
+//      visitor [IN]    -- a callable that takes a const reference to a
+//                         NodeType object and returns nothing or a
+//                         VisitSignal (see visitor.h)
+//
+// Output:
+//      A value of false if the visitor stopped the traversal, true otherwise.
 //
 // ============================================================================
 
 template    <typename  NodeType>
-void    CBSTree<NodeType>::PreOrder(const CTreeNode<NodeType>  *const nodePtr
-                                    , void  (*fPtr)(const NodeType&)) const
+template    <typename  Visitor>
+bool    CBSTree<NodeType>::PreOrder(const CTreeNode<NodeType> *const nodePtr
+                                  , Visitor  &visitor) const
 {
-    // perform pre-order traversal.
+    // perform pre-order traversal, stop as soon as the visitor asks for it
     if (NULL != nodePtr)
     {
-        fPtr(nodePtr->m_value);
-        PreOrder(nodePtr->m_left, fPtr);
-        PreOrder(nodePtr->m_right, fPtr);
+        if (!CallVisitor(visitor, nodePtr->m_value)
+            || !PreOrder(nodePtr->m_left, visitor)
+            || !PreOrder(nodePtr->m_right, visitor))
+        {
+            return false;
+        }
     }
+    return true;
 
 }  // end of "CBSTree<NodeType>::PreOrder"
 
@@ -650,28 +1152,28 @@ void    CBSTree<NodeType>::PreOrder(const CTreeNode<NodeType>  *const nodePtr
 // ==== CBSTree::PreOrderTraversal ============================================
 //
 // This function allows the caller to execute a pre-order traversal through the
-// tree, and have the "fPtr" parameter called for each node in the tree.
+// tree, and have the visitor called for each node in the tree. The visitor
+// is any callable (a function, a function object, a lambda); it may keep
+// state, and it may return VISIT_STOP (or false) to end the walk early.
 //
 // Access: public
 //
 // Input:
-//      fPtr [IN]   -- a pointer to a non-member function that takes a const 
-//                     reference to a NodeType object as input, and returns 
-//                     nothing
+//      visitor [IN]    -- a callable that takes a const reference to a
+//                         NodeType object and returns nothing or a
+//                         VisitSignal
 //
 // Output:
-//      Nothing
+//      A value of false if the visitor stopped the traversal, true otherwise.
 //
 // ============================================================================
 
 template    <typename  NodeType>
-void    CBSTree<NodeType>::PreOrderTraversal(void (*fPtr)(const NodeType&)) const
+template    <typename  Visitor>
+bool    CBSTree<NodeType>::PreOrderTraversal(Visitor  &&visitor) const
 {
-    // call protected member function to perform pre-order traversal.
-    if (NULL != m_root)
-    {
-        PreOrder(m_root, fPtr);
-    }
+    // call 'PreOrder' function to perform pre-order traversal
+    return PreOrder(m_root, visitor);
 
 }  // end of "CBSTree<NodeType>::PreOrderTraversal"
 
@@ -706,7 +1208,14 @@ template    <typename  NodeType>
 CTreeNode<NodeType>*  CBSTree<NodeType>::Retrieve(const NodeType  &target
 		  , CTreeNode<NodeType>  *nodePtr, const int height) const
 {
-        int currDim = height % DIMENSIONAL;
+    // check to see if recursive reach base case (if this base case is true,
+    // then the target is not in the tree).
+    if (NULL == nodePtr)
+    {
+        return NULL;
+    }
+
+    int currDim = nodePtr->m_axis;
 
 	// get pointer to function
 	double (FieldNode::*coordFunc)() const = NULL;
@@ -717,13 +1226,6 @@ CTreeNode<NodeType>*  CBSTree<NodeType>::Retrieve(const NodeType  &target
 	else if (currDim == 2)
 	  coordFunc = &FieldNode::GetZCoord;
 
-    // check to see if recursive reach base case (if this base case is true,
-    // then the target is not in the tree).
-    if (NULL == nodePtr)
-    {
-        return NULL;
-    }
-
     if ((nodePtr->m_value.GetXCoord() == target.GetXCoord())
 	&& (nodePtr->m_value.GetYCoord() == target.GetYCoord())
 	&& (nodePtr->m_value.GetZCoord() == target.GetZCoord()))
@@ -801,10 +1303,40 @@ template    <typename  NodeType>
 CBSTree<NodeType>&  CBSTree<NodeType>::operator=(const CBSTree<NodeType> &rhs)
 {
     // perform deep copy if they are not the same tree.
-    if (m_root != rhs.m_root)
+    if (this != &rhs)
+    {
+        DestroyTree();
+        m_root = CopyTree(rhs.m_root);
+    }
+    return *this;
+    
+}  // end of "CBSTree<NodeType>::operator="
+
+
+
+// ==== CBSTree::operator= ====================================================
+// 
+// This is the move assignment operator for the CBSTree class. It releases
+// the nodes of the calling object and takes those of the other tree, which
+// is left empty.
+// 
+// Input:
+//      rhs [IN/OUT]    -- the tree to take the nodes from
+// 
+// Output:
+//      A reference to the calling object.
+// 
+// ============================================================================
+
+template    <typename  NodeType>
+CBSTree<NodeType>&  CBSTree<NodeType>::operator=(CBSTree<NodeType> &&rhs)
+{
+    if (this != &rhs)
     {
         DestroyTree();
-        CopyTree(rhs.m_root);
+        m_root = rhs.m_root;
+        rhs.m_root = NULL;
+        ++rhs.m_version;
     }
     return *this;
     
@@ -813,10 +1345,13 @@ CBSTree<NodeType>&  CBSTree<NodeType>::operator=(const CBSTree<NodeType> &rhs)
 
 
 // === CBSTree:NeighborTraversal ==============================================
-// This function will call function 'Neighbor'  to get nearest neighbor
+// This function will call function 'Neighbor'  to get nearest neighbor, print
+// the naive result, then hand each neighbor of the k-d tree search to the
+// visitor, nearest first.
 // 
-// Input: -- fPtr: this is pointer to function of the function that going to 
-//                 display neighbor information.
+// Input: -- visitor: callable that takes a const reference to a NodeType
+//                    object (going to display neighbor information); it may
+//                    return VISIT_STOP to skip the remaining neighbors.
 //        -- num: number of nearest neighbor user wants.
 //
 // Output: nothing
@@ -824,7 +1359,8 @@ CBSTree<NodeType>&  CBSTree<NodeType>::operator=(const CBSTree<NodeType> &rhs)
 // ============================================================================
 
 template    <typename  NodeType>
-void CBSTree<NodeType>::NeighborTraversal(void (*fPtr)(const NodeType&)
+template    <typename  Visitor>
+void CBSTree<NodeType>::NeighborTraversal(Visitor &&visitor
 					  , const NodeType &target, int &num) 
 {
   vector<NodeType> listN;
@@ -832,8 +1368,8 @@ void CBSTree<NodeType>::NeighborTraversal(void (*fPtr)(const NodeType&)
     if (NULL != m_root)
     {
         Retrieve(target, m_root, 0);
-	    NaiveNeighbor(m_root, fPtr, target, listN, 0);
-	    OptNeighbor(m_root, target, listN2, 0);
+	    NaiveNeighbor(m_root, target, listN, 0);
+	    NearestNeighbors(target, NUM_NEAREST_NEIGH, listN2);
     }
     for (auto it = listN.begin(); it != listN.end(); ++it)
     {
@@ -842,7 +1378,10 @@ void CBSTree<NodeType>::NeighborTraversal(void (*fPtr)(const NodeType&)
     cout << "####################\n";
     for (auto it = listN2.begin(); it != listN2.end(); ++it)
     {
-	    cout << (*it).GetName() << " " << (*it).GetDistance() << endl;
+	    if (!CallVisitor(visitor, *it))
+	    {
+	        break;
+	    }
     }
 
 }
@@ -852,9 +1391,8 @@ void CBSTree<NodeType>::NeighborTraversal(void (*fPtr)(const NodeType&)
 // === CBSTree::NaiveNeighbor =================================================
 // This function will do naive traversal to find neighbors
 //
-// Input: -- fPtr: this is pointer to function. It will call this function to
-//                 display neighbor information.
-//        -- numNeighbor: number of neighbor user wants.
+// Input: -- target: the target point
+//        -- listN: list of neighbors found so far
 //        -- height: current tree level
 // Output: Nothing
 //
@@ -862,15 +1400,15 @@ void CBSTree<NodeType>::NeighborTraversal(void (*fPtr)(const NodeType&)
 
 template    <typename  NodeType>
 void CBSTree<NodeType>::NaiveNeighbor(CTreeNode<NodeType> *nodePtr
-		 , void (*fPtr)(const NodeType&), const NodeType &target
-		 , vector<NodeType> &listN, const int height) 
+		 , const NodeType &target, vector<NodeType> &listN
+		 , const int height) 
 {
 	if (nodePtr == NULL)
 	{
 	    return;
 	}
 
-	NaiveNeighbor(nodePtr->m_left, fPtr, target, listN, height);
+	NaiveNeighbor(nodePtr->m_left, target, listN, height);
 	
     int currDim = height % DIMENSIONAL;
 
@@ -884,11 +1422,7 @@ void CBSTree<NodeType>::NaiveNeighbor(CTreeNode<NodeType> *nodePtr
 	  coordFunc = &FieldNode::GetZCoord;
 
 	// get distance to neighbor
-	double dist = 0;
-	dist = pow(nodePtr->m_value.GetXCoord() - target.GetXCoord(), 2);
-	dist += pow(nodePtr->m_value.GetYCoord() - target.GetYCoord(), 2);
-	dist += pow(nodePtr->m_value.GetZCoord() - target.GetZCoord(), 2);
-	dist = sqrt(dist);
+	double dist = MetricDistance(CEuclideanMetric(), nodePtr->m_value, target);
 	nodePtr->m_value.SetDistance(dist);
 	// get 6 nearest neighbor
 	if ((listN.size() < NUM_NEAREST_NEIGH) && (nodePtr->m_value.GetDistance() > 0))
@@ -918,99 +1452,905 @@ void CBSTree<NodeType>::NaiveNeighbor(CTreeNode<NodeType> *nodePtr
 	   }
 	}
 
-	NaiveNeighbor(nodePtr->m_right, fPtr, target, listN, height);
+	NaiveNeighbor(nodePtr->m_right, target, listN, height);
 	
 } // end of "CBSTree::NaiveNeighbor"
 
 
 
+// === CBSTree::OptNeighbor ===================================================
+// This function will apply k-d tree search to find nearest neighbors in a
+// metric (see metric.h). The neighbors found so far are kept in a max-heap
+// on the reduced distance, so the farthest one is always at the front; the
+// distances are turned into real ones at the end by NearestNeighbors.
+//
+// A subtree is skipped in two steps once "num" neighbors are known. First the
+// cell of the far side is checked: "offset" holds the gap from the target to
+// the cell along each axis, going to the far side only changes the gap of
+// the split axis (Arya and Mount). If the cell is close enough, the tight
+// bounding box of the subtree is checked. Both gaps come from the metric, so
+// in a periodic box a subtree near the opposite face is reached through the
+// boundary. The tree itself is not modified, so several threads can search
+// the same tree at the same time.
+//
+// Input: -- nodePtr: pointer to a tree node (initially the root)
+//        -- target: coordinates of the target point
+//        -- listN: heap of nearest neighbors found so far
+//        -- num: number of neighbor user wants
+//        -- height: current tree level
+//        -- offset: gap from the target to the cell along each axis
+//        -- metric: the distance metric
+//        -- stats: work counters of the query (may be NULL)
+// Output: Nothing
+//
+// ============================================================================
+
 template    <typename  NodeType>
-void CBSTree<NodeType>::OptNeighbor(CTreeNode<NodeType> *nodePtr
-    , const NodeType &target, vector<NodeType> &listN, const int height)
+template    <typename  Metric>
+void CBSTree<NodeType>::OptNeighbor(const CTreeNode<NodeType> *nodePtr
+    , const double target[], vector<NodeType> &listN, const int num
+    , const int height, double offset[], const Metric &metric
+    , CQueryStats *stats) const
 {
-    // get pointer to function that return the coordinate
-    int currDim = height % DIMENSIONAL;
-    double (FieldNode::*coordFunc)() const = NULL;
-    if (currDim == 0)
-      coordFunc = &FieldNode::GetXCoord;
-    else if (currDim == 1)
-      coordFunc = &FieldNode::GetYCoord;
-    else if (currDim == 2)
-      coordFunc = &FieldNode::GetZCoord;
-
     if (NULL == nodePtr)
     {
 	   return;
     }
-    // get 6 neighbors
-    double dist = 0;
-    dist = pow(nodePtr->m_value.GetXCoord() - target.GetXCoord(), 2);
-    dist += pow(nodePtr->m_value.GetYCoord() - target.GetYCoord(), 2);
-    dist += pow(nodePtr->m_value.GetZCoord() - target.GetZCoord(), 2);
-    dist = sqrt(dist);
-    nodePtr->m_value.SetDistance(dist);
-    if ((listN.size() < NUM_NEAREST_NEIGH) && (nodePtr->m_value.GetDistance() > 0))
+    KNN_COUNT(stats, visitedNodes++);
+    KNN_COUNT(stats, distanceEvals++);
+    KNN_COUNT(stats, Depth(height));
+    if ((NULL == nodePtr->m_left) && (NULL == nodePtr->m_right))
     {
-	   listN.push_back(nodePtr->m_value);
+        KNN_COUNT(stats, leafPoints++);
     }
-    else
+
+    // get distance to this node, the target itself (distance 0) is skipped
+    double coord[DIMENSIONAL] = {nodePtr->m_value.GetXCoord()
+                                 , nodePtr->m_value.GetYCoord()
+                                 , nodePtr->m_value.GetZCoord()};
+    double dist = metric.Term(metric.Gap(coord[0], target[0], 0), 0);
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
     {
-    	// look for biggest value and remove it
-    	int index = 0;
-    	double currLongest = nodePtr->m_value.GetDistance();
-    	int updateIndex = -1;
-
-    	for (auto it = listN.begin(); it != listN.end(); ++it)
-    	{
-    	   if (currLongest < (*it).GetDistance())
-    	   {
-    	       currLongest = (*it).GetDistance();
-    		  updateIndex = index;
-    	   }
-    	   ++index;
-    	}
-    	if ((updateIndex > -1) && (nodePtr->m_value.GetDistance() > 0))
-    	{
-            listN.erase(listN.begin() + updateIndex);
-    	    listN.push_back(nodePtr->m_value);
-    	}
-    }
-
-    // traverse to find nearest neighbor
-    if ((target.*coordFunc)() < (nodePtr->m_value.*coordFunc)())
+        dist = metric.Accumulate(dist, metric.Term(
+                                    metric.Gap(coord[dim], target[dim], dim)
+                                    , dim));
+    }
+    if (dist > 0)
+    {
+        if (static_cast<int>(listN.size()) < num)
+        {
+            listN.push_back(nodePtr->m_value);
+            listN.back().SetDistance(dist);
+            push_heap(listN.begin(), listN.end(), CloserThan);
+        }
+        else if (dist < listN.front().GetDistance())
+        {
+            // replace the farthest neighbor
+            pop_heap(listN.begin(), listN.end(), CloserThan);
+            listN.back() = nodePtr->m_value;
+            listN.back().SetDistance(dist);
+            push_heap(listN.begin(), listN.end(), CloserThan);
+            KNN_COUNT(stats, heapReplacements++);
+        }
+    }
+
+    // traverse the near side first, it has the same cell
+    int    axis = nodePtr->m_axis;
+    double delta = target[axis] - coord[axis];
+    const CTreeNode<NodeType> *nearPtr = nodePtr->m_right;
+    const CTreeNode<NodeType> *farPtr = nodePtr->m_left;
+    if (delta < 0)
+    {
+        nearPtr = nodePtr->m_left;
+        farPtr = nodePtr->m_right;
+    }
+    OptNeighbor(nearPtr, target, listN, num, height + 1, offset, metric
+                , stats);
+    if (NULL == farPtr)
+    {
+        return;
+    }
+
+    // detemine if we need to look at the other side: first the cell, then
+    // the tight box
+    double oldOffset = offset[axis];
+    double gap = metric.HalfSpaceGap(target[axis], coord[axis], delta < 0
+                                     , axis);
+    bool   bVisit = (static_cast<int>(listN.size()) < num);
+    offset[axis] = max(oldOffset, gap);
+    if (!bVisit)
+    {
+        double worst = listN.front().GetDistance();
+        double farCellDist = metric.Term(offset[0], 0);
+        for (int dim = 1; dim < DIMENSIONAL; ++dim)
+        {
+            farCellDist = metric.Accumulate(farCellDist
+                                            , metric.Term(offset[dim], dim));
+        }
+        bVisit = (farCellDist < worst)
+                 && (BoxDistance(farPtr, target, metric) < worst);
+    }
+    if (bVisit)
     {
-    	OptNeighbor(nodePtr->m_left, target, listN, height + 1);
-    	// detemine if we need to look at the other side
-    	double biggest = (*(listN.begin())).GetDistance();
-    	for (auto it = listN.begin(); it != listN.end(); ++it)
-    	{
-    	   if ((*it).GetDistance() > biggest)
-    	   {
-    		  biggest = (*it).GetDistance();
-    	   }
-    	}
-    	if ((biggest > abs((nodePtr->m_value.*coordFunc)() - (target.*coordFunc)()))
-    	    || (listN.size() < NUM_NEAREST_NEIGH))
-    	{
-    	   OptNeighbor(nodePtr->m_right, target, listN, height + 1);
-    	}
+        KNN_COUNT(stats, backtracks++);
+        OptNeighbor(farPtr, target, listN, num, height + 1, offset, metric
+                    , stats);
     }
     else
     {
-    	OptNeighbor(nodePtr->m_right, target, listN, height + 1);
-    	// detemine if we need to look at the other side
-    	double biggest = (*(listN.begin())).GetDistance();
-    	for (auto it = listN.begin(); it != listN.end(); ++it)
-    	{
-    	   if ((*it).GetDistance() > biggest)
-    	   {
-    		  biggest = (*it).GetDistance();
-    	   }
-    	}
-    	if ((biggest > abs((nodePtr->m_value.*coordFunc)() - (target.*coordFunc)()))
-    	    || (listN.size() < NUM_NEAREST_NEIGH))
-    	{
-    	   OptNeighbor(nodePtr->m_left, target, listN, height + 1);
-    	}
+        KNN_COUNT(stats, pruned++);
     }
-}
+    offset[axis] = oldOffset;
+
+} // end of "CBSTree::OptNeighbor"
+
+
+
+// === CBSTree::NearestNeighbors ==============================================
+// This function will find the "num" nearest neighbors of the target point in
+// the Euclidean metric and return them nearest first. The target itself is
+// not part of the result. It does not modify the tree, so it can be called
+// from several threads at once.
+//
+// Input: -- target: the target point
+//        -- num: number of nearest neighbor user wants
+//        -- listN: the nearest neighbors, sorted by distance
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::NearestNeighbors(const NodeType &target, const int num
+                                         , vector<NodeType> &listN
+                                         , CQueryStats *stats) const
+{
+    NearestNeighbors(target, num, listN, CEuclideanMetric(), stats);
+
+} // end of "CBSTree::NearestNeighbors"
+
+
+
+// === CBSTree::NearestNeighbors ==============================================
+// This function will find the "num" nearest neighbors of the target point in
+// any metric of metric.h and return them nearest first, with their distance
+// in that metric.
+//
+// Input: -- target: the target point
+//        -- num: number of nearest neighbor user wants
+//        -- listN: the nearest neighbors, sorted by distance
+//        -- metric: the distance metric
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void CBSTree<NodeType>::NearestNeighbors(const NodeType &target, const int num
+                                         , vector<NodeType> &listN
+                                         , const Metric &metric
+                                         , CQueryStats *stats) const
+{
+    double coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                 , target.GetZCoord()};
+    double offset[DIMENSIONAL] = {0};
+
+    KNN_COUNT(stats, Clear());
+    listN.clear();
+    if ((NULL == m_root) || (num <= 0))
+    {
+        return;
+    }
+    listN.reserve(num);
+    OptNeighbor(m_root, coord, listN, num, 0, offset, metric, stats);
+    sort_heap(listN.begin(), listN.end(), CloserThan);
+    for (auto it = listN.begin(); it != listN.end(); ++it)
+    {
+        (*it).SetDistance(metric.Distance((*it).GetDistance()));
+    }
+
+} // end of "CBSTree::NearestNeighbors"
+
+
+
+// === CBSTree::BoxDisjoint ===================================================
+// This function will tell if the bounding box of a subtree and a query box
+// (closed on both sides) have no point in common.
+//
+// Input: -- nodePtr: root of the subtree
+//        -- low, high: corners of the query box
+//
+// Output: true if no point of the subtree can be in the query box
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool CBSTree<NodeType>::BoxDisjoint(const CTreeNode<NodeType> *nodePtr
+                                    , const double low[], const double high[])
+{
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        if ((nodePtr->m_high[dim] < low[dim])
+            || (nodePtr->m_low[dim] > high[dim]))
+        {
+            return true;
+        }
+    }
+    return false;
+
+} // end of "CBSTree::BoxDisjoint"
+
+
+
+// === CBSTree::BoxDistance ===================================================
+// This function will compute the reduced distance (the squared distance for
+// the Euclidean metric) from the target to the bounding box of a subtree,
+// zero if the target is inside the box.
+//
+// Input: -- nodePtr: root of the subtree
+//        -- target: coordinates of the target point
+//        -- metric: the distance metric
+//
+// Output: the reduced distance
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+double CBSTree<NodeType>::BoxDistance(const CTreeNode<NodeType> *nodePtr
+                                      , const double target[]
+                                      , const Metric &metric)
+{
+    double dist = metric.Term(metric.IntervalGap(target[0], nodePtr->m_low[0]
+                                                 , nodePtr->m_high[0], 0)
+                              , 0);
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        dist = metric.Accumulate(dist, metric.Term(
+                        metric.IntervalGap(target[dim], nodePtr->m_low[dim]
+                                           , nodePtr->m_high[dim], dim)
+                        , dim));
+    }
+    return dist;
+
+} // end of "CBSTree::BoxDistance"
+
+
+
+// === CBSTree::BoxInside =====================================================
+// This function will tell if the bounding box of a subtree lies in a query
+// box (closed on both sides), then every point of the subtree is in it.
+//
+// Input: -- nodePtr: root of the subtree
+//        -- low, high: corners of the query box
+//
+// Output: true if the whole subtree is in the query box
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool CBSTree<NodeType>::BoxInside(const CTreeNode<NodeType> *nodePtr
+                                  , const double low[], const double high[])
+{
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        if ((nodePtr->m_low[dim] < low[dim])
+            || (nodePtr->m_high[dim] > high[dim]))
+        {
+            return false;
+        }
+    }
+    return true;
+
+} // end of "CBSTree::BoxInside"
+
+
+
+// === CBSTree::CloserThan ====================================================
+// This function will compare two neighbors by distance; with it the heap of
+// neighbors keeps the farthest one at the front.
+// ============================================================================
+
+template    <typename  NodeType>
+bool CBSTree<NodeType>::CloserThan(const NodeType &a, const NodeType &b)
+{
+    return a.GetDistance() < b.GetDistance();
+
+} // end of "CBSTree::CloserThan"
+
+
+
+// === CBSTree::CountItem =====================================================
+// This function will add an item to the count and the coordinate sum of a
+// node, or take it away.
+//
+// Input: -- nodePtr: the node
+//        -- item: the item that joins (or leaves) the subtree of the node
+//        -- sign: 1 when it joins, -1 when it leaves
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::CountItem(CTreeNode<NodeType> *nodePtr
+                                  , const NodeType &item, const int sign)
+{
+    nodePtr->m_count += sign;
+    nodePtr->m_sum[0] += sign * item.GetXCoord();
+    nodePtr->m_sum[1] += sign * item.GetYCoord();
+    nodePtr->m_sum[2] += sign * item.GetZCoord();
+
+} // end of "CBSTree::CountItem"
+
+
+
+// === CBSTree::ExtendBox =====================================================
+// This function will grow the bounding box of a node so that it holds the
+// item. A new node (an empty box) should call it with "reset" set.
+//
+// Input: -- nodePtr: the node
+//        -- item: the item that is now in the subtree of the node
+//        -- reset: true to make the box hold only the item
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::ExtendBox(CTreeNode<NodeType> *nodePtr
+                                  , const NodeType &item, const bool reset)
+{
+    double coord[DIMENSIONAL] = {item.GetXCoord(), item.GetYCoord()
+                                 , item.GetZCoord()};
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        if (reset || (coord[dim] < nodePtr->m_low[dim]))
+            nodePtr->m_low[dim] = coord[dim];
+        if (reset || (coord[dim] > nodePtr->m_high[dim]))
+            nodePtr->m_high[dim] = coord[dim];
+    }
+
+} // end of "CBSTree::ExtendBox"
+
+
+
+// === CBSTree::FitNode =======================================================
+// This function will make the bounding box, the count and the coordinate
+// sum of a node again from its value and those of its children.
+//
+// Input: -- nodePtr: the node
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::FitNode(CTreeNode<NodeType> *nodePtr)
+{
+    ExtendBox(nodePtr, nodePtr->m_value, true);
+    nodePtr->m_count = 0;
+    nodePtr->ClearSum();
+    CountItem(nodePtr, nodePtr->m_value, 1);
+
+    const CTreeNode<NodeType> *child[2] = {nodePtr->m_left, nodePtr->m_right};
+    for (int side = 0; side < 2; ++side)
+    {
+        if (NULL == child[side])
+        {
+            continue;
+        }
+        nodePtr->m_count += child[side]->m_count;
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            nodePtr->m_sum[dim] += child[side]->m_sum[dim];
+            nodePtr->m_low[dim] = min(nodePtr->m_low[dim]
+                                      , child[side]->m_low[dim]);
+            nodePtr->m_high[dim] = max(nodePtr->m_high[dim]
+                                       , child[side]->m_high[dim]);
+        }
+    }
+
+} // end of "CBSTree::FitNode"
+
+
+
+// === CBSTree::UniqueItems ===================================================
+// This function will remove the items with the same coordinates as an
+// earlier item; the first item of each group is kept. The items end up
+// sorted by coordinates. Every builder of the tree uses it, and so do the
+// other indexes (CBruteForce) so that all of them hold the same points.
+//
+// Input: -- items: the items
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::UniqueItems(vector<NodeType> &items)
+{
+    auto lessCoord = [](const NodeType &a, const NodeType &b)
+    {
+        if (a.GetXCoord() != b.GetXCoord())
+            return a.GetXCoord() < b.GetXCoord();
+        if (a.GetYCoord() != b.GetYCoord())
+            return a.GetYCoord() < b.GetYCoord();
+        return a.GetZCoord() < b.GetZCoord();
+    };
+    stable_sort(items.begin(), items.end(), lessCoord);
+    items.erase(unique(items.begin(), items.end()
+                       , [lessCoord](const NodeType &a, const NodeType &b)
+                         { return !lessCoord(a, b) && !lessCoord(b, a); })
+                , items.end());
+
+} // end of "CBSTree::UniqueItems"
+
+
+
+// === CBSTree::RadiusSearch ==================================================
+// This function will apply k-d tree search to find every point within a
+// distance of the target in a metric. A side of a split is skipped when the
+// split plane, or else the bounding box of the subtree, is farther away than
+// the radius. Each point found is handed to the visitor with its reduced
+// distance, the search ends as soon as the visitor asks to stop.
+//
+// Input: -- nodePtr: pointer to a tree node (initially the root)
+//        -- target: coordinates of the target point
+//        -- radius: the reduced search distance
+//        -- visitor: callable that takes (const NodeType&, double reduced)
+//        -- height: current tree level
+//        -- metric: the distance metric
+//        -- stats: work counters of the query (may be NULL)
+// Output: false if the visitor stopped the search, true otherwise
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric, typename  Visitor>
+bool CBSTree<NodeType>::RadiusSearch(const CTreeNode<NodeType> *nodePtr
+    , const double target[], const double radius, Visitor &visitor
+    , const int height, const Metric &metric, CQueryStats *stats) const
+{
+    if (NULL == nodePtr)
+    {
+        return true;
+    }
+    KNN_COUNT(stats, visitedNodes++);
+    KNN_COUNT(stats, distanceEvals++);
+    KNN_COUNT(stats, Depth(height));
+    if ((NULL == nodePtr->m_left) && (NULL == nodePtr->m_right))
+    {
+        KNN_COUNT(stats, leafPoints++);
+    }
+
+    // keep this node if it is close enough, the target itself is skipped
+    double coord[DIMENSIONAL] = {nodePtr->m_value.GetXCoord()
+                                 , nodePtr->m_value.GetYCoord()
+                                 , nodePtr->m_value.GetZCoord()};
+    double dist = metric.Term(metric.Gap(coord[0], target[0], 0), 0);
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        dist = metric.Accumulate(dist, metric.Term(
+                                    metric.Gap(coord[dim], target[dim], dim)
+                                    , dim));
+    }
+    if ((dist > 0) && (dist <= radius) && !CallVisitor(visitor
+                                                       , nodePtr->m_value
+                                                       , dist))
+    {
+        return false;
+    }
+
+    // go to each side that the ball around the target reaches, the far side
+    // is also checked against its bounding box and counted as a backtrack
+    int    axis = nodePtr->m_axis;
+    double delta = target[axis] - coord[axis];
+    const CTreeNode<NodeType> *nearPtr = nodePtr->m_right;
+    const CTreeNode<NodeType> *farPtr = nodePtr->m_left;
+    if (delta < 0)
+    {
+        nearPtr = nodePtr->m_left;
+        farPtr = nodePtr->m_right;
+    }
+    if (!RadiusSearch(nearPtr, target, radius, visitor, height + 1, metric
+                      , stats))
+    {
+        return false;
+    }
+    if (NULL == farPtr)
+    {
+        return true;
+    }
+    double gap = metric.HalfSpaceGap(target[axis], coord[axis], delta < 0
+                                     , axis);
+    if ((metric.Term(gap, axis) <= radius)
+        && (BoxDistance(farPtr, target, metric) <= radius))
+    {
+        KNN_COUNT(stats, backtracks++);
+        return RadiusSearch(farPtr, target, radius, visitor, height + 1
+                            , metric, stats);
+    }
+    KNN_COUNT(stats, pruned++);
+    return true;
+
+} // end of "CBSTree::RadiusSearch"
+
+
+
+// === CBSTree::RadiusNeighbors ===============================================
+// This function will find every point within a Euclidean distance of the
+// target point and return them nearest first. The target itself is not part
+// of the result. It does not modify the tree, so it can be called from
+// several threads at once.
+//
+// Input: -- target: the target point
+//        -- radius: the search distance
+//        -- listN: the neighbors, sorted by distance
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::RadiusNeighbors(const NodeType &target
+                                        , const double radius
+                                        , vector<NodeType> &listN
+                                        , CQueryStats *stats) const
+{
+    RadiusNeighbors(target, radius, listN, CEuclideanMetric(), stats);
+
+} // end of "CBSTree::RadiusNeighbors"
+
+
+
+// === CBSTree::RadiusNeighbors ===============================================
+// This function will find every point within a distance of the target point
+// in any metric of metric.h and return them nearest first.
+//
+// Input: -- target: the target point
+//        -- radius: the search distance
+//        -- listN: the neighbors, sorted by distance
+//        -- metric: the distance metric
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void CBSTree<NodeType>::RadiusNeighbors(const NodeType &target
+                                        , const double radius
+                                        , vector<NodeType> &listN
+                                        , const Metric &metric
+                                        , CQueryStats *stats) const
+{
+    double coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                 , target.GetZCoord()};
+
+    KNN_COUNT(stats, Clear());
+    listN.clear();
+    if ((NULL == m_root) || (radius < 0))
+    {
+        return;
+    }
+    auto collect = [&listN](const NodeType &value, const double dist)
+    {
+        listN.push_back(value);
+        listN.back().SetDistance(dist);
+    };
+    RadiusSearch(m_root, coord, metric.Reduced(radius), collect, 0, metric
+                 , stats);
+    sort(listN.begin(), listN.end(), CloserThan);
+    for (auto it = listN.begin(); it != listN.end(); ++it)
+    {
+        (*it).SetDistance(metric.Distance((*it).GetDistance()));
+    }
+
+} // end of "CBSTree::RadiusNeighbors"
+
+
+
+// === CBSTree::RadiusVisit ===================================================
+// This function will hand every point within a distance of the target point
+// to the visitor, in tree order (not sorted), with its distance in the
+// metric. The visitor may return VISIT_STOP (or false) when it has what it
+// needs, e.g. "is there any point closer than r", and the search ends there.
+// The target itself is skipped.
+//
+// Input: -- target: the target point
+//        -- radius: the search distance
+//        -- visitor: callable that takes (const NodeType&, double distance)
+//                    and returns nothing or a VisitSignal
+//        -- metric: the distance metric (Euclidean by default)
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: false if the visitor stopped the search, true otherwise
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Visitor, typename  Metric>
+bool CBSTree<NodeType>::RadiusVisit(const NodeType &target
+                                    , const double radius, Visitor &&visitor
+                                    , const Metric &metric
+                                    , CQueryStats *stats) const
+{
+    double coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                 , target.GetZCoord()};
+
+    KNN_COUNT(stats, Clear());
+    if ((NULL == m_root) || (radius < 0))
+    {
+        return true;
+    }
+    auto report = [&visitor, &metric](const NodeType &value
+                                      , const double dist)
+    {
+        return CallVisitor(visitor, value, metric.Distance(dist));
+    };
+    return RadiusSearch(m_root, coord, metric.Reduced(radius), report, 0
+                        , metric, stats);
+
+} // end of "CBSTree::RadiusVisit"
+
+
+
+// === CBSTree::RangeAggregate ================================================
+// This function will count the points inside an axis-aligned box (closed on
+// both sides) and add up their coordinates. A subtree whose bounding box is
+// inside the query box is answered from the count and the sum kept in its
+// root, so only the nodes along the faces of the box are looked at, not
+// every point inside it. The corners may be given in any order.
+//
+// Input: -- low, high: opposite corners of the box
+//        -- aggregate: the number of point in the box and their sum
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::RangeAggregate(const NodeType &low
+                                       , const NodeType &high
+                                       , CRangeAggregate &aggregate
+                                       , CQueryStats *stats) const
+{
+    double boxLow[DIMENSIONAL] = {min(low.GetXCoord(), high.GetXCoord())
+                                  , min(low.GetYCoord(), high.GetYCoord())
+                                  , min(low.GetZCoord(), high.GetZCoord())};
+    double boxHigh[DIMENSIONAL] = {max(low.GetXCoord(), high.GetXCoord())
+                                   , max(low.GetYCoord(), high.GetYCoord())
+                                   , max(low.GetZCoord(), high.GetZCoord())};
+
+    KNN_COUNT(stats, Clear());
+    aggregate.Clear();
+    RangeTally(m_root, boxLow, boxHigh, aggregate, 0, stats);
+
+} // end of "CBSTree::RangeAggregate"
+
+
+
+// === CBSTree::RangeCount ====================================================
+// This function will count the points inside an axis-aligned box (closed on
+// both sides), from the counts of the subtrees (see RangeAggregate).
+//
+// Input: -- low, high: opposite corners of the box
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: the number of point in the box
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int CBSTree<NodeType>::RangeCount(const NodeType &low, const NodeType &high
+                                  , CQueryStats *stats) const
+{
+    CRangeAggregate aggregate;
+    RangeAggregate(low, high, aggregate, stats);
+    return aggregate.count;
+
+} // end of "CBSTree::RangeCount"
+
+
+
+// === CBSTree::RangeQuery ====================================================
+// This function will find every point inside an axis-aligned box (closed on
+// both sides), in tree order. The corners may be given in any order.
+//
+// Input: -- low, high: opposite corners of the box
+//        -- listN: the points in the box
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::RangeQuery(const NodeType &low, const NodeType &high
+                                   , vector<NodeType> &listN
+                                   , CQueryStats *stats) const
+{
+    listN.clear();
+    RangeVisit(low, high, [&listN](const NodeType &value)
+                          { listN.push_back(value); }
+               , stats);
+
+} // end of "CBSTree::RangeQuery"
+
+
+
+// === CBSTree::RangeSearch ===================================================
+// This function will apply k-d tree search to find every point inside a box.
+// A subtree whose bounding box misses the query box is skipped; one whose
+// bounding box is inside the query box is handed to the visitor whole, with
+// no test on its points. Only the other nodes test their own point.
+//
+// Input: -- nodePtr: pointer to a tree node (initially the root)
+//        -- low, high: corners of the query box, low <= high on each axis
+//        -- visitor: callable that takes (const NodeType&)
+//        -- height: current tree level
+//        -- stats: work counters of the query (may be NULL)
+// Output: false if the visitor stopped the search, true otherwise
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Visitor>
+bool CBSTree<NodeType>::RangeSearch(const CTreeNode<NodeType> *nodePtr
+    , const double low[], const double high[], Visitor &visitor
+    , const int height, CQueryStats *stats) const
+{
+    if (NULL == nodePtr)
+    {
+        return true;
+    }
+    if (BoxDisjoint(nodePtr, low, high))
+    {
+        KNN_COUNT(stats, pruned++);
+        return true;
+    }
+    KNN_COUNT(stats, visitedNodes++);
+    KNN_COUNT(stats, Depth(height));
+    if (BoxInside(nodePtr, low, high))
+    {
+        return PreOrder(nodePtr, visitor);
+    }
+
+    // test the point of this node, then both sides
+    KNN_COUNT(stats, distanceEvals++);
+    double coord[DIMENSIONAL] = {nodePtr->m_value.GetXCoord()
+                                 , nodePtr->m_value.GetYCoord()
+                                 , nodePtr->m_value.GetZCoord()};
+    bool   bInside = true;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        bInside = bInside && (coord[dim] >= low[dim])
+                  && (coord[dim] <= high[dim]);
+    }
+    if (bInside && !CallVisitor(visitor, nodePtr->m_value))
+    {
+        return false;
+    }
+    return RangeSearch(nodePtr->m_left, low, high, visitor, height + 1
+                       , stats)
+           && RangeSearch(nodePtr->m_right, low, high, visitor, height + 1
+                          , stats);
+
+} // end of "CBSTree::RangeSearch"
+
+
+
+// === CBSTree::RangeTally ====================================================
+// This function will add up the points of a subtree that are inside a box.
+// A subtree whose bounding box is inside the query box adds its count and
+// sum at once, one whose bounding box misses the query box is skipped.
+//
+// Input: -- nodePtr: pointer to a tree node (initially the root)
+//        -- low, high: corners of the query box, low <= high on each axis
+//        -- aggregate: the count and the sum so far
+//        -- height: current tree level
+//        -- stats: work counters of the query (may be NULL)
+// Output: nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void CBSTree<NodeType>::RangeTally(const CTreeNode<NodeType> *nodePtr
+    , const double low[], const double high[], CRangeAggregate &aggregate
+    , const int height, CQueryStats *stats) const
+{
+    if (NULL == nodePtr)
+    {
+        return;
+    }
+    if (BoxDisjoint(nodePtr, low, high))
+    {
+        KNN_COUNT(stats, pruned++);
+        return;
+    }
+    KNN_COUNT(stats, visitedNodes++);
+    KNN_COUNT(stats, Depth(height));
+    if (BoxInside(nodePtr, low, high))
+    {
+        aggregate.count += nodePtr->m_count;
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            aggregate.sum[dim] += nodePtr->m_sum[dim];
+        }
+        return;
+    }
+
+    // test the point of this node, then both sides
+    KNN_COUNT(stats, distanceEvals++);
+    double coord[DIMENSIONAL] = {nodePtr->m_value.GetXCoord()
+                                 , nodePtr->m_value.GetYCoord()
+                                 , nodePtr->m_value.GetZCoord()};
+    bool   bInside = true;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        bInside = bInside && (coord[dim] >= low[dim])
+                  && (coord[dim] <= high[dim]);
+    }
+    if (bInside)
+    {
+        ++aggregate.count;
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            aggregate.sum[dim] += coord[dim];
+        }
+    }
+    RangeTally(nodePtr->m_left, low, high, aggregate, height + 1, stats);
+    RangeTally(nodePtr->m_right, low, high, aggregate, height + 1, stats);
+
+} // end of "CBSTree::RangeTally"
+
+
+
+// === CBSTree::RangeVisit ====================================================
+// This function will hand every point inside an axis-aligned box (closed on
+// both sides) to the visitor, in tree order. The subtrees that lie in the box
+// are walked with no test on their points. The visitor may return VISIT_STOP
+// (or false) to end the search. The corners may be given in any order.
+//
+// Input: -- low, high: opposite corners of the box
+//        -- visitor: callable that takes (const NodeType&) and returns
+//                    nothing or a VisitSignal
+//        -- stats: if not NULL, gets the work counters of this query (only
+//                  when compiled with KNN_STATS)
+//
+// Output: false if the visitor stopped the search, true otherwise
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Visitor>
+bool CBSTree<NodeType>::RangeVisit(const NodeType &low, const NodeType &high
+                                   , Visitor &&visitor
+                                   , CQueryStats *stats) const
+{
+    double boxLow[DIMENSIONAL] = {min(low.GetXCoord(), high.GetXCoord())
+                                  , min(low.GetYCoord(), high.GetYCoord())
+                                  , min(low.GetZCoord(), high.GetZCoord())};
+    double boxHigh[DIMENSIONAL] = {max(low.GetXCoord(), high.GetXCoord())
+                                   , max(low.GetYCoord(), high.GetYCoord())
+                                   , max(low.GetZCoord(), high.GetZCoord())};
+
+    KNN_COUNT(stats, Clear());
+    return RangeSearch(m_root, boxLow, boxHigh, visitor, 0, stats);
+
+} // end of "CBSTree::RangeVisit"
@@ -11,68 +11,212 @@
 
 #include    "ctreenode.h"
 #include    "fieldnode.h"
+#include    "metric.h"
+#include    "querystats.h"
+#include    "treeshape.h"
+#include    "visitor.h"
 #include    <vector>
 
 int NUM_NEAREST_NEIGH = 1;
+
+// split rules of the bulk builder (BuildTree)
+enum SplitRule
+{
+    SPLIT_MEDIAN,           // cycle the axes with the depth, split at the
+                            // median
+    SPLIT_WIDEST,           // axis of widest spread, split at the median
+    SPLIT_SLIDING_MIDPOINT  // axis of widest spread, split at the middle of the
+                            // spread, slid to the nearest point above it
+};
+
+// InsertBatch rebuilds a subtree that a block of new items grows by at least
+// 1 / BATCH_REBUILD_SHARE of its size
+const int BATCH_REBUILD_SHARE = 2;
+
+// result of CBSTree::RangeAggregate, the points inside a box
+struct CRangeAggregate
+{
+    CRangeAggregate() { Clear(); }
+    void    Clear()
+    {
+        count = 0;
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            sum[dim] = 0;
+        }
+    }
+    double  GetCentroid(const int dim) const
+    {
+        return (count > 0) ? sum[dim] / count : 0;
+    }
+
+    int     count;              // number of point
+    double  sum[DIMENSIONAL];   // sum of their coordinates
+};
+
+template    <typename  NodeType, typename  Metric>
+class   CGroupSearch;
+template    <typename  NodeType, typename  Metric>
+class   CKnnJoin;
+template    <typename  NodeType, typename  Metric>
+class   CNeighborIterator;
+
 // class declaration
 template    <typename  NodeType>
 class   CBSTree
 {
+    // walk the nodes of the tree
+    template    <typename, typename>
+    friend class    CGroupSearch;
+    template    <typename, typename>
+    friend class    CKnnJoin;
+    template    <typename, typename>
+    friend class    CNeighborIterator;
+
 public:
     // constructors and destructor
-    CBSTree() : m_root(NULL) {}
+    CBSTree() : m_root(NULL), m_version(0) {}
     CBSTree(const CBSTree  &other);
+    CBSTree(CBSTree  &&other);
     virtual ~CBSTree() { DestroyTree(); }
 
     // member functions
+    void    AnalyzeTree(CTreeShape  &shape) const;
+    int     BuildTree(const NodeType items[], const int num
+                      , const SplitRule rule = SPLIT_MEDIAN);
     bool    DeleteItem(const NodeType  &targetItem);
-    void    DestroyTree() { DestroyNodes(m_root); m_root = NULL; }
+    void    DestroyTree() { DestroyNodes(m_root); m_root = NULL; ++m_version; }
     void    GetTreeInfo(int  &numNodes, int  &height) const;
-    void    InOrderTraversal(void  (*fPtr)(const NodeType&)) const;
+    unsigned long long  GetVersion() const { return m_version; }
+    template    <typename  Visitor>
+    bool    InOrderTraversal(Visitor  &&visitor) const;
+    int     InsertBatch(const NodeType items[], const int num
+                        , const SplitRule rule = SPLIT_MEDIAN);
     bool    InsertItem(const NodeType  &newItem);
     bool    IsTreeEmpty() { return (NULL == m_root); }
-    void    PostOrderTraversal(void (*fPtr)(const NodeType&)) const;
-    void    PreOrderTraversal(void (*fPtr)(const NodeType&)) const;
+    template    <typename  Visitor>
+    bool    PostOrderTraversal(Visitor  &&visitor) const;
+    template    <typename  Visitor>
+    bool    PreOrderTraversal(Visitor  &&visitor) const;
     bool    RetrieveItem(const NodeType  &target) const;
+    static void     UniqueItems(vector<NodeType> &items);
 
     // for nearest neighbor problem
-    void    NeighborTraversal(void (*fPtr)(const NodeType&)
-			      , const NodeType &target, int &num);
+    template    <typename  Visitor>
+    void    NeighborTraversal(Visitor &&visitor, const NodeType &target
+                              , int &num);
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN
+                             , CQueryStats *stats = NULL) const;
+    template    <typename  Metric>
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN, const Metric &metric
+                             , CQueryStats *stats = NULL) const;
+    void    RadiusNeighbors(const NodeType &target, const double radius
+                            , vector<NodeType> &listN
+                            , CQueryStats *stats = NULL) const;
+    template    <typename  Metric>
+    void    RadiusNeighbors(const NodeType &target, const double radius
+                            , vector<NodeType> &listN, const Metric &metric
+                            , CQueryStats *stats = NULL) const;
+    template    <typename  Visitor, typename  Metric = CEuclideanMetric>
+    bool    RadiusVisit(const NodeType &target, const double radius
+                        , Visitor &&visitor, const Metric &metric = Metric()
+                        , CQueryStats *stats = NULL) const;
+
+    // for box range queries
+    void    RangeAggregate(const NodeType &low, const NodeType &high
+                           , CRangeAggregate &aggregate
+                           , CQueryStats *stats = NULL) const;
+    int     RangeCount(const NodeType &low, const NodeType &high
+                       , CQueryStats *stats = NULL) const;
+    void    RangeQuery(const NodeType &low, const NodeType &high
+                       , vector<NodeType> &listN
+                       , CQueryStats *stats = NULL) const;
+    template    <typename  Visitor>
+    bool    RangeVisit(const NodeType &low, const NodeType &high
+                       , Visitor &&visitor, CQueryStats *stats = NULL) const;
+
     // operators
     CBSTree<NodeType>&  operator=(const CBSTree<NodeType> &rhs);
+    CBSTree<NodeType>&  operator=(CBSTree<NodeType> &&rhs);
 
 protected:
     // member functions
-    int         CountNodes(const CTreeNode<NodeType>  *nodePtr, int  currDepth
-                                                       , int  &numNodes) const;
+    CTreeNode<NodeType>*    Build(vector<NodeType>  &items, const int first
+                                  , const int last, const int depth
+                                  , const SplitRule rule);
     CTreeNode<NodeType>*    Delete(const NodeType  &targetItem
                                         , CTreeNode<NodeType>  *nodePtr
+                                        , const int height
                                         , bool  &bItemDeleted);
     void        DestroyNodes(CTreeNode<NodeType>  *const nodePtr);
-    CTreeNode<NodeType>*   FindMinNode(CTreeNode<NodeType>  *nodePtr) const;
-    void        InOrder(const CTreeNode<NodeType> *const nodePtr
-                                    , void (*fPtr)(const NodeType&)) const;
+    CTreeNode<NodeType>*   FindMinNode(CTreeNode<NodeType>  *nodePtr
+                                       , const int dim, const int height) const;
+    template    <typename  Visitor>
+    bool        InOrder(const CTreeNode<NodeType> *const nodePtr
+                                    , Visitor  &visitor) const;
     CTreeNode<NodeType>*   Insert(const NodeType  &newItem
 			 , CTreeNode<NodeType>  *nodePtr, const int treeHeight);
-    void        PostOrder(const CTreeNode<NodeType>  *const nodePtr
-                                        , void (*fPtr)(const NodeType&)) const;
-    void        PreOrder(const CTreeNode<NodeType>  *const nodePtr
-                                        , void (*fPtr)(const NodeType&)) const;
+    CTreeNode<NodeType>*   MergeItems(CTreeNode<NodeType>  *nodePtr
+                                      , vector<NodeType>  &items
+                                      , const int first, const int last
+                                      , const int depth
+                                      , const SplitRule rule);
+    template    <typename  Visitor>
+    bool        PostOrder(const CTreeNode<NodeType>  *const nodePtr
+                                        , Visitor  &visitor) const;
+    template    <typename  Visitor>
+    bool        PreOrder(const CTreeNode<NodeType>  *const nodePtr
+                                        , Visitor  &visitor) const;
     CTreeNode<NodeType>*  Retrieve(const NodeType  &target
 			 , CTreeNode<NodeType> *nodePtr, const int height) const;
     // for nearest neighbor problem
     void NaiveNeighbor(CTreeNode<NodeType> *nodePtr
-		     , void (*fPtr)(const NodeType&), const NodeType &target
-		     , vector<NodeType> &listN, const int height);
+		     , const NodeType &target, vector<NodeType> &listN
+		     , const int height);
+
+    template    <typename  Metric>
+    void OptNeighbor(const CTreeNode<NodeType> *nodePtr
+		     , const double target[], vector<NodeType> &listN
+		     , const int num, const int height, double offset[]
+		     , const Metric &metric, CQueryStats *stats) const;
 
-    void OptNeighbor(CTreeNode<NodeType> *nodePtr, const NodeType &target
-		     , vector<NodeType> &listN, const int height);
+    template    <typename  Metric, typename  Visitor>
+    bool RadiusSearch(const CTreeNode<NodeType> *nodePtr
+		      , const double target[], const double radius
+		      , Visitor &visitor, const int height
+		      , const Metric &metric, CQueryStats *stats) const;
+    // for box range queries
+    template    <typename  Visitor>
+    bool RangeSearch(const CTreeNode<NodeType> *nodePtr, const double low[]
+		     , const double high[], Visitor &visitor
+		     , const int height, CQueryStats *stats) const;
+    void RangeTally(const CTreeNode<NodeType> *nodePtr, const double low[]
+		    , const double high[], CRangeAggregate &aggregate
+		    , const int height, CQueryStats *stats) const;
+    // for the bounding box and the count of each subtree
+    static bool     BoxDisjoint(const CTreeNode<NodeType> *nodePtr
+                                , const double low[], const double high[]);
+    template    <typename  Metric>
+    static double   BoxDistance(const CTreeNode<NodeType> *nodePtr
+                                , const double target[]
+                                , const Metric &metric);
+    static bool     BoxInside(const CTreeNode<NodeType> *nodePtr
+                              , const double low[], const double high[]);
+    static bool     CloserThan(const NodeType &a, const NodeType &b);
+    static void     CountItem(CTreeNode<NodeType> *nodePtr
+                              , const NodeType &item, const int sign);
+    static void     ExtendBox(CTreeNode<NodeType> *nodePtr
+                              , const NodeType &item, const bool reset);
+    static void     FitNode(CTreeNode<NodeType> *nodePtr);
 private:
     // member functions
     CTreeNode<NodeType>*    CopyTree(const CTreeNode<NodeType>  *sourcePtr);
 
     // data members
     CTreeNode<NodeType> *m_root;
+    unsigned long long  m_version;  // bumped by every change of the points
 };
 
 #include    "cbstree.cpp"
@@ -0,0 +1,734 @@
+// ============================================================================
+// File: compacttree.cpp
+// ============================================================================
+// This header file contains the implementation of the CCompactTree class. It
+// uses the template parameter "NodeType" for the type of the points and
+// "CoordType" for the stored coordinates (double, float or unsigned short).
+// ============================================================================
+
+#include    <algorithm>
+#include    <cfloat>
+#include    <cmath>
+using namespace std;
+#include    "compacttree.h"
+
+
+
+// === EncodeCoord ============================================================
+// These functions will turn a coordinate into its code: double keeps it,
+// float keeps the offset from the low corner, unsigned short keeps the
+// nearest of 65536 steps between the low and the high corner.
+// ============================================================================
+
+inline void EncodeCoord(const double value, const double, const double
+                        , double &code)
+{
+    code = value;
+}
+
+inline void EncodeCoord(const double value, const double low, const double
+                        , float &code)
+{
+    code = static_cast<float>(value - low);
+}
+
+inline void EncodeCoord(const double value, const double low
+                        , const double step, unsigned short &code)
+{
+    double cell = (step > 0) ? floor((value - low) / step + 0.5) : 0;
+    code = static_cast<unsigned short>(max(0.0, min(65535.0, cell)));
+
+} // end of "EncodeCoord"
+
+
+
+// === DecodeCoord ============================================================
+// These functions will turn a code back into a coordinate.
+// ============================================================================
+
+inline double DecodeCoord(const double code, const double, const double)
+{
+    return code;
+}
+
+inline double DecodeCoord(const float code, const double low, const double)
+{
+    return low + code;
+}
+
+inline double DecodeCoord(const unsigned short code, const double low
+                          , const double step)
+{
+    return low + code * step;
+
+} // end of "DecodeCoord"
+
+
+
+// === CodeError ==============================================================
+// These functions will return the largest gap between a coordinate and its
+// decoded code along one axis, for a box of size "extent". Only the type of
+// the first parameter is used.
+// ============================================================================
+
+inline double CodeError(const double*, const double, const double)
+{
+    return 0;
+}
+
+inline double CodeError(const float*, const double extent, const double)
+{
+    return extent * FLT_EPSILON / 2;
+}
+
+inline double CodeError(const unsigned short*, const double
+                        , const double step)
+{
+    return step / 2;
+
+} // end of "CodeError"
+
+
+
+// ==== CCompactTree::Build ===================================================
+//
+// This recursive function builds the subtree of the items order[first] to
+// order[last - 1]. The node is the median item along the axis where the
+// codes spread the most, it goes to the middle of the range; the smaller
+// items go before it, the others after it.
+//
+// Access: protected
+//
+// Input:
+//      order [IN/OUT]  -- index of the point at each position, reordered
+//      code [IN]       -- DIMENSIONAL codes of each point
+//      first [IN]      -- first position of the subtree
+//      last [IN]       -- one past the last position of the subtree
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+void    CCompactTree<NodeType, CoordType>::Build(vector<int> &order
+                                        , const vector<CoordType> &code
+                                        , const int first, const int last)
+{
+    if (last - first <= 1)
+    {
+        if (last - first == 1)
+        {
+            m_axis[first] = 0;
+        }
+        return;
+    }
+
+    // pick the axis of widest spread
+    int     axis = 0;
+    double  widest = -1;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        CoordType low = code[1LL * order[first] * DIMENSIONAL + dim];
+        CoordType high = low;
+        for (int index = first + 1; index < last; ++index)
+        {
+            CoordType value = code[1LL * order[index] * DIMENSIONAL + dim];
+            low = min(low, value);
+            high = max(high, value);
+        }
+        double spread = Decode(high, dim) - Decode(low, dim);
+        if (spread > widest)
+        {
+            widest = spread;
+            axis = dim;
+        }
+    }
+
+    // the median goes to the middle
+    int middle = (first + last) / 2;
+    nth_element(order.begin() + first, order.begin() + middle
+                , order.begin() + last
+                , [&code, axis](const int a, const int b)
+                  { return code[1LL * a * DIMENSIONAL + axis]
+                           < code[1LL * b * DIMENSIONAL + axis]; });
+    m_axis[middle] = static_cast<unsigned char>(axis);
+    Build(order, code, first, middle);
+    Build(order, code, middle + 1, last);
+
+}  // end of "CCompactTree<NodeType, CoordType>::Build"
+
+
+
+// ==== CCompactTree::BuildTree ===============================================
+//
+// This function replaces the content of the tree with the points. The codes
+// are made relative to the bounding box of the points. Points with the same
+// coordinates as an earlier one are skipped, the same as CBSTree does. The
+// tree keeps a pointer to the points, they must not change or move while the
+// tree is in use.
+//
+// Access: public
+//
+// Input:
+//      point [IN]  -- the points, in full precision
+//      num [IN]    -- number of point
+//
+// Output:
+//      The number of point in the tree.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+int     CCompactTree<NodeType, CoordType>::BuildTree(const NodeType point[]
+                                                     , const int num)
+{
+    vector<int>         order;
+    vector<CoordType>   code;
+    double              high[DIMENSIONAL];
+    double              error = 0;
+
+    Clear();
+    if (num <= 0)
+    {
+        return 0;
+    }
+    m_point = point;
+
+    // get the box and the size of a 16-bit cell
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        m_low[dim] = HUGE_VAL;
+        high[dim] = -HUGE_VAL;
+    }
+    for (int index = 0; index < num; ++index)
+    {
+        double coord[DIMENSIONAL] = {point[index].GetXCoord()
+                                     , point[index].GetYCoord()
+                                     , point[index].GetZCoord()};
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            m_low[dim] = min(m_low[dim], coord[dim]);
+            high[dim] = max(high[dim], coord[dim]);
+        }
+    }
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        double extent = high[dim] - m_low[dim];
+        double gap = 0;
+        m_step[dim] = extent / 65535;
+        gap = CodeError(static_cast<const CoordType*>(NULL), extent
+                        , m_step[dim]);
+        // leave room for the rounding of the decoding itself
+        gap += 4 * DBL_EPSILON * (fabs(m_low[dim]) + extent);
+        error += gap * gap;
+    }
+    m_error = sqrt(error);
+
+    // remove repeated coordinates, the first point of each group is kept
+    auto lessCoord = [point](const int a, const int b)
+    {
+        if (point[a].GetXCoord() != point[b].GetXCoord())
+            return point[a].GetXCoord() < point[b].GetXCoord();
+        if (point[a].GetYCoord() != point[b].GetYCoord())
+            return point[a].GetYCoord() < point[b].GetYCoord();
+        return point[a].GetZCoord() < point[b].GetZCoord();
+    };
+    order.resize(num);
+    for (int index = 0; index < num; ++index)
+    {
+        order[index] = index;
+    }
+    stable_sort(order.begin(), order.end(), lessCoord);
+    order.erase(unique(order.begin(), order.end()
+                       , [lessCoord](const int a, const int b)
+                         { return !lessCoord(a, b) && !lessCoord(b, a); })
+                , order.end());
+
+    // encode every point, then build the tree over the codes
+    code.resize(1LL * num * DIMENSIONAL);
+    for (int index = 0; index < num; ++index)
+    {
+        double coord[DIMENSIONAL] = {point[index].GetXCoord()
+                                     , point[index].GetYCoord()
+                                     , point[index].GetZCoord()};
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            Encode(coord[dim], dim, code[1LL * index * DIMENSIONAL + dim]);
+        }
+    }
+    int size = static_cast<int>(order.size());
+    m_axis.resize(size);
+    Build(order, code, 0, size);
+
+    // lay out the nodes
+    m_index.swap(order);
+    m_coord.resize(1LL * size * DIMENSIONAL);
+    for (int pos = 0; pos < size; ++pos)
+    {
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            m_coord[1LL * pos * DIMENSIONAL + dim]
+                = code[1LL * m_index[pos] * DIMENSIONAL + dim];
+        }
+    }
+    return size;
+
+}  // end of "CCompactTree<NodeType, CoordType>::BuildTree"
+
+
+
+// ==== CCompactTree::Clear ===================================================
+//
+// This function removes every node.
+//
+// Access: public
+//
+// Input:
+//      Nothing
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+void    CCompactTree<NodeType, CoordType>::Clear()
+{
+    m_point = NULL;
+    m_coord.clear();
+    m_index.clear();
+    m_axis.clear();
+    m_error = 0;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        m_low[dim] = 0;
+        m_step[dim] = 0;
+    }
+
+}  // end of "CCompactTree<NodeType, CoordType>::Clear"
+
+
+
+// ==== CCompactTree::Decode ==================================================
+//
+// This function turns a code back into a coordinate.
+//
+// Access: protected
+//
+// Input:
+//      code [IN]   -- the code
+//      dim [IN]    -- its dimension
+//
+// Output:
+//      The coordinate, at most the error of the tree away from the point.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+double  CCompactTree<NodeType, CoordType>::Decode(const CoordType code
+                                                  , const int dim) const
+{
+    return DecodeCoord(code, m_low[dim], m_step[dim]);
+
+}  // end of "CCompactTree<NodeType, CoordType>::Decode"
+
+
+
+// ==== CCompactTree::Encode ==================================================
+//
+// This function turns a coordinate into a code.
+//
+// Access: protected
+//
+// Input:
+//      value [IN]  -- the coordinate
+//      dim [IN]    -- its dimension
+//      code [OUT]  -- the code
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+void    CCompactTree<NodeType, CoordType>::Encode(const double value
+                                                  , const int dim
+                                                  , CoordType &code) const
+{
+    EncodeCoord(value, m_low[dim], m_step[dim], code);
+
+}  // end of "CCompactTree<NodeType, CoordType>::Encode"
+
+
+
+// ==== CCompactTree::GetMemoryBytes ==========================================
+//
+// This function returns the memory held by the tree, the full-precision
+// points of the caller are not counted.
+//
+// Access: public
+//
+// Input:
+//      Nothing
+//
+// Output:
+//      The number of byte.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+long long CCompactTree<NodeType, CoordType>::GetMemoryBytes() const
+{
+    return m_coord.capacity() * sizeof(CoordType)
+           + m_index.capacity() * sizeof(int)
+           + m_axis.capacity() * sizeof(unsigned char) + sizeof(*this);
+
+}  // end of "CCompactTree<NodeType, CoordType>::GetMemoryBytes"
+
+
+
+// ==== CCompactTree::KnnSearch ===============================================
+//
+// This recursive function finds the "num" nearest codes of the target and
+// every other code that could still hide one of the nearest points. With e
+// the error of the tree and w the distance of the farthest code in the heap,
+// a point at distance d has its code between d - e and d + e away, so only
+// codes closer than w + 2e ("slack" is 2e) can belong to the answer. The
+// far side of a node is skipped in the same way as CBSTree::OptNeighbor
+// does it, with the cell distance of Arya and Mount against w + 2e.
+//
+// Access: protected
+//
+// Input:
+//      first [IN]          -- first position of the subtree
+//      last [IN]           -- one past the last position of the subtree
+//      target [IN]         -- coordinates of the target
+//      num [IN]            -- size of the heap
+//      slack [IN]          -- twice the error of the tree
+//      heap [IN/OUT]       -- max-heap of (squared code distance, position)
+//      candidate [IN/OUT]  -- every (squared code distance, position) that
+//                             was within w + 2e when it was seen
+//      height [IN]         -- level of the subtree
+//      cellDist [IN]       -- squared distance from the target to the cell
+//      offset [IN/OUT]     -- distance from the target to the cell along
+//                             each axis
+//      stats [OUT]         -- work counters of the query (may be NULL)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+void    CCompactTree<NodeType, CoordType>::KnnSearch(const int first
+                                , const int last, const double target[]
+                                , const int num, const double slack
+                                , vector<pair<double, int> > &heap
+                                , vector<pair<double, int> > &candidate
+                                , const int height, const double cellDist
+                                , double offset[], CQueryStats *stats) const
+{
+    if (first >= last)
+    {
+        return;
+    }
+    int middle = (first + last) / 2;
+    const CoordType *code = &m_coord[1LL * middle * DIMENSIONAL];
+    KNN_COUNT(stats, visitedNodes++);
+    KNN_COUNT(stats, distanceEvals++);
+    KNN_COUNT(stats, Depth(height));
+    if (last - first == 1)
+    {
+        KNN_COUNT(stats, leafPoints++);
+    }
+
+    // distance to the code of this node
+    double dist = 0;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        double gap = Decode(code[dim], dim) - target[dim];
+        dist += gap * gap;
+    }
+    if (static_cast<int>(heap.size()) < num)
+    {
+        heap.push_back(make_pair(dist, middle));
+        push_heap(heap.begin(), heap.end());
+        candidate.push_back(make_pair(dist, middle));
+    }
+    else
+    {
+        if (dist < heap.front().first)
+        {
+            pop_heap(heap.begin(), heap.end());
+            heap.back() = make_pair(dist, middle);
+            push_heap(heap.begin(), heap.end());
+            KNN_COUNT(stats, heapReplacements++);
+        }
+        double bound = sqrt(heap.front().first) + slack;
+        if (dist <= bound * bound)
+        {
+            candidate.push_back(make_pair(dist, middle));
+        }
+    }
+
+    // near side first, then the far side if its cell is close enough
+    int     axis = m_axis[middle];
+    double  delta = target[axis] - Decode(code[axis], axis);
+    int     nearFirst = middle + 1;
+    int     nearLast = last;
+    int     farFirst = first;
+    int     farLast = middle;
+    if (delta < 0)
+    {
+        swap(nearFirst, farFirst);
+        swap(nearLast, farLast);
+    }
+    KnnSearch(nearFirst, nearLast, target, num, slack, heap, candidate
+              , height + 1, cellDist, offset, stats);
+    if (farFirst >= farLast)
+    {
+        return;
+    }
+
+    double oldOffset = offset[axis];
+    double farCellDist = cellDist - oldOffset * oldOffset + delta * delta;
+    bool   bVisit = (static_cast<int>(heap.size()) < num);
+    if (!bVisit)
+    {
+        double bound = sqrt(heap.front().first) + slack;
+        bVisit = (farCellDist <= bound * bound);
+    }
+    if (bVisit)
+    {
+        KNN_COUNT(stats, backtracks++);
+        offset[axis] = delta;
+        KnnSearch(farFirst, farLast, target, num, slack, heap, candidate
+                  , height + 1, farCellDist, offset, stats);
+        offset[axis] = oldOffset;
+    }
+    else
+    {
+        KNN_COUNT(stats, pruned++);
+    }
+
+}  // end of "CCompactTree<NodeType, CoordType>::KnnSearch"
+
+
+
+// ==== CCompactTree::NearestNeighbors ========================================
+//
+// This function finds the "num" nearest neighbors of the target point and
+// returns them nearest first, like CBSTree::NearestNeighbors. The search
+// looks for one more code than asked, because the code of the target itself
+// may be among them; the candidates are then re-ranked on the full-precision
+// points and the target itself (distance 0) is dropped.
+//
+// Access: public
+//
+// Input:
+//      target [IN]     -- the target point
+//      num [IN]        -- number of nearest neighbor
+//      listN [OUT]     -- the nearest neighbors, sorted by distance
+//      stats [OUT]     -- if not NULL, gets the work counters of this query
+//                         (only when compiled with KNN_STATS)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+void    CCompactTree<NodeType, CoordType>::NearestNeighbors(
+                                        const NodeType &target, const int num
+                                        , vector<NodeType> &listN
+                                        , CQueryStats *stats) const
+{
+    vector<pair<double, int> >  heap;
+    vector<pair<double, int> >  candidate;
+    vector<pair<double, int> >  exact;
+    double  coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                  , target.GetZCoord()};
+    double  offset[DIMENSIONAL] = {0};
+
+    KNN_COUNT(stats, Clear());
+    listN.clear();
+    if (m_index.empty() || (num <= 0))
+    {
+        return;
+    }
+    heap.reserve(num + 1);
+    KnnSearch(0, static_cast<int>(m_index.size()), coord, num + 1
+              , 2 * m_error, heap, candidate, 0, 0, offset, stats);
+
+    // keep the candidates that can still be an answer; if the heap is not
+    // full every point was a candidate
+    double bound = HUGE_VAL;
+    if (static_cast<int>(heap.size()) > num)
+    {
+        bound = sqrt(heap.front().first) + 2 * m_error;
+        bound *= bound;
+    }
+
+    // re-rank them on the full-precision points
+    for (auto it = candidate.begin(); it != candidate.end(); ++it)
+    {
+        if ((*it).first > bound)
+        {
+            continue;
+        }
+        const NodeType &point = m_point[m_index[(*it).second]];
+        double dx = point.GetXCoord() - coord[0];
+        double dy = point.GetYCoord() - coord[1];
+        double dz = point.GetZCoord() - coord[2];
+        double dist = sqrt(dx * dx + dy * dy + dz * dz);
+        KNN_COUNT(stats, distanceEvals++);
+        if (dist > 0)
+        {
+            exact.push_back(make_pair(dist, m_index[(*it).second]));
+        }
+    }
+    int size = min(num, static_cast<int>(exact.size()));
+    partial_sort(exact.begin(), exact.begin() + size, exact.end());
+    listN.reserve(size);
+    for (int index = 0; index < size; ++index)
+    {
+        listN.push_back(m_point[exact[index].second]);
+        listN.back().SetDistance(exact[index].first);
+    }
+
+}  // end of "CCompactTree<NodeType, CoordType>::NearestNeighbors"
+
+
+
+// ==== CCompactTree::RadiusNeighbors =========================================
+//
+// This function finds every point within a distance of the target point and
+// returns them nearest first, like CBSTree::RadiusNeighbors. The codes are
+// searched with the radius grown by the error of the tree, then the points
+// found are checked in full precision.
+//
+// Access: public
+//
+// Input:
+//      target [IN]     -- the target point
+//      radius [IN]     -- the search distance
+//      listN [OUT]     -- the neighbors, sorted by distance
+//      stats [OUT]     -- if not NULL, gets the work counters of this query
+//                         (only when compiled with KNN_STATS)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+void    CCompactTree<NodeType, CoordType>::RadiusNeighbors(
+                                        const NodeType &target
+                                        , const double radius
+                                        , vector<NodeType> &listN
+                                        , CQueryStats *stats) const
+{
+    vector<int>     found;
+    double  coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                  , target.GetZCoord()};
+
+    KNN_COUNT(stats, Clear());
+    listN.clear();
+    if (m_index.empty() || (radius < 0))
+    {
+        return;
+    }
+    RadiusSearch(0, static_cast<int>(m_index.size()), coord
+                 , radius + m_error, found, 0, stats);
+    for (auto it = found.begin(); it != found.end(); ++it)
+    {
+        const NodeType &point = m_point[m_index[*it]];
+        double dx = point.GetXCoord() - coord[0];
+        double dy = point.GetYCoord() - coord[1];
+        double dz = point.GetZCoord() - coord[2];
+        double dist = sqrt(dx * dx + dy * dy + dz * dz);
+        KNN_COUNT(stats, distanceEvals++);
+        if ((dist > 0) && (dist <= radius))
+        {
+            listN.push_back(point);
+            listN.back().SetDistance(dist);
+        }
+    }
+    sort(listN.begin(), listN.end()
+         , [](const NodeType &a, const NodeType &b)
+           { return a.GetDistance() < b.GetDistance(); });
+
+}  // end of "CCompactTree<NodeType, CoordType>::RadiusNeighbors"
+
+
+
+// ==== CCompactTree::RadiusSearch ============================================
+//
+// This recursive function finds the position of every code within a
+// distance of the target. A side of a node is skipped when the split plane
+// is farther away than the radius.
+//
+// Access: protected
+//
+// Input:
+//      first [IN]      -- first position of the subtree
+//      last [IN]       -- one past the last position of the subtree
+//      target [IN]     -- coordinates of the target
+//      radius [IN]     -- the search distance
+//      found [IN/OUT]  -- positions found so far
+//      height [IN]     -- level of the subtree
+//      stats [OUT]     -- work counters of the query (may be NULL)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  CoordType>
+void    CCompactTree<NodeType, CoordType>::RadiusSearch(const int first
+                                        , const int last
+                                        , const double target[]
+                                        , const double radius
+                                        , vector<int> &found
+                                        , const int height
+                                        , CQueryStats *stats) const
+{
+    if (first >= last)
+    {
+        return;
+    }
+    int middle = (first + last) / 2;
+    const CoordType *code = &m_coord[1LL * middle * DIMENSIONAL];
+    KNN_COUNT(stats, visitedNodes++);
+    KNN_COUNT(stats, distanceEvals++);
+    KNN_COUNT(stats, Depth(height));
+    if (last - first == 1)
+    {
+        KNN_COUNT(stats, leafPoints++);
+    }
+
+    double dist = 0;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        double gap = Decode(code[dim], dim) - target[dim];
+        dist += gap * gap;
+    }
+    if (dist <= radius * radius)
+    {
+        found.push_back(middle);
+    }
+
+    int     axis = m_axis[middle];
+    double  delta = target[axis] - Decode(code[axis], axis);
+    if (delta <= radius)
+    {
+        RadiusSearch(first, middle, target, radius, found, height + 1, stats);
+    }
+    if (-delta <= radius)
+    {
+        RadiusSearch(middle + 1, last, target, radius, found, height + 1
+                     , stats);
+    }
+
+}  // end of "CCompactTree<NodeType, CoordType>::RadiusSearch"
@@ -0,0 +1,79 @@
+// ============================================================================
+// File: compacttree.h
+// ============================================================================
+// This header file contains the declaration of the CCompactTree class. It is
+// a k-d tree for nearest neighbor queries that keeps reduced-precision
+// coordinates: "CoordType" is float (offset from the corner of the bounding
+// box) or unsigned short (16-bit grid over the bounding box), double keeps
+// them exact. The tree has no pointers, it is a balanced tree laid out in one
+// array (the node of items [first, last) is at (first + last) / 2), so a
+// node is the coordinate codes, the index of the point and its split axis.
+//
+// The search runs on the codes only. Since a code is at most GetError() away
+// from its point, the search keeps every candidate that could still be one of
+// the answers, and only those are re-ranked against the full-precision points
+// of the caller. The results are exact.
+// ============================================================================
+
+#ifndef CCOMPACT_TREE_HEADER
+#define CCOMPACT_TREE_HEADER
+
+#include    "fieldnode.h"
+#include    "querystats.h"
+#include    <utility>
+#include    <vector>
+using namespace std;
+
+template    <typename  NodeType, typename  CoordType>
+class   CCompactTree
+{
+public:
+    // constructor
+    CCompactTree() : m_point(NULL), m_error(0) {}
+
+    // member functions
+    int     BuildTree(const NodeType point[], const int num);
+    void    Clear();
+    double  GetError() const { return m_error; }
+    long long GetMemoryBytes() const;
+    int     GetNumNodes() const { return static_cast<int>(m_index.size()); }
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN
+                             , CQueryStats *stats = NULL) const;
+    void    RadiusNeighbors(const NodeType &target, const double radius
+                            , vector<NodeType> &listN
+                            , CQueryStats *stats = NULL) const;
+
+protected:
+    // member functions
+    void    Build(vector<int> &order, const vector<CoordType> &code
+                  , const int first, const int last);
+    double  Decode(const CoordType code, const int dim) const;
+    void    Encode(const double value, const int dim, CoordType &code) const;
+    void    KnnSearch(const int first, const int last, const double target[]
+                      , const int num, const double slack
+                      , vector<pair<double, int> > &heap
+                      , vector<pair<double, int> > &candidate
+                      , const int height, const double cellDist
+                      , double offset[], CQueryStats *stats) const;
+    void    RadiusSearch(const int first, const int last
+                         , const double target[], const double radius
+                         , vector<int> &found, const int height
+                         , CQueryStats *stats) const;
+
+private:
+    // data members
+    const NodeType          *m_point;   // full-precision points, owned by
+                                        // the caller, must outlive the tree
+    vector<CoordType>       m_coord;    // DIMENSIONAL codes per node
+    vector<int>             m_index;    // index of each node in m_point
+    vector<unsigned char>   m_axis;     // split dimension of each node
+    double                  m_low[DIMENSIONAL];     // corner of the box
+    double                  m_step[DIMENSIONAL];    // size of a 16-bit cell
+    double                  m_error;    // largest distance from a point to
+                                        // its decoded code
+};
+
+#include    "compacttree.cpp"
+
+#endif  // CCOMPACT_TREE_HEADER
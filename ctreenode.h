@@ -2,13 +2,17 @@
 // File: ctreenode.h 
 // ============================================================================
 // This file contains the definition of the CTreeNode class.  It uses the
-// "NodeValueType" template parameter to store a copy of a value.
+// "NodeValueType" template parameter to store a copy of a value. Each node
+// also keeps the axis it splits on and the bounding box of the values in its
+// subtree, CBSTree uses the box to skip subtrees during a search, and the
+// number and coordinate sum of those values for the range aggregates.
 // ============================================================================
 
 #ifndef CTREE_NODE_HEADER
 #define CTREE_NODE_HEADER
 
 #include    <iostream>
+#include    "fieldnode.h"
 using namespace std;
 
 template    <typename NodeValueType>
@@ -16,15 +20,29 @@ class   CTreeNode
 {
 public:
     // constructor
-    CTreeNode() : m_left(NULL), m_right(NULL) {}
+    CTreeNode() : m_left(NULL), m_right(NULL), m_axis(0), m_count(0)
+                                                        { ClearSum(); }
     CTreeNode(const NodeValueType  &newValue) : m_value(newValue), m_left(NULL)
-                                                                , m_right(NULL) {}
+                                                , m_right(NULL), m_axis(0)
+                                                , m_count(0) { ClearSum(); }
     ~CTreeNode() { m_left = m_right = NULL; }
+    void    ClearSum()
+    {
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            m_sum[dim] = 0;
+        }
+    }
 
     // data members
     NodeValueType       m_value;
     CTreeNode           *m_left;
     CTreeNode           *m_right;
+    int                 m_axis;                 // split dimension of the node
+    double              m_low[DIMENSIONAL];     // bounding box of the subtree
+    double              m_high[DIMENSIONAL];
+    int                 m_count;                // values in the subtree
+    double              m_sum[DIMENSIONAL];     // sum of their coordinates
 };
 
 #endif  // CTREE_NODE_HEADER
@@ -0,0 +1,313 @@
+// ============================================================================
+// File: curveorder.h
+// ============================================================================
+// This header file contains the helpers that put points in the order of a
+// space-filling curve (Morton or Hilbert). Points that are close on the curve
+// are close in space, so a batch of queries in curve order walks the same
+// paths of the tree one after the other and finds them in the cache. The
+// order is a permutation: order[i] is the index of the i-th point on the
+// curve, the caller uses it to put the results back in its own order.
+// ============================================================================
+
+#ifndef CURVE_ORDER_HEADER
+#define CURVE_ORDER_HEADER
+
+#include    <algorithm>
+#include    <cmath>
+#include    <string>
+#include    <utility>
+#include    <vector>
+#include    "fieldnode.h"
+#include    "parallel.h"
+using namespace std;
+
+// space-filling curves
+enum CurveType
+{
+    CURVE_NONE,         // keep the order of the caller
+    CURVE_MORTON,       // Z-order, interleaved coordinate bits
+    CURVE_HILBERT       // Hilbert curve, no jumps between neighbor cells
+};
+
+// bits of each coordinate in a key, DIMENSIONAL * CURVE_BITS <= 64
+const int CURVE_BITS = 21;
+
+
+
+// === InterleaveBits =========================================================
+// This function will interleave the bits of the cell coordinates into one
+// key, the highest bit of the first coordinate first.
+//
+// Input: -- cell: the cell coordinates, CURVE_BITS bits each
+//
+// Output: the key
+// ============================================================================
+
+inline unsigned long long InterleaveBits(const unsigned cell[DIMENSIONAL])
+{
+    unsigned long long key = 0;
+    for (int bit = CURVE_BITS - 1; bit >= 0; --bit)
+    {
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            key = (key << 1) | ((cell[dim] >> bit) & 1);
+        }
+    }
+    return key;
+
+} // end of "InterleaveBits"
+
+
+
+// === HilbertKey =============================================================
+// This function will return the position of a cell on the Hilbert curve. The
+// cell coordinates are turned into the "transposed" Hilbert index (J.
+// Skilling, "Programming the Hilbert curve", 2004), whose bits interleaved
+// give the key.
+//
+// Input: -- cell: the cell coordinates, CURVE_BITS bits each
+//
+// Output: the key
+// ============================================================================
+
+inline unsigned long long HilbertKey(const unsigned cell[DIMENSIONAL])
+{
+    unsigned x[DIMENSIONAL];
+    unsigned top = 1U << (CURVE_BITS - 1);
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        x[dim] = cell[dim];
+    }
+
+    // inverse undo of the rotations and reflections
+    for (unsigned q = top; q > 1; q >>= 1)
+    {
+        unsigned p = q - 1;
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            if (x[dim] & q)
+            {
+                x[0] ^= p;
+            }
+            else
+            {
+                unsigned t = (x[0] ^ x[dim]) & p;
+                x[0] ^= t;
+                x[dim] ^= t;
+            }
+        }
+    }
+
+    // Gray encode
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        x[dim] ^= x[dim - 1];
+    }
+    unsigned t = 0;
+    for (unsigned q = top; q > 1; q >>= 1)
+    {
+        if (x[DIMENSIONAL - 1] & q)
+        {
+            t ^= q - 1;
+        }
+    }
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        x[dim] ^= t;
+    }
+    return InterleaveBits(x);
+
+} // end of "HilbertKey"
+
+
+
+// === MortonKey ==============================================================
+// This function will return the position of a cell on the Morton (Z-order)
+// curve.
+//
+// Input: -- cell: the cell coordinates, CURVE_BITS bits each
+//
+// Output: the key
+// ============================================================================
+
+inline unsigned long long MortonKey(const unsigned cell[DIMENSIONAL])
+{
+    return InterleaveBits(cell);
+
+} // end of "MortonKey"
+
+
+
+// === CurveOrder =============================================================
+// This function will sort the points along a curve. The bounding box of the
+// points is cut into 2^CURVE_BITS cells per axis, each point gets the key of
+// its cell and the points are sorted by key (by index for equal keys). The
+// keys are computed on every core.
+//
+// Input: -- point: the points
+//        -- num: number of point
+//        -- curve: the curve (CURVE_NONE gives 0, 1, 2, ...)
+//        -- order: order[i] is the index of the i-th point on the curve
+//        -- numThreads: number of thread (0 means every core)
+//
+// Output: nothing
+// ============================================================================
+
+template    <typename  NodeType>
+void CurveOrder(const NodeType point[], const int num, const CurveType curve
+                , vector<int> &order, const int numThreads = 0)
+{
+    vector<pair<unsigned long long, int> > key(max(num, 0));
+    double low[DIMENSIONAL];
+    double high[DIMENSIONAL];
+    double scale[DIMENSIONAL];
+
+    order.resize(max(num, 0));
+    for (int index = 0; index < num; ++index)
+    {
+        order[index] = index;
+    }
+    if ((curve == CURVE_NONE) || (num <= 1))
+    {
+        return;
+    }
+
+    // get the box of the points and the size of a cell
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        low[dim] = HUGE_VAL;
+        high[dim] = -HUGE_VAL;
+    }
+    for (int index = 0; index < num; ++index)
+    {
+        double coord[DIMENSIONAL] = {point[index].GetXCoord()
+                                     , point[index].GetYCoord()
+                                     , point[index].GetZCoord()};
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            low[dim] = min(low[dim], coord[dim]);
+            high[dim] = max(high[dim], coord[dim]);
+        }
+    }
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        double cells = static_cast<double>((1U << CURVE_BITS) - 1);
+        scale[dim] = (high[dim] > low[dim]) ? cells / (high[dim] - low[dim])
+                                            : 0;
+    }
+
+    // key of each point
+    ParallelFor(0, num, numThreads, [&](int, int index)
+    {
+        double coord[DIMENSIONAL] = {point[index].GetXCoord()
+                                     , point[index].GetYCoord()
+                                     , point[index].GetZCoord()};
+        unsigned cell[DIMENSIONAL];
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            cell[dim] = static_cast<unsigned>((coord[dim] - low[dim])
+                                              * scale[dim]);
+        }
+        key[index].first = (curve == CURVE_HILBERT) ? HilbertKey(cell)
+                                                    : MortonKey(cell);
+        key[index].second = index;
+    });
+    sort(key.begin(), key.end());
+    for (int index = 0; index < num; ++index)
+    {
+        order[index] = key[index].second;
+    }
+
+} // end of "CurveOrder"
+
+
+
+// === ApplyOrder =============================================================
+// This function will put the items in the order of a permutation, item i
+// becomes the old item order[i].
+//
+// Input: -- items: the items, reordered
+//        -- order: the permutation (from CurveOrder)
+//
+// Output: nothing
+// ============================================================================
+
+template    <typename  ItemType>
+void ApplyOrder(vector<ItemType> &items, const vector<int> &order)
+{
+    vector<ItemType> sorted;
+    sorted.reserve(order.size());
+    for (auto it = order.begin(); it != order.end(); ++it)
+    {
+        sorted.push_back(items[*it]);
+    }
+    items.swap(sorted);
+
+} // end of "ApplyOrder"
+
+
+
+// === RestoreOrder ===========================================================
+// This function will undo ApplyOrder, item order[i] becomes the old item i.
+// It also puts the results of a reordered batch back in the caller's order.
+//
+// Input: -- items: the items, reordered
+//        -- order: the permutation (from CurveOrder)
+//
+// Output: nothing
+// ============================================================================
+
+template    <typename  ItemType>
+void RestoreOrder(vector<ItemType> &items, const vector<int> &order)
+{
+    vector<ItemType> restored(items.size());
+    for (size_t index = 0; index < order.size(); ++index)
+    {
+        restored[order[index]] = items[index];
+    }
+    items.swap(restored);
+
+} // end of "RestoreOrder"
+
+
+
+// === GetCurveName ===========================================================
+// This function will return the name of a curve.
+// ============================================================================
+
+inline const char* GetCurveName(const CurveType curve)
+{
+    switch (curve)
+    {
+    case CURVE_NONE:        return "none";
+    case CURVE_MORTON:      return "morton";
+    case CURVE_HILBERT:     return "hilbert";
+    }
+    return "unknown";
+
+} // end of "GetCurveName"
+
+
+
+// === ParseCurve =============================================================
+// This function will find a curve from its name (none, morton or hilbert).
+//
+// Output: true if the name is known, false otherwise
+// ============================================================================
+
+inline bool ParseCurve(const string &name, CurveType &curve)
+{
+    const CurveType all[] = {CURVE_NONE, CURVE_MORTON, CURVE_HILBERT};
+    for (int index = 0; index < 3; ++index)
+    {
+        if (name == GetCurveName(all[index]))
+        {
+            curve = all[index];
+            return true;
+        }
+    }
+    return false;
+
+} // end of "ParseCurve"
+
+#endif // CURVE_ORDER_HEADER
@@ -0,0 +1,385 @@
+// ============================================================================
+// File: datagen.cpp
+// ============================================================================
+// This header file contains the implementation of the CDataGenerator class.
+// ============================================================================
+
+#include    <cmath>
+#include    <cstring>
+using namespace std;
+#include    "datagen.h"
+#include    "fieldnode.h"
+#include    "parallel.h"
+
+
+
+// ==== CDataGenerator::CDataGenerator ========================================
+//
+// This is the constructor for the CDataGenerator class. By default there are
+// 20 blobs with a standard deviation of 1.5% of the box, and the lattice has
+// 20 cells per axis.
+//
+// Access: public
+//
+// Input:
+//      seed [IN]   -- seed of the random engines
+//      extent [IN] -- size of the box the points are made in
+//
+// ============================================================================
+
+inline  CDataGenerator::CDataGenerator(const unsigned long long seed
+                                       , const double extent)
+    : m_seed(seed), m_extent(extent), m_numClusters(20)
+    , m_spread(extent * 0.015), m_gridSize(20)
+{
+}  // end of "CDataGenerator::CDataGenerator"
+
+
+
+// ==== CDataGenerator::Generate ==============================================
+//
+// This function makes "num" points of any dimension into a flat array, the
+// coordinates of point i are coord[i * dimension .. i * dimension + D - 1].
+//
+// Access: public
+//
+// Input:
+//      dist [IN]       -- the distribution
+//      num [IN]        -- number of point
+//      dimension [IN]  -- number of coordinate per point
+//      coord [OUT]     -- the coordinates, num * dimension values
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+inline  void    CDataGenerator::Generate(const DataDistribution dist
+                                         , const int num, const int dimension
+                                         , double coord[]
+                                         , const int numThreads) const
+{
+    GenerateBlocks(dist, num, dimension
+                   , [coord, dimension](int index, const double *value)
+                     {
+                         memcpy(coord + 1LL * index * dimension, value
+                                , dimension * sizeof(double));
+                     }
+                   , numThreads);
+
+}  // end of "CDataGenerator::Generate"
+
+
+
+// ==== CDataGenerator::Generate ==============================================
+//
+// This function makes "num" points straight into an array of tree nodes,
+// named 1 to num, with a distance of zero.
+//
+// Access: public
+//
+// Input:
+//      dist [IN]       -- the distribution
+//      point [OUT]     -- the points
+//      num [IN]        -- number of point
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CDataGenerator::Generate(const DataDistribution dist, NodeType point[]
+                                 , const int num, const int numThreads) const
+{
+    GenerateBlocks(dist, num, DIMENSIONAL
+                   , [point](int index, const double *value)
+                     {
+                         point[index].SetName(index + 1);
+                         point[index].SetDistance(0);
+                         point[index].SetXCoord(value[0]);
+                         point[index].SetYCoord(value[1]);
+                         point[index].SetZCoord(value[2]);
+                     }
+                   , numThreads);
+
+}  // end of "CDataGenerator::Generate"
+
+
+
+// ==== CDataGenerator::GenerateBlocks ========================================
+//
+// This function makes the points block by block on every core and hands each
+// one to the writer. The engine of a block is seeded from the seed and the
+// block number only.
+//
+// Access: protected
+//
+// Input:
+//      dist [IN]       -- the distribution
+//      num [IN]        -- number of point
+//      dimension [IN]  -- number of coordinate per point
+//      writer [IN]     -- function object that takes (int index,
+//                         const double *coord)
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  Writer>
+void    CDataGenerator::GenerateBlocks(const DataDistribution dist
+                                       , const int num, const int dimension
+                                       , Writer writer
+                                       , const int numThreads) const
+{
+    vector<double> center;
+    int numBlocks = (num + DATAGEN_BLOCK - 1) / DATAGEN_BLOCK;
+
+    if ((num <= 0) || (dimension <= 0))
+    {
+        return;
+    }
+    MakeCenters(dimension, center);
+    ParallelFor(0, numBlocks, numThreads, [&](int, int block)
+    {
+        seed_seq seq = {static_cast<unsigned>(m_seed)
+                        , static_cast<unsigned>(m_seed >> 32)
+                        , static_cast<unsigned>(block)};
+        mt19937_64 engine(seq);
+        vector<double> coord(dimension);
+        int last = min(num, (block + 1) * DATAGEN_BLOCK);
+
+        for (int index = block * DATAGEN_BLOCK; index < last; ++index)
+        {
+            MakePoint(dist, index, num, dimension, center, engine
+                      , coord.data());
+            writer(index, coord.data());
+        }
+    });
+
+}  // end of "CDataGenerator::GenerateBlocks"
+
+
+
+// ==== CDataGenerator::GetDistributionName ===================================
+//
+// This function returns the name of a distribution.
+//
+// Access: public
+//
+// Input:
+//      dist [IN]   -- the distribution
+//
+// Output:
+//      The name, as accepted by ParseDistribution.
+//
+// ============================================================================
+
+inline  const char* CDataGenerator::GetDistributionName(
+                                            const DataDistribution dist)
+{
+    switch (dist)
+    {
+    case DIST_UNIFORM:      return "uniform";
+    case DIST_CLUSTERED:    return "clustered";
+    case DIST_SURFACE:      return "surface";
+    case DIST_GRID:         return "grid";
+    case DIST_SORTED:       return "sorted";
+    }
+    return "unknown";
+
+}  // end of "CDataGenerator::GetDistributionName"
+
+
+
+// ==== CDataGenerator::MakeCenters ===========================================
+//
+// This function picks the blob centers, from the seed only.
+//
+// Access: protected
+//
+// Input:
+//      dimension [IN]  -- number of coordinate per point
+//      center [OUT]    -- m_numClusters * dimension coordinates
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+inline  void    CDataGenerator::MakeCenters(const int dimension
+                                            , vector<double> &center) const
+{
+    mt19937_64 engine(m_seed);
+    uniform_real_distribution<double> uniform(0, m_extent);
+
+    center.resize(1LL * m_numClusters * dimension);
+    for (auto it = center.begin(); it != center.end(); ++it)
+    {
+        *it = uniform(engine);
+    }
+
+}  // end of "CDataGenerator::MakeCenters"
+
+
+
+// ==== CDataGenerator::MakePoint =============================================
+//
+// This function makes the coordinates of one point.
+//      uniform:   every coordinate uniform in [0, extent)
+//      clustered: a random blob center plus Gaussian noise
+//      surface:   x and y uniform, the other coordinates are smooth waves of
+//                 x and y around the middle of the box (like a terrain scan)
+//      grid:      every coordinate is one of the lattice values
+//      sorted:    the first coordinate grows with the index, the others are
+//                 uniform
+//
+// Access: protected
+//
+// Input:
+//      dist [IN]       -- the distribution
+//      index [IN]      -- index of the point
+//      num [IN]        -- number of point
+//      dimension [IN]  -- number of coordinate per point
+//      center [IN]     -- the blob centers
+//      engine [IN/OUT] -- random engine of the block
+//      coord [OUT]     -- the coordinates
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+inline  void    CDataGenerator::MakePoint(const DataDistribution dist
+                                          , const int index, const int num
+                                          , const int dimension
+                                          , const vector<double> &center
+                                          , mt19937_64 &engine
+                                          , double coord[]) const
+{
+    const double PI = 3.14159265358979323846;
+    uniform_real_distribution<double> uniform(0, m_extent);
+
+    switch (dist)
+    {
+    case DIST_CLUSTERED:
+    {
+        uniform_int_distribution<int> pick(0, m_numClusters - 1);
+        normal_distribution<double> noise(0, m_spread);
+        const double *blob = &center[1LL * pick(engine) * dimension];
+        for (int dim = 0; dim < dimension; ++dim)
+        {
+            coord[dim] = blob[dim] + noise(engine);
+        }
+        break;
+    }
+    case DIST_SURFACE:
+    {
+        double wave = 2 * PI / (m_extent / 4);
+        double height = m_extent * 0.05;
+        double u = uniform(engine);
+        double v = uniform(engine);
+        for (int dim = 0; dim < dimension; ++dim)
+        {
+            if (dim == 0)
+                coord[dim] = u;
+            else if (dim == 1)
+                coord[dim] = v;
+            else
+                coord[dim] = m_extent / 2 + height * sin(wave * u + dim)
+                                                   * cos(wave * v * dim);
+        }
+        break;
+    }
+    case DIST_GRID:
+    {
+        uniform_int_distribution<int> cell(0, m_gridSize - 1);
+        for (int dim = 0; dim < dimension; ++dim)
+        {
+            coord[dim] = cell(engine) * (m_extent / m_gridSize);
+        }
+        break;
+    }
+    case DIST_SORTED:
+    {
+        uniform_real_distribution<double> jitter(0, 1);
+        coord[0] = m_extent * (index + jitter(engine)) / num;
+        for (int dim = 1; dim < dimension; ++dim)
+        {
+            coord[dim] = uniform(engine);
+        }
+        break;
+    }
+    case DIST_UNIFORM:
+    default:
+        for (int dim = 0; dim < dimension; ++dim)
+        {
+            coord[dim] = uniform(engine);
+        }
+        break;
+    }
+
+}  // end of "CDataGenerator::MakePoint"
+
+
+
+// ==== CDataGenerator::ParseDistribution =====================================
+//
+// This function finds a distribution from its name.
+//
+// Access: public
+//
+// Input:
+//      name [IN]   -- uniform, clustered, surface, grid or sorted
+//      dist [OUT]  -- the distribution
+//
+// Output:
+//      A value of true if the name is known, false otherwise.
+//
+// ============================================================================
+
+inline  bool    CDataGenerator::ParseDistribution(const string &name
+                                                  , DataDistribution &dist)
+{
+    const DataDistribution all[] = {DIST_UNIFORM, DIST_CLUSTERED, DIST_SURFACE
+                                    , DIST_GRID, DIST_SORTED};
+    for (int index = 0; index < 5; ++index)
+    {
+        if (name == GetDistributionName(all[index]))
+        {
+            dist = all[index];
+            return true;
+        }
+    }
+    return false;
+
+}  // end of "CDataGenerator::ParseDistribution"
+
+
+
+// ==== CDataGenerator::SetClusters ===========================================
+//
+// This function sets the number of blob and their standard deviation.
+//
+// Access: public
+//
+// Input:
+//      numClusters [IN]    -- number of blob (at least 1)
+//      spread [IN]         -- standard deviation of a blob
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+inline  void    CDataGenerator::SetClusters(const int numClusters
+                                            , const double spread)
+{
+    m_numClusters = (numClusters > 0) ? numClusters : 1;
+    m_spread = spread;
+
+}  // end of "CDataGenerator::SetClusters"
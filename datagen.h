@@ -0,0 +1,79 @@
+// ============================================================================
+// File: datagen.h
+// ============================================================================
+// This header file contains the declaration of the CDataGenerator class. It
+// makes synthetic point sets from an explicit seed, so a run can always be
+// repeated. The points are made in blocks, each block has its own random
+// engine seeded from the seed and the block number, so the result does not
+// depend on the number of thread.
+// ============================================================================
+
+#ifndef CDATA_GENERATOR_HEADER
+#define CDATA_GENERATOR_HEADER
+
+#include    <random>
+#include    <string>
+#include    <vector>
+using namespace std;
+
+// point distributions
+enum DataDistribution
+{
+    DIST_UNIFORM,       // every coordinate uniform in the box
+    DIST_CLUSTERED,     // Gaussian blobs around random centers
+    DIST_SURFACE,       // points on a wavy height field (2-manifold in 3D)
+    DIST_GRID,          // points on a coarse lattice, so many are repeated
+    DIST_SORTED         // uniform, but sorted along the first coordinate
+};
+
+// number of point made by one random engine
+const int DATAGEN_BLOCK = 4096;
+
+class   CDataGenerator
+{
+public:
+    // constructor
+    CDataGenerator(const unsigned long long seed = 1
+                   , const double extent = 1000);
+
+    // member functions
+    void    Generate(const DataDistribution dist, const int num
+                     , const int dimension, double coord[]
+                     , const int numThreads = 0) const;
+    template    <typename  NodeType>
+    void    Generate(const DataDistribution dist, NodeType point[]
+                     , const int num, const int numThreads = 0) const;
+    unsigned long long GetSeed() const { return m_seed; }
+    void    SetClusters(const int numClusters, const double spread);
+    void    SetGridSize(const int gridSize)
+                        { m_gridSize = (gridSize > 0) ? gridSize : 1; }
+    void    SetSeed(const unsigned long long seed) { m_seed = seed; }
+
+    static  bool    ParseDistribution(const string &name
+                                      , DataDistribution &dist);
+    static  const char* GetDistributionName(const DataDistribution dist);
+
+protected:
+    // member functions
+    template    <typename  Writer>
+    void    GenerateBlocks(const DataDistribution dist, const int num
+                           , const int dimension, Writer writer
+                           , const int numThreads) const;
+    void    MakeCenters(const int dimension, vector<double> &center) const;
+    void    MakePoint(const DataDistribution dist, const int index
+                      , const int num, const int dimension
+                      , const vector<double> &center, mt19937_64 &engine
+                      , double coord[]) const;
+
+private:
+    // data members
+    unsigned long long  m_seed;         // seed of every random engine
+    double              m_extent;       // points are in [0, m_extent)^D
+    int                 m_numClusters;  // number of blob (DIST_CLUSTERED)
+    double              m_spread;       // standard deviation of a blob
+    int                 m_gridSize;     // lattice cells per axis (DIST_GRID)
+};
+
+#include    "datagen.cpp"
+
+#endif  // CDATA_GENERATOR_HEADER
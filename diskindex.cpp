@@ -0,0 +1,1175 @@
+// ============================================================================
+// File: diskindex.cpp
+// ============================================================================
+// This header file contains the implementation of the CDiskIndex class. It
+// uses the template parameter "NodeType" for the type of the points.
+// ============================================================================
+
+#include    <algorithm>
+#include    <cmath>
+#include    <cstdio>
+#include    <cstring>
+#include    <string>
+#include    <fcntl.h>
+#include    <sys/mman.h>
+#include    <sys/stat.h>
+#include    <unistd.h>
+using namespace std;
+#include    "diskindex.h"
+
+// format of the index file, and the largest number of chunk (one open
+// temporary file each during the build)
+const char  DISK_MAGIC[8] = {'K', 'D', 'D', 'I', 'S', 'K', '0', '1'};
+const int   DISK_VERSION = 1;
+const int   DISK_MAX_CHUNKS = 1000;
+
+// ==== CDiskIndex::Build =====================================================
+//
+// This function builds the index file of the points of a CDiskPoint file in
+// four passes (see diskindex.h), holding at most about "memoryBudget" bytes
+// of points: a third of it for one chunk, as much for sorting it, the rest
+// for the sample and the buffers. A chunk that gets more points than that
+// (the sample planes cannot cut apart many points at or near the same
+// place) is cut in two by SplitPart until every piece fits. The temporary
+// files of the chunks are "indexFile".part<number>, next to the index.
+//
+// Access: public
+//
+// Input:
+//      pointFile [IN]      -- the points, CDiskPoint records
+//      indexFile [IN]      -- the index file to write
+//      memoryBudget [IN]   -- memory for the points, in byte (at least 1 MB
+//                             is used)
+//
+// Output:
+//      True if the index was written, false otherwise (the input cannot be
+//      read or is empty, it needs more than DISK_MAX_CHUNKS chunks, or a
+//      file cannot be written).
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CDiskIndex<NodeType>::Build(const char *pointFile, const char *indexFile
+                                    , const long long memoryBudget)
+{
+    const long long recordSize = sizeof(CDiskPoint);
+    long long budget = max(memoryBudget, 1LL << 20);
+    long long capacity = budget / recordSize / 3;   // points of a chunk
+    int blockSize = static_cast<int>(min(budget / recordSize / 16, 1LL << 16));
+
+    FILE *input = fopen(pointFile, "rb");
+    if (NULL == input)
+    {
+        return false;
+    }
+    fseeko(input, 0, SEEK_END);
+    long long numPoints = ftello(input) / recordSize;
+    rewind(input);
+    long long numChunks = (numPoints + capacity - 1) / capacity;
+    if ((numPoints <= 0) || (numChunks > DISK_MAX_CHUNKS))
+    {
+        fclose(input);
+        return false;
+    }
+
+    // 1. an evenly spaced sample of the input
+    long long sampleSize = min(numPoints, max(capacity / 4, numChunks * 64));
+    long long stride = numPoints / sampleSize;
+    vector<CDiskPoint> block(blockSize);
+    vector<CDiskPoint> sample;
+    sample.reserve(sampleSize);
+    long long index = 0;
+    size_t got = 0;
+    while ((got = fread(block.data(), recordSize, blockSize, input)) > 0)
+    {
+        for (size_t item = 0; item < got; ++item, ++index)
+        {
+            if ((index % stride == 0)
+                && (static_cast<long long>(sample.size()) < sampleSize))
+            {
+                sample.push_back(block[item]);
+            }
+        }
+    }
+
+    // 2. the top tree, cut from the sample
+    vector<CTopNode> top;
+    int nextChunk = 0;
+    SplitSample(sample, 0, static_cast<int>(sample.size())
+                , static_cast<int>(numChunks), top, nextChunk);
+    vector<CDiskPoint>().swap(sample);
+    numChunks = nextChunk;
+
+    // 3. each point to the temporary file of its chunk
+    bool bOk = true;
+    size_t bufferSize = static_cast<size_t>(max(4096LL
+                                                , budget / 4 / numChunks));
+    vector<CPart> pending(numChunks);
+    vector<FILE*> part(numChunks, static_cast<FILE*>(NULL));
+    vector<vector<char> > partBuffer(numChunks);
+    int nextPart = 0;
+    for (int chunk = 0; bOk && (chunk < numChunks); ++chunk)
+    {
+        pending[chunk].name = string(indexFile) + ".part"
+                              + to_string(nextPart++);
+        pending[chunk].count = 0;
+        part[chunk] = fopen(pending[chunk].name.c_str(), "wb");
+        partBuffer[chunk].resize(bufferSize);
+        bOk = (NULL != part[chunk])
+              && (setvbuf(part[chunk], partBuffer[chunk].data(), _IOFBF
+                          , bufferSize) == 0);
+    }
+    for (int node = 0; node < static_cast<int>(top.size()); ++node)
+    {
+        if (top[node].axis < 0)
+        {
+            pending[top[node].left].node = node;
+        }
+    }
+    rewind(input);
+    while (bOk && ((got = fread(block.data(), recordSize, blockSize, input))
+                   > 0))
+    {
+        for (size_t item = 0; bOk && (item < got); ++item)
+        {
+            int chunk = Route(top, block[item].coord);
+            bOk = (fwrite(&block[item], recordSize, 1, part[chunk]) == 1);
+            ++pending[chunk].count;
+        }
+    }
+    fclose(input);
+    for (int chunk = 0; chunk < numChunks; ++chunk)
+    {
+        if ((NULL != part[chunk]) && (fclose(part[chunk]) != 0))
+        {
+            bOk = false;
+        }
+    }
+    vector<vector<char> >().swap(partBuffer);
+
+    // 4. each chunk, without its repeated points and in k-d order, into the
+    // index, then the top tree and the chunk table; the header goes last,
+    // over the first page. A chunk over the capacity is cut in two first,
+    // and its pieces are done in its place.
+    FILE *output = bOk ? fopen(indexFile, "wb") : NULL;
+    vector<char> zero(DISK_PAGE, 0);
+    vector<CChunk> table;
+    vector<CDiskPoint> points;
+    long long offset = DISK_PAGE;
+    long long numKept = 0;
+    reverse(pending.begin(), pending.end());
+    bOk = (NULL != output) && (fwrite(zero.data(), 1, DISK_PAGE, output)
+                               == static_cast<size_t>(DISK_PAGE));
+    while (bOk && !pending.empty())
+    {
+        CPart piece = pending.back();
+        pending.pop_back();
+        if (piece.count > capacity)
+        {
+            bOk = SplitPart(piece, capacity, indexFile, nextPart, top
+                            , pending);
+            continue;
+        }
+
+        FILE *file = fopen(piece.name.c_str(), "rb");
+        points.resize(piece.count);
+        bOk = (NULL != file)
+              && (fread(points.data(), recordSize, piece.count, file)
+                  == static_cast<size_t>(piece.count));
+        if (NULL != file)
+        {
+            fclose(file);
+        }
+        remove(piece.name.c_str());
+
+        UniquePoints(points);
+        long long count = static_cast<long long>(points.size());
+        LayoutChunk(points.data(), 0, count);
+        CChunk entry;
+        entry.offset = offset;
+        entry.count = count;
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            entry.low[dim] = HUGE_VAL;
+            entry.high[dim] = -HUGE_VAL;
+        }
+        for (auto it = points.begin(); it != points.end(); ++it)
+        {
+            for (int dim = 0; dim < DIMENSIONAL; ++dim)
+            {
+                entry.low[dim] = min(entry.low[dim], it->coord[dim]);
+                entry.high[dim] = max(entry.high[dim], it->coord[dim]);
+            }
+        }
+        top[piece.node].left = static_cast<int>(table.size());
+        table.push_back(entry);
+        numKept += count;
+
+        long long pad = (DISK_PAGE - (offset + count * recordSize) % DISK_PAGE)
+                        % DISK_PAGE;
+        bOk = bOk && (fwrite(points.data(), recordSize, count, output)
+                      == static_cast<size_t>(count))
+              && (fwrite(zero.data(), 1, pad, output)
+                  == static_cast<size_t>(pad));
+        offset += count * recordSize + pad;
+    }
+
+    CDiskHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISK_MAGIC, sizeof(header.magic));
+    header.version = DISK_VERSION;
+    header.numChunks = static_cast<int>(table.size());
+    header.numTop = static_cast<int>(top.size());
+    header.numPoints = numKept;
+    header.topOffset = offset;
+    header.chunkOffset = offset + top.size() * sizeof(CTopNode);
+    bOk = bOk && (fwrite(top.data(), sizeof(CTopNode), top.size(), output)
+                  == top.size())
+          && (fwrite(table.data(), sizeof(CChunk), table.size(), output)
+              == table.size())
+          && (fseeko(output, 0, SEEK_SET) == 0)
+          && (fwrite(&header, sizeof(header), 1, output) == 1);
+    if (NULL != output)
+    {
+        bOk = (fclose(output) == 0) && bOk;
+    }
+
+    for (auto it = pending.begin(); it != pending.end(); ++it)
+    {
+        remove(it->name.c_str());
+    }
+    if (!bOk)
+    {
+        remove(indexFile);
+    }
+    return bOk;
+
+}  // end of "CDiskIndex<NodeType>::Build"
+
+
+
+// ==== CDiskIndex::Close =====================================================
+//
+// This function unmaps the index file.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CDiskIndex<NodeType>::Close()
+{
+    if (NULL != m_base)
+    {
+        munmap(const_cast<char*>(m_base), m_size);
+    }
+    m_base = NULL;
+    m_size = 0;
+    m_header = NULL;
+    m_top = NULL;
+    m_chunk = NULL;
+
+}  // end of "CDiskIndex<NodeType>::Close"
+
+
+
+// ==== CDiskIndex::CloserThan ================================================
+//
+// This function compares two neighbors by distance, for the heap of the
+// search.
+//
+// Access: protected
+//
+// Input:
+//      a, b [IN]   -- the neighbors
+//
+// Output:
+//      True if "a" is closer than "b".
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CDiskIndex<NodeType>::CloserThan(const NodeType &a, const NodeType &b)
+{
+    return a.GetDistance() < b.GetDistance();
+
+}  // end of "CDiskIndex<NodeType>::CloserThan"
+
+
+
+// ==== CDiskIndex::GetNumChunks ==============================================
+//
+// This function returns the number of chunk of the open index.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      The number of chunk, 0 if no index is open.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CDiskIndex<NodeType>::GetNumChunks() const
+{
+    return IsOpen() ? m_header->numChunks : 0;
+
+}  // end of "CDiskIndex<NodeType>::GetNumChunks"
+
+
+
+// ==== CDiskIndex::GetNumPoints ==============================================
+//
+// This function returns the number of point of the open index.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      The number of point, 0 if no index is open.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+long long   CDiskIndex<NodeType>::GetNumPoints() const
+{
+    return IsOpen() ? m_header->numPoints : 0;
+
+}  // end of "CDiskIndex<NodeType>::GetNumPoints"
+
+
+
+// ==== CDiskIndex::LayoutChunk ===============================================
+//
+// This recursive function puts points[first] to points[last - 1] in k-d
+// order: the median on the axis of widest spread goes to the middle (first
+// + (last - first) / 2) and keeps that axis, the points below it go before
+// it and the others after it, and so on in each half.
+//
+// Access: protected
+//
+// Input:
+//      points [IN/OUT] -- the points of a chunk
+//      first [IN]      -- index of the first point
+//      last [IN]       -- index past the last point
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CDiskIndex<NodeType>::LayoutChunk(CDiskPoint points[]
+                                          , const long long first
+                                          , const long long last)
+{
+    if (last <= first)
+    {
+        return;
+    }
+    long long mid = first + (last - first) / 2;
+    if (last - first == 1)
+    {
+        points[mid].axis = 0;
+        return;
+    }
+
+    double low[DIMENSIONAL];
+    double high[DIMENSIONAL];
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        low[dim] = HUGE_VAL;
+        high[dim] = -HUGE_VAL;
+    }
+    for (long long index = first; index < last; ++index)
+    {
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            low[dim] = min(low[dim], points[index].coord[dim]);
+            high[dim] = max(high[dim], points[index].coord[dim]);
+        }
+    }
+    int axis = 0;
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        if (high[dim] - low[dim] > high[axis] - low[axis])
+        {
+            axis = dim;
+        }
+    }
+    nth_element(points + first, points + mid, points + last
+                , [axis](const CDiskPoint &a, const CDiskPoint &b)
+                {
+                    return a.coord[axis] < b.coord[axis];
+                });
+    points[mid].axis = axis;
+    LayoutChunk(points, first, mid);
+    LayoutChunk(points, mid + 1, last);
+
+}  // end of "CDiskIndex<NodeType>::LayoutChunk"
+
+
+
+// ==== CDiskIndex::NearestNeighbors ==========================================
+//
+// This function finds the "num" nearest neighbors of the target point in
+// the Euclidean metric, nearest first.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CDiskIndex<NodeType>::NearestNeighbors(const NodeType &target
+                                               , const int num
+                                               , vector<NodeType> &listN) const
+{
+    NearestNeighbors(target, num, listN, CEuclideanMetric());
+
+}  // end of "CDiskIndex<NodeType>::NearestNeighbors"
+
+
+
+// ==== CDiskIndex::NearestNeighbors ==========================================
+//
+// This function finds the "num" nearest neighbors of the target point in any
+// metric of metric.h, nearest first, with their distance in that metric.
+// It only reads the index, so it can be called from several threads at
+// once.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//      metric [IN] -- the distance metric
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void    CDiskIndex<NodeType>::NearestNeighbors(const NodeType &target
+                                               , const int num
+                                               , vector<NodeType> &listN
+                                               , const Metric &metric) const
+{
+    double coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                 , target.GetZCoord()};
+
+    listN.clear();
+    if (!IsOpen() || (num <= 0))
+    {
+        return;
+    }
+    listN.reserve(num);
+    SearchTop(0, coord, num, listN, metric);
+    sort_heap(listN.begin(), listN.end(), CloserThan);
+    for (auto it = listN.begin(); it != listN.end(); ++it)
+    {
+        (*it).SetDistance(metric.Distance((*it).GetDistance()));
+    }
+
+}  // end of "CDiskIndex<NodeType>::NearestNeighbors"
+
+
+
+// ==== CDiskIndex::Open ======================================================
+//
+// This function maps an index file written by Build into memory, read only.
+// Any open index is closed first. It checks the header, the nodes of the top
+// tree and that every chunk is inside the file, but does not read the
+// points: that would read in the whole file. The split axis of each point
+// is checked when a search reads it (SearchChunk).
+//
+// Access: public
+//
+// Input:
+//      indexFile [IN]  -- name of the index file
+//
+// Output:
+//      True if the index is open, false otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CDiskIndex<NodeType>::Open(const char *indexFile)
+{
+    struct stat status;
+
+    Close();
+    int fd = open(indexFile, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if ((fstat(fd, &status) != 0)
+        || (status.st_size < static_cast<off_t>(sizeof(CDiskHeader))))
+    {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == base)
+    {
+        return false;
+    }
+    m_base = static_cast<const char*>(base);
+    m_size = status.st_size;
+    madvise(base, m_size, MADV_RANDOM);
+
+    // check the header, the top tree and that every chunk is inside the
+    // file; the points are only read by the searches (see SearchChunk)
+    m_header = reinterpret_cast<const CDiskHeader*>(m_base);
+    long long size = static_cast<long long>(m_size);
+    bool bValid = (memcmp(m_header->magic, DISK_MAGIC, sizeof(DISK_MAGIC))
+                   == 0)
+                  && (m_header->version == DISK_VERSION)
+                  && (m_header->numChunks > 0) && (m_header->numTop > 0)
+                  && (m_header->topOffset >= 0)
+                  && (m_header->topOffset + m_header->numTop
+                      * static_cast<long long>(sizeof(CTopNode)) <= size)
+                  && (m_header->chunkOffset >= 0)
+                  && (m_header->chunkOffset + m_header->numChunks
+                      * static_cast<long long>(sizeof(CChunk)) <= size);
+    if (bValid)
+    {
+        m_top = reinterpret_cast<const CTopNode*>(m_base
+                                                  + m_header->topOffset);
+        m_chunk = reinterpret_cast<const CChunk*>(m_base
+                                                  + m_header->chunkOffset);
+    }
+    for (int node = 0; bValid && (node < m_header->numTop); ++node)
+    {
+        const CTopNode &entry = m_top[node];
+        bValid = (entry.axis < 0)
+                 ? ((entry.left >= 0) && (entry.left < m_header->numChunks))
+                 : ((entry.axis < DIMENSIONAL) && (entry.left > node)
+                    && (entry.left < m_header->numTop) && (entry.right > node)
+                    && (entry.right < m_header->numTop));
+    }
+    for (int chunk = 0; bValid && (chunk < m_header->numChunks); ++chunk)
+    {
+        const CChunk &entry = m_chunk[chunk];
+        bValid = (entry.offset >= 0) && (entry.count >= 0)
+                 && (entry.offset + entry.count
+                     * static_cast<long long>(sizeof(CDiskPoint)) <= size);
+    }
+    if (!bValid)
+    {
+        Close();
+    }
+    return bValid;
+
+}  // end of "CDiskIndex<NodeType>::Open"
+
+
+
+// ==== CDiskIndex::Route =====================================================
+//
+// This function finds the chunk of a point by walking the top tree.
+//
+// Access: protected
+//
+// Input:
+//      top [IN]    -- the top tree, root first
+//      coord [IN]  -- coordinates of the point
+//
+// Output:
+//      The number of the chunk.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CDiskIndex<NodeType>::Route(const vector<CTopNode> &top
+                                    , const double coord[])
+{
+    int node = 0;
+    while (top[node].axis >= 0)
+    {
+        node = (coord[top[node].axis] < top[node].value) ? top[node].left
+                                                          : top[node].right;
+    }
+    return top[node].left;
+
+}  // end of "CDiskIndex<NodeType>::Route"
+
+
+
+// ==== CDiskIndex::SearchChunk ===============================================
+//
+// This recursive function searches points[first] to points[last - 1] of a
+// chunk in k-d order (see LayoutChunk) like CBSTree::OptNeighbor: the point
+// in the middle, the near half, then the far half if the split plane is
+// closer than the farthest neighbor. The neighbors are a max-heap on the
+// reduced distance. Open does not read the points, so their split axes are
+// checked here: a point whose axis is out of range (a corrupt file) has both
+// halves searched, which needs no axis.
+//
+// Access: protected
+//
+// Input:
+//      points [IN]     -- the points of the chunk, in the mapped file
+//      first [IN]      -- index of the first point
+//      last [IN]       -- index past the last point
+//      target [IN]     -- coordinates of the target point
+//      num [IN]        -- number of nearest neighbor
+//      listN [IN/OUT]  -- heap of the nearest neighbors found so far
+//      metric [IN]     -- the distance metric
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void    CDiskIndex<NodeType>::SearchChunk(const CDiskPoint points[]
+                                          , const long long first
+                                          , const long long last
+                                          , const double target[]
+                                          , const int num
+                                          , vector<NodeType> &listN
+                                          , const Metric &metric) const
+{
+    if (last <= first)
+    {
+        return;
+    }
+    long long mid = first + (last - first) / 2;
+    const CDiskPoint &point = points[mid];
+
+    // offer the point, the target itself (distance 0) is skipped
+    double dist = metric.Term(metric.Gap(point.coord[0], target[0], 0), 0);
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        dist = metric.Accumulate(dist, metric.Term(
+                            metric.Gap(point.coord[dim], target[dim], dim)
+                            , dim));
+    }
+    bool bFull = (static_cast<int>(listN.size()) >= num);
+    if ((dist > 0) && (!bFull || (dist < listN.front().GetDistance())))
+    {
+        if (bFull)
+        {
+            pop_heap(listN.begin(), listN.end(), CloserThan);
+            listN.pop_back();
+        }
+        NodeType neighbor;
+        neighbor.SetName(point.name);
+        neighbor.SetXCoord(point.coord[0]);
+        neighbor.SetYCoord(point.coord[1]);
+        neighbor.SetZCoord(point.coord[2]);
+        neighbor.SetDistance(dist);
+        listN.push_back(neighbor);
+        push_heap(listN.begin(), listN.end(), CloserThan);
+    }
+    if (last - first == 1)
+    {
+        return;
+    }
+
+    int    axis = point.axis;
+    if ((axis < 0) || (axis >= DIMENSIONAL))
+    {
+        SearchChunk(points, first, mid, target, num, listN, metric);
+        SearchChunk(points, mid + 1, last, target, num, listN, metric);
+        return;
+    }
+
+    // the near half first, then the far half if the plane is close enough
+    double delta = target[axis] - point.coord[axis];
+    if (delta < 0)
+    {
+        SearchChunk(points, first, mid, target, num, listN, metric);
+    }
+    else
+    {
+        SearchChunk(points, mid + 1, last, target, num, listN, metric);
+    }
+    double gap = metric.Term(metric.HalfSpaceGap(target[axis]
+                                                 , point.coord[axis]
+                                                 , delta < 0, axis), axis);
+    if ((static_cast<int>(listN.size()) < num)
+        || (gap < listN.front().GetDistance()))
+    {
+        if (delta < 0)
+        {
+            SearchChunk(points, mid + 1, last, target, num, listN, metric);
+        }
+        else
+        {
+            SearchChunk(points, first, mid, target, num, listN, metric);
+        }
+    }
+
+}  // end of "CDiskIndex<NodeType>::SearchChunk"
+
+
+
+// ==== CDiskIndex::SearchTop =================================================
+//
+// This recursive function walks the top tree from a node, near side first;
+// the far side is skipped when its split plane is farther than the farthest
+// neighbor, and a chunk when its bounding box is. Only the chunks searched
+// are read from the file.
+//
+// Access: protected
+//
+// Input:
+//      node [IN]       -- the node of the top tree
+//      target [IN]     -- coordinates of the target point
+//      num [IN]        -- number of nearest neighbor
+//      listN [IN/OUT]  -- heap of the nearest neighbors found so far
+//      metric [IN]     -- the distance metric
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void    CDiskIndex<NodeType>::SearchTop(const int node, const double target[]
+                                        , const int num
+                                        , vector<NodeType> &listN
+                                        , const Metric &metric) const
+{
+    const CTopNode &entry = m_top[node];
+    if (entry.axis < 0)
+    {
+        const CChunk &chunk = m_chunk[entry.left];
+        if (chunk.count == 0)
+        {
+            return;
+        }
+        if (static_cast<int>(listN.size()) >= num)
+        {
+            double boxDist = metric.Term(metric.IntervalGap(target[0]
+                                                            , chunk.low[0]
+                                                            , chunk.high[0]
+                                                            , 0), 0);
+            for (int dim = 1; dim < DIMENSIONAL; ++dim)
+            {
+                boxDist = metric.Accumulate(boxDist, metric.Term(
+                                metric.IntervalGap(target[dim], chunk.low[dim]
+                                                   , chunk.high[dim], dim)
+                                , dim));
+            }
+            if (boxDist >= listN.front().GetDistance())
+            {
+                return;
+            }
+        }
+        SearchChunk(reinterpret_cast<const CDiskPoint*>(m_base
+                                                        + chunk.offset)
+                    , 0, chunk.count, target, num, listN, metric);
+        return;
+    }
+
+    double delta = target[entry.axis] - entry.value;
+    SearchTop((delta < 0) ? entry.left : entry.right, target, num, listN
+              , metric);
+    double gap = metric.Term(metric.HalfSpaceGap(target[entry.axis]
+                                                 , entry.value, delta < 0
+                                                 , entry.axis), entry.axis);
+    if ((static_cast<int>(listN.size()) < num)
+        || (gap < listN.front().GetDistance()))
+    {
+        SearchTop((delta < 0) ? entry.right : entry.left, target, num, listN
+                  , metric);
+    }
+
+}  // end of "CDiskIndex<NodeType>::SearchTop"
+
+
+
+// ==== CDiskIndex::SplitPart =================================================
+//
+// This function cuts a temporary chunk file that has more points than a
+// chunk may hold in two, streaming it twice with a bounded sample: the
+// plane is the median of the sample on the axis of widest spread, moved up
+// when no point would be below it, so each side gets at least one point.
+// The leaf of the chunk in the top tree becomes that plane, with a new leaf
+// for each side, and both sides go on the pending list (the lower side on
+// top). A chunk whose points all are at one place is cut down to its first
+// point instead, the one UniquePoints would keep.
+//
+// Access: protected
+//
+// Input:
+//      piece [IN]          -- the chunk file, removed here
+//      capacity [IN]       -- number of point a chunk may hold
+//      indexFile [IN]      -- the index file, for the names of the new files
+//      nextPart [IN/OUT]   -- number of the next temporary file
+//      top [IN/OUT]        -- the top tree
+//      pending [IN/OUT]    -- the chunk files still to write
+//
+// Output:
+//      True if the chunk was cut, false if a file cannot be read or written.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CDiskIndex<NodeType>::SplitPart(const CPart &piece
+                                        , const long long capacity
+                                        , const char *indexFile
+                                        , int &nextPart
+                                        , vector<CTopNode> &top
+                                        , vector<CPart> &pending)
+{
+    const long long recordSize = sizeof(CDiskPoint);
+    const int blockSize = 4096;
+    long long sampleSize = min(piece.count, max(capacity / 4, 1LL));
+    long long stride = piece.count / sampleSize;
+    vector<CDiskPoint> block(blockSize);
+    vector<CDiskPoint> sample;
+    CDiskPoint first;
+    memset(&first, 0, sizeof(first));
+    double low[DIMENSIONAL];
+    double high[DIMENSIONAL];
+
+    FILE *input = fopen(piece.name.c_str(), "rb");
+    if (NULL == input)
+    {
+        remove(piece.name.c_str());
+        return false;
+    }
+
+    // the box and a sample of the chunk
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        low[dim] = HUGE_VAL;
+        high[dim] = -HUGE_VAL;
+    }
+    sample.reserve(sampleSize);
+    long long index = 0;
+    size_t got = 0;
+    while ((got = fread(block.data(), recordSize, blockSize, input)) > 0)
+    {
+        for (size_t item = 0; item < got; ++item, ++index)
+        {
+            const CDiskPoint &point = block[item];
+            if (index == 0)
+            {
+                first = point;
+            }
+            for (int dim = 0; dim < DIMENSIONAL; ++dim)
+            {
+                low[dim] = min(low[dim], point.coord[dim]);
+                high[dim] = max(high[dim], point.coord[dim]);
+            }
+            if ((index % stride == 0)
+                && (static_cast<long long>(sample.size()) < sampleSize))
+            {
+                sample.push_back(point);
+            }
+        }
+    }
+    int axis = 0;
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        if (high[dim] - low[dim] > high[axis] - low[axis])
+        {
+            axis = dim;
+        }
+    }
+
+    // every point at one place: only the first one stays
+    if ((index == 0) || (high[axis] <= low[axis]))
+    {
+        fclose(input);
+        CPart single = piece;
+        single.count = min(index, 1LL);
+        FILE *file = fopen(piece.name.c_str(), "wb");
+        bool bOk = (NULL != file)
+                   && (fwrite(&first, recordSize, single.count, file)
+                       == static_cast<size_t>(single.count));
+        if (NULL != file)
+        {
+            bOk = (fclose(file) == 0) && bOk;
+        }
+        pending.push_back(single);
+        return bOk;
+    }
+
+    // the plane, with points on both sides
+    size_t mid = sample.size() / 2;
+    nth_element(sample.begin(), sample.begin() + mid, sample.end()
+                , [axis](const CDiskPoint &a, const CDiskPoint &b)
+                {
+                    return a.coord[axis] < b.coord[axis];
+                });
+    double value = sample[mid].coord[axis];
+    if (value <= low[axis])
+    {
+        value = low[axis] + (high[axis] - low[axis]) / 2;
+        if (value <= low[axis])
+        {
+            value = high[axis];
+        }
+    }
+    vector<CDiskPoint>().swap(sample);
+
+    // each point to the file of its side
+    CPart side[2];
+    FILE *output[2];
+    vector<CDiskPoint> buffer[2];
+    bool bOk = true;
+    for (int s = 0; s < 2; ++s)
+    {
+        side[s].name = string(indexFile) + ".part" + to_string(nextPart++);
+        side[s].count = 0;
+        side[s].node = static_cast<int>(top.size()) + s;
+        output[s] = fopen(side[s].name.c_str(), "wb");
+        bOk = bOk && (NULL != output[s]);
+        buffer[s].reserve(blockSize);
+    }
+    rewind(input);
+    while (bOk && ((got = fread(block.data(), recordSize, blockSize, input))
+                   > 0))
+    {
+        for (size_t item = 0; item < got; ++item)
+        {
+            int s = (block[item].coord[axis] < value) ? 0 : 1;
+            buffer[s].push_back(block[item]);
+            ++side[s].count;
+        }
+        for (int s = 0; s < 2; ++s)
+        {
+            bOk = bOk && (fwrite(buffer[s].data(), recordSize
+                                 , buffer[s].size(), output[s])
+                          == buffer[s].size());
+            buffer[s].clear();
+        }
+    }
+    fclose(input);
+    remove(piece.name.c_str());
+    for (int s = 0; s < 2; ++s)
+    {
+        if ((NULL != output[s]) && (fclose(output[s]) != 0))
+        {
+            bOk = false;
+        }
+    }
+
+    // the leaf becomes the plane, each side a new leaf
+    CTopNode leaf;
+    memset(&leaf, 0, sizeof(leaf));
+    leaf.axis = -1;
+    leaf.right = -1;
+    top[piece.node].axis = axis;
+    top[piece.node].left = side[0].node;
+    top[piece.node].right = side[1].node;
+    top[piece.node].value = value;
+    top.push_back(leaf);
+    top.push_back(leaf);
+    pending.push_back(side[1]);
+    pending.push_back(side[0]);
+    return bOk;
+
+}  // end of "CDiskIndex<NodeType>::SplitPart"
+
+
+
+// ==== CDiskIndex::SplitSample ===============================================
+//
+// This recursive function cuts sample[first] to sample[last - 1] into
+// "numChunks" parts of about the same size by median planes on the axis of
+// widest spread, and adds the nodes to the top tree (a node before its
+// children). A part with too few sample points to cut becomes one chunk.
+//
+// Access: protected
+//
+// Input:
+//      sample [IN/OUT] -- the sample, reordered
+//      first [IN]      -- index of the first sample point
+//      last [IN]       -- index past the last sample point
+//      numChunks [IN]  -- number of chunk wanted
+//      top [IN/OUT]    -- the top tree
+//      nextChunk [IN/OUT]  -- number of the next chunk
+//
+// Output:
+//      The index of the node in the top tree.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CDiskIndex<NodeType>::SplitSample(vector<CDiskPoint> &sample
+                                          , const int first, const int last
+                                          , const int numChunks
+                                          , vector<CTopNode> &top
+                                          , int &nextChunk)
+{
+    int node = static_cast<int>(top.size());
+    top.push_back(CTopNode());
+    memset(&top[node], 0, sizeof(CTopNode));
+    if ((numChunks <= 1) || (last - first < 2))
+    {
+        top[node].axis = -1;
+        top[node].left = nextChunk++;
+        top[node].right = -1;
+        return node;
+    }
+
+    double low[DIMENSIONAL];
+    double high[DIMENSIONAL];
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        low[dim] = HUGE_VAL;
+        high[dim] = -HUGE_VAL;
+    }
+    for (int index = first; index < last; ++index)
+    {
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            low[dim] = min(low[dim], sample[index].coord[dim]);
+            high[dim] = max(high[dim], sample[index].coord[dim]);
+        }
+    }
+    int axis = 0;
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        if (high[dim] - low[dim] > high[axis] - low[axis])
+        {
+            axis = dim;
+        }
+    }
+
+    // the left part gets its share of the chunks and of the sample
+    int leftChunks = numChunks / 2;
+    int mid = first + static_cast<int>(1LL * (last - first) * leftChunks
+                                       / numChunks);
+    nth_element(sample.begin() + first, sample.begin() + mid
+                , sample.begin() + last
+                , [axis](const CDiskPoint &a, const CDiskPoint &b)
+                {
+                    return a.coord[axis] < b.coord[axis];
+                });
+    double value = sample[mid].coord[axis];
+    int left = SplitSample(sample, first, mid, leftChunks, top, nextChunk);
+    int right = SplitSample(sample, mid, last, numChunks - leftChunks, top
+                            , nextChunk);
+    top[node].axis = axis;
+    top[node].left = left;
+    top[node].right = right;
+    top[node].value = value;
+    return node;
+
+}  // end of "CDiskIndex<NodeType>::SplitSample"
+
+
+
+// ==== CDiskIndex::UniquePoints ==============================================
+//
+// This function removes the points with the same coordinates as an earlier
+// point, like CBSTree::UniqueItems: the first point of each group (in the
+// order of the input, which a chunk file keeps) stays. Repeated points
+// always fall in the same chunk, so this is done per chunk.
+//
+// Access: protected
+//
+// Input:
+//      points [IN/OUT] -- the points of a chunk, sorted by coordinates here
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CDiskIndex<NodeType>::UniquePoints(vector<CDiskPoint> &points)
+{
+    auto lessCoord = [](const CDiskPoint &a, const CDiskPoint &b)
+    {
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            if (a.coord[dim] != b.coord[dim])
+            {
+                return a.coord[dim] < b.coord[dim];
+            }
+        }
+        return false;
+    };
+    stable_sort(points.begin(), points.end(), lessCoord);
+    points.erase(unique(points.begin(), points.end()
+                        , [lessCoord](const CDiskPoint &a, const CDiskPoint &b)
+                          { return !lessCoord(a, b) && !lessCoord(b, a); })
+                 , points.end());
+
+}  // end of "CDiskIndex<NodeType>::UniquePoints"
+
+
+
+// ==== CDiskIndex::WritePoints ===============================================
+//
+// This function writes points as CDiskPoint records, the input of Build. A
+// large point set can be written a block at a time with "bAppend".
+//
+// Access: public
+//
+// Input:
+//      pointFile [IN]  -- name of the file
+//      items [IN]      -- the points
+//      num [IN]        -- number of point
+//      bAppend [IN]    -- add to the end of the file instead of replacing it
+//
+// Output:
+//      True if the points were written, false otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CDiskIndex<NodeType>::WritePoints(const char *pointFile
+                                          , const NodeType items[]
+                                          , const int num
+                                          , const bool bAppend)
+{
+    FILE *file = fopen(pointFile, bAppend ? "ab" : "wb");
+    if (NULL == file)
+    {
+        return false;
+    }
+    vector<CDiskPoint> block;
+    bool bOk = true;
+    for (int first = 0; bOk && (first < num); first += 4096)
+    {
+        int last = min(num, first + 4096);
+        block.resize(last - first);
+        for (int index = first; index < last; ++index)
+        {
+            CDiskPoint &point = block[index - first];
+            point.coord[0] = items[index].GetXCoord();
+            point.coord[1] = items[index].GetYCoord();
+            point.coord[2] = items[index].GetZCoord();
+            point.name = items[index].GetName();
+            point.axis = 0;
+        }
+        bOk = (fwrite(block.data(), sizeof(CDiskPoint), block.size(), file)
+               == block.size());
+    }
+    return (fclose(file) == 0) && bOk;
+
+}  // end of "CDiskIndex<NodeType>::WritePoints"
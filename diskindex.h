@@ -0,0 +1,162 @@
+// ============================================================================
+// File: diskindex.h
+// ============================================================================
+// This header file contains the declaration of the CDiskIndex class, a k-d
+// tree index kept in one file, for point sets larger than the memory. Build
+// never holds more than a memory budget of points:
+//
+//      1. it streams the input once and keeps an evenly spaced sample
+//      2. it cuts the sample by median planes (widest axis first) into as
+//         many chunks as it takes for each chunk to fit in a third of the
+//         budget; these planes are the top tree
+//      3. it streams the input again and appends each point to the
+//         temporary file of its chunk
+//      4. it loads one chunk at a time, drops its repeated points, puts it
+//         in k-d order (see LayoutChunk) and writes it to the index, page
+//         aligned; a chunk that came out too large for the budget is first
+//         cut in two (and its leaf of the top tree with it) until it fits
+// Then it writes the top tree and the table of chunks (place, count and
+// bounding box) and removes the temporary files.
+//
+// Open maps the index into memory (mmap): a query walks the top tree,
+// nearest side first, and only searches the chunks whose box may hold a
+// neighbor, so the system reads in only the pages of the chunks it touches.
+// A chunk is an implicit tree, the median of a range is its root, so no
+// pointer is stored and it is used in place. Like CBSTree, a point repeated
+// at the same coordinates is kept once (the first one of the input), and a
+// point at distance 0 of the target is not one of its neighbors, so the
+// answers are those of the tree.
+//
+// The input of Build is a file of CDiskPoint records (WritePoints makes
+// one); the index records have the same layout. Both are in the byte order
+// of the machine.
+// ============================================================================
+
+#ifndef CDISK_INDEX_HEADER
+#define CDISK_INDEX_HEADER
+
+#include    "fieldnode.h"
+#include    "metric.h"
+#include    <string>
+#include    <vector>
+using namespace std;
+
+// one point on disk, 32 bytes
+struct CDiskPoint
+{
+    double  coord[DIMENSIONAL];
+    int     name;
+    int     axis;       // split axis of the point in its chunk
+};
+
+// alignment of the chunks in the index file, a page
+const int DISK_PAGE = 4096;
+
+// default memory budget of Build, in byte
+const long long DISK_BUDGET = 1LL << 30;
+
+template    <typename  NodeType>
+class   CDiskIndex
+{
+public:
+    // constructor and destructor
+    CDiskIndex() : m_base(NULL), m_size(0), m_header(NULL), m_top(NULL)
+                 , m_chunk(NULL) {}
+    ~CDiskIndex() { Close(); }
+
+    // member functions
+    static bool Build(const char *pointFile, const char *indexFile
+                      , const long long memoryBudget = DISK_BUDGET);
+    void    Close();
+    int     GetNumChunks() const;
+    long long   GetNumPoints() const;
+    bool    IsOpen() const { return (NULL != m_base); }
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN) const;
+    template    <typename  Metric>
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN
+                             , const Metric &metric) const;
+    bool    Open(const char *indexFile);
+    static bool WritePoints(const char *pointFile, const NodeType items[]
+                            , const int num, const bool bAppend = false);
+
+protected:
+    // start of the index file
+    struct  CDiskHeader
+    {
+        char        magic[8];
+        int         version;
+        int         numChunks;
+        int         numTop;         // nodes of the top tree, root first
+        int         reserved;
+        long long   numPoints;
+        long long   topOffset;      // byte offset of the top tree
+        long long   chunkOffset;    // byte offset of the chunk table
+    };
+
+    // a node of the top tree: a split plane, or a chunk (axis -1, left is
+    // the chunk number); points below "value" go left
+    struct  CTopNode
+    {
+        int         axis;
+        int         left;
+        int         right;
+        int         reserved;
+        double      value;
+    };
+
+    // a temporary chunk file of Build, and its leaf in the top tree
+    struct  CPart
+    {
+        string      name;
+        long long   count;          // number of point in the file
+        int         node;
+    };
+
+    // an entry of the chunk table
+    struct  CChunk
+    {
+        long long   offset;         // byte offset of the first point
+        long long   count;          // number of point
+        double      low[DIMENSIONAL];
+        double      high[DIMENSIONAL];
+    };
+
+    // member functions
+    static bool CloserThan(const NodeType &a, const NodeType &b);
+    static void LayoutChunk(CDiskPoint points[], const long long first
+                            , const long long last);
+    static int  Route(const vector<CTopNode> &top, const double coord[]);
+    template    <typename  Metric>
+    void    SearchChunk(const CDiskPoint points[], const long long first
+                        , const long long last, const double target[]
+                        , const int num, vector<NodeType> &listN
+                        , const Metric &metric) const;
+    template    <typename  Metric>
+    void    SearchTop(const int node, const double target[], const int num
+                      , vector<NodeType> &listN, const Metric &metric) const;
+    static bool SplitPart(const CPart &piece, const long long capacity
+                          , const char *indexFile, int &nextPart
+                          , vector<CTopNode> &top, vector<CPart> &pending);
+    static int  SplitSample(vector<CDiskPoint> &sample, const int first
+                            , const int last, const int numChunks
+                            , vector<CTopNode> &top, int &nextChunk);
+    static void UniquePoints(vector<CDiskPoint> &points);
+
+private:
+    // no copy, it owns the mapping
+    CDiskIndex(const CDiskIndex &other);
+    CDiskIndex& operator=(const CDiskIndex &rhs);
+
+    // data members
+    const char          *m_base;        // the mapped file, NULL if closed
+    size_t              m_size;         // its size in byte
+    const CDiskHeader   *m_header;
+    const CTopNode      *m_top;
+    const CChunk        *m_chunk;
+};
+
+#include    "diskindex.cpp"
+
+#endif  // CDISK_INDEX_HEADER
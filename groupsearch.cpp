@@ -0,0 +1,357 @@
+// ============================================================================
+// File: groupsearch.cpp
+// ============================================================================
+// This header file contains the implementation of the CGroupSearch class. It
+// uses the template parameter "NodeType" for the type of the points and
+// "Metric" for the distance metric (see metric.h).
+// ============================================================================
+
+#include    <algorithm>
+using namespace std;
+#include    "groupsearch.h"
+#include    "parallel.h"
+
+// ==== CGroupSearch::Finish ==================================================
+//
+// This function turns the heap of a finished query into its result: sorted,
+// nearest first, with real distances (like CBSTree::NearestNeighbors).
+//
+// Access: protected
+//
+// Input:
+//      query [IN/OUT]  -- the finished query
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CGroupSearch<NodeType, Metric>::Finish(CQuery &query) const
+{
+    vector<NodeType> &listN = *query.listN;
+    sort_heap(listN.begin(), listN.end(), CBSTree<NodeType>::CloserThan);
+    for (auto it = listN.begin(); it != listN.end(); ++it)
+    {
+        (*it).SetDistance(m_metric.Distance((*it).GetDistance()));
+    }
+
+}  // end of "CGroupSearch<NodeType, Metric>::Finish"
+
+
+
+// ==== CGroupSearch::NearestNeighbors ========================================
+//
+// This function finds the "num" nearest neighbors of every target, nearest
+// first. The targets are cut into blocks of GROUP_BLOCK, each searched by
+// one thread in interleaved groups (see SearchBlock). The tree must not
+// change during the search.
+//
+// Access: public
+//
+// Input:
+//      targets [IN]    -- the target points
+//      count [IN]      -- number of target
+//      num [IN]        -- number of nearest neighbor
+//      listN [OUT]     -- listN[i] are the neighbors of targets[i], sorted by
+//                         distance
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CGroupSearch<NodeType, Metric>::NearestNeighbors(
+                                            const NodeType targets[]
+                                            , const int count, const int num
+                                            , vector<NodeType> listN[]
+                                            , const int numThreads) const
+{
+    int numBlocks = (max(count, 0) + GROUP_BLOCK - 1) / GROUP_BLOCK;
+    ParallelFor(0, numBlocks, numThreads, [&](int, int block)
+    {
+        int first = block * GROUP_BLOCK;
+        SearchBlock(targets, first, min(count, first + GROUP_BLOCK), num
+                    , listN);
+    }, 1);
+
+}  // end of "CGroupSearch<NodeType, Metric>::NearestNeighbors"
+
+
+
+// ==== CGroupSearch::Prefetch ================================================
+//
+// This function asks the processor to start loading a node into the cache,
+// without waiting for it.
+//
+// Access: protected
+//
+// Input:
+//      nodePtr [IN]    -- the node
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CGroupSearch<NodeType, Metric>::Prefetch(
+                                        const CTreeNode<NodeType> *nodePtr)
+{
+#ifdef __GNUC__
+    const char *byte = reinterpret_cast<const char*>(nodePtr);
+    for (size_t line = 0; line < sizeof(CTreeNode<NodeType>); line += 64)
+    {
+        __builtin_prefetch(byte + line);
+    }
+#endif
+
+}  // end of "CGroupSearch<NodeType, Metric>::Prefetch"
+
+
+
+// ==== CGroupSearch::SearchBlock =============================================
+//
+// This function searches targets[first] to targets[last - 1] on the calling
+// thread. Up to "m_groupSize" queries are in flight; they take one step each
+// in turn, and a finished query hands its place to the next target.
+//
+// Access: protected
+//
+// Input:
+//      targets [IN]    -- the target points
+//      first [IN]      -- index of the first target
+//      last [IN]       -- index past the last target
+//      num [IN]        -- number of nearest neighbor
+//      listN [OUT]     -- the neighbors of each target
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CGroupSearch<NodeType, Metric>::SearchBlock(const NodeType targets[]
+                                                    , const int first
+                                                    , const int last
+                                                    , const int num
+                                                    , vector<NodeType> listN[]
+                                                    ) const
+{
+    vector<CQuery> group(max(0, min(m_groupSize, last - first)));
+    int next = first;
+    int active = 0;
+
+    for (auto it = group.begin(); it != group.end(); ++it)
+    {
+        Start(*it, targets[next], num, listN[next]);
+        ++next;
+        ++active;
+    }
+    while (active > 0)
+    {
+        for (auto it = group.begin(); it != group.end(); ++it)
+        {
+            if ((NULL == it->listN) || Step(*it, num))
+            {
+                continue;
+            }
+            Finish(*it);
+            if (next < last)
+            {
+                Start(*it, targets[next], num, listN[next]);
+                ++next;
+            }
+            else
+            {
+                it->listN = NULL;
+                --active;
+            }
+        }
+    }
+
+}  // end of "CGroupSearch<NodeType, Metric>::SearchBlock"
+
+
+
+// ==== CGroupSearch::Start ===================================================
+//
+// This function sets a query up at the root of the tree.
+//
+// Access: protected
+//
+// Input:
+//      query [OUT]     -- the state of the query
+//      target [IN]     -- the target point
+//      num [IN]        -- number of nearest neighbor
+//      listN [IN]      -- gets the neighbors
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CGroupSearch<NodeType, Metric>::Start(CQuery &query
+                                              , const NodeType &target
+                                              , const int num
+                                              , vector<NodeType> &listN) const
+{
+    query.target[0] = target.GetXCoord();
+    query.target[1] = target.GetYCoord();
+    query.target[2] = target.GetZCoord();
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        query.offset[dim] = 0;
+    }
+    query.nodePtr = (num > 0) ? m_tree.m_root : NULL;
+    query.bCheckBox = false;
+    query.stack.clear();
+    query.listN = &listN;
+    listN.clear();
+    if (NULL != query.nodePtr)
+    {
+        listN.reserve(num);
+        Prefetch(query.nodePtr);
+    }
+
+}  // end of "CGroupSearch<NodeType, Metric>::Start"
+
+
+
+// ==== CGroupSearch::Step ====================================================
+//
+// This function takes one step of a query. With a node to look at, it
+// prunes the node by its box if asked, or offers the point of the node to
+// the neighbors, keeps the far side on the stack (with the gap of its cell)
+// and moves to the near side. Without one, it takes the top of the stack if
+// its cell can still hold a neighbor. The node of the next step is
+// prefetched. These are the steps of CBSTree::OptNeighbor, in its order.
+//
+// Access: protected
+//
+// Input:
+//      query [IN/OUT]  -- the state of the query
+//      num [IN]        -- number of nearest neighbor
+//
+// Output:
+//      True if the query has more steps, false if it is done.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+bool    CGroupSearch<NodeType, Metric>::Step(CQuery &query, const int num) const
+{
+    const CTreeNode<NodeType> *nodePtr = query.nodePtr;
+    vector<NodeType> &listN = *query.listN;
+    bool bFull = (static_cast<int>(listN.size()) >= num);
+
+    if (NULL == nodePtr)
+    {
+        // the next far side whose cell is close enough, checked by its box
+        // at the next step
+        while (!query.stack.empty())
+        {
+            const CFrame &frame = query.stack.back();
+            bool bVisit = !bFull;
+            if (bFull)
+            {
+                double cellDist = m_metric.Term(frame.offset[0], 0);
+                for (int dim = 1; dim < DIMENSIONAL; ++dim)
+                {
+                    cellDist = m_metric.Accumulate(cellDist
+                                    , m_metric.Term(frame.offset[dim], dim));
+                }
+                bVisit = (cellDist < listN.front().GetDistance());
+            }
+            if (bVisit)
+            {
+                query.nodePtr = frame.nodePtr;
+                for (int dim = 0; dim < DIMENSIONAL; ++dim)
+                {
+                    query.offset[dim] = frame.offset[dim];
+                }
+                query.bCheckBox = bFull;
+                query.stack.pop_back();
+                Prefetch(query.nodePtr);
+                return true;
+            }
+            query.stack.pop_back();
+        }
+        return false;
+    }
+
+    if (query.bCheckBox
+        && (CBSTree<NodeType>::BoxDistance(nodePtr, query.target, m_metric)
+            >= listN.front().GetDistance()))
+    {
+        query.nodePtr = NULL;
+        return true;
+    }
+
+    // offer the point of the node, the target itself (distance 0) is skipped
+    double coord[DIMENSIONAL] = {nodePtr->m_value.GetXCoord()
+                                 , nodePtr->m_value.GetYCoord()
+                                 , nodePtr->m_value.GetZCoord()};
+    double dist = m_metric.Term(m_metric.Gap(coord[0], query.target[0], 0)
+                                , 0);
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        dist = m_metric.Accumulate(dist, m_metric.Term(
+                        m_metric.Gap(coord[dim], query.target[dim], dim), dim));
+    }
+    if (dist > 0)
+    {
+        if (!bFull)
+        {
+            listN.push_back(nodePtr->m_value);
+            listN.back().SetDistance(dist);
+            push_heap(listN.begin(), listN.end()
+                      , CBSTree<NodeType>::CloserThan);
+        }
+        else if (dist < listN.front().GetDistance())
+        {
+            pop_heap(listN.begin(), listN.end()
+                     , CBSTree<NodeType>::CloserThan);
+            listN.back() = nodePtr->m_value;
+            listN.back().SetDistance(dist);
+            push_heap(listN.begin(), listN.end()
+                      , CBSTree<NodeType>::CloserThan);
+        }
+    }
+
+    // keep the far side for later, go on with the near side
+    int    axis = nodePtr->m_axis;
+    double delta = query.target[axis] - coord[axis];
+    const CTreeNode<NodeType> *nearPtr = nodePtr->m_right;
+    const CTreeNode<NodeType> *farPtr = nodePtr->m_left;
+    if (delta < 0)
+    {
+        nearPtr = nodePtr->m_left;
+        farPtr = nodePtr->m_right;
+    }
+    if (NULL != farPtr)
+    {
+        CFrame frame;
+        frame.nodePtr = farPtr;
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            frame.offset[dim] = query.offset[dim];
+        }
+        frame.offset[axis] = max(query.offset[axis]
+                                 , m_metric.HalfSpaceGap(query.target[axis]
+                                                         , coord[axis]
+                                                         , delta < 0, axis));
+        query.stack.push_back(frame);
+    }
+    query.nodePtr = nearPtr;
+    query.bCheckBox = false;
+    if (NULL != nearPtr)
+    {
+        Prefetch(nearPtr);
+    }
+    return true;
+
+}  // end of "CGroupSearch<NodeType, Metric>::Step"
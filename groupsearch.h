@@ -0,0 +1,91 @@
+// ============================================================================
+// File: groupsearch.h
+// ============================================================================
+// This header file contains the declaration of the CGroupSearch class. It
+// finds the nearest neighbors of many targets on one CBSTree, a group of
+// queries at a time, to hide the memory latency of the tree. One search
+// walks from a node to a child that is seldom in the cache, and waits for it
+// at every level. Here each query of the group is a small state machine
+// with its own stack of subtrees to look at (the same order and pruning as
+// CBSTree::NearestNeighbors); a step of a query handles one node and
+// prefetches the node of its next step, then the next query of the group
+// takes a step. By the time a query comes back to its node, the node is on
+// its way from memory, so the loads of the group overlap.
+//
+// The group size is a trade: it must cover the memory latency (8 to 16
+// queries), and the states of the group must stay in the L1 cache. Trees
+// that fit in the cache gain nothing and lose a little to the switching.
+// ============================================================================
+
+#ifndef CGROUP_SEARCH_HEADER
+#define CGROUP_SEARCH_HEADER
+
+#include    "cbstree.h"
+#include    "ctreenode.h"
+#include    "fieldnode.h"
+#include    "metric.h"
+#include    <vector>
+using namespace std;
+
+// default number of interleaved queries, and queries given to a thread at
+// a time
+const int QUERY_GROUP = 8;
+const int GROUP_BLOCK = 256;
+
+template    <typename  NodeType, typename  Metric = CEuclideanMetric>
+class   CGroupSearch
+{
+public:
+    // constructor
+    CGroupSearch(const CBSTree<NodeType> &tree
+                 , const int groupSize = QUERY_GROUP
+                 , const Metric &metric = Metric())
+        : m_tree(tree), m_metric(metric)
+        , m_groupSize((groupSize > 0) ? groupSize : 1) {}
+
+    // member functions
+    int     GetGroupSize() const { return m_groupSize; }
+    void    NearestNeighbors(const NodeType targets[], const int count
+                             , const int num, vector<NodeType> listN[]
+                             , const int numThreads = 1) const;
+
+protected:
+    // a subtree a query still has to look at, with the gap from the target
+    // to its cell along each axis
+    struct  CFrame
+    {
+        const CTreeNode<NodeType>   *nodePtr;
+        double                      offset[DIMENSIONAL];
+    };
+
+    // the state of one query of the group
+    struct  CQuery
+    {
+        double                      target[DIMENSIONAL];
+        const CTreeNode<NodeType>   *nodePtr;   // node of the next step
+        double                      offset[DIMENSIONAL];
+        bool                        bCheckBox;  // prune nodePtr by its box
+        vector<CFrame>              stack;      // far sides, last on top
+        vector<NodeType>            *listN;     // heap of the neighbors
+    };
+
+    // member functions
+    void    Finish(CQuery &query) const;
+    static void Prefetch(const CTreeNode<NodeType> *nodePtr);
+    void    SearchBlock(const NodeType targets[], const int first
+                        , const int last, const int num
+                        , vector<NodeType> listN[]) const;
+    void    Start(CQuery &query, const NodeType &target, const int num
+                  , vector<NodeType> &listN) const;
+    bool    Step(CQuery &query, const int num) const;
+
+private:
+    // data members
+    const CBSTree<NodeType> &m_tree;
+    Metric                  m_metric;
+    int                     m_groupSize;
+};
+
+#include    "groupsearch.cpp"
+
+#endif  // CGROUP_SEARCH_HEADER
@@ -0,0 +1,803 @@
+// ============================================================================
+// File: knnjoin.cpp
+// ============================================================================
+// This header file contains the implementation of the CKnnJoin class. It uses
+// the template parameter "NodeType" for the type of the points and "Metric"
+// for the distance metric (see metric.h).
+// ============================================================================
+
+#include    <algorithm>
+#include    <cmath>
+using namespace std;
+#include    "knnjoin.h"
+#include    "parallel.h"
+
+// ==== CKnnJoin::BaseCase ====================================================
+//
+// This function compares every query point of an item with every reference
+// point of another item, then updates the bounds of the query subtree. A
+// query that is not closer to the reference box than its worst neighbor is
+// skipped. With "bBoth" the two items are of the same tree (all-kNN) and each
+// distance is offered to both points; an item paired with itself compares
+// each pair of its points once.
+//
+// Access: protected
+//
+// Input:
+//      queryItem [IN]      -- an item of the query tree
+//      referenceItem [IN]  -- an item of the reference tree
+//      bBoth [IN]          -- also offer the query points to the references
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::BaseCase(const int queryItem
+                                             , const int referenceItem
+                                             , const bool bBoth)
+{
+    int queryFirst = queryItem >> 1;
+    int queryLast = queryFirst + Count(m_query, queryItem);
+    int referenceFirst = referenceItem >> 1;
+    int referenceLast = referenceFirst + Count(*m_refPtr, referenceItem);
+    bool bSame = bBoth && (queryItem == referenceItem);
+    bool bSkip = !bBoth && !(referenceItem & 1);
+
+    for (int query = queryFirst; query < queryLast; ++query)
+    {
+        const double *queryCoord = &m_query.coord[DIMENSIONAL * query];
+        if (bSkip && (CBSTree<NodeType>::BoxDistance(
+                                        m_refPtr->node[referenceFirst]
+                                        , queryCoord, m_metric)
+                      >= m_kth[query]))
+        {
+            continue;
+        }
+        for (int reference = bSame ? query + 1 : referenceFirst
+             ; reference < referenceLast; ++reference)
+        {
+            double dist = PointDist(queryCoord
+                                    , &m_refPtr->coord[DIMENSIONAL
+                                                       * reference]);
+            if (dist > 0)
+            {
+                Offer(query, dist, reference);
+                if (bBoth)
+                {
+                    Offer(reference, dist, query);
+                }
+            }
+        }
+    }
+    UpdateBounds(queryItem);
+    if (bBoth && !bSame)
+    {
+        UpdateBounds(referenceItem);
+    }
+
+}  // end of "CKnnJoin<NodeType, Metric>::BaseCase"
+
+
+
+// ==== CKnnJoin::Bound =======================================================
+//
+// This function returns the bound of an item: no new neighbor of a query
+// under it can be farther than that. It is the worst neighbor of the point,
+// or the worst one under the subtree, HUGE_VAL until a query has "num"
+// neighbors.
+//
+// Access: protected
+//
+// Input:
+//      item [IN]   -- an item of the query tree
+//
+// Output:
+//      The reduced bound.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+double  CKnnJoin<NodeType, Metric>::Bound(const int item) const
+{
+    return (item & 1) ? m_kth[item >> 1] : m_bound[item >> 1];
+
+}  // end of "CKnnJoin<NodeType, Metric>::Bound"
+
+
+
+// ==== CKnnJoin::Count =======================================================
+//
+// This function returns the number of point of an item.
+//
+// Access: protected
+//
+// Input:
+//      flat [IN]   -- the tree of the item
+//      item [IN]   -- the item
+//
+// Output:
+//      1 for a point, the size of the subtree otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+int     CKnnJoin<NodeType, Metric>::Count(const CFlatTree &flat
+                                          , const int item)
+{
+    return (item & 1) ? 1 : flat.node[item >> 1]->m_count;
+
+}  // end of "CKnnJoin<NodeType, Metric>::Count"
+
+
+
+// ==== CKnnJoin::Flatten =====================================================
+//
+// This function numbers the nodes of a tree in pre-order, so the results and
+// the bounds of each node can be kept in arrays. It uses its own stack, a
+// tree built by insertion can be deep.
+//
+// Access: protected
+//
+// Input:
+//      root [IN]   -- root of the tree (may be NULL)
+//      flat [OUT]  -- the nodes and the index of their children
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::Flatten(const CTreeNode<NodeType> *root
+                                            , CFlatTree &flat)
+{
+    vector<pair<const CTreeNode<NodeType>*, int> > stack;    // node, parent
+    vector<bool> bLeft;
+
+    flat.node.clear();
+    flat.left.clear();
+    flat.right.clear();
+    flat.coord.clear();
+    if (NULL == root)
+    {
+        return;
+    }
+    stack.push_back(make_pair(root, -1));
+    bLeft.push_back(false);
+    while (!stack.empty())
+    {
+        const CTreeNode<NodeType> *nodePtr = stack.back().first;
+        int parent = stack.back().second;
+        bool bLeftChild = bLeft.back();
+        int index = static_cast<int>(flat.node.size());
+        stack.pop_back();
+        bLeft.pop_back();
+
+        flat.node.push_back(nodePtr);
+        flat.left.push_back(-1);
+        flat.right.push_back(-1);
+        flat.coord.push_back(nodePtr->m_value.GetXCoord());
+        flat.coord.push_back(nodePtr->m_value.GetYCoord());
+        flat.coord.push_back(nodePtr->m_value.GetZCoord());
+        if (parent >= 0)
+        {
+            (bLeftChild ? flat.left : flat.right)[parent] = index;
+        }
+
+        // the left child comes out first
+        if (NULL != nodePtr->m_right)
+        {
+            stack.push_back(make_pair(nodePtr->m_right, index));
+            bLeft.push_back(false);
+        }
+        if (NULL != nodePtr->m_left)
+        {
+            stack.push_back(make_pair(nodePtr->m_left, index));
+            bLeft.push_back(true);
+        }
+    }
+
+}  // end of "CKnnJoin<NodeType, Metric>::Flatten"
+
+
+
+// ==== CKnnJoin::Join ========================================================
+//
+// This function finds the "num" nearest neighbors in "reference" of every
+// point of "query". The query tree is cut into subtrees of about
+// n / (16 * threads) points (at least JOIN_MIN_TASK); each one is a task, and
+// so is the point of each node above them. Against another tree, the queries
+// of a task are first seeded (see Seed), then the task is paired with the
+// whole reference tree. When "query" and "reference" are
+// the same tree, a task first pairs its subtree with itself, computing each
+// distance once for both points, then with the rest of the tree, nearest
+// part first. The trees must not change during the join.
+//
+// Access: public
+//
+// Input:
+//      query [IN]      -- the tree of the query points
+//      reference [IN]  -- the tree of the candidate neighbors (may be
+//                         "query" itself)
+//      num [IN]        -- number of neighbor of each query
+//      point [OUT]     -- the query points, in pre-order of their tree
+//      listN [OUT]     -- listN[i] are the neighbors of point[i], nearest
+//                         first, with their distance in the metric
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::Join(const CBSTree<NodeType> &query
+                                         , const CBSTree<NodeType> &reference
+                                         , const int num
+                                         , vector<NodeType> &point
+                                         , vector<vector<NodeType> > &listN
+                                         , const int numThreads)
+{
+    vector<int>     task;       // items of the query tree
+    vector<int>     top;        // point items above the task subtrees
+    vector<int>     walk;
+
+    m_num = max(num, 0);
+    m_bSelf = (&query == &reference);
+    Flatten(query.m_root, m_query);
+    Flatten(m_bSelf ? NULL : reference.m_root, m_reference);
+    m_refPtr = m_bSelf ? &m_query : &m_reference;
+
+    int numQuery = static_cast<int>(m_query.node.size());
+    m_heap.assign(numQuery, vector<pair<double, int> >());
+    m_kth.assign(numQuery, HUGE_VAL);
+    m_bound.assign(numQuery, HUGE_VAL);
+
+    // cut the query tree into tasks
+    int threads = GetNumThreads(numThreads);
+    if ((numQuery > 0) && (m_num > 0) && !m_refPtr->node.empty())
+    {
+        int grain = max(JOIN_MIN_TASK, numQuery / (16 * threads));
+        walk.push_back(0);
+        while (!walk.empty())
+        {
+            int index = walk.back();
+            walk.pop_back();
+            if (m_query.node[index]->m_count <= grain)
+            {
+                task.push_back(2 * index);
+                continue;
+            }
+            top.push_back(2 * index + 1);
+            if (m_query.left[index] >= 0)
+                walk.push_back(m_query.left[index]);
+            if (m_query.right[index] >= 0)
+                walk.push_back(m_query.right[index]);
+        }
+        task.insert(task.end(), top.begin(), top.end());
+    }
+
+    // search each task on its own
+    ParallelFor(0, static_cast<int>(task.size()), threads, [&](int, int index)
+    {
+        int item = task[index];
+        if (!m_bSelf && !(item & 1))
+        {
+            Seed(item);
+        }
+        if (!m_bSelf || (item & 1))
+        {
+            Pair(item, 0, MinDist(m_query, item, *m_refPtr, 0));
+            return;
+        }
+
+        // all-kNN: the subtree with itself, then the other tasks and the
+        // points above them
+        vector<pair<double, int> > other;
+        SymPair(item, item);
+        for (auto it = task.begin(); it != task.end(); ++it)
+        {
+            if (*it != item)
+            {
+                other.push_back(make_pair(MinDist(m_query, item, m_query
+                                                  , *it)
+                                          , *it));
+            }
+        }
+        sort(other.begin(), other.end());
+        for (auto it = other.begin(); it != other.end(); ++it)
+        {
+            Pair(item, it->second, it->first);
+        }
+    }, 1);
+
+    // hand out the results nearest first
+    point.resize(numQuery);
+    listN.resize(numQuery);
+    ParallelFor(0, numQuery, threads, [&](int, int index)
+    {
+        vector<pair<double, int> > &heap = m_heap[index];
+        sort_heap(heap.begin(), heap.end());
+        point[index] = m_query.node[index]->m_value;
+        listN[index].resize(heap.size());
+        for (size_t rank = 0; rank < heap.size(); ++rank)
+        {
+            listN[index][rank] = m_refPtr->node[heap[rank].second]->m_value;
+            listN[index][rank].SetDistance(m_metric.Distance(
+                                                    heap[rank].first));
+        }
+        vector<pair<double, int> >().swap(heap);
+    });
+
+}  // end of "CKnnJoin<NodeType, Metric>::Join"
+
+
+
+// ==== CKnnJoin::MinDist =====================================================
+//
+// This function returns the reduced distance between the boxes of two items:
+// the bounding box of a subtree, or a point.
+//
+// Access: protected
+//
+// Input:
+//      flatA, itemA [IN]   -- the first item and its tree
+//      flatB, itemB [IN]   -- the second item and its tree
+//
+// Output:
+//      The reduced distance, 0 if the boxes meet.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+double  CKnnJoin<NodeType, Metric>::MinDist(const CFlatTree &flatA
+                                            , const int itemA
+                                            , const CFlatTree &flatB
+                                            , const int itemB) const
+{
+    const CTreeNode<NodeType> *nodeA = flatA.node[itemA >> 1];
+    const CTreeNode<NodeType> *nodeB = flatB.node[itemB >> 1];
+    double pointA[DIMENSIONAL] = {nodeA->m_value.GetXCoord()
+                                  , nodeA->m_value.GetYCoord()
+                                  , nodeA->m_value.GetZCoord()};
+    double pointB[DIMENSIONAL] = {nodeB->m_value.GetXCoord()
+                                  , nodeB->m_value.GetYCoord()
+                                  , nodeB->m_value.GetZCoord()};
+    const double *lowA = (itemA & 1) ? pointA : nodeA->m_low;
+    const double *highA = (itemA & 1) ? pointA : nodeA->m_high;
+    const double *lowB = (itemB & 1) ? pointB : nodeB->m_low;
+    const double *highB = (itemB & 1) ? pointB : nodeB->m_high;
+
+    double dist = m_metric.Term(m_metric.BoxGap(lowA[0], highA[0], lowB[0]
+                                                , highB[0], 0)
+                                , 0);
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        dist = m_metric.Accumulate(dist, m_metric.Term(
+                        m_metric.BoxGap(lowA[dim], highA[dim], lowB[dim]
+                                        , highB[dim], dim)
+                        , dim));
+    }
+    return dist;
+
+}  // end of "CKnnJoin<NodeType, Metric>::MinDist"
+
+
+
+// ==== CKnnJoin::Offer =======================================================
+//
+// This function offers a reference point to the neighbors of a query; it
+// replaces the worst one if the query already has "num" of them. Against
+// another tree, a point given by Seed can be offered again by the walk, and
+// is then not added twice.
+//
+// Access: protected
+//
+// Input:
+//      query [IN]      -- index of the query node
+//      dist [IN]       -- reduced distance between the two points
+//      reference [IN]  -- index of the reference node
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::Offer(const int query, const double dist
+                                          , const int reference)
+{
+    if (dist >= m_kth[query])
+    {
+        return;
+    }
+    vector<pair<double, int> > &heap = m_heap[query];
+    if (!m_bSelf)
+    {
+        for (auto it = heap.begin(); it != heap.end(); ++it)
+        {
+            if (it->second == reference)
+            {
+                return;
+            }
+        }
+    }
+    if (static_cast<int>(heap.size()) < m_num)
+    {
+        heap.push_back(make_pair(dist, reference));
+        push_heap(heap.begin(), heap.end());
+    }
+    else if (dist < heap.front().first)
+    {
+        pop_heap(heap.begin(), heap.end());
+        heap.back() = make_pair(dist, reference);
+        push_heap(heap.begin(), heap.end());
+    }
+    if (static_cast<int>(heap.size()) == m_num)
+    {
+        m_kth[query] = heap.front().first;
+    }
+
+}  // end of "CKnnJoin<NodeType, Metric>::Offer"
+
+
+
+// ==== CKnnJoin::Pair ========================================================
+//
+// This function searches the neighbors of the queries of one item among the
+// points of a reference item. The pair is skipped when the boxes are not
+// closer than the bound of the queries. Otherwise the item with the most
+// points is split: a query subtree into its point and its two sides (then
+// its bound is updated), a reference subtree the same way, nearest part
+// first. Items with few points are compared point by point (BaseCase).
+//
+// Access: protected
+//
+// Input:
+//      queryItem [IN]      -- an item of the query tree
+//      referenceItem [IN]  -- an item of the reference tree
+//      dist [IN]           -- reduced distance between their boxes
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::Pair(const int queryItem
+                                         , const int referenceItem
+                                         , const double dist)
+{
+    int part[3];
+    int numPart = 0;
+
+    if (dist >= Bound(queryItem))
+    {
+        return;
+    }
+
+    // few points, compare them all
+    int queryCount = Count(m_query, queryItem);
+    int referenceCount = Count(*m_refPtr, referenceItem);
+    if (queryCount * referenceCount <= JOIN_LEAF_PAIRS)
+    {
+        BaseCase(queryItem, referenceItem, false);
+        return;
+    }
+
+    // split the query side
+    if (!(queryItem & 1) && (queryCount >= referenceCount))
+    {
+        numPart = Split(m_query, queryItem, part);
+        for (int index = 0; index < numPart; ++index)
+        {
+            Pair(part[index], referenceItem, MinDist(m_query, part[index]
+                                                     , *m_refPtr
+                                                     , referenceItem));
+        }
+        UpdateBound(queryItem);
+        return;
+    }
+
+    // split the reference side, nearest part first
+    pair<double, int> order[3];
+    numPart = Split(*m_refPtr, referenceItem, part);
+    for (int index = 0; index < numPart; ++index)
+    {
+        order[index] = make_pair(MinDist(m_query, queryItem, *m_refPtr
+                                         , part[index])
+                                 , part[index]);
+    }
+    for (int index = 1; index < numPart; ++index)
+    {
+        for (int other = index; (other > 0)
+                                && (order[other] < order[other - 1]); --other)
+        {
+            swap(order[other], order[other - 1]);
+        }
+    }
+    for (int index = 0; index < numPart; ++index)
+    {
+        Pair(queryItem, order[index].second, order[index].first);
+    }
+
+}  // end of "CKnnJoin<NodeType, Metric>::Pair"
+
+
+
+// ==== CKnnJoin::PointDist ===================================================
+//
+// This function returns the reduced distance between two points.
+//
+// Access: protected
+//
+// Input:
+//      pointA, pointB [IN] -- the coordinates of the points
+//
+// Output:
+//      The reduced distance.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+double  CKnnJoin<NodeType, Metric>::PointDist(const double *pointA
+                                              , const double *pointB) const
+{
+    double dist = m_metric.Term(m_metric.Gap(pointA[0], pointB[0], 0), 0);
+    for (int dim = 1; dim < DIMENSIONAL; ++dim)
+    {
+        dist = m_metric.Accumulate(dist, m_metric.Term(
+                            m_metric.Gap(pointA[dim], pointB[dim], dim), dim));
+    }
+    return dist;
+
+}  // end of "CKnnJoin<NodeType, Metric>::PointDist"
+
+
+
+// ==== CKnnJoin::Seed ========================================================
+//
+// This function gives each query of a subtree its first neighbors, before
+// the subtree is paired with another tree: the query goes down one path of
+// the reference tree, to the side with the nearer box at each node, and is
+// offered the points on the way. Without it the bound of a subtree stays
+// HUGE_VAL until its last query has "num" neighbors, and the first pairs
+// prune nothing.
+//
+// Access: protected
+//
+// Input:
+//      item [IN]   -- a subtree item of the query tree
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::Seed(const int item)
+{
+    int queryFirst = item >> 1;
+    int queryLast = queryFirst + Count(m_query, item);
+
+    for (int query = queryFirst; query < queryLast; ++query)
+    {
+        const double *queryCoord = &m_query.coord[DIMENSIONAL * query];
+        int reference = 0;
+        while (reference >= 0)
+        {
+            double dist = PointDist(queryCoord
+                                    , &m_refPtr->coord[DIMENSIONAL
+                                                       * reference]);
+            if (dist > 0)
+            {
+                Offer(query, dist, reference);
+            }
+            int left = m_refPtr->left[reference];
+            int right = m_refPtr->right[reference];
+            if ((left < 0) || (right < 0))
+            {
+                reference = (left < 0) ? right : left;
+                continue;
+            }
+            reference = (CBSTree<NodeType>::BoxDistance(
+                                    m_refPtr->node[left], queryCoord, m_metric)
+                         <= CBSTree<NodeType>::BoxDistance(
+                                    m_refPtr->node[right], queryCoord
+                                    , m_metric))
+                        ? left : right;
+        }
+    }
+    UpdateBounds(item);
+
+}  // end of "CKnnJoin<NodeType, Metric>::Seed"
+
+
+
+// ==== CKnnJoin::Split =======================================================
+//
+// This function splits the item of a whole subtree into the point of its
+// root and the subtrees of its two sides.
+//
+// Access: protected
+//
+// Input:
+//      flat [IN]   -- the tree of the item
+//      item [IN]   -- a subtree item
+//      part [OUT]  -- the parts, up to 3
+//
+// Output:
+//      The number of part.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+int     CKnnJoin<NodeType, Metric>::Split(const CFlatTree &flat
+                                          , const int item, int part[])
+{
+    int index = item >> 1;
+    int numPart = 0;
+    part[numPart++] = 2 * index + 1;
+    if (flat.left[index] >= 0)
+        part[numPart++] = 2 * flat.left[index];
+    if (flat.right[index] >= 0)
+        part[numPart++] = 2 * flat.right[index];
+    return numPart;
+
+}  // end of "CKnnJoin<NodeType, Metric>::Split"
+
+
+
+// ==== CKnnJoin::SymPair =====================================================
+//
+// This function searches two items of the same tree for each other's
+// neighbors (all-kNN): every distance is offered to both points, so each
+// pair of points is compared once. A subtree paired with itself becomes all
+// the pairs of its parts, its two sides with themselves first. When the
+// boxes of two items are not closer than the bound of one of them, only the
+// other one still searches (see Pair).
+//
+// Access: protected
+//
+// Input:
+//      itemX, itemY [IN]   -- two items of the query tree, the same or
+//                             disjoint
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::SymPair(const int itemX, const int itemY)
+{
+    int part[3];
+    int numPart = 0;
+
+    if (itemX == itemY)
+    {
+        int count = Count(m_query, itemX);
+        if (count * count <= JOIN_LEAF_PAIRS)
+        {
+            BaseCase(itemX, itemX, true);
+            return;
+        }
+
+        // each side with itself first, so their bounds are known before the
+        // pairs across
+        numPart = Split(m_query, itemX, part);
+        for (int index = 1; index < numPart; ++index)
+        {
+            SymPair(part[index], part[index]);
+        }
+        for (int first = numPart - 1; first >= 0; --first)
+        {
+            for (int second = first + 1; second < numPart; ++second)
+            {
+                SymPair(part[first], part[second]);
+            }
+        }
+        UpdateBound(itemX);
+        return;
+    }
+
+    // once one side cannot get a neighbor from the other, only the other
+    // side is searched
+    double dist = MinDist(m_query, itemX, m_query, itemY);
+    if (dist >= Bound(itemY))
+    {
+        Pair(itemX, itemY, dist);
+        return;
+    }
+    if (dist >= Bound(itemX))
+    {
+        Pair(itemY, itemX, dist);
+        return;
+    }
+    int countX = Count(m_query, itemX);
+    int countY = Count(m_query, itemY);
+    if (countX * countY <= JOIN_LEAF_PAIRS)
+    {
+        BaseCase(itemX, itemY, true);
+        return;
+    }
+
+    // split the larger subtree, a point is never split
+    if (itemX & 1)
+        countX = 0;
+    if (itemY & 1)
+        countY = 0;
+    int splitItem = (countX >= countY) ? itemX : itemY;
+    int otherItem = (countX >= countY) ? itemY : itemX;
+    numPart = Split(m_query, splitItem, part);
+    for (int index = 0; index < numPart; ++index)
+    {
+        SymPair(part[index], otherItem);
+    }
+    UpdateBound(splitItem);
+
+}  // end of "CKnnJoin<NodeType, Metric>::SymPair"
+
+
+
+// ==== CKnnJoin::UpdateBound =================================================
+//
+// This function updates the bound of a query subtree from its point and its
+// two sides.
+//
+// Access: protected
+//
+// Input:
+//      item [IN]   -- a subtree item of the query tree
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::UpdateBound(const int item)
+{
+    int index = item >> 1;
+    double bound = m_kth[index];
+    if (m_query.left[index] >= 0)
+        bound = max(bound, m_bound[m_query.left[index]]);
+    if (m_query.right[index] >= 0)
+        bound = max(bound, m_bound[m_query.right[index]]);
+    m_bound[index] = bound;
+
+}  // end of "CKnnJoin<NodeType, Metric>::UpdateBound"
+
+
+
+// ==== CKnnJoin::UpdateBounds ================================================
+//
+// This function updates the bound of every query subtree under an item,
+// bottom-up (a child comes after its parent in pre-order).
+//
+// Access: protected
+//
+// Input:
+//      item [IN]   -- an item of the query tree
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CKnnJoin<NodeType, Metric>::UpdateBounds(const int item)
+{
+    if (item & 1)
+    {
+        return;
+    }
+    for (int index = (item >> 1) + Count(m_query, item) - 1
+         ; index >= (item >> 1); --index)
+    {
+        UpdateBound(2 * index);
+    }
+
+}  // end of "CKnnJoin<NodeType, Metric>::UpdateBounds"
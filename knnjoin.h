@@ -0,0 +1,102 @@
+// ============================================================================
+// File: knnjoin.h
+// ============================================================================
+// This header file contains the declaration of the CKnnJoin class. It finds,
+// for every point of one tree (the queries), its "num" nearest points in
+// another tree (the references), by walking both trees together (dual-tree
+// search): a pair of subtrees is skipped when their bounding boxes are
+// farther apart than the worst current neighbor of every query under the
+// query subtree, so nearby queries share one test instead of a search each.
+//
+// The query tree is cut into subtrees that are searched on several threads;
+// each thread only writes the results of its own queries. Against another
+// tree, each query first takes the points along one path of the reference
+// tree, so the bounds prune from the first pair on. When both trees
+// are the same object (all-kNN), a distance is computed once for each pair
+// of points of a subtree and offered to both of them.
+//
+// Like the other searches, a point at distance 0 of a query (the query
+// itself) is not one of its neighbors.
+// ============================================================================
+
+#ifndef CKNN_JOIN_HEADER
+#define CKNN_JOIN_HEADER
+
+#include    "cbstree.h"
+#include    "ctreenode.h"
+#include    "fieldnode.h"
+#include    "metric.h"
+#include    <utility>
+#include    <vector>
+using namespace std;
+
+// smallest subtree searched as one task
+const int JOIN_MIN_TASK = 256;
+
+// largest number of point pairs of two items compared directly instead of
+// splitting the items further
+const int JOIN_LEAF_PAIRS = 64;
+
+template    <typename  NodeType, typename  Metric = CEuclideanMetric>
+class   CKnnJoin
+{
+public:
+    // constructor
+    CKnnJoin(const Metric &metric = Metric()) : m_metric(metric), m_num(0)
+                                              , m_bSelf(false)
+                                              , m_refPtr(NULL) {}
+
+    // member functions
+    void    Join(const CBSTree<NodeType> &query
+                 , const CBSTree<NodeType> &reference, const int num
+                 , vector<NodeType> &point
+                 , vector<vector<NodeType> > &listN
+                 , const int numThreads = 0);
+
+protected:
+    // the nodes of a tree in pre-order, so the subtree of node i is the
+    // nodes i to i + m_count - 1; an "item" of a tree is either the whole
+    // subtree of node i (2 * i) or the point of node i only (2 * i + 1)
+    struct  CFlatTree
+    {
+        vector<const CTreeNode<NodeType>*>  node;
+        vector<int>                         left;   // -1 if none
+        vector<int>                         right;
+        vector<double>                      coord;  // DIMENSIONAL per node
+    };
+
+    // member functions
+    void    BaseCase(const int queryItem, const int referenceItem
+                     , const bool bBoth);
+    double  Bound(const int item) const;
+    static int  Count(const CFlatTree &flat, const int item);
+    static void Flatten(const CTreeNode<NodeType> *root, CFlatTree &flat);
+    double  MinDist(const CFlatTree &flatA, const int itemA
+                    , const CFlatTree &flatB, const int itemB) const;
+    void    Offer(const int query, const double dist, const int reference);
+    void    Pair(const int queryItem, const int referenceItem
+                 , const double dist);
+    double  PointDist(const double *pointA, const double *pointB) const;
+    void    Seed(const int item);
+    static int  Split(const CFlatTree &flat, const int item, int part[]);
+    void    SymPair(const int itemX, const int itemY);
+    void    UpdateBound(const int item);
+    void    UpdateBounds(const int item);
+
+private:
+    // data members
+    Metric          m_metric;
+    int             m_num;          // number of neighbor of each query
+    bool            m_bSelf;        // the query tree is the reference tree
+    CFlatTree       m_query;
+    CFlatTree       m_reference;    // empty when m_bSelf is set
+    const CFlatTree *m_refPtr;      // m_reference, or m_query if m_bSelf
+    vector<vector<pair<double, int> > > m_heap; // max-heap of each query on
+                                                // the reduced distance
+    vector<double>  m_kth;          // worst neighbor of each query
+    vector<double>  m_bound;        // worst m_kth under each query subtree
+};
+
+#include    "knnjoin.cpp"
+
+#endif  // CKNN_JOIN_HEADER
@@ -0,0 +1,417 @@
+// ============================================================================
+// File: knntable.cpp
+// ============================================================================
+// This header file contains the implementation of the CKnnTable class. It
+// uses the template parameter "NodeType" for the type of the points.
+// ============================================================================
+
+#include    <cstdio>
+#include    <cstring>
+using namespace std;
+#include    "knntable.h"
+#include    "parallel.h"
+
+// format of the file of Save and Load
+const char  KNN_TABLE_MAGIC[8] = {'K', 'N', 'N', 'T', 'A', 'B', 'L', 'E'};
+const int   KNN_TABLE_VERSION = 1;
+
+// the names index the table if the largest is below this many times the
+// number of point, so the array of rows stays small
+const int   KNN_TABLE_NAME_SPREAD = 4;
+
+// ==== CKnnTable::Build ======================================================
+//
+// This function builds the tree of the points (median split) and the table
+// of the "num" nearest neighbors of each of them. Points with the same
+// coordinates are kept once, like in CBSTree::BuildTree. If the names of the
+// points cannot index the table (see knntable.h), only the tree is built and
+// every query goes to it; the points are kept, but there is nothing to Save.
+//
+// Access: public
+//
+// Input:
+//      items [IN]      -- the points
+//      numPoints [IN]  -- number of point
+//      num [IN]        -- number of neighbor kept for each point
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      The number of row of the table, 0 if there is no table.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CKnnTable<NodeType>::Build(const NodeType items[], const int numPoints
+                                   , const int num, const int numThreads)
+{
+    vector<vector<NodeType> > listN;
+    CKnnJoin<NodeType> join;
+
+    Clear();
+    m_tree.BuildTree(items, numPoints, SPLIT_MEDIAN);
+    if (m_tree.IsTreeEmpty() || (num <= 0))
+    {
+        return 0;
+    }
+    join.Join(m_tree, m_tree, num, m_point, listN, numThreads);
+    if (!IndexNames())
+    {
+        return 0;
+    }
+
+    int rows = static_cast<int>(m_point.size());
+    m_num = num;
+    m_neighbor.assign(static_cast<size_t>(rows) * m_num, -1);
+    m_dist.assign(static_cast<size_t>(rows) * m_num, 0);
+    ParallelFor(0, rows, numThreads, [&](int, int row)
+    {
+        size_t first = static_cast<size_t>(row) * m_num;
+        for (size_t index = 0; index < listN[row].size(); ++index)
+        {
+            m_neighbor[first + index] = m_row[listN[row][index].GetName()];
+            m_dist[first + index] = listN[row][index].GetDistance();
+        }
+    });
+    return rows;
+
+}  // end of "CKnnTable<NodeType>::Build"
+
+
+
+// ==== CKnnTable::Clear ======================================================
+//
+// This function empties the table and the tree.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CKnnTable<NodeType>::Clear()
+{
+    m_tree.DestroyTree();
+    m_point.clear();
+    m_row.clear();
+    m_neighbor.clear();
+    m_dist.clear();
+    m_num = 0;
+
+}  // end of "CKnnTable<NodeType>::Clear"
+
+
+
+// ==== CKnnTable::FindRow ====================================================
+//
+// This function finds the row of a target point: the row of its name, if
+// that row holds the same coordinates.
+//
+// Access: protected
+//
+// Input:
+//      target [IN] -- the target point
+//
+// Output:
+//      The row, or -1 if the point is not in the table.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CKnnTable<NodeType>::FindRow(const NodeType &target) const
+{
+    int name = target.GetName();
+    if ((name < 0) || (name >= static_cast<int>(m_row.size())))
+    {
+        return -1;
+    }
+    int row = m_row[name];
+    if ((row < 0) || (m_point[row].GetXCoord() != target.GetXCoord())
+        || (m_point[row].GetYCoord() != target.GetYCoord())
+        || (m_point[row].GetZCoord() != target.GetZCoord()))
+    {
+        return -1;
+    }
+    return row;
+
+}  // end of "CKnnTable<NodeType>::FindRow"
+
+
+
+// ==== CKnnTable::IndexNames =================================================
+//
+// This function fills the array from the names of the points to their rows.
+//
+// Access: protected
+//
+// Input:
+//      None
+//
+// Output:
+//      True if every name is unique, not negative and below
+//      KNN_TABLE_NAME_SPREAD times the number of point, false otherwise
+//      (the array is then empty).
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CKnnTable<NodeType>::IndexNames()
+{
+    int maxName = -1;
+    m_row.clear();
+    for (auto it = m_point.begin(); it != m_point.end(); ++it)
+    {
+        if (it->GetName() < 0)
+        {
+            return false;
+        }
+        maxName = max(maxName, it->GetName());
+    }
+    if (static_cast<long long>(maxName)
+        >= KNN_TABLE_NAME_SPREAD * static_cast<long long>(m_point.size()))
+    {
+        return false;
+    }
+    m_row.assign(maxName + 1, -1);
+    for (int row = 0; row < static_cast<int>(m_point.size()); ++row)
+    {
+        int &entry = m_row[m_point[row].GetName()];
+        if (entry >= 0)
+        {
+            m_row.clear();
+            return false;
+        }
+        entry = row;
+    }
+    return true;
+
+}  // end of "CKnnTable<NodeType>::IndexNames"
+
+
+
+// ==== CKnnTable::Load =======================================================
+//
+// This function replaces the table by one written by Save and rebuilds the
+// tree of its points.
+//
+// Access: public
+//
+// Input:
+//      fileName [IN]   -- name of the file
+//
+// Output:
+//      True if the file was read, false otherwise (the table is then
+//      empty).
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CKnnTable<NodeType>::Load(const char *fileName)
+{
+    FILE *file = fopen(fileName, "rb");
+    char magic[sizeof(KNN_TABLE_MAGIC)];
+    int header[4] = {0};    // version, dimension, points, num
+
+    Clear();
+    if (NULL == file)
+    {
+        return false;
+    }
+    bool bRead = (fread(magic, 1, sizeof(magic), file) == sizeof(magic))
+                 && (memcmp(magic, KNN_TABLE_MAGIC, sizeof(magic)) == 0)
+                 && (fread(header, sizeof(int), 4, file) == 4)
+                 && (header[0] == KNN_TABLE_VERSION)
+                 && (header[1] == DIMENSIONAL) && (header[2] >= 0)
+                 && (header[3] >= 0);
+
+    // the counts must fit the length of the file before anything is sized
+    // from them, so a cut or corrupt file cannot ask for gigabytes
+    long start = bRead ? ftell(file) : -1;
+    bRead = bRead && (start >= 0) && (fseek(file, 0, SEEK_END) == 0);
+    long long rest = bRead ? static_cast<long long>(ftell(file)) - start : 0;
+    long long rowBytes = sizeof(int) + DIMENSIONAL * sizeof(double);
+    long long cellBytes = sizeof(int) + sizeof(double);
+    bRead = bRead && (fseek(file, start, SEEK_SET) == 0)
+            && (1LL * header[2] * rowBytes <= rest)
+            && ((header[3] == 0)
+                || (1LL * header[2] <= (rest - 1LL * header[2] * rowBytes)
+                                       / cellBytes / header[3]));
+    size_t rows = bRead ? header[2] : 0;
+    size_t cells = rows * (bRead ? header[3] : 0);
+    vector<int> name(rows);
+    vector<double> coord(rows * DIMENSIONAL);
+    m_neighbor.resize(cells);
+    m_dist.resize(cells);
+    bRead = bRead && (fread(name.data(), sizeof(int), rows, file) == rows)
+            && (fread(coord.data(), sizeof(double), coord.size(), file)
+                == coord.size())
+            && (fread(m_neighbor.data(), sizeof(int), cells, file) == cells)
+            && (fread(m_dist.data(), sizeof(double), cells, file) == cells);
+    fclose(file);
+
+    for (size_t index = 0; bRead && (index < cells); ++index)
+    {
+        bRead = (m_neighbor[index] >= -1)
+                && (m_neighbor[index] < static_cast<int>(rows));
+    }
+    if (bRead)
+    {
+        m_point.resize(rows);
+        for (size_t row = 0; row < rows; ++row)
+        {
+            m_point[row].SetName(name[row]);
+            m_point[row].SetDistance(0);
+            m_point[row].SetXCoord(coord[row * DIMENSIONAL]);
+            m_point[row].SetYCoord(coord[row * DIMENSIONAL + 1]);
+            m_point[row].SetZCoord(coord[row * DIMENSIONAL + 2]);
+        }
+        bRead = IndexNames();
+    }
+    if (!bRead)
+    {
+        Clear();
+        return false;
+    }
+    m_num = header[3];
+    m_tree.BuildTree(m_point.data(), static_cast<int>(rows), SPLIT_MEDIAN);
+    return true;
+
+}  // end of "CKnnTable<NodeType>::Load"
+
+
+
+// ==== CKnnTable::Lookup =====================================================
+//
+// This function reads the "num" nearest neighbors of a point of the table,
+// nearest first, from its row.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, unchanged if the table does not
+//                     have them
+//
+// Output:
+//      True if the target is a point of the table and "num" is at most the
+//      number of neighbor kept, false otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CKnnTable<NodeType>::Lookup(const NodeType &target, const int num
+                                    , vector<NodeType> &listN) const
+{
+    int row = (num <= m_num) ? FindRow(target) : -1;
+    if (row < 0)
+    {
+        return false;
+    }
+    size_t first = static_cast<size_t>(row) * m_num;
+    listN.clear();
+    for (int index = 0; index < num; ++index)
+    {
+        int neighbor = m_neighbor[first + index];
+        if (neighbor < 0)
+        {
+            break;
+        }
+        listN.push_back(m_point[neighbor]);
+        listN.back().SetDistance(m_dist[first + index]);
+    }
+    return true;
+
+}  // end of "CKnnTable<NodeType>::Lookup"
+
+
+
+// ==== CKnnTable::NearestNeighbors ===========================================
+//
+// This function finds the "num" nearest neighbors of the target point,
+// nearest first: from the table when it has them (see Lookup), by a search
+// of the tree otherwise. It can be called from several threads at once.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CKnnTable<NodeType>::NearestNeighbors(const NodeType &target
+                                              , const int num
+                                              , vector<NodeType> &listN) const
+{
+    if (!Lookup(target, num, listN))
+    {
+        m_tree.NearestNeighbors(target, num, listN);
+    }
+
+}  // end of "CKnnTable<NodeType>::NearestNeighbors"
+
+
+
+// ==== CKnnTable::Save =======================================================
+//
+// This function writes the table to a file (format in knntable.h).
+//
+// Access: public
+//
+// Input:
+//      fileName [IN]   -- name of the file
+//
+// Output:
+//      True if the file was written, false otherwise (also when there is no
+//      table, see Build).
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CKnnTable<NodeType>::Save(const char *fileName) const
+{
+    if (0 == m_num)
+    {
+        return false;
+    }
+    FILE *file = fopen(fileName, "wb");
+    if (NULL == file)
+    {
+        return false;
+    }
+    size_t rows = m_point.size();
+    int header[4] = {KNN_TABLE_VERSION, DIMENSIONAL, static_cast<int>(rows)
+                     , m_num};
+    vector<int> name(rows);
+    vector<double> coord(rows * DIMENSIONAL);
+    for (size_t row = 0; row < rows; ++row)
+    {
+        name[row] = m_point[row].GetName();
+        coord[row * DIMENSIONAL] = m_point[row].GetXCoord();
+        coord[row * DIMENSIONAL + 1] = m_point[row].GetYCoord();
+        coord[row * DIMENSIONAL + 2] = m_point[row].GetZCoord();
+    }
+    bool bWritten = (fwrite(KNN_TABLE_MAGIC, 1, sizeof(KNN_TABLE_MAGIC), file)
+                     == sizeof(KNN_TABLE_MAGIC))
+                    && (fwrite(header, sizeof(int), 4, file) == 4)
+                    && (fwrite(name.data(), sizeof(int), rows, file) == rows)
+                    && (fwrite(coord.data(), sizeof(double), coord.size()
+                               , file) == coord.size())
+                    && (fwrite(m_neighbor.data(), sizeof(int)
+                               , m_neighbor.size(), file)
+                        == m_neighbor.size())
+                    && (fwrite(m_dist.data(), sizeof(double), m_dist.size()
+                               , file) == m_dist.size());
+    return (fclose(file) == 0) && bWritten;
+
+}  // end of "CKnnTable<NodeType>::Save"
@@ -0,0 +1,73 @@
+// ============================================================================
+// File: knntable.h
+// ============================================================================
+// This header file contains the declaration of the CKnnTable class. For a
+// set of points that does not change, it finds the "num" nearest neighbors
+// of every point once (all-kNN with CKnnJoin, on every core) and keeps them
+// in a dense table of num entries per point: the row of each neighbor and
+// its distance. The row of a point is found from its name in an array, so
+// the neighbors of a point of the set cost one array read instead of a
+// search. Targets that are not in the set, and queries for more than "num"
+// neighbors, go to the tree the table was built from.
+//
+// The names of the points are used as array indexes: they should be unique,
+// not negative and below KNN_TABLE_NAME_SPREAD (4) times the number of point
+// (like the 1 to n of CDataGenerator or a TetGen ".node" file). Otherwise
+// there is no table: every query goes to the tree and Save fails.
+//
+// Save writes the table to a binary file, in the byte order of the machine:
+//      "KNNTABLE", then int32 version, dimension, number of point and num
+//      the names (int32) and coordinates (float64) of the points, by row
+//      the neighbor rows (int32, -1 past the last neighbor), by row
+//      the neighbor distances (float64), by row
+// Load reads it back and rebuilds the tree for the fallback.
+// ============================================================================
+
+#ifndef CKNN_TABLE_HEADER
+#define CKNN_TABLE_HEADER
+
+#include    "cbstree.h"
+#include    "knnjoin.h"
+#include    <vector>
+using namespace std;
+
+template    <typename  NodeType>
+class   CKnnTable
+{
+public:
+    // constructor
+    CKnnTable() : m_num(0) {}
+
+    // member functions
+    int     Build(const NodeType items[], const int numPoints, const int num
+                  , const int numThreads = 0);
+    void    Clear();
+    int     GetNumNeighbors() const { return m_num; }
+    int     GetNumPoints() const { return static_cast<int>(m_point.size()); }
+    const vector<NodeType>&     GetPoints() const { return m_point; }
+    const CBSTree<NodeType>&    GetTree() const { return m_tree; }
+    bool    Load(const char *fileName);
+    bool    Lookup(const NodeType &target, const int num
+                   , vector<NodeType> &listN) const;
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN) const;
+    bool    Save(const char *fileName) const;
+
+protected:
+    // member functions
+    int     FindRow(const NodeType &target) const;
+    bool    IndexNames();
+
+private:
+    // data members
+    CBSTree<NodeType>   m_tree;         // fallback search
+    vector<NodeType>    m_point;        // the point of each row
+    vector<int>         m_row;          // row of each name, -1 if none
+    vector<int>         m_neighbor;     // m_num neighbor rows per row
+    vector<double>      m_dist;         // m_num distances per row
+    int                 m_num;          // neighbors per row
+};
+
+#include    "knntable.cpp"
+
+#endif  // CKNN_TABLE_HEADER
@@ -1,21 +1,87 @@
 // ============================================================================
-// This is the main file for nearest neighbor
+// This is the main file for nearest neighbor. With no flag it asks for a
+// target point among 100 generated points and shows its 6 nearest neighbors.
+// With flags it runs in batch mode: it loads the points from a file, finds
+// the neighbors of every query on every core and writes them through one
+// large buffer (see CResultWriter).
+//
+// Usage: main [-points file] [-queries file|all] [-k neighbors] [-r radius]
+//             [-threads count] [-format csv|binary] [-out file]
+//             [-table file]
+//        -points: a TetGen ".node" file, or a text file with one point per
+//                 line, "x y z" or "name x y z" (blank, comma or semicolon
+//                 separated; lines that do not start with a number, like a
+//                 CSV header, are skipped). Points without a name are named
+//                 by their line number among the points, from 1
+//        -queries: the query points in the same format, or "all" (default)
+//                  for the neighbors of every point
+//        -k: number of nearest neighbor (default 6)
+//        -r: find every point within that radius instead, nearest first
+//        -threads: number of thread (default 0, every core)
+//        -format: csv (default) or binary, see resultwriter.h
+//        -out: output file (default "-", the standard output)
+//        -table: answer the kNN queries from a table of the k nearest
+//                neighbors of every point (CKnnTable). The table is read
+//                from the file if it exists (then -points is optional and
+//                "all" means the points of the table), else it is built
+//                from -points and -k and saved to the file. With both
+//                flags, the points of -points must be those of the table
+//                (repeats aside), else main stops with an error instead of
+//                answering from a table of another data set. Queries that
+//                are not points of the table, or ask for more neighbors
+//                than it keeps, are searched in the tree, and so is every
+//                query when the names cannot index a table (knntable.h)
+//
+// A query point is never its own neighbor, like in the interactive mode: a
+// point at distance 0 from the query is left out.
 // ============================================================================
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 #include "fieldnode.h"
 #include "cbstree.h"
 #include <math.h>
 #include "ctreenode.h"
+#include "datagen.h"
+#include "knntable.h"
+#include "parallel.h"
+#include "resultwriter.h"
 using namespace std;
 
 // global constant, number of point on the graph
 const int NUM_NODE = 100;
 
+// global constant, seed of the point generator (same seed, same graph)
+const unsigned long long SEED = 1;
+
+// global constant, number of query searched before their results are written
+const int BATCH_BLOCK = 1 << 16;
+
+// batch mode settings, changed by the command line flags
+struct BatchOptions
+{
+    const char  *pointFile;
+    const char  *queryFile;
+    const char  *tableFile;
+    const char  *outFile;
+    int         numNeighbor;
+    double      radius;
+    int         numThreads;
+    ResultFormat format;
+};
+
 // function prototype
 void SetupCoordinate(FieldNode node[]);
 void AddNodeToTree(FieldNode &root, FieldNode point[], CBSTree<FieldNode> &tree);
 void DisplayNeighbor(const FieldNode &neighbor);
+int RunBatch(const BatchOptions &opt);
+bool LoadPoints(const char *fileName, vector<FieldNode> &point);
+bool SamePoints(const vector<FieldNode> &a, const vector<FieldNode> &b);
 
 
 
@@ -23,8 +89,62 @@ void DisplayNeighbor(const FieldNode &neighbor);
 //
 // ============================================================================
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (argc > 1)
+    {
+        BatchOptions opt;
+        opt.pointFile = NULL;
+        opt.queryFile = "all";
+        opt.tableFile = NULL;
+        opt.outFile = "-";
+        opt.numNeighbor = 6;
+        opt.radius = -1;
+        opt.numThreads = 0;
+        opt.format = RESULT_CSV;
+        for (int arg = 1; arg < argc; arg += 2)
+        {
+            if (arg + 1 >= argc)
+            {
+                fprintf(stderr, "missing value of %s\n", argv[arg]);
+                return 1;
+            }
+            if (strcmp(argv[arg], "-points") == 0)
+                opt.pointFile = argv[arg + 1];
+            else if (strcmp(argv[arg], "-queries") == 0)
+                opt.queryFile = argv[arg + 1];
+            else if (strcmp(argv[arg], "-table") == 0)
+                opt.tableFile = argv[arg + 1];
+            else if (strcmp(argv[arg], "-out") == 0)
+                opt.outFile = argv[arg + 1];
+            else if (strcmp(argv[arg], "-k") == 0)
+                opt.numNeighbor = max(1, atoi(argv[arg + 1]));
+            else if (strcmp(argv[arg], "-r") == 0)
+                opt.radius = atof(argv[arg + 1]);
+            else if (strcmp(argv[arg], "-threads") == 0)
+                opt.numThreads = atoi(argv[arg + 1]);
+            else if (strcmp(argv[arg], "-format") == 0)
+            {
+                if (!CResultWriter::ParseFormat(argv[arg + 1], opt.format))
+                {
+                    fprintf(stderr, "unknown format %s\n", argv[arg + 1]);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "unknown flag %s\n", argv[arg]);
+                return 1;
+            }
+        }
+        if ((NULL == opt.pointFile) && (NULL == opt.tableFile))
+        {
+            fprintf(stderr, "batch mode needs -points or -table\n");
+            return 1;
+        }
+        return RunBatch(opt);
+    }
+
     FieldNode node[NUM_NODE];
     CBSTree<FieldNode> neighborTree;
     int center = 0;
@@ -69,7 +189,8 @@ int main()
 
 
 // === SetupCoordinate =========================================================
-// This function will generate random 3D points
+// This function will generate random 3D points, uniform in a 1000 x 1000 x
+// 1000 box, from the fixed seed.
 //
 // Input: --node[] an array of node that represent each point on the graph
 //
@@ -78,14 +199,8 @@ int main()
 
 void SetupCoordinate(FieldNode node[])
 {
-    for(int index = 0; index < NUM_NODE; ++index)
-    {
-        node[index].SetName(index + 1);
-	node[index].SetDistance(0);
-	node[index].SetXCoord(rand() % 1000);
-	node[index].SetYCoord(rand() % 1000);
-	node[index].SetZCoord(rand() % 1000);
-    }
+    CDataGenerator generator(SEED, 1000);
+    generator.Generate(DIST_UNIFORM, node, NUM_NODE);
 } // end of "SetupCordinate"
 
 
@@ -103,18 +218,14 @@ void SetupCoordinate(FieldNode node[])
 
 void AddNodeToTree(FieldNode &root, FieldNode point[], CBSTree<FieldNode> &tree)
 {
-    double sum = 0;
-
     // get Euclidean distance and insert to tree
     for (int index = 0; index < NUM_NODE; ++index)
     {
-        sum = pow(root.GetXCoord() - point[index].GetXCoord(), 2);
-        sum += pow(root.GetYCoord() - point[index].GetYCoord(), 2);
-        sum += pow(root.GetZCoord() - point[index].GetZCoord(), 2);
-	point[index].SetDistance(sqrt(sum));
+	point[index].SetDistance(MetricDistance(CEuclideanMetric(), root
+	                                        , point[index]));
 
 	cout << "+++++ FROM MAIN ++++\n";
-	cout << point[index].GetDistance() << endl;
+	cout << point[index].GetDistance() << '\n';
 	tree.InsertItem(point[index]);
     }
 } // end of "AddNodeToTree"
@@ -131,10 +242,263 @@ void AddNodeToTree(FieldNode &root, FieldNode point[], CBSTree<FieldNode> &tree)
 
 void DisplayNeighbor(const FieldNode &neighbor)
 {
-    cout << "Point name: " << neighbor.GetName() <<endl;
-    cout << "\t x coordinate: " << neighbor.GetXCoord() << endl;
-    cout << "\t y coordinate: " << neighbor.GetYCoord() << endl;
-    cout << "\t z coordinate: " << neighbor.GetZCoord() << endl;
+    cout << "Point name: " << neighbor.GetName() << '\n';
+    cout << "\t x coordinate: " << neighbor.GetXCoord() << '\n';
+    cout << "\t y coordinate: " << neighbor.GetYCoord() << '\n';
+    cout << "\t z coordinate: " << neighbor.GetZCoord() << '\n';
     cout << "\t distance from target point: " << neighbor.GetDistance() 
-	 << endl;
+	 << '\n';
 } // end of "DisplayNeighbor"
+
+
+
+// === RunBatch ===============================================================
+// This function runs the batch mode: it builds the tree from the points
+// (median split), or reads (checked against -points) or builds the kNN table
+// of -table, searches the queries a block at a time on every core and writes
+// the results of each block in query order. A line with the counts and the
+// time goes to the standard error.
+//
+// Input: -- opt: the batch settings
+//
+// Output: 0 if every result was written, 1 otherwise
+// ============================================================================
+
+int RunBatch(const BatchOptions &opt)
+{
+    vector<FieldNode> point;
+    vector<FieldNode> query;
+    CBSTree<FieldNode> tree;
+    CKnnTable<FieldNode> table;
+    CResultWriter writer;
+    long long numWritten = 0;
+
+    bool bTable = (NULL != opt.tableFile) && table.Load(opt.tableFile);
+    if ((NULL != opt.pointFile)
+        && (!LoadPoints(opt.pointFile, point) || point.empty()))
+    {
+        fprintf(stderr, "cannot read points from %s\n", opt.pointFile);
+        return 1;
+    }
+    if (NULL == opt.pointFile)
+    {
+        if (!bTable)
+        {
+            fprintf(stderr, "cannot read table %s\n", opt.tableFile);
+            return 1;
+        }
+        point = table.GetPoints();
+    }
+    else if (bTable && !SamePoints(point, table.GetPoints()))
+    {
+        fprintf(stderr, "table %s is not of the points of %s (remove it to"
+                " build a new one)\n", opt.tableFile, opt.pointFile);
+        return 1;
+    }
+    if (strcmp(opt.queryFile, "all") == 0)
+    {
+        query = point;
+    }
+    else if (!LoadPoints(opt.queryFile, query))
+    {
+        fprintf(stderr, "cannot read queries from %s\n", opt.queryFile);
+        return 1;
+    }
+    if (!writer.Open(opt.outFile, opt.format))
+    {
+        fprintf(stderr, "cannot write %s\n", opt.outFile);
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    if ((NULL != opt.tableFile) && !bTable)
+    {
+        if (table.Build(point.data(), static_cast<int>(point.size())
+                        , opt.numNeighbor, opt.numThreads) == 0)
+        {
+            fprintf(stderr, "the names of the points cannot index a table"
+                    " (see knntable.h), %s is not written\n", opt.tableFile);
+        }
+        else if (!table.Save(opt.tableFile))
+        {
+            fprintf(stderr, "cannot write table %s\n", opt.tableFile);
+        }
+        bTable = true;
+    }
+    else if (!bTable)
+    {
+        tree.BuildTree(point.data(), static_cast<int>(point.size())
+                       , SPLIT_MEDIAN);
+    }
+    const CBSTree<FieldNode> &search = bTable ? table.GetTree() : tree;
+    int numQueries = static_cast<int>(query.size());
+    vector<vector<FieldNode> > result(min(numQueries, BATCH_BLOCK));
+    for (int first = 0; first < numQueries; first += BATCH_BLOCK)
+    {
+        int last = min(numQueries, first + BATCH_BLOCK);
+        ParallelFor(first, last, opt.numThreads, [&](int, int index)
+        {
+            if (opt.radius >= 0)
+            {
+                search.RadiusNeighbors(query[index], opt.radius
+                                       , result[index - first]);
+            }
+            else if (bTable)
+            {
+                table.NearestNeighbors(query[index], opt.numNeighbor
+                                       , result[index - first]);
+            }
+            else
+            {
+                search.NearestNeighbors(query[index], opt.numNeighbor
+                                        , result[index - first]);
+            }
+        });
+        for (int index = first; index < last; ++index)
+        {
+            writer.Write(query[index].GetName(), result[index - first]);
+            numWritten += result[index - first].size();
+        }
+    }
+    if (!writer.Close())
+    {
+        fprintf(stderr, "cannot write %s\n", opt.outFile);
+        return 1;
+    }
+    fprintf(stderr, "%d points, %d queries, %lld neighbors, %lld bytes"
+            " (%s) in %.3f s\n", static_cast<int>(point.size())
+            , numQueries, numWritten, writer.GetBytes()
+            , CResultWriter::GetFormatName(opt.format)
+            , chrono::duration<double>(chrono::steady_clock::now()
+                                       - start).count());
+    return 0;
+} // end of "RunBatch"
+
+
+
+// === LoadPoints =============================================================
+// This function will read points from a file, all at once. A TetGen ".node"
+// file (by its name) has a header line that is skipped, and its lines start
+// with the point name. Any other file holds "x y z" or "name x y z" per line;
+// values after the fourth are ignored, so are lines that start with "#" or
+// with anything but a number.
+//
+// Input: --fileName: name of the file
+//        --point: gets the points, in file order
+//
+// Output: true if the file was read, false otherwise
+// ============================================================================
+
+bool LoadPoints(const char *fileName, vector<FieldNode> &point)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (NULL == file)
+    {
+        return false;
+    }
+    string text;
+    char block[1 << 16];
+    size_t size = 0;
+    while ((size = fread(block, 1, sizeof(block), file)) > 0)
+    {
+        text.append(block, size);
+    }
+    fclose(file);
+
+    size_t length = strlen(fileName);
+    bool bHeader = (length > 5)
+                   && (strcmp(fileName + length - 5, ".node") == 0);
+    int autoName = 0;
+    FieldNode item;
+    point.clear();
+    for (char *line = &text[0]; *line != '\0'; )
+    {
+        char *next = strchr(line, '\n');
+        if (NULL != next)
+        {
+            *next++ = '\0';
+        }
+        else
+        {
+            next = line + strlen(line);
+        }
+
+        double value[4] = {0};
+        int count = 0;
+        char *cursor = line;
+        while (count < 4)
+        {
+            while ((*cursor == ' ') || (*cursor == '\t') || (*cursor == ',')
+                   || (*cursor == ';') || (*cursor == '\r'))
+            {
+                ++cursor;
+            }
+            char *end = NULL;
+            value[count] = strtod(cursor, &end);
+            if (end == cursor)
+            {
+                break;
+            }
+            cursor = end;
+            ++count;
+        }
+        line = next;
+        if (count == 0)
+        {
+            continue;   // blank line, comment or text header
+        }
+        if (bHeader)
+        {
+            bHeader = false;
+            continue;
+        }
+        if (count < 3)
+        {
+            return false;
+        }
+        int first = (count == 4) ? 1 : 0;
+        item.SetName((count == 4) ? static_cast<int>(value[0]) : ++autoName);
+        item.SetDistance(0);
+        item.SetXCoord(value[first]);
+        item.SetYCoord(value[first + 1]);
+        item.SetZCoord(value[first + 2]);
+        point.push_back(item);
+    }
+    return true;
+} // end of "LoadPoints"
+
+
+
+// === SamePoints =============================================================
+// This function tells if two point sets hold the same points: the same
+// names at the same coordinates, whatever their order. Repeated coordinates
+// count once, as in the tree (CBSTree::UniqueItems).
+//
+// Input: -- a, b: the point sets
+//
+// Output: true if they are the same
+// ============================================================================
+
+bool SamePoints(const vector<FieldNode> &a, const vector<FieldNode> &b)
+{
+    vector<FieldNode> sortedA(a);
+    vector<FieldNode> sortedB(b);
+    CBSTree<FieldNode>::UniqueItems(sortedA);
+    CBSTree<FieldNode>::UniqueItems(sortedB);
+    if (sortedA.size() != sortedB.size())
+    {
+        return false;
+    }
+    for (size_t index = 0; index < sortedA.size(); ++index)
+    {
+        if ((sortedA[index].GetName() != sortedB[index].GetName())
+            || (sortedA[index].GetXCoord() != sortedB[index].GetXCoord())
+            || (sortedA[index].GetYCoord() != sortedB[index].GetYCoord())
+            || (sortedA[index].GetZCoord() != sortedB[index].GetZCoord()))
+        {
+            return false;
+        }
+    }
+    return true;
+
+} // end of "SamePoints"
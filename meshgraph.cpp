@@ -0,0 +1,685 @@
+// ============================================================================
+// File: meshgraph.cpp
+// ============================================================================
+// This header file contains the implementation of the CMeshGraph class. It
+// uses the template parameter "NodeType" for the type of the vertices.
+// ============================================================================
+
+#include    <algorithm>
+#include    <fstream>
+#include    <functional>
+#include    <queue>
+using namespace std;
+#include    "meshgraph.h"
+#include    "parallel.h"
+
+
+
+// ==== CMeshGraph::AddEdge ===================================================
+//
+// This function adds an edge between two vertices. The names are only looked
+// up by BuildAdjacency, so edges to unknown vertices and edges from a vertex
+// to itself are dropped there.
+//
+// Access: public
+//
+// Input:
+//      nameA [IN]  -- name of the first end point
+//      nameB [IN]  -- name of the second end point
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CMeshGraph<NodeType>::AddEdge(const int nameA, const int nameB)
+{
+    m_edge.push_back(make_pair(nameA, nameB));
+
+}  // end of "CMeshGraph<NodeType>::AddEdge"
+
+
+
+// ==== CMeshGraph::AddVertex =================================================
+//
+// This function adds a vertex to the graph. The vertex is known by its name.
+//
+// Access: public
+//
+// Input:
+//      vertex [IN] -- the vertex, fully initialized
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CMeshGraph<NodeType>::AddVertex(const NodeType &vertex)
+{
+    m_indexOf[vertex.GetName()] = static_cast<int>(m_vertex.size());
+    m_vertex.push_back(vertex);
+
+}  // end of "CMeshGraph<NodeType>::AddVertex"
+
+
+
+// ==== CMeshGraph::AllNearestNeighbors =======================================
+//
+// This function finds the nearest neighbors of every vertex of the graph. The
+// vertices are shared between several threads, each thread keeps its own
+// visited marks.
+//
+// Access: public
+//
+// Input:
+//      num [IN]        -- number of neighbor for each vertex
+//      table [OUT]     -- table[i] is the neighbor list of vertex i, nearest
+//                         first
+//      numThreads [IN] -- number of thread (0 means every core)
+//      maxVisit [IN]   -- limit on the vertices expanded per search (0 means
+//                         no limit)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CMeshGraph<NodeType>::AllNearestNeighbors(const int num
+                                    , vector<vector<NodeType> > &table
+                                    , const int numThreads
+                                    , const int maxVisit) const
+{
+    int threads = GetNumThreads(numThreads);
+    vector<vector<unsigned> > mark(threads);
+    vector<unsigned> epoch(threads, 0);
+
+    table.assign(m_vertex.size(), vector<NodeType>());
+    ParallelFor(0, GetNumVertices(), threads, [&](int threadId, int index)
+    {
+        if (mark[threadId].empty())
+        {
+            mark[threadId].assign(m_vertex.size(), 0);
+        }
+        Expand(index, num, maxVisit, mark[threadId], epoch[threadId]
+               , table[index]);
+    });
+
+}  // end of "CMeshGraph<NodeType>::AllNearestNeighbors"
+
+
+
+// ==== CMeshGraph::BuildAdjacency ============================================
+//
+// This function turns the edge list into a compact adjacency list, on every
+// core. Every edge is stored in both directions and repeated edges are stored
+// only once. The neighbors of each vertex are sorted by edge length, shortest
+// first, and only the "maxDegree" shortest ones are kept if it is positive
+// (so vertex A may keep B while B drops A). Call it once, after every edge
+// is added; the edge list is released.
+//
+// Access: public
+//
+// Input:
+//      maxDegree [IN]  -- number of neighbor to keep per vertex (0 keeps all)
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CMeshGraph<NodeType>::BuildAdjacency(const int maxDegree
+                                             , const int numThreads)
+{
+    typedef pair<double, int>   Neighbor;   // squared length, vertex index
+    int threads = GetNumThreads(numThreads);
+    int numVertices = GetNumVertices();
+    int numEdges = static_cast<int>(m_edge.size());
+    vector<atomic<int> > position(numVertices + 1);
+    vector<double> x(numVertices);
+    vector<double> y(numVertices);
+    vector<double> z(numVertices);
+
+    // copy the coordinates into flat arrays for the length kernel
+    ParallelFor(0, numVertices + 1, threads, [&](int, int index)
+    {
+        position[index].store(0, memory_order_relaxed);
+        if (index < numVertices)
+        {
+            x[index] = m_vertex[index].GetXCoord();
+            y[index] = m_vertex[index].GetYCoord();
+            z[index] = m_vertex[index].GetZCoord();
+        }
+    });
+
+    // look up the end points and count the degree of each vertex
+    ParallelFor(0, numEdges, threads, [&](int, int index)
+    {
+        int indexA = GetIndex(m_edge[index].first);
+        int indexB = GetIndex(m_edge[index].second);
+        if ((indexA < 0) || (indexB < 0) || (indexA == indexB))
+        {
+            m_edge[index].first = -1;
+            return;
+        }
+        m_edge[index] = make_pair(indexA, indexB);
+        position[indexA + 1].fetch_add(1, memory_order_relaxed);
+        position[indexB + 1].fetch_add(1, memory_order_relaxed);
+    });
+    m_offset.assign(numVertices + 1, 0);
+    for (int index = 0; index < numVertices; ++index)
+    {
+        m_offset[index + 1] = m_offset[index]
+                              + position[index + 1].load(memory_order_relaxed);
+        position[index].store(m_offset[index], memory_order_relaxed);
+    }
+
+    // place both directions of every edge
+    m_adjacent.assign(m_offset[numVertices], 0);
+    m_weight.assign(m_offset[numVertices], 0);
+    ParallelFor(0, numEdges, threads, [&](int, int index)
+    {
+        int indexA = m_edge[index].first;
+        int indexB = m_edge[index].second;
+        if (indexA >= 0)
+        {
+            m_adjacent[position[indexA].fetch_add(1, memory_order_relaxed)]
+                = indexB;
+            m_adjacent[position[indexB].fetch_add(1, memory_order_relaxed)]
+                = indexA;
+        }
+    });
+    vector<pair<int, int> >().swap(m_edge);
+
+    // per vertex: drop repeated edges, get the lengths, sort and truncate
+    vector<vector<Neighbor> > scratch(threads);
+    vector<int> kept(numVertices + 1, 0);
+    ParallelFor(0, numVertices, threads, [&](int threadId, int index)
+    {
+        int *first = m_adjacent.data() + m_offset[index];
+        int count = m_offset[index + 1] - m_offset[index];
+        double *weight = m_weight.data() + m_offset[index];
+        vector<Neighbor> &list = scratch[threadId];
+
+        sort(first, first + count);
+        count = static_cast<int>(unique(first, first + count) - first);
+        SquaredLengths(x.data(), y.data(), z.data(), index, first, count
+                       , weight);
+
+        list.resize(count);
+        for (int n = 0; n < count; ++n)
+        {
+            list[n] = Neighbor(weight[n], first[n]);
+        }
+        sort(list.begin(), list.end());
+        if ((maxDegree > 0) && (count > maxDegree))
+        {
+            count = maxDegree;
+        }
+        for (int n = 0; n < count; ++n)
+        {
+            weight[n] = list[n].first;
+            first[n] = list[n].second;
+        }
+        kept[index + 1] = count;
+    });
+
+    // close the gaps left by the repeated and the dropped edges
+    for (int index = 0; index < numVertices; ++index)
+    {
+        kept[index + 1] += kept[index];
+    }
+    vector<int> adjacent(kept[numVertices]);
+    vector<double> weight(kept[numVertices]);
+    ParallelFor(0, numVertices, threads, [&](int, int index)
+    {
+        copy(m_adjacent.begin() + m_offset[index]
+             , m_adjacent.begin() + m_offset[index]
+               + (kept[index + 1] - kept[index])
+             , adjacent.begin() + kept[index]);
+        copy(m_weight.begin() + m_offset[index]
+             , m_weight.begin() + m_offset[index]
+               + (kept[index + 1] - kept[index])
+             , weight.begin() + kept[index]);
+    });
+    m_offset.swap(kept);
+    m_adjacent.swap(adjacent);
+    m_weight.swap(weight);
+
+}  // end of "CMeshGraph<NodeType>::BuildAdjacency"
+
+
+
+// ==== CMeshGraph::CrossCheck ================================================
+//
+// This function compares the neighbors found over the edges with the ones
+// found by the k-d tree, for every vertex. The tree must hold the same
+// vertices as the graph.
+//
+// Access: public
+//
+// Input:
+//      tree [IN]       -- k-d tree that holds the vertices of the graph
+//      num [IN]        -- number of neighbor for each vertex
+//      numThreads [IN] -- number of thread (0 means every core)
+//
+// Output:
+//      The recall, the fraction of the k-d tree neighbors that the graph
+//      search also found (1 means the two answers are the same).
+//
+// ============================================================================
+
+template    <typename  NodeType>
+double  CMeshGraph<NodeType>::CrossCheck(const CBSTree<NodeType> &tree
+                                         , const int num
+                                         , const int numThreads) const
+{
+    int threads = GetNumThreads(numThreads);
+    vector<vector<unsigned> > mark(threads);
+    vector<unsigned> epoch(threads, 0);
+    vector<long long> found(threads, 0);
+    vector<long long> expected(threads, 0);
+
+    ParallelFor(0, GetNumVertices(), threads, [&](int threadId, int index)
+    {
+        vector<NodeType> graphList;
+        vector<NodeType> treeList;
+        if (mark[threadId].empty())
+        {
+            mark[threadId].assign(m_vertex.size(), 0);
+        }
+        Expand(index, num, 0, mark[threadId], epoch[threadId], graphList);
+        tree.NearestNeighbors(m_vertex[index], num, treeList);
+
+        vector<int> names;
+        for (auto it = graphList.begin(); it != graphList.end(); ++it)
+        {
+            names.push_back((*it).GetName());
+        }
+        sort(names.begin(), names.end());
+        for (auto it = treeList.begin(); it != treeList.end(); ++it)
+        {
+            if (binary_search(names.begin(), names.end(), (*it).GetName()))
+            {
+                ++found[threadId];
+            }
+        }
+        expected[threadId] += treeList.size();
+    });
+
+    long long totalFound = 0;
+    long long totalExpected = 0;
+    for (int threadId = 0; threadId < threads; ++threadId)
+    {
+        totalFound += found[threadId];
+        totalExpected += expected[threadId];
+    }
+    if (totalExpected == 0)
+    {
+        return 1.0;
+    }
+    return static_cast<double>(totalFound) / totalExpected;
+
+}  // end of "CMeshGraph<NodeType>::CrossCheck"
+
+
+
+// ==== CMeshGraph::Expand ====================================================
+//
+// This function performs the best-first walk from the source vertex. The
+// frontier is ordered by the Euclidean distance to the source, so the walk
+// grows outward like a ball. Each vertex is looked at once per walk, the
+// "mark" vector remembers which vertices this walk already reached. The walk
+// stops when the closest vertex that is left in the frontier is farther away
+// than the farthest of the "num" best vertices found so far.
+//
+// The answer is approximate: the walk only goes through vertices closer than
+// that bound, so a near vertex that is reached only through farther ones (a
+// mesh that bends back on itself, a hole) is missed. CrossCheck measures how
+// often that happens against the k-d tree.
+//
+// Access: protected
+//
+// Input:
+//      source [IN]     -- index of the source vertex
+//      num [IN]        -- number of neighbor
+//      maxVisit [IN]   -- limit on the vertices expanded (0 means no limit)
+//      mark [IN/OUT]   -- visited marks, one per vertex
+//      epoch [IN/OUT]  -- the mark value of the last walk
+//      listN [OUT]     -- the neighbors, nearest first
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CMeshGraph<NodeType>::Expand(const int source, const int num
+                                     , const int maxVisit
+                                     , vector<unsigned> &mark, unsigned &epoch
+                                     , vector<NodeType> &listN) const
+{
+    typedef pair<double, int>   Candidate;  // squared distance, vertex index
+    priority_queue<Candidate, vector<Candidate>, greater<Candidate> > frontier;
+    priority_queue<Candidate> best;
+    int numExpanded = 0;
+
+    listN.clear();
+    if ((num <= 0) || m_offset.empty())
+    {
+        return;
+    }
+
+    // start a new walk, clear the marks when the counter wraps around
+    if (++epoch == 0)
+    {
+        fill(mark.begin(), mark.end(), 0);
+        epoch = 1;
+    }
+    mark[source] = epoch;
+    frontier.push(Candidate(0, source));
+
+    while (!frontier.empty())
+    {
+        Candidate current = frontier.top();
+        frontier.pop();
+        if ((static_cast<int>(best.size()) == num)
+            && (current.first > best.top().first))
+        {
+            break;
+        }
+        if ((maxVisit > 0) && (numExpanded >= maxVisit))
+        {
+            break;
+        }
+        ++numExpanded;
+
+        for (int edge = m_offset[current.second]
+             ; edge < m_offset[current.second + 1]; ++edge)
+        {
+            int next = m_adjacent[edge];
+            if (mark[next] == epoch)
+            {
+                continue;
+            }
+            mark[next] = epoch;
+
+            // a vertex at or past the k-th bound would end the walk as soon
+            // as it left the frontier, so only the ones below it go there
+            double dist = SquaredDistance(source, next);
+            bool bFull = (static_cast<int>(best.size()) == num);
+            if (bFull && (dist >= best.top().first))
+            {
+                continue;
+            }
+            frontier.push(Candidate(dist, next));
+            if (bFull)
+            {
+                best.pop();
+            }
+            best.push(Candidate(dist, next));
+        }
+    }
+
+    // hand back the neighbors nearest first
+    listN.resize(best.size());
+    for (int index = static_cast<int>(best.size()) - 1; index >= 0; --index)
+    {
+        listN[index] = m_vertex[best.top().second];
+        listN[index].SetDistance(sqrt(best.top().first));
+        best.pop();
+    }
+
+}  // end of "CMeshGraph<NodeType>::Expand"
+
+
+
+// ==== CMeshGraph::GetIndex ==================================================
+//
+// This function finds the index of a vertex from its name.
+//
+// Access: public
+//
+// Input:
+//      name [IN]   -- name of the vertex
+//
+// Output:
+//      The index of the vertex, or -1 if there is no such vertex.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CMeshGraph<NodeType>::GetIndex(const int name) const
+{
+    auto it = m_indexOf.find(name);
+    if (it == m_indexOf.end())
+    {
+        return -1;
+    }
+    return it->second;
+
+}  // end of "CMeshGraph<NodeType>::GetIndex"
+
+
+
+// ==== CMeshGraph::LoadEdgeFile ==============================================
+//
+// This function reads the edges of a mesh from a TetGen ".edge" file. The
+// first line holds the number of edges and the boundary marker flag, then
+// each line holds: edge number, first end point, second end point and the
+// boundary marker if the flag is set. The vertices must be loaded first.
+//
+// Access: public
+//
+// Input:
+//      fileName [IN]   -- name of the ".edge" file
+//
+// Output:
+//      A value of true if the file was read, false otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CMeshGraph<NodeType>::LoadEdgeFile(const char *fileName)
+{
+    ifstream    ifs(fileName);
+    int         numEdges = 0;
+    int         hasMarker = 0;
+    int         number = 0;
+    int         nameA = 0;
+    int         nameB = 0;
+    int         marker = 0;
+
+    if (!(ifs >> numEdges >> hasMarker))
+    {
+        return false;
+    }
+    m_edge.reserve(m_edge.size() + numEdges);
+    for (int index = 0; index < numEdges; ++index)
+    {
+        if (!(ifs >> number >> nameA >> nameB))
+        {
+            return false;
+        }
+        if (hasMarker)
+        {
+            ifs >> marker;
+        }
+        AddEdge(nameA, nameB);
+    }
+    return true;
+
+}  // end of "CMeshGraph<NodeType>::LoadEdgeFile"
+
+
+
+// ==== CMeshGraph::LoadNodeFile ==============================================
+//
+// This function reads the vertices of a mesh from a TetGen ".node" file. The
+// first line holds the number of points, the dimension, the number of
+// attributes and the boundary marker flag, then each line holds: point
+// number, x, y, z, the attributes and the boundary marker.
+//
+// Access: public
+//
+// Input:
+//      fileName [IN]   -- name of the ".node" file
+//
+// Output:
+//      A value of true if the file was read, false otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CMeshGraph<NodeType>::LoadNodeFile(const char *fileName)
+{
+    ifstream    ifs(fileName);
+    int         numPoints = 0;
+    int         dimension = 0;
+    int         numAttributes = 0;
+    int         hasMarker = 0;
+    int         name = 0;
+    double      coord[DIMENSIONAL] = {0};
+    double      skip = 0;
+    NodeType    vertex;
+
+    if (!(ifs >> numPoints >> dimension >> numAttributes >> hasMarker)
+        || (dimension > DIMENSIONAL))
+    {
+        return false;
+    }
+    m_vertex.reserve(m_vertex.size() + numPoints);
+    for (int index = 0; index < numPoints; ++index)
+    {
+        if (!(ifs >> name))
+        {
+            return false;
+        }
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            coord[dim] = 0;
+            if ((dim < dimension) && !(ifs >> coord[dim]))
+            {
+                return false;
+            }
+        }
+        for (int attr = 0; attr < numAttributes + (hasMarker ? 1 : 0); ++attr)
+        {
+            ifs >> skip;
+        }
+        vertex.SetName(name);
+        vertex.SetDistance(0);
+        vertex.SetXCoord(coord[0]);
+        vertex.SetYCoord(coord[1]);
+        vertex.SetZCoord(coord[2]);
+        AddVertex(vertex);
+    }
+    return true;
+
+}  // end of "CMeshGraph<NodeType>::LoadNodeFile"
+
+
+
+// ==== CMeshGraph::NearestNeighbors ==========================================
+//
+// This function finds the nearest neighbors of one vertex by walking the
+// edges of the mesh, an approximate answer (see Expand). To look up every
+// vertex, AllNearestNeighbors is faster.
+//
+// Access: public
+//
+// Input:
+//      index [IN]      -- index of the vertex
+//      num [IN]        -- number of neighbor
+//      listN [OUT]     -- the neighbors, nearest first
+//      maxVisit [IN]   -- limit on the vertices expanded (0 means no limit)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CMeshGraph<NodeType>::NearestNeighbors(const int index, const int num
+                                               , vector<NodeType> &listN
+                                               , const int maxVisit) const
+{
+    vector<unsigned> mark(m_vertex.size(), 0);
+    unsigned epoch = 0;
+
+    listN.clear();
+    if ((index < 0) || (index >= GetNumVertices()))
+    {
+        return;
+    }
+    Expand(index, num, maxVisit, mark, epoch, listN);
+
+}  // end of "CMeshGraph<NodeType>::NearestNeighbors"
+
+
+
+// ==== CMeshGraph::SquaredDistance ===========================================
+//
+// This function computes the squared Euclidean distance between two vertices.
+//
+// Access: protected
+//
+// Input:
+//      indexA [IN] -- index of the first vertex
+//      indexB [IN] -- index of the second vertex
+//
+// Output:
+//      The squared distance.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+double  CMeshGraph<NodeType>::SquaredDistance(const int indexA
+                                              , const int indexB) const
+{
+    const NodeType  &a = m_vertex[indexA];
+    const NodeType  &b = m_vertex[indexB];
+    double dx = a.GetXCoord() - b.GetXCoord();
+    double dy = a.GetYCoord() - b.GetYCoord();
+    double dz = a.GetZCoord() - b.GetZCoord();
+    return dx * dx + dy * dy + dz * dz;
+
+}  // end of "CMeshGraph<NodeType>::SquaredDistance"
+
+
+
+// === SquaredLengths =========================================================
+// This function computes the squared length of the edges from one vertex to
+// a list of vertices, from flat coordinate arrays. The loads go through the
+// edge list (a gather), so gcc does not vectorize the loop, even at -O3; it
+// only saves the call and the node loads of SquaredDistance per edge.
+//
+// Input: -- x, y, z: coordinates of every vertex
+//        -- source: index of the vertex the edges start from
+//        -- target: index of the vertices the edges go to
+//        -- count: number of edge
+//        -- length: the squared lengths
+//
+// Output: nothing
+// ============================================================================
+
+inline void SquaredLengths(const double *x, const double *y, const double *z
+                           , const int source, const int *target
+                           , const int count, double *length)
+{
+    const double sourceX = x[source];
+    const double sourceY = y[source];
+    const double sourceZ = z[source];
+    for (int n = 0; n < count; ++n)
+    {
+        double dx = x[target[n]] - sourceX;
+        double dy = y[target[n]] - sourceY;
+        double dz = z[target[n]] - sourceZ;
+        length[n] = dx * dx + dy * dy + dz * dz;
+    }
+
+} // end of "SquaredLengths"
@@ -0,0 +1,77 @@
+// ============================================================================
+// File: meshgraph.h
+// ============================================================================
+// This header file contains the declaration of the CMeshGraph class. It keeps
+// the vertices and edges of a mesh and finds nearest neighbors by walking the
+// edges instead of searching the space. The walk is approximate: a vertex
+// that is near in space but reached only through farther vertices can be
+// missed (CrossCheck gives the recall against the k-d tree). It uses the
+// template parameter "NodeType" for the type of the vertices.
+// ============================================================================
+
+#ifndef CMESH_GRAPH_HEADER
+#define CMESH_GRAPH_HEADER
+
+#include    "cbstree.h"
+#include    <atomic>
+#include    <unordered_map>
+#include    <vector>
+
+template    <typename  NodeType>
+class   CMeshGraph
+{
+public:
+    // constructor
+    CMeshGraph() {}
+
+    // member functions
+    void    AddEdge(const int nameA, const int nameB);
+    void    AddVertex(const NodeType &vertex);
+    void    AllNearestNeighbors(const int num
+                                , vector<vector<NodeType> > &table
+                                , const int numThreads = 0
+                                , const int maxVisit = 0) const;
+    void    BuildAdjacency(const int maxDegree = 0, const int numThreads = 0);
+    double  CrossCheck(const CBSTree<NodeType> &tree, const int num
+                       , const int numThreads = 0) const;
+    int     GetAdjacent(const int index, const int n) const
+                        { return m_adjacent[m_offset[index] + n]; }
+    int     GetDegree(const int index) const
+                        { return m_offset[index + 1] - m_offset[index]; }
+    int     GetIndex(const int name) const;
+    int     GetNumEdges() const { return static_cast<int>(m_adjacent.size()); }
+    int     GetNumVertices() const { return static_cast<int>(m_vertex.size()); }
+    const NodeType& GetVertex(const int index) const { return m_vertex[index]; }
+    double  GetWeight(const int index, const int n) const
+                        { return m_weight[m_offset[index] + n]; }
+    bool    LoadEdgeFile(const char *fileName);
+    bool    LoadNodeFile(const char *fileName);
+    void    NearestNeighbors(const int index, const int num
+                             , vector<NodeType> &listN
+                             , const int maxVisit = 0) const;
+
+protected:
+    // member functions
+    void    Expand(const int source, const int num, const int maxVisit
+                   , vector<unsigned> &mark, unsigned &epoch
+                   , vector<NodeType> &listN) const;
+    double  SquaredDistance(const int indexA, const int indexB) const;
+
+private:
+    // data members
+    vector<NodeType>        m_vertex;   // vertices, in file order
+    unordered_map<int, int> m_indexOf;  // vertex name -> index in m_vertex
+    vector<pair<int, int> > m_edge;     // edges as read, by vertex name
+    vector<int>             m_offset;   // adjacency of vertex i is m_adjacent
+    vector<int>             m_adjacent; // [m_offset[i], m_offset[i + 1])
+    vector<double>          m_weight;   // squared length of each adjacent edge
+};
+
+// flat squared-distance kernel used by BuildAdjacency
+inline void SquaredLengths(const double *x, const double *y, const double *z
+                           , const int source, const int *target
+                           , const int count, double *length);
+
+#include    "meshgraph.cpp"
+
+#endif  // CMESH_GRAPH_HEADER
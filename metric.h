@@ -0,0 +1,206 @@
+// ============================================================================
+// File: metric.h
+// ============================================================================
+// This header file contains the distance metrics of the nearest neighbor
+// searches. A metric is a small class given as a template parameter, so the
+// search is compiled for it and the default Euclidean path stays inlined.
+// Every metric has the same members:
+//
+//      Gap(a, b, dim)                  separation of two coordinates
+//      IntervalGap(t, low, high, dim)  separation of t and [low, high]
+//      BoxGap(lowA, highA, lowB, highB, dim)
+//                                      separation of two intervals
+//      HalfSpaceGap(t, split, bRight, dim)
+//                                      separation of t and the side of a
+//                                      split plane (x >= split if bRight)
+//      Term(gap, dim)                  contribution of one axis
+//      Accumulate(sum, term)           adds a contribution
+//      Distance(reduced)               reduced distance -> distance
+//      Reduced(distance)               distance -> reduced distance
+//
+// The search compares reduced distances (the sum of the squares for the
+// Euclidean metric), so it never takes a square root on the way. Since the
+// gaps are lower bounds, the pruning of the search stays exact for each
+// metric.
+// ============================================================================
+
+#ifndef METRIC_HEADER
+#define METRIC_HEADER
+
+#include    <algorithm>
+#include    <cmath>
+#include    "fieldnode.h"
+using namespace std;
+
+// gaps of an ordinary (not periodic) space
+struct CAxisGap
+{
+    double  Gap(const double a, const double b, const int) const
+    {
+        return fabs(a - b);
+    }
+    double  IntervalGap(const double t, const double low, const double high
+                        , const int) const
+    {
+        return (t < low) ? low - t : ((t > high) ? t - high : 0);
+    }
+    double  BoxGap(const double lowA, const double highA, const double lowB
+                   , const double highB, const int) const
+    {
+        return (highA < lowB) ? lowB - highA
+                              : ((highB < lowA) ? lowA - highB : 0);
+    }
+    double  HalfSpaceGap(const double t, const double split, const bool bRight
+                         , const int) const
+    {
+        return bRight ? max(0.0, split - t) : max(0.0, t - split);
+    }
+};
+
+// sqrt(dx^2 + dy^2 + dz^2)
+struct CEuclideanMetric : public CAxisGap
+{
+    double  Term(const double gap, const int) const { return gap * gap; }
+    double  Accumulate(const double sum, const double term) const
+                                                        { return sum + term; }
+    double  Distance(const double reduced) const { return sqrt(reduced); }
+    double  Reduced(const double dist) const { return dist * dist; }
+};
+
+// |dx| + |dy| + |dz|
+struct CManhattanMetric : public CAxisGap
+{
+    double  Term(const double gap, const int) const { return gap; }
+    double  Accumulate(const double sum, const double term) const
+                                                        { return sum + term; }
+    double  Distance(const double reduced) const { return reduced; }
+    double  Reduced(const double dist) const { return dist; }
+};
+
+// max(|dx|, |dy|, |dz|)
+struct CChebyshevMetric : public CAxisGap
+{
+    double  Term(const double gap, const int) const { return gap; }
+    double  Accumulate(const double sum, const double term) const
+                                                { return max(sum, term); }
+    double  Distance(const double reduced) const { return reduced; }
+    double  Reduced(const double dist) const { return dist; }
+};
+
+// sqrt(wx dx^2 + wy dy^2 + wz dz^2), the weights must not be negative
+struct CWeightedMetric : public CEuclideanMetric
+{
+    CWeightedMetric(const double wx = 1, const double wy = 1
+                    , const double wz = 1)
+    {
+        weight[0] = wx;
+        weight[1] = wy;
+        weight[2] = wz;
+    }
+    double  Term(const double gap, const int dim) const
+    {
+        return weight[dim] * gap * gap;
+    }
+
+    double  weight[DIMENSIONAL];
+};
+
+// Euclidean distance in a periodic box [0, period) on each axis with a
+// period above zero (minimum image). The points of the tree must be inside
+// the box; a subtree on the other side of the box is still reached through
+// the boundary, so no ghost copies of the points are needed.
+struct CPeriodicMetric : public CEuclideanMetric
+{
+    CPeriodicMetric(const double px = 0, const double py = 0
+                    , const double pz = 0)
+    {
+        period[0] = px;
+        period[1] = py;
+        period[2] = pz;
+    }
+    double  Wrap(const double t, const int dim) const
+    {
+        return (period[dim] > 0) ? t - period[dim] * floor(t / period[dim])
+                                 : t;
+    }
+    double  Gap(const double a, const double b, const int dim) const
+    {
+        double gap = fabs(a - b);
+        if (period[dim] > 0)
+        {
+            gap = fmod(gap, period[dim]);
+            gap = min(gap, period[dim] - gap);
+        }
+        return gap;
+    }
+    double  IntervalGap(const double t, const double low, const double high
+                        , const int dim) const
+    {
+        if (period[dim] <= 0)
+        {
+            return CAxisGap::IntervalGap(t, low, high, dim);
+        }
+        double x = Wrap(t, dim);
+        if (x < low)
+            return min(low - x, x + period[dim] - high);
+        if (x > high)
+            return min(x - high, low + period[dim] - x);
+        return 0;
+    }
+    double  BoxGap(const double lowA, const double highA, const double lowB
+                   , const double highB, const int dim) const
+    {
+        // both intervals are inside [0, period)
+        if (period[dim] <= 0)
+        {
+            return CAxisGap::BoxGap(lowA, highA, lowB, highB, dim);
+        }
+        if (highA < lowB)
+            return min(lowB - highA, lowA + period[dim] - highB);
+        if (highB < lowA)
+            return min(lowA - highB, lowB + period[dim] - highA);
+        return 0;
+    }
+    double  HalfSpaceGap(const double t, const double split, const bool bRight
+                         , const int dim) const
+    {
+        if (period[dim] <= 0)
+        {
+            return CAxisGap::HalfSpaceGap(t, split, bRight, dim);
+        }
+        // the side is [split, period) or [0, split]
+        double x = Wrap(t, dim);
+        if (bRight)
+            return (x < split) ? min(split - x, x) : 0;
+        return (x > split) ? min(x - split, period[dim] - x) : 0;
+    }
+
+    double  period[DIMENSIONAL];
+};
+
+
+
+// === MetricDistance =========================================================
+// This function will return the distance between two points in a metric.
+//
+// Input: -- metric: the metric
+//        -- a, b: the points
+//
+// Output: the distance
+// ============================================================================
+
+template    <typename  Metric, typename  NodeType>
+double MetricDistance(const Metric &metric, const NodeType &a
+                      , const NodeType &b)
+{
+    double reduced = metric.Term(metric.Gap(a.GetXCoord(), b.GetXCoord(), 0)
+                                 , 0);
+    reduced = metric.Accumulate(reduced, metric.Term(
+                        metric.Gap(a.GetYCoord(), b.GetYCoord(), 1), 1));
+    reduced = metric.Accumulate(reduced, metric.Term(
+                        metric.Gap(a.GetZCoord(), b.GetZCoord(), 2), 2));
+    return metric.Distance(reduced);
+
+} // end of "MetricDistance"
+
+#endif // METRIC_HEADER
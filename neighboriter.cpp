@@ -0,0 +1,278 @@
+// ============================================================================
+// File: neighboriter.cpp
+// ============================================================================
+// This header file contains the implementation of the CNeighborIterator
+// class. It uses the template parameter "NodeType" for the type of the points
+// and "Metric" for the distance metric (see metric.h).
+// ============================================================================
+
+#include    <algorithm>
+using namespace std;
+#include    "neighboriter.h"
+
+// ==== CNeighborIterator::CNeighborIterator ==================================
+//
+// This is the constructor for the CNeighborIterator class. It only puts the
+// root of the tree in the queue, no point is looked at before the first call
+// of Next or PeekDistance.
+//
+// Access: public
+//
+// Input:
+//      tree [IN]   -- the tree, it must not change while the iterator is used
+//      target [IN] -- the target point
+//      metric [IN] -- the distance metric (Euclidean by default)
+//      stats [IN]  -- if not NULL, gets the work counters of this query (only
+//                     when compiled with KNN_STATS)
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+CNeighborIterator<NodeType, Metric>::CNeighborIterator(
+                                        const CBSTree<NodeType> &tree
+                                        , const NodeType &target
+                                        , const Metric &metric
+                                        , CQueryStats *stats)
+    : m_tree(tree), m_metric(metric), m_stats(stats), m_count(0)
+{
+    Reset(target);
+
+}  // end of "CNeighborIterator<NodeType, Metric>::CNeighborIterator"
+
+
+
+// ==== CNeighborIterator::Advance ============================================
+//
+// This function opens the subtrees at the front of the queue until a point is
+// at the front, or the queue is empty. Opening a node queues its value with
+// its distance and its children with the distance to their bounding boxes.
+// A box is never farther than the points inside it, so once a point is at
+// the front nothing left in the queue can be closer.
+//
+// Access: protected
+//
+// Input:
+//      None
+//
+// Output:
+//      True if a point is at the front of the queue, false if every point
+//      has been handed out.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+bool    CNeighborIterator<NodeType, Metric>::Advance()
+{
+    while (!m_queue.empty() && !m_queue.front().bPoint)
+    {
+        CEntry entry = m_queue.front();
+        const CTreeNode<NodeType> *nodePtr = entry.nodePtr;
+        pop_heap(m_queue.begin(), m_queue.end(), FartherThan);
+        m_queue.pop_back();
+
+        KNN_COUNT(m_stats, visitedNodes++);
+        KNN_COUNT(m_stats, distanceEvals++);
+        KNN_COUNT(m_stats, Depth(entry.height));
+        if ((NULL == nodePtr->m_left) && (NULL == nodePtr->m_right))
+        {
+            KNN_COUNT(m_stats, leafPoints++);
+        }
+
+        // the value of the node, the target itself is skipped
+        double coord[DIMENSIONAL] = {nodePtr->m_value.GetXCoord()
+                                     , nodePtr->m_value.GetYCoord()
+                                     , nodePtr->m_value.GetZCoord()};
+        double dist = m_metric.Term(m_metric.Gap(coord[0], m_target[0], 0)
+                                    , 0);
+        for (int dim = 1; dim < DIMENSIONAL; ++dim)
+        {
+            dist = m_metric.Accumulate(dist, m_metric.Term(
+                            m_metric.Gap(coord[dim], m_target[dim], dim)
+                            , dim));
+        }
+        if (dist > 0)
+        {
+            Push(nodePtr, dist, entry.height, true);
+        }
+
+        // the children, keyed by their bounding box
+        if (NULL != nodePtr->m_left)
+        {
+            Push(nodePtr->m_left, CBSTree<NodeType>::BoxDistance(
+                                        nodePtr->m_left, m_target, m_metric)
+                 , entry.height + 1, false);
+        }
+        if (NULL != nodePtr->m_right)
+        {
+            Push(nodePtr->m_right, CBSTree<NodeType>::BoxDistance(
+                                        nodePtr->m_right, m_target, m_metric)
+                 , entry.height + 1, false);
+        }
+    }
+    return !m_queue.empty();
+
+}  // end of "CNeighborIterator<NodeType, Metric>::Advance"
+
+
+
+// ==== CNeighborIterator::FartherThan ========================================
+//
+// This function compares two entries of the queue; with it the heap keeps
+// the nearest entry at the front, and a point before a subtree at the same
+// distance, so that ties do not open more nodes than needed.
+//
+// Access: protected
+//
+// Input:
+//      a, b [IN]   -- the entries
+//
+// Output:
+//      True if "a" comes after "b".
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+bool    CNeighborIterator<NodeType, Metric>::FartherThan(const CEntry &a
+                                                         , const CEntry &b)
+{
+    if (a.dist != b.dist)
+    {
+        return a.dist > b.dist;
+    }
+    return !a.bPoint && b.bPoint;
+
+}  // end of "CNeighborIterator<NodeType, Metric>::FartherThan"
+
+
+
+// ==== CNeighborIterator::Next ===============================================
+//
+// This function hands out the next nearest neighbor, with its distance in
+// the metric. Ties come out in no particular order.
+//
+// Access: public
+//
+// Input:
+//      neighbor [OUT]  -- the neighbor, unchanged when there is none left
+//
+// Output:
+//      True if there was one more neighbor, false otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+bool    CNeighborIterator<NodeType, Metric>::Next(NodeType &neighbor)
+{
+    if (!Advance())
+    {
+        return false;
+    }
+    neighbor = m_queue.front().nodePtr->m_value;
+    neighbor.SetDistance(m_metric.Distance(m_queue.front().dist));
+    pop_heap(m_queue.begin(), m_queue.end(), FartherThan);
+    m_queue.pop_back();
+    ++m_count;
+    return true;
+
+}  // end of "CNeighborIterator<NodeType, Metric>::Next"
+
+
+
+// ==== CNeighborIterator::PeekDistance =======================================
+//
+// This function gives the distance of the next neighbor without handing it
+// out, e.g. to stop before the first neighbor past some distance.
+//
+// Access: public
+//
+// Input:
+//      dist [OUT]  -- distance of the next neighbor in the metric
+//
+// Output:
+//      True if there is one more neighbor, false otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+bool    CNeighborIterator<NodeType, Metric>::PeekDistance(double &dist)
+{
+    if (!Advance())
+    {
+        return false;
+    }
+    dist = m_metric.Distance(m_queue.front().dist);
+    return true;
+
+}  // end of "CNeighborIterator<NodeType, Metric>::PeekDistance"
+
+
+
+// ==== CNeighborIterator::Push ===============================================
+//
+// This function adds an entry to the queue.
+//
+// Access: protected
+//
+// Input:
+//      nodePtr [IN]    -- the node
+//      dist [IN]       -- reduced distance of its value or of its box
+//      height [IN]     -- level of the node
+//      bPoint [IN]     -- true for the value of the node, false for its
+//                         whole subtree
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CNeighborIterator<NodeType, Metric>::Push(
+                                        const CTreeNode<NodeType> *nodePtr
+                                        , const double dist, const int height
+                                        , const bool bPoint)
+{
+    CEntry entry;
+    entry.dist = dist;
+    entry.nodePtr = nodePtr;
+    entry.height = height;
+    entry.bPoint = bPoint;
+    m_queue.push_back(entry);
+    push_heap(m_queue.begin(), m_queue.end(), FartherThan);
+
+}  // end of "CNeighborIterator<NodeType, Metric>::Push"
+
+
+
+// ==== CNeighborIterator::Reset ==============================================
+//
+// This function starts over with a new target on the same tree; the memory
+// of the queue is kept for the next search.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CNeighborIterator<NodeType, Metric>::Reset(const NodeType &target)
+{
+    m_target[0] = target.GetXCoord();
+    m_target[1] = target.GetYCoord();
+    m_target[2] = target.GetZCoord();
+    m_queue.clear();
+    m_count = 0;
+    KNN_COUNT(m_stats, Clear());
+    if (NULL != m_tree.m_root)
+    {
+        Push(m_tree.m_root, CBSTree<NodeType>::BoxDistance(m_tree.m_root
+                                                           , m_target
+                                                           , m_metric)
+             , 0, false);
+    }
+
+}  // end of "CNeighborIterator<NodeType, Metric>::Reset"
@@ -0,0 +1,72 @@
+// ============================================================================
+// File: neighboriter.h
+// ============================================================================
+// This header file contains the declaration of the CNeighborIterator class. It
+// hands out the points of a CBSTree one at a time in increasing distance from
+// a target, for callers that do not know how many neighbors they need (e.g.
+// "until the weights add up to w"). It is a best-first search (Hjaltason and
+// Samet): one priority queue holds both subtrees, keyed by the distance to
+// their bounding box, and points, keyed by their own distance. A point at the
+// front of the queue is closer than anything left in the tree, so each call
+// of Next only opens the nodes needed to prove the next neighbor.
+//
+// Like the other searches, the target itself (distance 0) is skipped. The
+// iterator keeps pointers into the tree, so the tree must not change while
+// the iterator is in use; several iterators may share one tree.
+// ============================================================================
+
+#ifndef CNEIGHBOR_ITERATOR_HEADER
+#define CNEIGHBOR_ITERATOR_HEADER
+
+#include    "cbstree.h"
+#include    "ctreenode.h"
+#include    "fieldnode.h"
+#include    "metric.h"
+#include    "querystats.h"
+#include    <vector>
+using namespace std;
+
+template    <typename  NodeType, typename  Metric = CEuclideanMetric>
+class   CNeighborIterator
+{
+public:
+    // constructor
+    CNeighborIterator(const CBSTree<NodeType> &tree, const NodeType &target
+                      , const Metric &metric = Metric()
+                      , CQueryStats *stats = NULL);
+
+    // member functions
+    int     GetCount() const { return m_count; }
+    bool    Next(NodeType &neighbor);
+    bool    PeekDistance(double &dist);
+    void    Reset(const NodeType &target);
+
+protected:
+    // an entry of the queue: a point, or a subtree still to be opened
+    struct  CEntry
+    {
+        double                      dist;       // reduced distance
+        const CTreeNode<NodeType>   *nodePtr;
+        int                         height;     // level of the node
+        bool                        bPoint;     // the value of the node only
+    };
+
+    // member functions
+    bool    Advance();
+    static bool FartherThan(const CEntry &a, const CEntry &b);
+    void    Push(const CTreeNode<NodeType> *nodePtr, const double dist
+                 , const int height, const bool bPoint);
+
+private:
+    // data members
+    const CBSTree<NodeType> &m_tree;
+    Metric                  m_metric;
+    CQueryStats             *m_stats;
+    double                  m_target[DIMENSIONAL];
+    vector<CEntry>          m_queue;    // min-heap on the reduced distance
+    int                     m_count;    // number of neighbor handed out
+};
+
+#include    "neighboriter.cpp"
+
+#endif  // CNEIGHBOR_ITERATOR_HEADER
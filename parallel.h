@@ -0,0 +1,101 @@
+// ============================================================================
+// File: parallel.h
+// ============================================================================
+// This header file contains the small helper used to split a loop over many
+// points between several threads.
+// ============================================================================
+
+#ifndef PARALLEL_HEADER
+#define PARALLEL_HEADER
+
+#include    <algorithm>
+#include    <atomic>
+#include    <thread>
+#include    <vector>
+using namespace std;
+
+// number of loop index that a thread takes at a time
+const int PARALLEL_CHUNK = 256;
+
+
+
+// === GetNumThreads ==========================================================
+// This function will return the number of thread to use. A value of zero or
+// less means "use every core of the machine".
+//
+// Input: -- numThreads: number of thread the caller asked for
+//
+// Output: the number of thread to use (at least 1)
+// ============================================================================
+
+inline int GetNumThreads(const int numThreads)
+{
+    if (numThreads > 0)
+    {
+        return numThreads;
+    }
+    int cores = static_cast<int>(thread::hardware_concurrency());
+    return (cores > 0) ? cores : 1;
+
+} // end of "GetNumThreads"
+
+
+
+// === ParallelFor ============================================================
+// This function will call "func(threadId, index)" for every index in
+// [begin, end). The threads take chunks of index from a shared counter, so
+// a slow index does not hold back the whole loop; a loop over a few large
+// tasks should use a chunk of 1. "threadId" goes from 0 to
+// the number of thread minus one, so the caller can keep one scratch buffer
+// per thread.
+//
+// Input: -- begin, end: range of index
+//        -- numThreads: number of thread (0 means every core)
+//        -- func: function object that takes (int threadId, int index)
+//        -- chunk: number of index taken at a time, a loop with no more
+//                  index than that runs on the calling thread
+//
+// Output: nothing
+// ============================================================================
+
+template    <typename  Function>
+void ParallelFor(const int begin, const int end, const int numThreads
+                 , Function func, const int chunk = PARALLEL_CHUNK)
+{
+    int threads = GetNumThreads(numThreads);
+    int step = max(1, chunk);
+    if ((threads == 1) || (end - begin <= step))
+    {
+        for (int index = begin; index < end; ++index)
+        {
+            func(0, index);
+        }
+        return;
+    }
+
+    atomic<int> next(begin);
+    vector<thread> pool;
+    pool.reserve(threads);
+    for (int threadId = 0; threadId < threads; ++threadId)
+    {
+        pool.push_back(thread([&next, end, &func, threadId, step]()
+        {
+            int first = 0;
+            while ((first = next.fetch_add(step)) < end)
+            {
+                int last = (first + step < end) ? first + step : end;
+                for (int index = first; index < last; ++index)
+                {
+                    func(threadId, index);
+                }
+            }
+        }));
+    }
+    for (auto it = pool.begin(); it != pool.end(); ++it)
+    {
+        (*it).join();
+    }
+
+} // end of "ParallelFor"
+
+#endif // PARALLEL_HEADER
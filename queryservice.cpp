@@ -0,0 +1,221 @@
+// ============================================================================
+// File: queryservice.cpp
+// ============================================================================
+// This header file contains the implementation of the CQueryService class.
+// It uses the template parameter "NodeType" for the type of the points.
+// ============================================================================
+
+#include    "queryservice.h"
+
+// ==== CQueryService::CQueryService ==========================================
+//
+// This is the constructor. It starts the workers.
+//
+// Access: public
+//
+// Input:
+//      tree [IN]       -- the tree to search, kept by reference
+//      numWorkers [IN] -- number of worker thread (0 means every core)
+//      maxBatch [IN]   -- largest number of request in a micro-batch
+//      maxWait [IN]    -- longest wait, in microsecond, for a micro-batch to
+//                         fill once it has one request (0 takes what is
+//                         queued)
+//      capacity [IN]   -- largest number of request waiting in the queue
+//      order [IN]      -- curve that each micro-batch is sorted along
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+CQueryService<NodeType>::CQueryService(const CBSTree<NodeType> &tree
+                                       , const int numWorkers
+                                       , const int maxBatch
+                                       , const int maxWait
+                                       , const int capacity
+                                       , const CurveType order)
+    : m_tree(tree), m_queue(capacity), m_maxBatch(max(maxBatch, 1))
+    , m_maxWait(max(maxWait, 0)), m_order(order), m_numBatches(0)
+    , m_numFailed(0), m_numServed(0)
+{
+    int threads = GetNumThreads(numWorkers);
+    m_worker.reserve(threads);
+    for (int index = 0; index < threads; ++index)
+    {
+        m_worker.push_back(thread(&CQueryService<NodeType>::Work, this));
+    }
+
+}  // end of "CQueryService<NodeType>::CQueryService"
+
+
+
+// ==== CQueryService::Stop ===================================================
+//
+// This function closes the queue, lets the workers serve the requests still
+// in it and waits for them. Submit fails from now on. Called on a worker
+// (from a callback) it would wait for itself, so it does nothing there.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      False if called on a worker thread, true otherwise.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CQueryService<NodeType>::Stop()
+{
+    for (auto it = m_worker.begin(); it != m_worker.end(); ++it)
+    {
+        if ((*it).get_id() == this_thread::get_id())
+        {
+            return false;
+        }
+    }
+    m_queue.Close();
+    for (auto it = m_worker.begin(); it != m_worker.end(); ++it)
+    {
+        (*it).join();
+    }
+    m_worker.clear();
+    return true;
+
+}  // end of "CQueryService<NodeType>::Stop"
+
+
+
+// ==== CQueryService::Submit =================================================
+//
+// This function queues a query for the "num" nearest neighbors of a target
+// point, waiting while the queue is full.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//
+// Output:
+//      A future that gets the neighbors, nearest first (none once the
+//      service is stopped).
+//
+// ============================================================================
+
+template    <typename  NodeType>
+future<vector<NodeType> >   CQueryService<NodeType>::Submit(
+                                const NodeType &target, const int num)
+{
+    Request request;
+    request.target = target;
+    request.num = num;
+    future<vector<NodeType> > result = request.result.get_future();
+    if (!m_queue.Push(move(request)))
+    {
+        request.result.set_value(vector<NodeType>());
+    }
+    return result;
+
+}  // end of "CQueryService<NodeType>::Submit"
+
+
+
+// ==== CQueryService::Submit =================================================
+//
+// This function queues a query for the "num" nearest neighbors of a target
+// point, waiting while the queue is full. The callback runs on a worker
+// thread, so it should be short: the rest of the micro-batch waits for it.
+//
+// Access: public
+//
+// Input:
+//      target [IN]     -- the target point
+//      num [IN]        -- number of nearest neighbor
+//      callback [IN]   -- gets the neighbors, nearest first
+//
+// Output:
+//      True if the query was queued, false if the service is stopped.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CQueryService<NodeType>::Submit(const NodeType &target, const int num
+                                        , const Callback &callback)
+{
+    Request request;
+    request.target = target;
+    request.num = num;
+    request.callback = callback;
+    return m_queue.Push(move(request));
+
+}  // end of "CQueryService<NodeType>::Submit"
+
+
+
+// ==== CQueryService::Work ===================================================
+//
+// This function is the loop of a worker: take a micro-batch, sort it along
+// the curve, search the tree for each request in that order and deliver
+// the result, or the exception of a failed search to its future. It
+// returns when the queue is closed and empty.
+//
+// Access: private
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CQueryService<NodeType>::Work()
+{
+    vector<Request> batch;
+    vector<NodeType> target;
+    vector<int> order;
+    vector<NodeType> listN;
+
+    while (m_queue.PopBatch(batch, m_maxBatch, m_maxWait) > 0)
+    {
+        int count = static_cast<int>(batch.size());
+        target.resize(count);
+        for (int index = 0; index < count; ++index)
+        {
+            target[index] = batch[index].target;
+        }
+        CurveOrder(target.data(), count, m_order, order, 1);
+        for (int position = 0; position < count; ++position)
+        {
+            Request &request = batch[order[position]];
+            try
+            {
+                m_tree.NearestNeighbors(request.target, request.num, listN);
+                if (request.callback)
+                {
+                    request.callback(listN);
+                }
+                else
+                {
+                    request.result.set_value(move(listN));
+                }
+            }
+            catch (...)
+            {
+                // only this request fails, the worker goes on
+                ++m_numFailed;
+                if (!request.callback)
+                {
+                    request.result.set_exception(current_exception());
+                }
+            }
+        }
+        m_numServed += count;
+        ++m_numBatches;
+    }
+
+}  // end of "CQueryService<NodeType>::Work"
@@ -0,0 +1,97 @@
+// ============================================================================
+// File: queryservice.h
+// ============================================================================
+// This header file contains the declaration of the CQueryService class. It
+// serves nearest neighbor queries from many threads (e.g. request handlers
+// that each have one target) on a built tree. Submit puts the request in a
+// bounded queue (CBoundedQueue) and returns at once; worker threads take the
+// requests in micro-batches of up to "maxBatch", waiting at most "maxWait"
+// microseconds for a batch to fill, sort each batch along a space-filling
+// curve (CurveOrder) so that queries close in space run one after the other
+// on the same paths of the tree, and hand each result back through a future
+// or a callback. An exception from the search or from a callback fails only
+// its own request: a future gets it, a callback's is dropped, and both are
+// counted (GetNumFailed). Stop must not be called from a callback, where it
+// would wait for its own worker; there it does nothing and returns false.
+//
+// The tree is shared by the workers and is not copied: it must outlive the
+// service and must not change while the service runs. A tree that changes
+// is served by one service per version, or through CSnapshotIndex.
+// ============================================================================
+
+#ifndef CQUERY_SERVICE_HEADER
+#define CQUERY_SERVICE_HEADER
+
+#include    "boundedqueue.h"
+#include    "cbstree.h"
+#include    "curveorder.h"
+#include    <atomic>
+#include    <exception>
+#include    <functional>
+#include    <future>
+#include    <thread>
+#include    <vector>
+using namespace std;
+
+// default settings of the service
+const int SERVICE_CAPACITY = 4096;  // requests waiting in the queue
+const int SERVICE_BATCH = 64;       // requests in a micro-batch
+const int SERVICE_WAIT_US = 50;     // wait for a micro-batch to fill
+
+template    <typename  NodeType>
+class   CQueryService
+{
+public:
+    // called on a worker thread with the neighbors, nearest first
+    typedef function<void(vector<NodeType> &)>   Callback;
+
+    // constructor and destructor
+    CQueryService(const CBSTree<NodeType> &tree, const int numWorkers = 0
+                  , const int maxBatch = SERVICE_BATCH
+                  , const int maxWait = SERVICE_WAIT_US
+                  , const int capacity = SERVICE_CAPACITY
+                  , const CurveType order = CURVE_HILBERT);
+    ~CQueryService() { Stop(); }
+
+    // member functions
+    long long   GetNumBatches() const { return m_numBatches.load(); }
+    long long   GetNumFailed() const { return m_numFailed.load(); }
+    long long   GetNumServed() const { return m_numServed.load(); }
+    int     GetNumWorkers() const { return static_cast<int>(m_worker.size()); }
+    bool    Stop();
+    future<vector<NodeType> >   Submit(const NodeType &target, const int num);
+    bool    Submit(const NodeType &target, const int num
+                   , const Callback &callback);
+
+private:
+    // a query waiting in the queue
+    struct Request
+    {
+        NodeType                    target;
+        int                         num;
+        Callback                    callback;   // empty: fulfil "result"
+        promise<vector<NodeType> >  result;
+    };
+
+    // no copy, the workers hold a pointer to it
+    CQueryService(const CQueryService &other);
+    CQueryService& operator=(const CQueryService &rhs);
+
+    // member functions
+    void    Work();
+
+    // data members
+    const CBSTree<NodeType>     &m_tree;
+    CBoundedQueue<Request>      m_queue;
+    int                         m_maxBatch;
+    chrono::microseconds        m_maxWait;
+    CurveType                   m_order;
+    vector<thread>              m_worker;
+    atomic<long long>           m_numBatches;
+    atomic<long long>           m_numFailed;
+    atomic<long long>           m_numServed;
+};
+
+#include    "queryservice.cpp"
+
+#endif  // CQUERY_SERVICE_HEADER
@@ -0,0 +1,180 @@
+// ============================================================================
+// File: querystats.h
+// ============================================================================
+// This header file contains the counters that describe the work done by one
+// query, and the aggregate that collects them over many queries. Counting is
+// only compiled in when KNN_STATS is defined (g++ -DKNN_STATS ...); without
+// it KNN_COUNT expands to an empty statement and the search does no extra
+// work. Both forms are a single statement, safe in an unbraced if/else.
+// ============================================================================
+
+#ifndef QUERY_STATS_HEADER
+#define QUERY_STATS_HEADER
+
+#include    <cstdio>
+#include    <string>
+using namespace std;
+
+#ifdef KNN_STATS
+#define KNN_COUNT(stats, statement) \
+    do { if (NULL != (stats)) { (stats)->statement; } } while (0)
+#else
+#define KNN_COUNT(stats, statement)  do { } while (0)
+#endif
+
+// number of histogram bucket, bucket b counts values in [2^(b-1), 2^b)
+const int STATS_BUCKETS = 32;
+
+// counters of one query
+struct CQueryStats
+{
+    CQueryStats() { Clear(); }
+    void    Clear()
+    {
+        visitedNodes = leafPoints = distanceEvals = backtracks = pruned
+            = heapReplacements = 0;
+        maxDepth = 0;
+    }
+    void    Depth(const int depth)
+    {
+        if (depth > maxDepth)
+        {
+            maxDepth = depth;
+        }
+    }
+
+    long long   visitedNodes;       // tree nodes looked at
+    long long   leafPoints;         // points of leaf nodes looked at
+    long long   distanceEvals;      // distance computations
+    long long   backtracks;         // far sides that had to be searched
+    long long   pruned;             // far sides skipped by the bound
+    long long   heapReplacements;   // results replaced by a closer point
+    int         maxDepth;           // deepest level reached
+};
+
+// power-of-two histogram of one counter
+struct CStatsHistogram
+{
+    CStatsHistogram() { Clear(); }
+    void    Clear()
+    {
+        count = 0;
+        sum = 0;
+        max = 0;
+        for (int index = 0; index < STATS_BUCKETS; ++index)
+        {
+            bucket[index] = 0;
+        }
+    }
+    void    Add(const long long value)
+    {
+        int index = 0;
+        while ((index < STATS_BUCKETS - 1) && ((1LL << index) <= value))
+        {
+            ++index;
+        }
+        ++bucket[index];
+        ++count;
+        sum += value;
+        if (value > max)
+        {
+            max = value;
+        }
+    }
+    void    Merge(const CStatsHistogram &other)
+    {
+        for (int index = 0; index < STATS_BUCKETS; ++index)
+        {
+            bucket[index] += other.bucket[index];
+        }
+        count += other.count;
+        sum += other.sum;
+        if (other.max > max)
+        {
+            max = other.max;
+        }
+    }
+    string  ToJson() const
+    {
+        char    text[64];
+        string  json;
+        int     last = STATS_BUCKETS - 1;
+        while ((last > 0) && (bucket[last] == 0))
+        {
+            --last;
+        }
+        snprintf(text, sizeof(text), "{\"mean\":%.3f,\"max\":%lld,\"log2\":["
+                 , (count > 0) ? static_cast<double>(sum) / count : 0.0, max);
+        json = text;
+        for (int index = 0; index <= last; ++index)
+        {
+            snprintf(text, sizeof(text), (index > 0) ? ",%lld" : "%lld"
+                     , bucket[index]);
+            json += text;
+        }
+        return json + "]}";
+    }
+
+    long long   bucket[STATS_BUCKETS];
+    long long   count;
+    long long   sum;
+    long long   max;
+};
+
+// counters of many queries
+struct CQueryStatsAggregate
+{
+    void    Add(const CQueryStats &stats)
+    {
+        visitedNodes.Add(stats.visitedNodes);
+        leafPoints.Add(stats.leafPoints);
+        distanceEvals.Add(stats.distanceEvals);
+        backtracks.Add(stats.backtracks);
+        pruned.Add(stats.pruned);
+        heapReplacements.Add(stats.heapReplacements);
+        maxDepth.Add(stats.maxDepth);
+    }
+    void    Clear()
+    {
+        visitedNodes.Clear();
+        leafPoints.Clear();
+        distanceEvals.Clear();
+        backtracks.Clear();
+        pruned.Clear();
+        heapReplacements.Clear();
+        maxDepth.Clear();
+    }
+    void    Merge(const CQueryStatsAggregate &other)
+    {
+        visitedNodes.Merge(other.visitedNodes);
+        leafPoints.Merge(other.leafPoints);
+        distanceEvals.Merge(other.distanceEvals);
+        backtracks.Merge(other.backtracks);
+        pruned.Merge(other.pruned);
+        heapReplacements.Merge(other.heapReplacements);
+        maxDepth.Merge(other.maxDepth);
+    }
+    string  ToJson() const
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "{\"queries\":%lld", visitedNodes.count);
+        return string(text)
+               + ",\"visited_nodes\":" + visitedNodes.ToJson()
+               + ",\"leaf_points\":" + leafPoints.ToJson()
+               + ",\"distance_evals\":" + distanceEvals.ToJson()
+               + ",\"backtracks\":" + backtracks.ToJson()
+               + ",\"pruned\":" + pruned.ToJson()
+               + ",\"heap_replacements\":" + heapReplacements.ToJson()
+               + ",\"max_depth\":" + maxDepth.ToJson() + "}";
+    }
+
+    CStatsHistogram visitedNodes;
+    CStatsHistogram leafPoints;
+    CStatsHistogram distanceEvals;
+    CStatsHistogram backtracks;
+    CStatsHistogram pruned;
+    CStatsHistogram heapReplacements;
+    CStatsHistogram maxDepth;
+};
+
+#endif  // QUERY_STATS_HEADER
@@ -0,0 +1,408 @@
+// ============================================================================
+// File: resultcache.cpp
+// ============================================================================
+// This header file contains the implementation of the CResultCache class. It
+// uses the template parameter "NodeType" for the type of the points and
+// "Metric" for the distance metric (see metric.h).
+// ============================================================================
+
+#include    <algorithm>
+#include    <cmath>
+#include    <cstring>
+using namespace std;
+#include    "resultcache.h"
+
+// ==== CResultCache::CResultCache ============================================
+//
+// This is the constructor.
+//
+// Access: public
+//
+// Input:
+//      tree [IN]       -- the tree searched on a miss, kept by reference
+//      capacity [IN]   -- largest number of entry (rounded up to a multiple
+//                         of CACHE_SHARDS)
+//      mode [IN]       -- what the entries are keyed on
+//      quantum [IN]    -- grid spacing of the coordinate keys, 0 for exact
+//                         coordinates
+//      metric [IN]     -- the distance metric
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+CResultCache<NodeType, Metric>::CResultCache(const CBSTree<NodeType> &tree
+                                             , const int capacity
+                                             , const CacheKeyMode mode
+                                             , const double quantum
+                                             , const Metric &metric)
+    : m_tree(tree), m_metric(metric), m_mode(mode)
+    , m_quantum(max(quantum, 0.0))
+    , m_shardCapacity(max(1, (capacity + CACHE_SHARDS - 1) / CACHE_SHARDS))
+    , m_version(tree.GetVersion()), m_hits(0), m_misses(0), m_evictions(0)
+{
+
+}  // end of "CResultCache<NodeType, Metric>::CResultCache"
+
+
+
+// ==== CResultCache::Clear ===================================================
+//
+// This function drops every entry. The counters are kept.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CResultCache<NodeType, Metric>::Clear()
+{
+    for (int index = 0; index < CACHE_SHARDS; ++index)
+    {
+        lock_guard<mutex> guard(m_shard[index].lock);
+        m_shard[index].index.clear();
+        m_shard[index].entries.clear();
+    }
+
+}  // end of "CResultCache<NodeType, Metric>::Clear"
+
+
+
+// ==== CResultCache::GetSize =================================================
+//
+// This function returns the number of entry in the cache.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      The number of entry.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+int     CResultCache<NodeType, Metric>::GetSize() const
+{
+    int size = 0;
+    for (int index = 0; index < CACHE_SHARDS; ++index)
+    {
+        lock_guard<mutex> guard(m_shard[index].lock);
+        size += static_cast<int>(m_shard[index].index.size());
+    }
+    return size;
+
+}  // end of "CResultCache<NodeType, Metric>::GetSize"
+
+
+
+// ==== CResultCache::HashKey =================================================
+//
+// This function mixes the parts of a key into a hash value.
+//
+// Access: protected
+//
+// Input:
+//      key [IN]    -- the key
+//
+// Output:
+//      The hash value.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+size_t  CResultCache<NodeType, Metric>::HashKey(const CKey &key)
+{
+    unsigned long long hash = 0;
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        hash = (hash ^ static_cast<unsigned long long>(key.part[dim]))
+               * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+    return static_cast<size_t>(hash);
+
+}  // end of "CResultCache<NodeType, Metric>::HashKey"
+
+
+
+// ==== CResultCache::MakeKey =================================================
+//
+// This function makes the key of a target: its name, the bits of its
+// coordinates, or the grid cell of its coordinates.
+//
+// Access: protected
+//
+// Input:
+//      target [IN] -- the target point
+//
+// Output:
+//      The key.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+typename CResultCache<NodeType, Metric>::CKey
+        CResultCache<NodeType, Metric>::MakeKey(const NodeType &target) const
+{
+    CKey key;
+    double coord[DIMENSIONAL] = {target.GetXCoord(), target.GetYCoord()
+                                 , target.GetZCoord()};
+    for (int dim = 0; dim < DIMENSIONAL; ++dim)
+    {
+        if (m_mode == CACHE_BY_NAME)
+        {
+            key.part[dim] = (dim == 0) ? target.GetName() : 0;
+        }
+        else if (m_quantum > 0)
+        {
+            key.part[dim] = static_cast<long long>(floor(coord[dim]
+                                                         / m_quantum));
+        }
+        else
+        {
+            memcpy(&key.part[dim], &coord[dim], sizeof(double));
+        }
+    }
+    return key;
+
+}  // end of "CResultCache<NodeType, Metric>::MakeKey"
+
+
+
+// ==== CResultCache::NearestNeighbors ========================================
+//
+// This function finds the "num" nearest neighbors of the target point,
+// nearest first: from the entry of its key if that entry has at least "num"
+// neighbors of the current version of the tree and was made for the same
+// coordinates, or for any coordinates of the cell in the grid mode (a hit),
+// else by a search of the tree whose result is kept in the entry (a miss).
+// It can be called from several threads at once.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//      stats [IN]  -- if not NULL, gets the work counters of the search on a
+//                     miss (only when compiled with KNN_STATS)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CResultCache<NodeType, Metric>::NearestNeighbors(
+                                            const NodeType &target
+                                            , const int num
+                                            , vector<NodeType> &listN
+                                            , CQueryStats *stats)
+{
+    // the first query after a change of the tree drops the old entries
+    unsigned long long version = m_tree.GetVersion();
+    unsigned long long seen = m_version.load();
+    if ((seen != version) && m_version.compare_exchange_strong(seen, version))
+    {
+        Clear();
+    }
+
+    bool bGrid = (m_mode == CACHE_BY_COORD) && (m_quantum > 0);
+    CKey key = MakeKey(target);
+    CShard &shard = m_shard[HashKey(key) % CACHE_SHARDS];
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.index.find(key);
+        if ((found != shard.index.end()) && (found->second->num >= num)
+            && (found->second->version == version))
+        {
+            const CEntry &entry = *found->second;
+            bool bSame = SameTarget(entry, target);
+            if (bSame || bGrid)
+            {
+                if (bSame)
+                {
+                    listN.assign(entry.listN.begin(), entry.listN.begin()
+                                 + min(static_cast<int>(entry.listN.size())
+                                       , max(num, 0)));
+                }
+                else
+                {
+                    Rebase(entry.listN, target, num, listN);
+                }
+                shard.entries.splice(shard.entries.begin(), shard.entries
+                                     , found->second);
+                ++m_hits;
+                return;
+            }
+        }
+    }
+
+    // the grid mode keeps one more neighbor, for a target of the cell that
+    // is one of them
+    ++m_misses;
+    vector<NodeType> result;
+    m_tree.NearestNeighbors(target, (bGrid && (num > 0)) ? num + 1 : num
+                            , result, m_metric, stats);
+    listN.assign(result.begin(), result.begin()
+                 + min(static_cast<int>(result.size()), max(num, 0)));
+
+    lock_guard<mutex> guard(shard.lock);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end())
+    {
+        // another thread may have filled it meanwhile, keep the larger one
+        // unless it was made for another target
+        CEntry &entry = *found->second;
+        if ((entry.version != version) || (entry.num < num)
+            || !SameTarget(entry, target))
+        {
+            entry.coord[0] = target.GetXCoord();
+            entry.coord[1] = target.GetYCoord();
+            entry.coord[2] = target.GetZCoord();
+            entry.num = num;
+            entry.version = version;
+            entry.listN = result;
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries
+                             , found->second);
+        return;
+    }
+    CEntry entry;
+    entry.key = key;
+    entry.coord[0] = target.GetXCoord();
+    entry.coord[1] = target.GetYCoord();
+    entry.coord[2] = target.GetZCoord();
+    entry.num = num;
+    entry.version = version;
+    entry.listN = result;
+    shard.entries.push_front(move(entry));
+    shard.index[key] = shard.entries.begin();
+    if (static_cast<int>(shard.entries.size()) > m_shardCapacity)
+    {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        ++m_evictions;
+    }
+
+}  // end of "CResultCache<NodeType, Metric>::NearestNeighbors"
+
+
+
+// ==== CResultCache::Rebase ==================================================
+//
+// This function turns the neighbors of an entry into the approximate answer
+// for another target of its grid cell: their distances to that target, a
+// point at distance 0 (the target itself) dropped, nearest first.
+//
+// Access: protected
+//
+// Input:
+//      cached [IN] -- the neighbors of the entry
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- at most "num" of them, sorted by distance
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+void    CResultCache<NodeType, Metric>::Rebase(const vector<NodeType> &cached
+                                               , const NodeType &target
+                                               , const int num
+                                               , vector<NodeType> &listN
+                                               ) const
+{
+    listN.clear();
+    for (auto it = cached.begin(); it != cached.end(); ++it)
+    {
+        double dist = MetricDistance(m_metric, *it, target);
+        if (dist > 0)
+        {
+            listN.push_back(*it);
+            listN.back().SetDistance(dist);
+        }
+    }
+    stable_sort(listN.begin(), listN.end()
+                , [](const NodeType &a, const NodeType &b)
+                {
+                    return a.GetDistance() < b.GetDistance();
+                });
+    if (static_cast<int>(listN.size()) > max(num, 0))
+    {
+        listN.resize(max(num, 0));
+    }
+
+}  // end of "CResultCache<NodeType, Metric>::Rebase"
+
+
+
+// ==== CResultCache::SameTarget ==============================================
+//
+// This function tells if an entry was made for a target at the same
+// coordinates.
+//
+// Access: protected
+//
+// Input:
+//      entry [IN]  -- the entry
+//      target [IN] -- the target point
+//
+// Output:
+//      True if the coordinates are the same.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+bool    CResultCache<NodeType, Metric>::SameTarget(const CEntry &entry
+                                                   , const NodeType &target)
+{
+    return (entry.coord[0] == target.GetXCoord())
+           && (entry.coord[1] == target.GetYCoord())
+           && (entry.coord[2] == target.GetZCoord());
+
+}  // end of "CResultCache<NodeType, Metric>::SameTarget"
+
+
+
+// ==== CResultCache::ToJson ==================================================
+//
+// This function returns the counters of the cache as a JSON object, to size
+// it: hits, misses, hit rate, evictions, entries and capacity.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      The JSON text.
+//
+// ============================================================================
+
+template    <typename  NodeType, typename  Metric>
+string  CResultCache<NodeType, Metric>::ToJson() const
+{
+    char text[192];
+    long long hits = GetHits();
+    long long misses = GetMisses();
+    snprintf(text, sizeof(text), "{\"hits\":%lld,\"misses\":%lld"
+             ",\"hit_rate\":%.4f,\"evictions\":%lld,\"size\":%d"
+             ",\"capacity\":%d}", hits, misses
+             , (hits + misses > 0) ? 1.0 * hits / (hits + misses) : 0.0
+             , GetEvictions(), GetSize(), m_shardCapacity * CACHE_SHARDS);
+    return string(text);
+
+}  // end of "CResultCache<NodeType, Metric>::ToJson"
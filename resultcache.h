@@ -0,0 +1,151 @@
+// ============================================================================
+// File: resultcache.h
+// ============================================================================
+// This header file contains the declaration of the CResultCache class, a
+// bounded cache of nearest neighbor results in front of a tree, for targets
+// that are queried over and over. An entry is keyed on the target and holds
+// the neighbors of the largest "num" asked for it so far; a query for fewer
+// neighbors is answered from the first ones. The least recently used entry
+// is dropped when the cache is full.
+//
+// The key is one of:
+//      CACHE_BY_COORD  the coordinates of the target, exact when "quantum" is
+//                      0, else the cell of a grid of that spacing. With a
+//                      grid the answer is approximate: a target of the cell
+//                      at other coordinates than the entry was made for gets
+//                      the entry's neighbors (one more than asked, kept for
+//                      this) with their distances to itself, a point at
+//                      distance 0 dropped; a nearer point that is not among
+//                      them is missed. A trade of exactness for hits.
+//      CACHE_BY_NAME   the name of the target, for the points of the set
+// An entry keeps the coordinates of its target; outside the grid mode it
+// only answers a target at the same coordinates, so the answer is exact (a
+// target named like an earlier one, at another place, is a miss and takes
+// the entry over).
+// A cache serves one metric, given as the template parameter: a metric that
+// differs (or another weight or period) needs its own cache.
+//
+// The tree bumps a version on every insert, delete or build; entries of an
+// older version are never returned, and the first query that sees the new
+// version empties the cache. Like for the tree itself, changes must not run
+// during queries. The entries are split into CACHE_SHARDS parts by key, each
+// with its own lock and LRU list, so threads seldom wait for each other.
+// ============================================================================
+
+#ifndef CRESULT_CACHE_HEADER
+#define CRESULT_CACHE_HEADER
+
+#include    "cbstree.h"
+#include    "metric.h"
+#include    "querystats.h"
+#include    <atomic>
+#include    <list>
+#include    <mutex>
+#include    <string>
+#include    <unordered_map>
+#include    <vector>
+using namespace std;
+
+// what an entry of the cache is keyed on
+enum CacheKeyMode
+{
+    CACHE_BY_COORD,     // coordinates of the target (or their grid cell)
+    CACHE_BY_NAME       // name of the target
+};
+
+// default number of entry, and number of independently locked parts
+const int CACHE_CAPACITY = 65536;
+const int CACHE_SHARDS = 16;
+
+template    <typename  NodeType, typename  Metric = CEuclideanMetric>
+class   CResultCache
+{
+public:
+    // constructor
+    CResultCache(const CBSTree<NodeType> &tree
+                 , const int capacity = CACHE_CAPACITY
+                 , const CacheKeyMode mode = CACHE_BY_COORD
+                 , const double quantum = 0
+                 , const Metric &metric = Metric());
+
+    // member functions
+    void    Clear();
+    long long   GetEvictions() const { return m_evictions.load(); }
+    long long   GetHits() const { return m_hits.load(); }
+    long long   GetMisses() const { return m_misses.load(); }
+    int     GetSize() const;
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN
+                             , CQueryStats *stats = NULL);
+    string  ToJson() const;
+
+protected:
+    // key of an entry
+    struct  CKey
+    {
+        bool    operator==(const CKey &other) const
+        {
+            for (int dim = 0; dim < DIMENSIONAL; ++dim)
+            {
+                if (part[dim] != other.part[dim])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        long long   part[DIMENSIONAL];
+    };
+    struct  CKeyHash
+    {
+        size_t  operator()(const CKey &key) const { return HashKey(key); }
+    };
+
+    // neighbors of one target
+    struct  CEntry
+    {
+        CKey                key;
+        double              coord[DIMENSIONAL]; // of the target
+        int                 num;        // neighbors asked for
+        unsigned long long  version;    // version of the tree
+        vector<NodeType>    listN;      // nearest first
+    };
+    typedef list<CEntry>    EntryList;
+
+    // one independently locked part of the cache, most recent entry first
+    struct  CShard
+    {
+        mutable mutex   lock;
+        EntryList       entries;
+        unordered_map<CKey, typename EntryList::iterator, CKeyHash>  index;
+    };
+
+    // member functions
+    static size_t   HashKey(const CKey &key);
+    CKey    MakeKey(const NodeType &target) const;
+    void    Rebase(const vector<NodeType> &cached, const NodeType &target
+                   , const int num, vector<NodeType> &listN) const;
+    static bool SameTarget(const CEntry &entry, const NodeType &target);
+
+private:
+    // no copy, threads hold its locks
+    CResultCache(const CResultCache &other);
+    CResultCache& operator=(const CResultCache &rhs);
+
+    // data members
+    const CBSTree<NodeType>     &m_tree;
+    Metric                      m_metric;
+    CacheKeyMode                m_mode;
+    double                      m_quantum;
+    int                         m_shardCapacity;    // entries per shard
+    CShard                      m_shard[CACHE_SHARDS];
+    atomic<unsigned long long>  m_version;          // version of the entries
+    atomic<long long>           m_hits;
+    atomic<long long>           m_misses;
+    atomic<long long>           m_evictions;
+};
+
+#include    "resultcache.cpp"
+
+#endif  // CRESULT_CACHE_HEADER
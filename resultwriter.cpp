@@ -0,0 +1,248 @@
+// ============================================================================
+// File: resultwriter.cpp
+// ============================================================================
+// This header file contains the implementation of the CResultWriter class.
+// ============================================================================
+
+#include    <cstring>
+using namespace std;
+#include    "resultwriter.h"
+
+// ==== CResultWriter::Append =================================================
+//
+// This function copies bytes to the buffer, writing the buffer out first
+// when they do not fit.
+//
+// Access: protected
+//
+// Input:
+//      data [IN]   -- the bytes
+//      size [IN]   -- number of byte, at most WRITER_BUFFER
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+inline  void    CResultWriter::Append(const void *data, const int size)
+{
+    if (m_used + size > static_cast<int>(m_buffer.size()))
+    {
+        Flush();
+    }
+    memcpy(&m_buffer[m_used], data, size);
+    m_used += size;
+
+}  // end of "CResultWriter::Append"
+
+
+
+// ==== CResultWriter::Close ==================================================
+//
+// This function writes out what is left in the buffer and closes the file
+// (the standard output is only flushed).
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      True if every byte was written, false otherwise.
+//
+// ============================================================================
+
+inline  bool    CResultWriter::Close()
+{
+    if (NULL == m_file)
+    {
+        return !m_bError;
+    }
+    Flush();
+    if (m_file == stdout)
+    {
+        m_bError = (fflush(m_file) != 0) || m_bError;
+    }
+    else
+    {
+        m_bError = (fclose(m_file) != 0) || m_bError;
+    }
+    m_file = NULL;
+    return !m_bError;
+
+}  // end of "CResultWriter::Close"
+
+
+
+// ==== CResultWriter::Flush ==================================================
+//
+// This function gives the buffer to the file in one write.
+//
+// Access: protected
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+inline  void    CResultWriter::Flush()
+{
+    if ((NULL != m_file) && (m_used > 0))
+    {
+        if (fwrite(m_buffer.data(), 1, m_used, m_file)
+            != static_cast<size_t>(m_used))
+        {
+            m_bError = true;
+        }
+        m_bytes += m_used;
+    }
+    m_used = 0;
+
+}  // end of "CResultWriter::Flush"
+
+
+
+// ==== CResultWriter::Open ===================================================
+//
+// This function opens the output and, for CSV, writes the header line. Any
+// open output is closed first.
+//
+// Access: public
+//
+// Input:
+//      fileName [IN]   -- name of the file, NULL or "-" for the standard
+//                         output
+//      format [IN]     -- the format
+//
+// Output:
+//      True if the output is open, false otherwise.
+//
+// ============================================================================
+
+inline  bool    CResultWriter::Open(const char *fileName
+                                    , const ResultFormat format)
+{
+    Close();
+    m_bError = false;
+    m_bytes = 0;
+    m_used = 0;
+    m_format = format;
+    m_buffer.resize(WRITER_BUFFER);
+    if ((NULL == fileName) || (strcmp(fileName, "-") == 0))
+    {
+        m_file = stdout;
+    }
+    else
+    {
+        m_file = fopen(fileName, (format == RESULT_BINARY) ? "wb" : "w");
+    }
+    if (NULL == m_file)
+    {
+        return false;
+    }
+    if (m_format == RESULT_CSV)
+    {
+        const char header[] = "query,rank,neighbor,distance\n";
+        Append(header, sizeof(header) - 1);
+    }
+    return true;
+
+}  // end of "CResultWriter::Open"
+
+
+
+// ==== CResultWriter::Write ==================================================
+//
+// This function writes the neighbors of one query, in the order of the list
+// (nearest first for the searches of CBSTree).
+//
+// Access: public
+//
+// Input:
+//      query [IN]  -- name of the query point
+//      listN [IN]  -- its neighbors, with their distance
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CResultWriter::Write(const int query, const vector<NodeType> &listN)
+{
+    char line[96];
+
+    for (size_t rank = 0; rank < listN.size(); ++rank)
+    {
+        int name = listN[rank].GetName();
+        double dist = listN[rank].GetDistance();
+        if (m_format == RESULT_BINARY)
+        {
+            memcpy(line, &query, sizeof(int));
+            memcpy(line + sizeof(int), &name, sizeof(int));
+            memcpy(line + 2 * sizeof(int), &dist, sizeof(double));
+            Append(line, 2 * sizeof(int) + sizeof(double));
+        }
+        else
+        {
+            int size = snprintf(line, sizeof(line), "%d,%d,%d,%.17g\n", query
+                                , static_cast<int>(rank) + 1, name, dist);
+            Append(line, size);
+        }
+    }
+
+}  // end of "CResultWriter::Write"
+
+
+
+// ==== CResultWriter::GetFormatName ==========================================
+//
+// This function returns the name of a format (csv or binary).
+//
+// Access: public
+//
+// Input:
+//      format [IN] -- the format
+//
+// Output:
+//      The name.
+//
+// ============================================================================
+
+inline  const char* CResultWriter::GetFormatName(const ResultFormat format)
+{
+    return (format == RESULT_BINARY) ? "binary" : "csv";
+
+}  // end of "CResultWriter::GetFormatName"
+
+
+
+// ==== CResultWriter::ParseFormat ============================================
+//
+// This function finds a format from its name.
+//
+// Access: public
+//
+// Input:
+//      name [IN]       -- csv or binary
+//      format [OUT]    -- the format, unchanged if the name is unknown
+//
+// Output:
+//      True if the name is known, false otherwise.
+//
+// ============================================================================
+
+inline  bool    CResultWriter::ParseFormat(const string &name
+                                           , ResultFormat &format)
+{
+    if ((name == "csv") || (name == "binary"))
+    {
+        format = (name == "csv") ? RESULT_CSV : RESULT_BINARY;
+        return true;
+    }
+    return false;
+
+}  // end of "CResultWriter::ParseFormat"
@@ -0,0 +1,75 @@
+// ============================================================================
+// File: resultwriter.h
+// ============================================================================
+// This header file contains the declaration of the CResultWriter class. It
+// writes the neighbors of many queries to a file or to the standard output
+// through one large buffer, so a batch of millions of queries is not held
+// back by a system call or a flush per line. There are two formats:
+//
+//      RESULT_CSV      a "query,rank,neighbor,distance" header, then one line
+//                      per neighbor with the names of the points, the rank
+//                      from 1 (nearest) and the distance
+//      RESULT_BINARY   one 16-byte record per neighbor, in the byte order of
+//                      the machine: int32 query name, int32 neighbor name,
+//                      float64 distance; the records of a query are nearest
+//                      first
+// ============================================================================
+
+#ifndef CRESULT_WRITER_HEADER
+#define CRESULT_WRITER_HEADER
+
+#include    <cstdio>
+#include    <string>
+#include    <vector>
+using namespace std;
+
+// output formats
+enum ResultFormat
+{
+    RESULT_CSV,
+    RESULT_BINARY
+};
+
+// size of the output buffer in byte
+const int WRITER_BUFFER = 1 << 20;
+
+class   CResultWriter
+{
+public:
+    // constructor and destructor
+    CResultWriter() : m_file(NULL), m_format(RESULT_CSV), m_used(0)
+                    , m_bytes(0), m_bError(false) {}
+    ~CResultWriter() { Close(); }
+
+    // member functions
+    bool    Close();
+    long long GetBytes() const { return m_bytes + m_used; }
+    bool    Open(const char *fileName, const ResultFormat format);
+    template    <typename  NodeType>
+    void    Write(const int query, const vector<NodeType> &listN);
+
+    static  bool    ParseFormat(const string &name, ResultFormat &format);
+    static  const char* GetFormatName(const ResultFormat format);
+
+protected:
+    // member functions
+    void    Append(const void *data, const int size);
+    void    Flush();
+
+private:
+    // no copy, the writer owns the file
+    CResultWriter(const CResultWriter &other);
+    CResultWriter& operator=(const CResultWriter &rhs);
+
+    // data members
+    FILE            *m_file;        // NULL when closed
+    ResultFormat    m_format;
+    vector<char>    m_buffer;       // WRITER_BUFFER byte
+    int             m_used;         // byte of m_buffer in use
+    long long       m_bytes;        // byte already given to the file
+    bool            m_bError;       // a write failed
+};
+
+#include    "resultwriter.cpp"
+
+#endif  // CRESULT_WRITER_HEADER
@@ -0,0 +1,200 @@
+// ============================================================================
+// File: searchplan.cpp
+// ============================================================================
+// This header file contains the implementation of the CSearchPlanner class.
+// It uses the template parameter "NodeType" for the type of the points.
+// ============================================================================
+
+#include    "searchplan.h"
+
+// ==== CSearchPlanner::BuildIndex ============================================
+//
+// This function keeps the points for the scan, and builds the tree too when
+// some query could be sent to it: the engine is forced to the tree, or there
+// are more points than the scan takes for one neighbor.
+//
+// Access: public
+//
+// Input:
+//      point [IN]  -- the points
+//      num [IN]    -- number of point
+//      rule [IN]   -- split rule of the tree (see CBSTree::BuildTree)
+//
+// Output:
+//      The number of point kept.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CSearchPlanner<NodeType>::BuildIndex(const NodeType point[]
+                                             , const int num
+                                             , const SplitRule rule)
+{
+    m_rule = rule;
+    m_tree.DestroyTree();
+    int numPoints = m_brute.BuildIndex(point, num);
+    BuildTree();
+    return numPoints;
+
+}  // end of "CSearchPlanner<NodeType>::BuildIndex"
+
+
+
+// ==== CSearchPlanner::BuildTree =============================================
+//
+// This function builds the tree from the points of the scan if a query can
+// use it and it is not built yet.
+//
+// Access: protected
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CSearchPlanner<NodeType>::BuildTree()
+{
+    int numPoints = m_brute.GetNumPoints();
+    bool bNeeded = (m_engine == ENGINE_KDTREE)
+                   || ((m_engine == ENGINE_AUTO)
+                       && (PlanEngine(numPoints, DIMENSIONAL, 1)
+                           == ENGINE_KDTREE));
+    if (bNeeded && m_tree.IsTreeEmpty() && (numPoints > 0))
+    {
+        m_tree.BuildTree(m_brute.GetPoints(), numPoints, m_rule);
+    }
+
+}  // end of "CSearchPlanner<NodeType>::BuildTree"
+
+
+
+// ==== CSearchPlanner::GetEngine =============================================
+//
+// This function returns the engine that a query for "num" neighbors runs
+// on: the forced one, or the choice of PlanEngine.
+//
+// Access: public
+//
+// Input:
+//      num [IN]    -- number of nearest neighbor
+//
+// Output:
+//      ENGINE_BRUTE or ENGINE_KDTREE.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+SearchEngine    CSearchPlanner<NodeType>::GetEngine(const int num) const
+{
+    if (m_engine != ENGINE_AUTO)
+    {
+        return m_engine;
+    }
+    return PlanEngine(m_brute.GetNumPoints(), DIMENSIONAL, num);
+
+}  // end of "CSearchPlanner<NodeType>::GetEngine"
+
+
+
+// ==== CSearchPlanner::NearestNeighbors ======================================
+//
+// This function finds the "num" nearest neighbors of the target point in the
+// Euclidean metric on the engine of GetEngine, nearest first. It can be
+// called from several threads at once.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//      stats [IN]  -- if not NULL, gets the work counters of this query (only
+//                     when compiled with KNN_STATS)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CSearchPlanner<NodeType>::NearestNeighbors(const NodeType &target
+                                                   , const int num
+                                                   , vector<NodeType> &listN
+                                                   , CQueryStats *stats) const
+{
+    NearestNeighbors(target, num, listN, CEuclideanMetric(), stats);
+
+}  // end of "CSearchPlanner<NodeType>::NearestNeighbors"
+
+
+
+// ==== CSearchPlanner::NearestNeighbors ======================================
+//
+// This function finds the "num" nearest neighbors of the target point in any
+// metric of metric.h on the engine of GetEngine, nearest first, with their
+// distance in that metric. Both engines give the same distances; among
+// points at the same distance they may keep different ones.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the nearest neighbors, sorted by distance
+//      metric [IN] -- the distance metric
+//      stats [IN]  -- if not NULL, gets the work counters of this query (only
+//                     when compiled with KNN_STATS)
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void    CSearchPlanner<NodeType>::NearestNeighbors(const NodeType &target
+                                                   , const int num
+                                                   , vector<NodeType> &listN
+                                                   , const Metric &metric
+                                                   , CQueryStats *stats) const
+{
+    if (GetEngine(num) == ENGINE_KDTREE)
+    {
+        m_tree.NearestNeighbors(target, num, listN, metric, stats);
+    }
+    else
+    {
+        m_brute.NearestNeighbors(target, num, listN, metric, stats);
+    }
+
+}  // end of "CSearchPlanner<NodeType>::NearestNeighbors"
+
+
+
+// ==== CSearchPlanner::SetEngine =============================================
+//
+// This function forces the engine of every query (ENGINE_AUTO gives the
+// choice back to PlanEngine). The tree is built now if it is needed and
+// missing, so this must not run during queries.
+//
+// Access: public
+//
+// Input:
+//      engine [IN] -- the engine
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CSearchPlanner<NodeType>::SetEngine(const SearchEngine engine)
+{
+    m_engine = engine;
+    BuildTree();
+
+}  // end of "CSearchPlanner<NodeType>::SetEngine"
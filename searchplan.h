@@ -0,0 +1,152 @@
+// ============================================================================
+// File: searchplan.h
+// ============================================================================
+// This header file contains the planner that picks the search engine of a
+// nearest neighbor query: a brute-force scan (CBruteForce) or the k-d tree
+// (CBSTree). A tree only pays when it can skip most of its points: with few
+// points, or when the number of neighbors is a large part of the points, it
+// visits nearly every node anyway and the flat scan is faster. PlanEngine
+// makes that choice from the number of point n, the dimension D and the
+// number of neighbor k; the limits below come from the engine_crossover
+// phase of bench.cpp and can be measured again on other hardware. The choice
+// can also be forced per planner (SetEngine).
+// ============================================================================
+
+#ifndef SEARCH_PLAN_HEADER
+#define SEARCH_PLAN_HEADER
+
+#include    "bruteforce.h"
+#include    "cbstree.h"
+#include    "fieldnode.h"
+#include    "metric.h"
+#include    "querystats.h"
+#include    <string>
+#include    <vector>
+using namespace std;
+
+// search engines
+enum SearchEngine
+{
+    ENGINE_AUTO,        // let PlanEngine choose for each query
+    ENGINE_BRUTE,       // scan every point (CBruteForce)
+    ENGINE_KDTREE       // k-d tree search (CBSTree)
+};
+
+// largest number of point scanned instead of searched with a tree in three
+// dimensions; a k-d tree needs n much larger than 2^D to prune, so the limit
+// doubles with each dimension past three
+const int PLAN_BRUTE_POINTS = 64;
+
+// the scan is also used when the number of neighbor is at least
+// 1 / PLAN_BRUTE_FRACTION of the points
+const int PLAN_BRUTE_FRACTION = 4;
+
+
+
+// === PlanEngine =============================================================
+// This function will pick the engine of a query.
+//
+// Input: -- numPoints: number of point searched
+//        -- dim: number of dimension
+//        -- num: number of nearest neighbor wanted
+//
+// Output: ENGINE_BRUTE or ENGINE_KDTREE
+// ============================================================================
+
+inline SearchEngine PlanEngine(const int numPoints, const int dim
+                               , const int num)
+{
+    long long limit = PLAN_BRUTE_POINTS;
+    for (int extra = dim; (extra > 3) && (limit < numPoints); --extra)
+    {
+        limit *= 2;
+    }
+    if ((numPoints <= limit)
+        || (1LL * num * PLAN_BRUTE_FRACTION >= numPoints))
+    {
+        return ENGINE_BRUTE;
+    }
+    return ENGINE_KDTREE;
+
+} // end of "PlanEngine"
+
+
+
+// === GetEngineName ==========================================================
+// This function will return the name of an engine.
+// ============================================================================
+
+inline const char* GetEngineName(const SearchEngine engine)
+{
+    switch (engine)
+    {
+    case ENGINE_AUTO:       return "auto";
+    case ENGINE_BRUTE:      return "brute";
+    case ENGINE_KDTREE:     return "kdtree";
+    }
+    return "unknown";
+
+} // end of "GetEngineName"
+
+
+
+// === ParseEngine ============================================================
+// This function will find an engine from its name (auto, brute or kdtree).
+//
+// Output: true if the name is known, false otherwise
+// ============================================================================
+
+inline bool ParseEngine(const string &name, SearchEngine &engine)
+{
+    const SearchEngine all[] = {ENGINE_AUTO, ENGINE_BRUTE, ENGINE_KDTREE};
+    for (int index = 0; index < 3; ++index)
+    {
+        if (name == GetEngineName(all[index]))
+        {
+            engine = all[index];
+            return true;
+        }
+    }
+    return false;
+
+} // end of "ParseEngine"
+
+
+
+template    <typename  NodeType>
+class   CSearchPlanner
+{
+public:
+    // constructor
+    CSearchPlanner(const SearchEngine engine = ENGINE_AUTO)
+        : m_engine(engine), m_rule(SPLIT_MEDIAN) {}
+
+    // member functions
+    int     BuildIndex(const NodeType point[], const int num
+                       , const SplitRule rule = SPLIT_MEDIAN);
+    SearchEngine    GetEngine(const int num) const;
+    int     GetNumPoints() const { return m_brute.GetNumPoints(); }
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN
+                             , CQueryStats *stats = NULL) const;
+    template    <typename  Metric>
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN, const Metric &metric
+                             , CQueryStats *stats = NULL) const;
+    void    SetEngine(const SearchEngine engine);
+
+protected:
+    // member functions
+    void    BuildTree();
+
+private:
+    // data members
+    SearchEngine            m_engine;   // ENGINE_AUTO, or the forced engine
+    SplitRule               m_rule;     // split rule of the tree
+    CBruteForce<NodeType>   m_brute;    // always built, it keeps the points
+    CBSTree<NodeType>       m_tree;     // only built when a query can use it
+};
+
+#include    "searchplan.cpp"
+
+#endif // SEARCH_PLAN_HEADER
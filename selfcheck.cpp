@@ -0,0 +1,881 @@
+// ============================================================================
+// This is the self-check of the searches. It compares the answers of the
+// k-d tree in every metric of metric.h, CCompactTree, CGroupSearch,
+// CNeighborIterator, CKnnJoin, CDiskIndex, CResultCache and CSnapshotIndex,
+// and the box range count and sums of the tree, with a scan of every point
+// (CBruteForce), on point sets
+// with many repeated points: a coarse lattice (DIST_GRID), Gaussian blobs,
+// and uniform points copied ten times each. Half of the queries are points
+// of the set, so the target and its copies are at distance 0.
+//
+// Two answers agree when they have the same number of neighbor and the same
+// distance at each rank (within a relative 1e-9); among points at the same
+// distance the engines may keep different ones.
+//
+// Usage: selfcheck [-n points] [-q queries] [-k neighbors] [-seed value]
+//
+// Output: one line per check and data set with the number of query whose
+//         answers differ; the exit status is 1 if any check failed.
+// ============================================================================
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <tuple>
+#include <string>
+#include <vector>
+#include "fieldnode.h"
+#include "bruteforce.h"
+#include "cbstree.h"
+#include "compacttree.h"
+#include "datagen.h"
+#include "diskindex.h"
+#include "groupsearch.h"
+#include "knnjoin.h"
+#include "neighboriter.h"
+#include "metric.h"
+#include "resultcache.h"
+#include "snapshot.h"
+using namespace std;
+
+// extent of the generated points, the period of the periodic metric
+const double CHECK_EXTENT = 1000;
+
+// settings of the check, changed by the command line flags
+struct CheckOptions
+{
+    int         numPoints;
+    int         numQueries;
+    int         numNeighbor;
+    unsigned long long seed;
+};
+
+// function prototype
+int CheckCache(const CheckOptions &opt, const char *dataset
+               , const vector<FieldNode> &point
+               , const vector<FieldNode> &query);
+template <typename CoordType>
+int CheckCompact(const CheckOptions &opt, const char *dataset
+                 , const vector<FieldNode> &point
+                 , const vector<FieldNode> &query, const char *storage);
+int CheckDisk(const CheckOptions &opt, const char *dataset
+              , const vector<FieldNode> &point
+              , const vector<FieldNode> &query);
+template <typename Metric>
+int CheckIterator(const CheckOptions &opt, const char *dataset
+                  , const vector<FieldNode> &point
+                  , const vector<FieldNode> &query, const char *name
+                  , const Metric &metric);
+int CheckJoin(const CheckOptions &opt, const char *dataset
+              , const vector<FieldNode> &point
+              , const vector<FieldNode> &query);
+template <typename Metric>
+int CheckMetric(const CheckOptions &opt, const char *dataset
+                , const vector<FieldNode> &point
+                , const vector<FieldNode> &query, const char *name
+                , const Metric &metric);
+int CheckRange(const CheckOptions &opt, const char *dataset
+               , const vector<FieldNode> &point
+               , const vector<FieldNode> &query);
+int CheckSnapshot(const CheckOptions &opt, const char *dataset
+                  , const vector<FieldNode> &point
+                  , const vector<FieldNode> &query);
+void MakePoints(const CheckOptions &opt, const int set
+                , vector<FieldNode> &point, vector<FieldNode> &query
+                , string &dataset);
+int Report(const char *check, const char *dataset, const int numBad
+           , const int numQuery);
+bool SameDistances(const vector<FieldNode> &a, const vector<FieldNode> &b);
+
+
+
+// === main ===================================================================
+//
+// ============================================================================
+
+int main(int argc, char *argv[])
+{
+    CheckOptions opt;
+    opt.numPoints = 40000;
+    opt.numQueries = 400;
+    opt.numNeighbor = 8;
+    opt.seed = 1;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool bValue = (arg + 1 < argc);
+        if ((strcmp(argv[arg], "-n") == 0) && bValue)
+            opt.numPoints = atoi(argv[++arg]);
+        else if ((strcmp(argv[arg], "-q") == 0) && bValue)
+            opt.numQueries = atoi(argv[++arg]);
+        else if ((strcmp(argv[arg], "-k") == 0) && bValue)
+            opt.numNeighbor = atoi(argv[++arg]);
+        else if ((strcmp(argv[arg], "-seed") == 0) && bValue)
+            opt.seed = strtoull(argv[++arg], NULL, 10);
+        else
+        {
+            fprintf(stderr, "usage: selfcheck [-n points] [-q queries]"
+                    " [-k neighbors] [-seed value]\n");
+            return 2;
+        }
+    }
+    if ((opt.numPoints < 10) || (opt.numQueries < 2)
+        || (opt.numNeighbor < 1))
+    {
+        fprintf(stderr, "selfcheck: need at least 10 points, 2 queries and 1"
+                " neighbor\n");
+        return 2;
+    }
+
+    int numFailed = 0;
+    for (int set = 0; set < 3; ++set)
+    {
+        vector<FieldNode> point;
+        vector<FieldNode> query;
+        string dataset;
+        MakePoints(opt, set, point, query, dataset);
+        const char *name = dataset.c_str();
+
+        numFailed += CheckMetric(opt, name, point, query, "euclidean"
+                                 , CEuclideanMetric());
+        numFailed += CheckMetric(opt, name, point, query, "manhattan"
+                                 , CManhattanMetric());
+        numFailed += CheckMetric(opt, name, point, query, "chebyshev"
+                                 , CChebyshevMetric());
+        numFailed += CheckMetric(opt, name, point, query, "weighted"
+                                 , CWeightedMetric(1, 4, 0.25));
+        numFailed += CheckMetric(opt, name, point, query, "periodic"
+                                 , CPeriodicMetric(CHECK_EXTENT, CHECK_EXTENT
+                                                   , CHECK_EXTENT));
+        numFailed += CheckIterator(opt, name, point, query, "euclidean"
+                                   , CEuclideanMetric());
+        numFailed += CheckIterator(opt, name, point, query, "manhattan"
+                                   , CManhattanMetric());
+        numFailed += CheckCompact<double>(opt, name, point, query, "double");
+        numFailed += CheckCompact<float>(opt, name, point, query, "float");
+        numFailed += CheckCompact<unsigned short>(opt, name, point, query
+                                                  , "int16");
+        numFailed += CheckRange(opt, name, point, query);
+        numFailed += CheckJoin(opt, name, point, query);
+        numFailed += CheckDisk(opt, name, point, query);
+        numFailed += CheckCache(opt, name, point, query);
+        numFailed += CheckSnapshot(opt, name, point, query);
+    }
+    printf("%s: %d check(s) failed\n", (numFailed == 0) ? "ok" : "FAILED"
+           , numFailed);
+    return (numFailed == 0) ? 0 : 1;
+
+} // end of "main"
+
+
+
+// === MakePoints =============================================================
+// This function will make one of the point sets and its queries: the first
+// half of the queries are points of the set, the rest uniform in the box.
+//
+// Input: -- opt: check settings
+//        -- set: 0 lattice, 1 blobs, 2 copies
+//        -- point: the points, named 1 to n
+//        -- query: the queries
+//        -- dataset: name of the set
+//
+// Output: nothing
+// ============================================================================
+
+void MakePoints(const CheckOptions &opt, const int set
+                , vector<FieldNode> &point, vector<FieldNode> &query
+                , string &dataset)
+{
+    CDataGenerator generator(opt.seed + set, CHECK_EXTENT);
+    mt19937_64 engine(opt.seed + set);
+    uniform_int_distribution<int> pick(0, opt.numPoints - 1);
+
+    point.resize(opt.numPoints);
+    if (set == 2)
+    {
+        // a tenth of the points, each one copied ten times
+        int numDistinct = opt.numPoints / 10;
+        generator.Generate(DIST_UNIFORM, point.data(), numDistinct, 1);
+        for (int index = numDistinct; index < opt.numPoints; ++index)
+        {
+            point[index] = point[index % numDistinct];
+            point[index].SetName(index + 1);
+        }
+        dataset = "copies";
+    }
+    else
+    {
+        DataDistribution dist = (set == 0) ? DIST_GRID : DIST_CLUSTERED;
+        generator.Generate(dist, point.data(), opt.numPoints, 1);
+        dataset = CDataGenerator::GetDistributionName(dist);
+    }
+
+    // a blob near the border reaches past the box, and the periodic metric
+    // needs every point inside it
+    CPeriodicMetric box(CHECK_EXTENT, CHECK_EXTENT, CHECK_EXTENT);
+    for (auto it = point.begin(); it != point.end(); ++it)
+    {
+        it->SetXCoord(box.Wrap(it->GetXCoord(), 0));
+        it->SetYCoord(box.Wrap(it->GetYCoord(), 1));
+        it->SetZCoord(box.Wrap(it->GetZCoord(), 2));
+    }
+
+    query.resize(opt.numQueries);
+    int numInSet = opt.numQueries / 2;
+    for (int index = 0; index < numInSet; ++index)
+    {
+        query[index] = point[pick(engine)];
+    }
+    generator.SetSeed(opt.seed + set + 100);
+    generator.Generate(DIST_UNIFORM, query.data() + numInSet
+                       , opt.numQueries - numInSet, 1);
+
+} // end of "MakePoints"
+
+
+
+// === CheckMetric ============================================================
+// This function will compare the k-d tree (NearestNeighbors, built one
+// point at a time, and built by InsertBatch in blocks of 1/16 of the points
+// with every fifth point then deleted and put back in one more block) and
+// CGroupSearch on a bulk-built tree with the scan, in one metric.
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//        -- name: name of the metric
+//        -- metric: the metric
+//
+// Output: the number of failed check
+// ============================================================================
+
+template <typename Metric>
+int CheckMetric(const CheckOptions &opt, const char *dataset
+                , const vector<FieldNode> &point
+                , const vector<FieldNode> &query, const char *name
+                , const Metric &metric)
+{
+    CBruteForce<FieldNode> brute;
+    CBSTree<FieldNode> tree;
+    CBSTree<FieldNode> bulk;
+    CBSTree<FieldNode> batch;
+    vector<FieldNode> expect;
+    vector<FieldNode> listN;
+    int numQuery = static_cast<int>(query.size());
+    int numBad = 0;
+
+    brute.BuildIndex(point.data(), point.size());
+    for (auto it = point.begin(); it != point.end(); ++it)
+    {
+        tree.InsertItem(*it);
+    }
+    bulk.BuildTree(point.data(), point.size());
+
+    // small blocks rebuild only the subtrees they grow by half or more
+    int size = static_cast<int>(point.size());
+    int block = max(1, size / 16);
+    for (int first = 0; first < size; first += block)
+    {
+        batch.InsertBatch(point.data() + first, min(block, size - first)
+                          , SPLIT_SLIDING_MIDPOINT);
+    }
+    vector<FieldNode> removed;
+    for (int at = 0; at < size; at += 5)
+    {
+        if (batch.DeleteItem(point[at]))
+        {
+            removed.push_back(point[at]);
+        }
+    }
+    batch.InsertBatch(removed.data(), removed.size(), SPLIT_WIDEST);
+
+    vector<vector<FieldNode> > result(numQuery);
+    CGroupSearch<FieldNode, Metric> group(bulk, QUERY_GROUP, metric);
+    group.NearestNeighbors(query.data(), numQuery, opt.numNeighbor
+                           , result.data());
+    int numGroupBad = 0;
+    int numBatchBad = 0;
+    for (int index = 0; index < numQuery; ++index)
+    {
+        brute.NearestNeighbors(query[index], opt.numNeighbor, expect
+                               , metric);
+        tree.NearestNeighbors(query[index], opt.numNeighbor, listN, metric);
+        numBad += SameDistances(expect, listN) ? 0 : 1;
+        batch.NearestNeighbors(query[index], opt.numNeighbor, listN, metric);
+        numBatchBad += SameDistances(expect, listN) ? 0 : 1;
+        numGroupBad += SameDistances(expect, result[index]) ? 0 : 1;
+    }
+
+    string check = string("tree_") + name;
+    int numFailed = Report(check.c_str(), dataset, numBad, numQuery);
+    check = string("batch_") + name;
+    numFailed += Report(check.c_str(), dataset, numBatchBad, numQuery);
+    check = string("group_") + name;
+    return numFailed + Report(check.c_str(), dataset, numGroupBad, numQuery);
+
+} // end of "CheckMetric"
+
+
+
+// === CheckIterator ==========================================================
+// This function will pull neighbors from one CNeighborIterator, Reset for
+// each query, and compare them rank by rank with the scan: three times the
+// number of neighbor plus ten, so the ranks past any fixed k are checked
+// too. PeekDistance must give the distance of the neighbor Next hands out.
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//        -- name: name of the metric
+//        -- metric: the metric
+//
+// Output: the number of failed check
+// ============================================================================
+
+template <typename Metric>
+int CheckIterator(const CheckOptions &opt, const char *dataset
+                  , const vector<FieldNode> &point
+                  , const vector<FieldNode> &query, const char *name
+                  , const Metric &metric)
+{
+    CBruteForce<FieldNode> brute;
+    CBSTree<FieldNode> tree;
+    vector<FieldNode> expect;
+    vector<FieldNode> listN;
+    FieldNode neighbor;
+    int num = 3 * opt.numNeighbor + 10;
+    int numBad = 0;
+
+    brute.BuildIndex(point.data(), point.size());
+    tree.BuildTree(point.data(), point.size(), SPLIT_WIDEST);
+    CNeighborIterator<FieldNode, Metric> next(tree, query[0], metric);
+    for (auto it = query.begin(); it != query.end(); ++it)
+    {
+        next.Reset(*it);
+        listN.clear();
+        bool bGood = true;
+        double dist = 0;
+        while ((static_cast<int>(listN.size()) < num)
+               && next.PeekDistance(dist) && next.Next(neighbor))
+        {
+            bGood = bGood && (dist == neighbor.GetDistance());
+            listN.push_back(neighbor);
+        }
+        brute.NearestNeighbors(*it, num, expect, metric);
+        numBad += (bGood && SameDistances(expect, listN)) ? 0 : 1;
+    }
+    string check = string("iter_") + name;
+    return Report(check.c_str(), dataset, numBad, query.size());
+
+} // end of "CheckIterator"
+
+
+
+// === CheckCompact ===========================================================
+// This function will compare a CCompactTree that keeps the coordinates in
+// "CoordType" with the scan.
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//        -- storage: name of the coordinate type
+//
+// Output: the number of failed check
+// ============================================================================
+
+template <typename CoordType>
+int CheckCompact(const CheckOptions &opt, const char *dataset
+                 , const vector<FieldNode> &point
+                 , const vector<FieldNode> &query, const char *storage)
+{
+    CBruteForce<FieldNode> brute;
+    CCompactTree<FieldNode, CoordType> compact;
+    vector<FieldNode> expect;
+    vector<FieldNode> listN;
+    int numBad = 0;
+
+    brute.BuildIndex(point.data(), point.size());
+    compact.BuildTree(point.data(), point.size());
+    for (auto it = query.begin(); it != query.end(); ++it)
+    {
+        brute.NearestNeighbors(*it, opt.numNeighbor, expect);
+        compact.NearestNeighbors(*it, opt.numNeighbor, listN);
+        numBad += SameDistances(expect, listN) ? 0 : 1;
+    }
+    string check = string("compact_") + storage;
+    return Report(check.c_str(), dataset, numBad, query.size());
+
+} // end of "CheckCompact"
+
+
+
+// === CheckRange =============================================================
+// This function will grow a tree by InsertItem and InsertBatch and shrink it
+// by DeleteItem over four rounds, and after each round compare RangeCount,
+// RangeAggregate (count and sums) and the size of RangeQuery with a scan of
+// the points left, for random boxes and for boxes with two queries as
+// corners (points on the faces count). The last round also checks a copy
+// of the tree and a tree moved from it, since the counts and sums of the
+// subtrees have to follow every change and every copy.
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//
+// Output: the number of failed check
+// ============================================================================
+
+int CheckRange(const CheckOptions &opt, const char *dataset
+               , const vector<FieldNode> &point
+               , const vector<FieldNode> &query)
+{
+    typedef tuple<double, double, double>   Key;
+    map<Key, FieldNode> live;
+    CBSTree<FieldNode> tree;
+    vector<FieldNode> listN;
+    mt19937_64 random(opt.seed);
+    uniform_real_distribution<double> coord(-CHECK_EXTENT / 10
+                                            , CHECK_EXTENT * 1.1);
+    int size = static_cast<int>(point.size());
+    int numBad = 0;
+    int numBoxes = 0;
+
+    auto keyOf = [](const FieldNode &item)
+    {
+        return Key(item.GetXCoord(), item.GetYCoord(), item.GetZCoord());
+    };
+    for (int at = 0; at < size / 4; ++at)
+    {
+        tree.InsertItem(point[at]);
+        live.insert(make_pair(keyOf(point[at]), point[at]));
+    }
+    for (int round = 0; round < 4; ++round)
+    {
+        // a block by InsertBatch, a few more one by one, then deletes
+        int first = size / 4 + round * size / 8;
+        int last = first + size / 8;
+        tree.InsertBatch(point.data() + first, last - first, SPLIT_WIDEST);
+        for (int at = first; at < last; ++at)
+        {
+            live.insert(make_pair(keyOf(point[at]), point[at]));
+        }
+        for (int at = last; at < min(size, last + size / 64); ++at)
+        {
+            tree.InsertItem(point[at]);
+            live.insert(make_pair(keyOf(point[at]), point[at]));
+        }
+        for (int at = round; at < last; at += 7)
+        {
+            tree.DeleteItem(point[at]);
+            live.erase(keyOf(point[at]));
+        }
+
+        CBSTree<FieldNode> copy(tree);
+        CBSTree<FieldNode> moved(move(copy));
+        const CBSTree<FieldNode> &check = (round == 3) ? moved : tree;
+        for (size_t box = 0; box < query.size(); ++box)
+        {
+            FieldNode low;
+            FieldNode high;
+            if (box % 2 == 0)
+            {
+                low.SetXCoord(coord(random));
+                low.SetYCoord(coord(random));
+                low.SetZCoord(coord(random));
+                high.SetXCoord(coord(random));
+                high.SetYCoord(coord(random));
+                high.SetZCoord(coord(random));
+            }
+            else
+            {
+                low = query[box];
+                high = query[(box * 7) % query.size()];
+            }
+
+            // the scan, with the corners put in order
+            double lo[DIMENSIONAL] = {low.GetXCoord(), low.GetYCoord()
+                                      , low.GetZCoord()};
+            double hi[DIMENSIONAL] = {high.GetXCoord(), high.GetYCoord()
+                                      , high.GetZCoord()};
+            for (int dim = 0; dim < DIMENSIONAL; ++dim)
+            {
+                if (lo[dim] > hi[dim])
+                {
+                    swap(lo[dim], hi[dim]);
+                }
+            }
+            int count = 0;
+            double sum[DIMENSIONAL] = {0};
+            double scale = 1;
+            for (auto it = live.begin(); it != live.end(); ++it)
+            {
+                double at[DIMENSIONAL] = {it->second.GetXCoord()
+                                          , it->second.GetYCoord()
+                                          , it->second.GetZCoord()};
+                bool bInside = true;
+                for (int dim = 0; dim < DIMENSIONAL; ++dim)
+                {
+                    bInside = bInside && (lo[dim] <= at[dim])
+                              && (at[dim] <= hi[dim]);
+                }
+                if (!bInside)
+                {
+                    continue;
+                }
+                ++count;
+                for (int dim = 0; dim < DIMENSIONAL; ++dim)
+                {
+                    sum[dim] += at[dim];
+                    scale += fabs(at[dim]);
+                }
+            }
+
+            CRangeAggregate aggregate;
+            check.RangeAggregate(low, high, aggregate);
+            check.RangeQuery(low, high, listN);
+            bool bGood = (check.RangeCount(low, high) == count)
+                         && (aggregate.count == count)
+                         && (static_cast<int>(listN.size()) == count);
+            for (int dim = 0; dim < DIMENSIONAL; ++dim)
+            {
+                bGood = bGood && (fabs(aggregate.sum[dim] - sum[dim])
+                                  <= 1e-9 * scale);
+            }
+            numBad += bGood ? 0 : 1;
+            ++numBoxes;
+        }
+    }
+    return Report("range_count", dataset, numBad, numBoxes);
+
+} // end of "CheckRange"
+
+
+
+// === CheckJoin ==============================================================
+// This function will compare CKnnJoin with the scan, for the queries joined
+// with the points and for the points joined with themselves (all-kNN, on
+// every tenth point).
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//
+// Output: the number of failed check
+// ============================================================================
+
+int CheckJoin(const CheckOptions &opt, const char *dataset
+              , const vector<FieldNode> &point
+              , const vector<FieldNode> &query)
+{
+    CBruteForce<FieldNode> brute;
+    CBSTree<FieldNode> queryTree;
+    CBSTree<FieldNode> tree;
+    CKnnJoin<FieldNode> join;
+    vector<FieldNode> joinPoint;
+    vector<vector<FieldNode> > joinResult;
+    vector<FieldNode> expect;
+    int numFailed = 0;
+
+    brute.BuildIndex(point.data(), point.size());
+    queryTree.BuildTree(query.data(), query.size());
+    tree.BuildTree(point.data(), point.size());
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        join.Join((mode == 0) ? queryTree : tree, tree, opt.numNeighbor
+                  , joinPoint, joinResult);
+        int step = (mode == 0) ? 1 : 10;
+        int numQuery = 0;
+        int numBad = 0;
+        for (size_t index = 0; index < joinPoint.size(); index += step)
+        {
+            brute.NearestNeighbors(joinPoint[index], opt.numNeighbor
+                                   , expect);
+            numBad += SameDistances(expect, joinResult[index]) ? 0 : 1;
+            ++numQuery;
+        }
+        numFailed += Report((mode == 0) ? "knn_join" : "all_knn", dataset
+                            , numBad, numQuery);
+    }
+    return numFailed;
+
+} // end of "CheckJoin"
+
+
+
+// === CheckDisk ==============================================================
+// This function will write the points to a file, build a CDiskIndex of it
+// with the smallest budget (1 MB, so a few chunks), and compare it with the
+// scan in the Euclidean and Manhattan metrics. The files are removed at the
+// end.
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//
+// Output: the number of failed check
+// ============================================================================
+
+int CheckDisk(const CheckOptions &opt, const char *dataset
+              , const vector<FieldNode> &point
+              , const vector<FieldNode> &query)
+{
+    const char *pointFile = "check_disk.points";
+    const char *indexFile = "check_disk.index";
+    CBruteForce<FieldNode> brute;
+    CDiskIndex<FieldNode> disk;
+    vector<FieldNode> expect;
+    vector<FieldNode> listN;
+    int numQuery = static_cast<int>(query.size());
+
+    brute.BuildIndex(point.data(), point.size());
+    bool bOpen = CDiskIndex<FieldNode>::WritePoints(pointFile, point.data()
+                                                    , point.size())
+                 && CDiskIndex<FieldNode>::Build(pointFile, indexFile, 0)
+                 && disk.Open(indexFile);
+    remove(pointFile);
+    if (!bOpen || (disk.GetNumPoints() != brute.GetNumPoints()))
+    {
+        remove(indexFile);
+        return Report("disk_build", dataset, 1, 1);
+    }
+
+    int numBad = 0;
+    int numManhattanBad = 0;
+    for (auto it = query.begin(); it != query.end(); ++it)
+    {
+        brute.NearestNeighbors(*it, opt.numNeighbor, expect);
+        disk.NearestNeighbors(*it, opt.numNeighbor, listN);
+        numBad += SameDistances(expect, listN) ? 0 : 1;
+        brute.NearestNeighbors(*it, opt.numNeighbor, expect
+                               , CManhattanMetric());
+        disk.NearestNeighbors(*it, opt.numNeighbor, listN
+                              , CManhattanMetric());
+        numManhattanBad += SameDistances(expect, listN) ? 0 : 1;
+    }
+    disk.Close();
+    remove(indexFile);
+    return Report("disk_euclidean", dataset, numBad, numQuery)
+           + Report("disk_manhattan", dataset, numManhattanBad, numQuery);
+
+} // end of "CheckDisk"
+
+
+
+// === CheckCache =============================================================
+// This function will ask a CResultCache for the neighbors of every query
+// three times, in each key mode: first with names shared by every eighth
+// query, then twice with a name of their own. The exact coordinate and
+// name modes must give the answers of the scan, also when a name comes
+// back at other coordinates. The grid mode is approximate: an answer must be
+// as long as the scan's, nearest first, with the true distance to the query
+// and no point at distance 0. Each mode must also have hits.
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//
+// Output: the number of failed check
+// ============================================================================
+
+int CheckCache(const CheckOptions &opt, const char *dataset
+               , const vector<FieldNode> &point
+               , const vector<FieldNode> &query)
+{
+    const char *check[3] = {"cache_coord", "cache_grid", "cache_name"};
+    CBruteForce<FieldNode> brute;
+    CBSTree<FieldNode> tree;
+    vector<FieldNode> expect;
+    vector<FieldNode> listN;
+    int numFailed = 0;
+
+    brute.BuildIndex(point.data(), point.size());
+    tree.BuildTree(point.data(), point.size());
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        CResultCache<FieldNode> cache(tree, CACHE_CAPACITY
+                                      , (mode == 2) ? CACHE_BY_NAME
+                                                    : CACHE_BY_COORD
+                                      , (mode == 1) ? CHECK_EXTENT / 20 : 0);
+        int numBad = 0;
+        for (int round = 0; round < 3; ++round)
+        {
+            for (size_t index = 0; index < query.size(); ++index)
+            {
+                FieldNode target = query[index];
+                target.SetName(static_cast<int>((round == 0) ? index % 8
+                                                             : index + 8));
+                cache.NearestNeighbors(target, opt.numNeighbor, listN);
+                brute.NearestNeighbors(target, opt.numNeighbor, expect);
+                if (mode != 1)
+                {
+                    numBad += SameDistances(expect, listN) ? 0 : 1;
+                    continue;
+                }
+                bool bGood = (listN.size() == expect.size());
+                for (size_t rank = 0; bGood && (rank < listN.size()); ++rank)
+                {
+                    double dist = MetricDistance(CEuclideanMetric()
+                                                 , listN[rank], target);
+                    bGood = (dist > 0) && (dist == listN[rank].GetDistance())
+                            && ((rank == 0) || (listN[rank - 1].GetDistance()
+                                                <= dist));
+                }
+                numBad += bGood ? 0 : 1;
+            }
+        }
+        // a mode without hits did not check its cached answers
+        numBad += (cache.GetHits() == 0) ? 1 : 0;
+        numFailed += Report(check[mode], dataset, numBad, 3 * query.size());
+    }
+    return numFailed;
+
+} // end of "CheckCache"
+
+
+
+// === CheckSnapshot ==========================================================
+// This function will build a CSnapshotIndex of the first half of the points,
+// then in four rounds insert a quarter of the second half and delete every
+// third point of the first half, publishing every 500 changes (so the base
+// is rebuilt on the way). After each round the current version must give
+// the answers of the scan of the points left, and the version held since
+// the round before must still give its own answers.
+//
+// Input: -- opt: check settings
+//        -- dataset: name of the point set
+//        -- point: the points
+//        -- query: the queries
+//
+// Output: the number of failed check
+// ============================================================================
+
+int CheckSnapshot(const CheckOptions &opt, const char *dataset
+                  , const vector<FieldNode> &point
+                  , const vector<FieldNode> &query)
+{
+    CSnapshotIndex<FieldNode> index;
+    CBSTree<FieldNode> live;
+    CBruteForce<FieldNode> brute;
+    vector<vector<FieldNode> > expect(query.size());
+    vector<FieldNode> listN;
+    vector<FieldNode> items;
+    int half = static_cast<int>(point.size()) / 2;
+    int numBad = 0;
+    int numOldBad = 0;
+
+    index.Build(point.data(), half);
+    live.BuildTree(point.data(), half);
+    CSnapshotIndex<FieldNode>::Snapshot old;
+    for (int round = 0; round < 4; ++round)
+    {
+        int first = half + round * (point.size() - half) / 4;
+        int last = half + (round + 1) * (point.size() - half) / 4;
+        for (int at = first; at < last; ++at)
+        {
+            if (index.Insert(point[at]) != live.InsertItem(point[at]))
+            {
+                ++numBad;
+            }
+            int gone = (at - half) * 3;
+            if ((gone < half)
+                && (index.Delete(point[gone]) != live.DeleteItem(point[gone])))
+            {
+                ++numBad;
+            }
+            if (index.GetNumPending() >= 500)
+            {
+                index.Publish();
+            }
+        }
+        index.Publish();
+
+        // the version of the round before still answers as it did
+        for (size_t at = 0; (NULL != old) && (at < query.size()); ++at)
+        {
+            old->NearestNeighbors(query[at], opt.numNeighbor, listN);
+            numOldBad += SameDistances(expect[at], listN) ? 0 : 1;
+        }
+
+        items.clear();
+        live.InOrderTraversal([&](const FieldNode &item)
+                              { items.push_back(item); });
+        brute.BuildIndex(items.data(), items.size());
+        old = index.Acquire();
+        numBad += (old->GetNumItems() == static_cast<int>(items.size()))
+                  ? 0 : 1;
+        for (size_t at = 0; at < query.size(); ++at)
+        {
+            brute.NearestNeighbors(query[at], opt.numNeighbor, expect[at]);
+            old->NearestNeighbors(query[at], opt.numNeighbor, listN);
+            numBad += SameDistances(expect[at], listN) ? 0 : 1;
+            numBad += (old->RetrieveItem(query[at])
+                       == live.RetrieveItem(query[at])) ? 0 : 1;
+        }
+    }
+    return Report("snapshot", dataset, numBad, 4 * query.size())
+           + Report("snapshot_old", dataset, numOldBad, 3 * query.size());
+
+} // end of "CheckSnapshot"
+
+
+
+// === SameDistances ==========================================================
+// This function will tell if two answers have the same number of neighbor
+// and the same distance at each rank, within a relative 1e-9.
+//
+// Input: -- a, b: the answers, nearest first
+//
+// Output: true if they agree
+// ============================================================================
+
+bool SameDistances(const vector<FieldNode> &a, const vector<FieldNode> &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t rank = 0; rank < a.size(); ++rank)
+    {
+        double expect = a[rank].GetDistance();
+        if (fabs(b[rank].GetDistance() - expect) > 1e-9 * max(expect, 1.0))
+        {
+            return false;
+        }
+    }
+    return true;
+
+} // end of "SameDistances"
+
+
+
+// === Report =================================================================
+// This function will print the result of one check.
+//
+// Input: -- check: name of the check
+//        -- dataset: name of the point set
+//        -- numBad: number of query whose answers differ
+//        -- numQuery: number of query compared
+//
+// Output: 1 if the check failed, 0 otherwise
+// ============================================================================
+
+int Report(const char *check, const char *dataset, const int numBad
+           , const int numQuery)
+{
+    printf("%-6s %-18s %-10s %d of %d differ\n"
+           , (numBad == 0) ? "ok" : "FAILED", check, dataset, numBad
+           , numQuery);
+    fflush(stdout);
+    return (numBad == 0) ? 0 : 1;
+
+} // end of "Report"
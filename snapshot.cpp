@@ -0,0 +1,369 @@
+// ============================================================================
+// File: snapshot.cpp
+// ============================================================================
+// This header file contains the implementation of the CTreeVersion and
+// CSnapshotIndex classes. They use the template parameter "NodeType" for the
+// type of the points.
+// ============================================================================
+
+#include    "snapshot.h"
+
+// ==== CTreeVersion::NearestNeighbors ========================================
+//
+// This function finds the "num" nearest neighbors of a target point in the
+// version: the base is searched for enough neighbors to make up for the
+// removed points among them, and the nearest added points are merged in.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//      num [IN]    -- number of nearest neighbor
+//      listN [OUT] -- the neighbors, nearest first
+//      metric [IN] -- the distance
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+template    <typename  Metric>
+void    CTreeVersion<NodeType>::NearestNeighbors(const NodeType &target
+                                                 , const int num
+                                                 , vector<NodeType> &listN
+                                                 , const Metric &metric) const
+{
+    vector<NodeType> found;
+
+    listN.clear();
+    if (num <= 0)
+    {
+        return;
+    }
+
+    // ask the base for more until the removed points are made up for
+    int want = num;
+    while (true)
+    {
+        m_base->NearestNeighbors(target, want, found, metric);
+        int numDropped = 0;
+        listN.clear();
+        for (auto it = found.begin(); it != found.end(); ++it)
+        {
+            if ((m_numRemoved > 0) && m_removed.RetrieveItem(*it))
+            {
+                ++numDropped;
+            }
+            else
+            {
+                listN.push_back(*it);
+            }
+        }
+        if ((static_cast<int>(listN.size()) >= num)
+            || (static_cast<int>(found.size()) < want))
+        {
+            break;
+        }
+        want = num + numDropped;
+    }
+
+    if (m_numAdded > 0)
+    {
+        m_added.NearestNeighbors(target, num, found, metric);
+        listN.insert(listN.end(), found.begin(), found.end());
+        stable_sort(listN.begin(), listN.end()
+                    , [](const NodeType &a, const NodeType &b)
+                      { return a.GetDistance() < b.GetDistance(); });
+    }
+    if (static_cast<int>(listN.size()) > num)
+    {
+        listN.resize(num);
+    }
+
+}  // end of "CTreeVersion<NodeType>::NearestNeighbors"
+
+
+
+// ==== CTreeVersion::RetrieveItem ============================================
+//
+// This function looks for a point with the coordinates of the target in the
+// version.
+//
+// Access: public
+//
+// Input:
+//      target [IN] -- the target point
+//
+// Output:
+//      True if the version holds the point.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CTreeVersion<NodeType>::RetrieveItem(const NodeType &target) const
+{
+    if (m_added.RetrieveItem(target))
+    {
+        return true;
+    }
+    return m_base->RetrieveItem(target) && !m_removed.RetrieveItem(target);
+
+}  // end of "CTreeVersion<NodeType>::RetrieveItem"
+
+
+
+// ==== CSnapshotIndex::CSnapshotIndex ========================================
+//
+// This is the constructor. The index starts empty, with version 0 current.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+CSnapshotIndex<NodeType>::CSnapshotIndex()
+    : m_version(0), m_rule(SPLIT_MEDIAN), m_numPending(0)
+{
+    m_master.m_base = make_shared<const CBSTree<NodeType> >();
+    m_master.m_numBase = 0;
+    m_master.m_numAdded = 0;
+    m_master.m_numRemoved = 0;
+    m_current = make_shared<const CTreeVersion<NodeType> >(m_master);
+
+}  // end of "CSnapshotIndex<NodeType>::CSnapshotIndex"
+
+
+
+// ==== CSnapshotIndex::Build =================================================
+//
+// This function replaces the points of the index by a set of points, built
+// into a new base (see CBSTree::BuildTree), and publishes it.
+//
+// Access: public
+//
+// Input:
+//      items [IN]  -- the points
+//      num [IN]    -- number of point
+//      rule [IN]   -- split rule of the base, kept for its rebuilds
+//
+// Output:
+//      The number of point in the index.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CSnapshotIndex<NodeType>::Build(const NodeType items[], const int num
+                                        , const SplitRule rule)
+{
+    int numNodes = 0;
+    {
+        lock_guard<mutex> guard(m_writeLock);
+        shared_ptr<CBSTree<NodeType> > base(new CBSTree<NodeType>());
+        numNodes = base->BuildTree(items, num, rule);
+        m_master.m_base = base;
+        m_master.m_added.DestroyTree();
+        m_master.m_removed.DestroyTree();
+        m_master.m_numBase = numNodes;
+        m_master.m_numAdded = 0;
+        m_master.m_numRemoved = 0;
+        m_rule = rule;
+        ++m_numPending;
+    }
+    Publish();
+    return numNodes;
+
+}  // end of "CSnapshotIndex<NodeType>::Build"
+
+
+
+// ==== CSnapshotIndex::Delete ================================================
+//
+// This function deletes a point from the writer's version: a point added
+// since the base leaves the added tree, a point of the base joins the
+// removed one. Readers see it gone after the next Publish.
+//
+// Access: public
+//
+// Input:
+//      item [IN]   -- the point
+//
+// Output:
+//      True if the point was in the index.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CSnapshotIndex<NodeType>::Delete(const NodeType &item)
+{
+    lock_guard<mutex> guard(m_writeLock);
+    if (m_master.m_added.DeleteItem(item))
+    {
+        --m_master.m_numAdded;
+    }
+    else if (m_master.m_base->RetrieveItem(item)
+             && m_master.m_removed.InsertItem(item))
+    {
+        ++m_master.m_numRemoved;
+    }
+    else
+    {
+        return false;
+    }
+    ++m_numPending;
+    return true;
+
+}  // end of "CSnapshotIndex<NodeType>::Delete"
+
+
+
+// ==== CSnapshotIndex::GetNumPending =========================================
+//
+// This function returns the number of change made to the writer's tree
+// since the last Publish, e.g. to publish every few thousand changes.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      The number of change not published yet.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+int     CSnapshotIndex<NodeType>::GetNumPending() const
+{
+    lock_guard<mutex> guard(m_writeLock);
+    return m_numPending;
+
+}  // end of "CSnapshotIndex<NodeType>::GetNumPending"
+
+
+
+// ==== CSnapshotIndex::Insert ================================================
+//
+// This function inserts a point into the writer's version, in the added
+// tree. Readers see it after the next Publish.
+//
+// Access: public
+//
+// Input:
+//      item [IN]   -- the point
+//
+// Output:
+//      True if the point was inserted, false if it was already there.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+bool    CSnapshotIndex<NodeType>::Insert(const NodeType &item)
+{
+    lock_guard<mutex> guard(m_writeLock);
+    if (m_master.RetrieveItem(item) || !m_master.m_added.InsertItem(item))
+    {
+        return false;
+    }
+    ++m_master.m_numAdded;
+    ++m_numPending;
+    return true;
+
+}  // end of "CSnapshotIndex<NodeType>::Insert"
+
+
+
+// ==== CSnapshotIndex::Publish ===============================================
+//
+// This function makes the writer's version the current one: a copy of it
+// is swapped in for the new readers. The copy shares the base and copies
+// only the changes since it, O(changes); once they reach their share of the
+// base, a new base is made first (Rebase), O(n). Readers of older
+// versions go on with them, and each old version is freed with its last
+// reader. Nothing is done when there is no change since the last Publish.
+//
+// Access: public
+//
+// Input:
+//      None
+//
+// Output:
+//      The number of the current version.
+//
+// ============================================================================
+
+template    <typename  NodeType>
+long long   CSnapshotIndex<NodeType>::Publish()
+{
+    lock_guard<mutex> guard(m_writeLock);
+    if (m_numPending > 0)
+    {
+        int limit = max(SNAPSHOT_MIN_DELTA
+                        , m_master.m_numBase / SNAPSHOT_DELTA_SHARE);
+        if (m_master.GetNumChanges() >= limit)
+        {
+            Rebase();
+        }
+        Snapshot next = make_shared<const CTreeVersion<NodeType> >(m_master);
+        atomic_store(&m_current, next);
+        m_numPending = 0;
+        ++m_version;
+    }
+    return m_version.load();
+
+}  // end of "CSnapshotIndex<NodeType>::Publish"
+
+
+
+// ==== CSnapshotIndex::Rebase ================================================
+//
+// This function makes a new base of the points of the writer's version: a
+// copy of the base loses the removed points and takes the added ones in
+// one block (CBSTree::InsertBatch, which rebuilds the subtrees that grow a
+// lot). The added and removed trees are emptied. The old base stays with
+// the versions that hold it.
+//
+// Access: private
+//
+// Input:
+//      None
+//
+// Output:
+//      Nothing
+//
+// ============================================================================
+
+template    <typename  NodeType>
+void    CSnapshotIndex<NodeType>::Rebase()
+{
+    shared_ptr<CBSTree<NodeType> > base(
+                                new CBSTree<NodeType>(*m_master.m_base));
+    m_master.m_removed.InOrderTraversal([&](const NodeType &item)
+    {
+        base->DeleteItem(item);
+    });
+
+    vector<NodeType> items;
+    items.reserve(m_master.m_numAdded);
+    m_master.m_added.InOrderTraversal([&](const NodeType &item)
+    {
+        items.push_back(item);
+    });
+    int numInserted = base->InsertBatch(items.data()
+                                        , static_cast<int>(items.size())
+                                        , m_rule);
+
+    m_master.m_numBase += numInserted - m_master.m_numRemoved;
+    m_master.m_base = base;
+    m_master.m_added.DestroyTree();
+    m_master.m_removed.DestroyTree();
+    m_master.m_numAdded = 0;
+    m_master.m_numRemoved = 0;
+
+}  // end of "CSnapshotIndex<NodeType>::Rebase"
@@ -0,0 +1,122 @@
+// ============================================================================
+// File: snapshot.h
+// ============================================================================
+// This header file contains the declaration of the CSnapshotIndex class. It
+// lets queries run on every core while one writer inserts and deletes
+// points (read-copy-update): a reader takes the current version of the index
+// (Acquire) and searches it for as long as it likes; that version never
+// changes. The writer keeps its changes aside and, on Publish, swaps in a
+// new version. A version is freed when the last reader that holds it lets
+// it go, so readers never wait for the writer and the writer never waits
+// for readers.
+//
+// A version (CTreeVersion) is a base tree shared by every version since the
+// last rebuild, plus two small trees of the changes made since: the points
+// added and the base points removed. Publish copies only those two trees,
+// so it costs O(changes), not O(n), and the versions share the memory of
+// the base. A search runs on the base, drops the removed points and merges
+// in the added ones. When the changes reach 1 / SNAPSHOT_DELTA_SHARE of the
+// base (and at least SNAPSHOT_MIN_DELTA), Publish first makes a new base
+// with the changes applied: that publish copies the whole tree, O(n), and
+// holds the writer lock meanwhile (readers go on with the older versions),
+// once every n / SNAPSHOT_DELTA_SHARE changes.
+//
+// The current version is a shared_ptr read and replaced with atomic_load /
+// atomic_store; the library guards those with a short spin lock on the
+// pointer only, never across a search or a copy. Writers are serialized by
+// a mutex that readers do not touch.
+// ============================================================================
+
+#ifndef CSNAPSHOT_INDEX_HEADER
+#define CSNAPSHOT_INDEX_HEADER
+
+#include    "cbstree.h"
+#include    "metric.h"
+#include    <algorithm>
+#include    <atomic>
+#include    <memory>
+#include    <mutex>
+#include    <vector>
+using namespace std;
+
+// Publish rebuilds the base once the changes reach 1 / SNAPSHOT_DELTA_SHARE
+// of it, and at least SNAPSHOT_MIN_DELTA
+const int SNAPSHOT_DELTA_SHARE = 16;
+const int SNAPSHOT_MIN_DELTA = 1024;
+
+template    <typename  NodeType>
+class   CSnapshotIndex;
+
+// a published version of the index, it never changes
+template    <typename  NodeType>
+class   CTreeVersion
+{
+    // fills the version in
+    friend class    CSnapshotIndex<NodeType>;
+
+public:
+    // member functions
+    int     GetNumChanges() const { return m_numAdded + m_numRemoved; }
+    int     GetNumItems() const
+                { return m_numBase - m_numRemoved + m_numAdded; }
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN) const
+                { NearestNeighbors(target, num, listN, CEuclideanMetric()); }
+    template    <typename  Metric>
+    void    NearestNeighbors(const NodeType &target, const int num
+                             , vector<NodeType> &listN
+                             , const Metric &metric) const;
+    bool    RetrieveItem(const NodeType &target) const;
+
+private:
+    // data members
+    shared_ptr<const CBSTree<NodeType> >    m_base; // shared with the others
+    CBSTree<NodeType>   m_added;        // points added since the base
+    CBSTree<NodeType>   m_removed;      // base points removed since
+    int                 m_numBase;      // number of point in the base
+    int                 m_numAdded;     // number of point in m_added
+    int                 m_numRemoved;   // number of point in m_removed
+};
+
+template    <typename  NodeType>
+class   CSnapshotIndex
+{
+public:
+    // a version of the index, it stays valid while it is held
+    typedef shared_ptr<const CTreeVersion<NodeType> >   Snapshot;
+
+    // constructor
+    CSnapshotIndex();
+
+    // member functions for the readers
+    Snapshot    Acquire() const { return atomic_load(&m_current); }
+    long long   GetVersion() const { return m_version.load(); }
+
+    // member functions for the writer
+    int     Build(const NodeType items[], const int num
+                  , const SplitRule rule = SPLIT_MEDIAN);
+    bool    Delete(const NodeType &item);
+    int     GetNumPending() const;
+    bool    Insert(const NodeType &item);
+    long long   Publish();
+
+private:
+    // no copy, the readers hold pointers into it
+    CSnapshotIndex(const CSnapshotIndex &other);
+    CSnapshotIndex& operator=(const CSnapshotIndex &rhs);
+
+    // member functions
+    void    Rebase();
+
+    // data members
+    Snapshot            m_current;      // version handed to new readers
+    atomic<long long>   m_version;      // number of version published
+    mutable mutex       m_writeLock;    // one writer at a time
+    CTreeVersion<NodeType>  m_master;   // the writer's version
+    SplitRule           m_rule;         // split rule of the base
+    int                 m_numPending;   // changes not published yet
+};
+
+#include    "snapshot.cpp"
+
+#endif  // CSNAPSHOT_INDEX_HEADER
@@ -1,115 +1,106 @@
+// ============================================================================
+// This is the test driver for nearest neighbor over the edges of a mesh. It
+// reads a TetGen mesh (w.1.node and w.1.edge by default) and finds the 6
+// nearest neighbors of every vertex by walking the edges.
+//
+// Usage: test [-check] [node file] [edge file]
+//        -check: also build the k-d tree and report how many of its
+//                neighbors the edge walk found (recall)
+// ============================================================================
+
 #include <iostream>
-#include <fstream>
-#include <map>
-#include <array>
-#include <vector>
-#include <math.h>
-#include <ctime>
+#include <cstring>
+#include <chrono>
+#include "fieldnode.h"
+#include "cbstree.h"
+#include "meshgraph.h"
 using namespace std;
 
+// global constant, number of nearest neighbor for each vertex
+const int NUM_NEIGHBOR = 6;
+
+// function prototype
+double Elapsed(const chrono::steady_clock::time_point &start);
+
 
-bool sortbysec(const pair<double,double> &a, 
-              const pair<double,double> &b) 
-{ 
-    return (a.second < b.second); 
-} 
 
+// === main ===================================================================
+//
+// ============================================================================
 
-int main()
+int main(int argc, char *argv[])
 {
-	std::clock_t start;
-    double duration;
-    start = clock();
-	ifstream ifs;
-	string ifsVal;
-	ifs.open("w.1.node");
-
-	// set up hash map for node	
-	double ins[4];
-	using coordinate = array<double, 3>;
-	ifs >> ins[0];
-	ifs >> ins[1];
-	ifs >> ins[2];
-	ifs >> ins[3];
-	map<double, coordinate> point;
-	coordinate c;
-
-	while (ifs >> ins[0]) 
-	{
-		ifs >> ins[1];
-		ifs >> ins[2];
-		ifs >> ins[3];
-		//cout << ins[0] << ' ' << ins[1] << ' ' << ins[2] << ' ' << ins[3] << endl;
-		c = {ins[1], ins[2], ins[3]};
-		point.insert({ins[0], c});
-	}
-
-	/*
-	for (auto it = point.begin(); it != point.end(); ++it)
-	{
-		cout << it->first << ' ' << it->second[0] 
-		<< ' ' << it->second[1] << ' ' << it->second[2] << endl;
-	}*/
-  	ifs.close();
-
-
-
-  	// get edge
-  	ifs.open("w.1.edge");
-  	map<double, vector<pair<double, double>>> edge;
-  	pair<double, double> pointB;
-  	double dist = 0;
-  	ifs >> ins[0];
-  	ifs >> ins[1];
-  	//cout << point[2][2] << endl;
-  	/*
-  	edge[0].push_back({1,2});
-  	edge[0].push_back({3,4});
-  	cout << edge[0].at(1).second << endl;
-  	*/
-  	while (ifs >> ins[0])
-  	{
-		ifs >> ins[1];
-		ifs >> ins[2];
-		ifs >> ins[3];
-
-		dist = pow(point[ins[1]][0] - point[ins[2]][0], 2)
-			+ pow(point[ins[1]][1] - point[ins[2]][1], 2)
-			+ pow(point[ins[1]][2] - point[ins[2]][2], 2);
-		dist = sqrt(dist);
-		edge[ins[1]].push_back({ins[2], dist});
-		//sort(edge[ins[1]].begin(), edge[ins[1]].end(), sortbysec);
-  	}
-
-  	ifs.close();
-
-  	for (auto it = edge.begin(); it != edge.end(); ++it)
-  	{
-  		sort(it->second.begin(), it->second.end(), sortbysec);
-  	}
-
-  	int index = 0;
-  	for (auto it = edge.begin(); it != edge.end(); ++it)
-  	{
-  		index = 0;
-  		while (it->second.size() < 6)
-  		{
-  			cout << "edge: " << it->first << ' '
-  				 << edge[it->second.at(index).first].at(0).first << endl;
-  			it->second.push_back(edge[it->second.at(index).first].at(0));
-  			++index;
-  		}
-
-  		/*
-  		cout << it->first << ' ';
-  		for (int i = 0; i < it->second.size(); ++i)
-  		{
-  			cout << ' ' << it->second.at(i).first << ' ' << it->second.at(i).second << ' ';
-		}
-		cout << endl;*/
-  	}
-
-	duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
-    std::cout<<"printf: "<< duration <<'\n';
+    // wall clock time of each phase, printed at the end
+    auto start = chrono::steady_clock::now();
+    double loadTime = 0;
+    double adjacencyTime = 0;
+    double searchTime = 0;
+
+    bool check = false;
+    const char *nodeFile = "w.1.node";
+    const char *edgeFile = "w.1.edge";
+    int numFile = 0;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "-check") == 0)
+            check = true;
+        else if (numFile++ == 0)
+            nodeFile = argv[arg];
+        else
+            edgeFile = argv[arg];
+    }
+
+    // set up the graph from the mesh
+    CMeshGraph<FieldNode> graph;
+    if (!graph.LoadNodeFile(nodeFile) || !graph.LoadEdgeFile(edgeFile))
+    {
+        cerr << "Cannot read " << nodeFile << " / " << edgeFile << '\n';
+        return 1;
+    }
+    loadTime = Elapsed(start);
+    graph.BuildAdjacency();
+    adjacencyTime = Elapsed(start) - loadTime;
+
+    // get nearest neighbors of every vertex
+    vector<vector<FieldNode> > table;
+    graph.AllNearestNeighbors(NUM_NEIGHBOR, table);
+    searchTime = Elapsed(start) - loadTime - adjacencyTime;
+    for (int index = 0; index < graph.GetNumVertices(); ++index)
+    {
+        cout << graph.GetVertex(index).GetName() << ' ';
+        for (auto it = table[index].begin(); it != table[index].end(); ++it)
+        {
+            cout << ' ' << (*it).GetName() << ' ' << (*it).GetDistance() << ' ';
+        }
+        cout << '\n';
+    }
+
+    // compare with the k-d tree
+    if (check)
+    {
+        CBSTree<FieldNode> tree;
+        for (int index = 0; index < graph.GetNumVertices(); ++index)
+        {
+            tree.InsertItem(graph.GetVertex(index));
+        }
+        cout << "recall: " << graph.CrossCheck(tree, NUM_NEIGHBOR) << '\n';
+    }
+
+    cerr << "load: " << loadTime << " s, adjacency: " << adjacencyTime
+         << " s, search: " << searchTime << " s, total: " << Elapsed(start)
+         << " s\n";
     return 0;
-}
+} // end of "main"
+
+
+
+// === Elapsed ================================================================
+// This function will return the wall clock time since "start", in seconds.
+// ============================================================================
+
+double Elapsed(const chrono::steady_clock::time_point &start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now()
+                                    - start).count();
+
+} // end of "Elapsed"
@@ -0,0 +1,85 @@
+// ============================================================================
+// File: treeshape.h
+// ============================================================================
+// This header file contains the CTreeShape structure, the result of
+// CBSTree::AnalyzeTree. It describes how well the tree is balanced, so the
+// caller can decide when a rebuild is due.
+// ============================================================================
+
+#ifndef TREE_SHAPE_HEADER
+#define TREE_SHAPE_HEADER
+
+#include    <cstdio>
+#include    <string>
+#include    <vector>
+#include    "fieldnode.h"
+using namespace std;
+
+struct CTreeShape
+{
+    CTreeShape() { Clear(); }
+    void    Clear()
+    {
+        numNodes = numLeaves = 0;
+        height = -1;
+        avgPathLength = avgLeafDepth = maxImbalance = 0;
+        memoryBytes = 0;
+        leafDepth.clear();
+        levelImbalance.clear();
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            axisSplits[dim] = 0;
+        }
+    }
+    string  ToJson() const
+    {
+        char    text[256];
+        string  json;
+        snprintf(text, sizeof(text), "{\"nodes\":%lld,\"leaves\":%lld"
+                 ",\"height\":%d,\"avg_path\":%.3f,\"avg_leaf_depth\":%.3f"
+                 ",\"max_imbalance\":%.3f,\"memory_bytes\":%lld"
+                 , numNodes, numLeaves, height, avgPathLength, avgLeafDepth
+                 , maxImbalance, memoryBytes);
+        json = text;
+        json += ",\"axis_splits\":[";
+        for (int dim = 0; dim < DIMENSIONAL; ++dim)
+        {
+            snprintf(text, sizeof(text), (dim > 0) ? ",%lld" : "%lld"
+                     , axisSplits[dim]);
+            json += text;
+        }
+        json += "],\"leaf_depth\":[";
+        for (size_t depth = 0; depth < leafDepth.size(); ++depth)
+        {
+            snprintf(text, sizeof(text), (depth > 0) ? ",%lld" : "%lld"
+                     , leafDepth[depth]);
+            json += text;
+        }
+        json += "],\"level_imbalance\":[";
+        for (size_t depth = 0; depth < levelImbalance.size(); ++depth)
+        {
+            snprintf(text, sizeof(text), (depth > 0) ? ",%.3f" : "%.3f"
+                     , levelImbalance[depth]);
+            json += text;
+        }
+        return json + "]}";
+    }
+
+    long long           numNodes;       // nodes in the tree
+    long long           numLeaves;      // nodes without children
+    int                 height;         // longest root-to-leaf path (edges),
+                                        // -1 for an empty tree
+    double              avgPathLength;  // nodes on the path to an average
+                                        // node (depth + 1), what an exact
+                                        // match search looks at
+    double              avgLeafDepth;   // mean depth of the leaves
+    double              maxImbalance;   // largest level imbalance
+    long long           memoryBytes;    // memory held by the nodes
+    long long           axisSplits[DIMENSIONAL];    // inner nodes per axis
+    vector<long long>   leafDepth;      // leafDepth[d]: leaves at depth d
+    vector<double>      levelImbalance; // mean of |left - right| /
+                                        // (left + right) over the inner
+                                        // nodes of each level, 0 is perfect
+};
+
+#endif  // TREE_SHAPE_HEADER
@@ -0,0 +1,58 @@
+// ============================================================================
+// File: visitor.h
+// ============================================================================
+// This header file contains the helper that calls the visitor of a tree walk
+// or of a search. A visitor is any callable (function, function object,
+// lambda), so it is inlined into the walk and can keep its own state. It may
+// return nothing, then the walk always goes on, or a VisitSignal (a bool
+// works too: false stops) to stop the walk early.
+// ============================================================================
+
+#ifndef VISITOR_HEADER
+#define VISITOR_HEADER
+
+#include    <type_traits>
+using namespace std;
+
+// what a visitor returns to go on with a walk or to stop it
+enum VisitSignal
+{
+    VISIT_STOP = 0,
+    VISIT_CONTINUE = 1
+};
+
+
+
+// === CallVisitor ============================================================
+// This function will call the visitor with the arguments and tell if the
+// walk should go on.
+//
+// Input: -- visitor: the visitor
+//        -- args: what the visitor gets (the value of a node, ...)
+//
+// Output: false if the visitor asked to stop, true otherwise
+// ============================================================================
+
+template    <typename  Visitor, typename...  Args>
+bool CallVisitorTag(true_type, Visitor &visitor, const Args&... args)
+{
+    visitor(args...);
+    return true;
+}
+
+template    <typename  Visitor, typename...  Args>
+bool CallVisitorTag(false_type, Visitor &visitor, const Args&... args)
+{
+    return (visitor(args...) != VISIT_STOP);
+}
+
+template    <typename  Visitor, typename...  Args>
+bool CallVisitor(Visitor &visitor, const Args&... args)
+{
+    return CallVisitorTag(
+                typename is_void<decltype(visitor(args...))>::type()
+                , visitor, args...);
+
+} // end of "CallVisitor"
+
+#endif // VISITOR_HEADER